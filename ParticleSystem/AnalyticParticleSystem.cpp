@@ -0,0 +1,192 @@
+#include "AnalyticParticleSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ResourceManager.h"
+#include "Utils.h"
+
+#define VERTS_PER_PARTICLE 6 // two triangles, without an index buffer
+#define PARAMS_BINDING_INDEX 1 // matches the binding of AnalyticParams in particle_analytic.vert
+
+// Times are sent to the shader as floats, which only have about 7 digits
+// of precision. After the app has been running for a day, that's not
+// even good enough for milliseconds, and the particles would start to
+// stutter. So instead, all times wrap around to 0 every TIME_WRAP_PERIOD
+// seconds, and the shader works out the age "modulo" the period. This
+// works as long as no particle lives longer than the period.
+#define TIME_WRAP_PERIOD 1024.0
+
+// Lifetimes are stored in milliseconds, in 16 bits.
+#define MAX_LIFETIME_MS 0xFFFF
+
+AnalyticParticleSystem::AnalyticParticleSystem(const Config& config) : config(config) {
+    // Make sure the lifetimes fit in 16 bits, and the ring isn't empty.
+    float maxLifetime = MAX_LIFETIME_MS / 1000.0f;
+    this->config.particleMinLifetime = std::min(std::max(config.particleMinLifetime, 0.0f), maxLifetime);
+    this->config.particleMaxLifetime = std::min(std::max(config.particleMaxLifetime, this->config.particleMinLifetime), maxLifetime);
+    this->config.maxParticles = std::max(config.maxParticles, 1u);
+}
+
+void AnalyticParticleSystem::initGraphicsResources(gfx::ResourceManager& resourceManager) {
+    // Same idea as ParticleSystem, except with a different vertex shader. The
+    // fragment shader just outputs the color, so we can share that one.
+    std::string vertShaderSource = loadAsciiFile("particle_analytic.vert");
+    std::string fragShaderSource = loadAsciiFile("particle.frag");
+    gfx::ResourceManager::ShaderSource shaders[2] = {
+        { gfx::ResourceManager::ShaderType::VERTEX_SHADER, vertShaderSource.c_str() },
+        { gfx::ResourceManager::ShaderType::FRAGMENT_SHADER, fragShaderSource.c_str() }
+    };
+    programHandle = resourceManager.createProgramFromSource(shaders, 2);
+
+    // The ring of spawn records. We never draw a slot that hasn't been
+    // written yet, so there's no need to fill it with anything up front.
+    unsigned int storageDataSize = sizeof(SpawnRecord) * config.maxParticles;
+    storageBufferHandle = resourceManager.createStreamingStorageBuffer(storageDataSize, nullptr);
+
+    paramsBufferHandle = resourceManager.createStreamingUniformBuffer(sizeof(ShaderParams), nullptr);
+
+    // We still need a VAO to draw with, even though it's empty.
+    gfx::ResourceManager::VAOConfig vaoConfig;
+    vaoConfig.indexBufferSizeBytes = 0;
+    vaoConfig.indexData = nullptr;
+    vaoHandle = resourceManager.createVAO(vaoConfig);
+}
+
+void AnalyticParticleSystem::update(double deltaT) {
+    double startTime = currentTime;
+    currentTime += deltaT;
+
+    // Work out how many particles are due this update, carrying
+    // the leftover fraction of a particle over to the next one.
+    float particlesDue = config.particlesPerSecond * (float)deltaT + emissionRemainder;
+    unsigned int numParticlesToEmit = (unsigned int)particlesDue;
+    emissionRemainder = particlesDue - numParticlesToEmit;
+
+    if (pendingRecords.empty()) {
+        firstPending = numEmitted;
+    }
+
+    for (unsigned int i = 0; i < numParticlesToEmit; ++i) {
+        SpawnRecord record;
+        record.position.x = randomFloat(config.emitterMin.x, config.emitterMax.x);
+        record.position.y = randomFloat(config.emitterMin.y, config.emitterMax.y);
+        record.position.z = randomFloat(config.emitterMin.z, config.emitterMax.z);
+        record.velocity.x = randomFloat(config.minVelocity.x, config.maxVelocity.x);
+        record.velocity.y = randomFloat(config.minVelocity.y, config.maxVelocity.y);
+        record.velocity.z = randomFloat(config.minVelocity.z, config.maxVelocity.z);
+
+        // Spread the particles out over the whole update. Since the
+        // shader works everything out from the age, a particle that was
+        // emitted part way through the update is automatically in the
+        // right spot, without any extra work.
+        record.spawnTime = wrapTime(startTime + randomFloat(0.0f, 1.0f) * deltaT);
+
+        uint32_t lifetimeMs = (uint32_t)(randomFloat(config.particleMinLifetime, config.particleMaxLifetime) * 1000.0f);
+        uint32_t seed = (rngState >> 16) & 0xFFFF;
+        record.lifetimeAndSeed = std::min(lifetimeMs, (uint32_t)MAX_LIFETIME_MS) | (seed << 16);
+
+        pendingRecords.push_back(record);
+    }
+
+    numEmitted += numParticlesToEmit;
+
+    // Keep track of which run of the ring each update's
+    // particles went into, and forget about the runs
+    // where everything has died.
+    if (numParticlesToEmit > 0) {
+        Batch batch;
+        batch.spawnTime = currentTime;
+        batch.end = numEmitted;
+        batches.push_back(batch);
+    }
+
+    while (!batches.empty() && batches.front().spawnTime + config.particleMaxLifetime <= currentTime) {
+        firstLive = batches.front().end;
+        batches.pop_front();
+    }
+
+    // Anything older than a full ring has been overwritten.
+    if (numEmitted - firstLive > config.maxParticles) {
+        firstLive = numEmitted - config.maxParticles;
+    }
+}
+
+void AnalyticParticleSystem::getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls) {
+    uploadPendingRecords(resourceManager);
+
+    unsigned int numLive = getNumLiveParticles();
+    if (numLive == 0) {
+        return;
+    }
+
+    // Everything that is the same for every particle. This is the
+    // only thing that gets sent to the GPU every frame.
+    ShaderParams params = {};
+    params.gravityAndDrag = glm::vec4(config.gravity, config.drag);
+    params.startColor = config.particleStartColor;
+    params.midColor = config.particleMidColor;
+    params.endColor = config.particleEndColor;
+    params.sizes = glm::vec4(config.particleStartSize, config.particleEndSize, config.sizeVariance, wrapTime(currentTime));
+    params.firstSlot = (uint32_t)(firstLive % config.maxParticles);
+    params.capacity = config.maxParticles;
+    resourceManager.streamDataToUniformBuffer(paramsBufferHandle, [&params](void* buffer) {
+            memcpy_s(buffer, sizeof(ShaderParams), &params, sizeof(ShaderParams));
+        });
+
+    gfx::DrawCall call;
+    call.mode = gfx::DrawCall::Mode::TRIANGLES;
+    call.numIndices = numLive * VERTS_PER_PARTICLE;
+    call.indexType = gfx::DrawCall::IndexType::NONE;
+    call.indices = nullptr;
+    call.programHandle = programHandle;
+    call.storageBuffer = storageBufferHandle;
+    call.vaoHandle = vaoHandle;
+    call.storageBufferBaseIndex = 0;
+    call.uniformBuffer = paramsBufferHandle;
+    call.uniformBufferBaseIndex = PARAMS_BINDING_INDEX;
+
+    drawCalls.push_back(call);
+}
+
+unsigned int AnalyticParticleSystem::getNumLiveParticles() const {
+    return (unsigned int)(numEmitted - firstLive);
+}
+
+float AnalyticParticleSystem::randomFloat(float min, float max) {
+    // We use our own generator rather than rand(), since we need a lot 
+    // of random numbers (see nextRandom()).
+    float t = nextRandomFloat(rngState);
+    return min + t * (max - min);
+}
+
+float AnalyticParticleSystem::wrapTime(double time) const {
+    return (float)fmod(time, TIME_WRAP_PERIOD);
+}
+
+void AnalyticParticleSystem::uploadPendingRecords(gfx::ResourceManager& resourceManager) {
+    if (pendingRecords.empty()) {
+        return;
+    }
+
+    // If more than a whole ring's worth was emitted since the last
+    // upload, the older ones would be overwritten anyway, so skip them.
+    size_t numRecords = pendingRecords.size();
+    size_t skip = numRecords > config.maxParticles ? numRecords - config.maxParticles : 0;
+    const SpawnRecord* records = pendingRecords.data() + skip;
+    uint64_t first = firstPending + skip;
+    numRecords -= skip;
+
+    // The new records might run off the end of the ring, in
+    // which case the rest of them go at the start.
+    while (numRecords > 0) {
+        unsigned int slot = (unsigned int)(first % config.maxParticles);
+        unsigned int count = (unsigned int)std::min<size_t>(numRecords, config.maxParticles - slot);
+        resourceManager.updateStorageBuffer(storageBufferHandle, slot * sizeof(SpawnRecord), count * sizeof(SpawnRecord), records);
+        records += count;
+        first += count;
+        numRecords -= count;
+    }
+
+    pendingRecords.clear();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <glm/glm.hpp>
+#include <vector>
+#include "DrawCall.h"
+
+namespace gfx {
+	class ResourceManager;
+}
+
+// A particle system for huge numbers of simple "ambient" particles
+// (dust, sparks, snow, etc.), where the CPU does no work at all for a
+// particle once it has been emitted.
+//
+// The trick is that a particle that only feels gravity and linear drag
+// (and never collides with anything) has a closed-form trajectory. If
+// we know where it started, how fast it was going and when it was
+// emitted, we can work out exactly where it is at any later time,
+// without stepping through all the frames in between. So when a particle
+// is emitted, we write those starting values (a "spawn record") to the
+// GPU exactly once, and particle_analytic.vert works out the position,
+// color and size from the particle's age every time it is drawn.
+//
+// The spawn records live in a ring buffer. New particles are written
+// after the newest one, wrapping around at the end, so the oldest
+// particles get overwritten. That means maxParticles has to be at
+// least particlesPerSecond * particleMaxLifetime, or particles will
+// disappear before the end of their life.
+//
+// Because the shader finds everything from gl_VertexID, there's no
+// index buffer either. Altogether, that's 32 bytes of GPU memory per
+// particle, and per-frame CPU cost that only depends on how many
+// particles are being emitted, not on how many there are.
+class AnalyticParticleSystem {
+public:
+	struct Config {
+		unsigned int maxParticles = 1000000;
+		float particlesPerSecond = 100000.0f;
+
+		// The particles are emitted from random spots inside this box.
+		glm::vec3 emitterMin = glm::vec3(-40.0f, 0.0f, -50.0f);
+		glm::vec3 emitterMax = glm::vec3(40.0f, 1.0f, 30.0f);
+
+		// The starting velocity is picked randomly between these.
+		glm::vec3 minVelocity = glm::vec3(-0.5f, 2.0f, -0.5f);
+		glm::vec3 maxVelocity = glm::vec3(0.5f, 6.0f, 0.5f);
+
+		glm::vec3 gravity = glm::vec3(0.0f, -0.5f, 0.0f);
+		float drag = 0.3f;
+
+		float particleMinLifetime = 4.0f;
+		float particleMaxLifetime = 8.0f;
+
+		glm::vec4 particleStartColor = glm::vec4(0.3f, 0.6f, 1.0f, 1.0f);
+		glm::vec4 particleMidColor = glm::vec4(0.6f, 0.3f, 1.0f, 1.0f);
+		glm::vec4 particleEndColor = glm::vec4(0.1f, 0.05f, 0.1f, 1.0f);
+
+		float particleStartSize = 0.05f;
+		float particleEndSize = 0.02f;
+
+		// Each particle's size is scaled by a random
+		// amount between 1 - sizeVariance and 1 + sizeVariance.
+		float sizeVariance = 0.5f;
+	};
+
+	AnalyticParticleSystem(const Config& config);
+
+	void initGraphicsResources(gfx::ResourceManager& resourceManager);
+
+	// Emits new particles. Existing particles aren't touched at all,
+	// so there's no need for a fixed timestep here: the positions are
+	// exact for whatever time we end up drawing.
+	void update(double deltaT);
+
+	void getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls);
+
+	// How many particles might still be alive (i.e. how many we draw).
+	unsigned int getNumLiveParticles() const;
+
+private:
+
+	// This struct has the same memory layout as SpawnRecord
+	// in particle_analytic.vert (std430).
+	struct SpawnRecord {
+		glm::vec3 position;
+		float spawnTime;
+		glm::vec3 velocity;
+		// The lifetime in milliseconds (low 16 bits), and
+		// a random number for the shader to use (high 16 bits).
+		uint32_t lifetimeAndSeed;
+	};
+
+	// This struct has the same memory layout as the
+	// AnalyticParams interface block in particle_analytic.vert.
+	struct ShaderParams {
+		glm::vec4 gravityAndDrag;
+		glm::vec4 startColor;
+		glm::vec4 midColor;
+		glm::vec4 endColor;
+		glm::vec4 sizes; // start size, end size, size variance, current time
+		uint32_t firstSlot;
+		uint32_t capacity;
+		uint32_t padding[2];
+	};
+
+	// The particles emitted by a single update() take up one contiguous
+	// run of the ring. Once the last of them has died, that whole run
+	// can be skipped when drawing.
+	struct Batch {
+		double spawnTime; // the time at the end of the update
+		uint64_t end; // one past the last particle of the batch
+	};
+
+	Config config;
+
+	double currentTime = 0.0;
+	float emissionRemainder = 0.0f;
+	uint32_t rngState = 0x12345678;
+
+	// How many particles have ever been emitted. The slot
+	// that particle i goes in is i % maxParticles.
+	uint64_t numEmitted = 0;
+
+	// The first particle that might still be alive.
+	uint64_t firstLive = 0;
+
+	std::deque<Batch> batches;
+
+	// The new spawn records, waiting to be uploaded.
+	std::vector<SpawnRecord> pendingRecords;
+	uint64_t firstPending = 0;
+
+	gfx::ResourceManager::HVAO vaoHandle = 0;
+	gfx::ResourceManager::HBUFFER storageBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER paramsBufferHandle = 0;
+	gfx::ResourceManager::HPROGRAM programHandle = 0;
+
+	float randomFloat(float min, float max);
+	float wrapTime(double time) const;
+	void uploadPendingRecords(gfx::ResourceManager& resourceManager);
+};
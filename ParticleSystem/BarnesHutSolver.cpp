@@ -0,0 +1,376 @@
+#include "BarnesHutSolver.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#define MORTON_BITS 10 // per axis, so the codes are 30 bits
+#define MAX_LEVEL MORTON_BITS // the deepest the tree goes; by then, the codes have run out of bits
+#define LEAF_SIZE 8 // a node with this many particles (or fewer) doesn't get split up
+#define RADIX_BITS 10 // the radix sort sorts this many bits at a time...
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES 3 // ...so this many passes covers all 30
+#define PARTICLE_BATCH_SIZE 4096
+#define FORCE_BATCH_SIZE 256
+#define MIN_SUBTREE_SIZE 1024
+
+// Spreads the bottom 10 bits of v out, so there are two 0 bits
+// between each of them. Interleaving three of these gives a Morton code.
+static unsigned int expandBits(unsigned int v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// Which of the 8 children of a node at level that a code's particle is in.
+static unsigned int getOctant(unsigned int code, unsigned int level) {
+    return (code >> (3 * (MAX_LEVEL - 1 - level))) & 7;
+}
+
+BarnesHutSolver::BarnesHutSolver(const Config& config, ThreadPool& threadPool)
+    : config(config), threadPool(threadPool) {
+}
+
+void BarnesHutSolver::computeMortonCodes(const glm::vec3* positions, unsigned int numParticles, glm::vec3& boxMin, float& boxSize) {
+    // Step 1: the box around all of the particles. Each thread finds
+    // the box around the particles that it looks at, and then we put
+    // those together.
+    unsigned int numThreads = threadPool.getNumThreads();
+    threadMins.assign(numThreads, glm::vec3(FLT_MAX));
+    threadMaxes.assign(numThreads, glm::vec3(-FLT_MAX));
+    threadPool.parallelFor(numParticles, PARTICLE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int threadIndex) {
+        glm::vec3 minimum = threadMins[threadIndex];
+        glm::vec3 maximum = threadMaxes[threadIndex];
+        for (unsigned int i = begin; i < end; ++i) {
+            minimum = glm::min(minimum, positions[i]);
+            maximum = glm::max(maximum, positions[i]);
+        }
+        threadMins[threadIndex] = minimum;
+        threadMaxes[threadIndex] = maximum;
+    });
+
+    glm::vec3 boxMax(-FLT_MAX);
+    boxMin = glm::vec3(FLT_MAX);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        boxMin = glm::min(boxMin, threadMins[i]);
+        boxMax = glm::max(boxMax, threadMaxes[i]);
+    }
+
+    // The octree's nodes are cubes, so the box is too. It's a smidge
+    // bigger than it needs to be, so that the particles right on the
+    // far sides don't end up just outside of it.
+    glm::vec3 extents = boxMax - boxMin;
+    boxSize = glm::max(glm::max(extents.x, extents.y), glm::max(extents.z, 1e-3f)) * 1.001f;
+
+    // Step 2: the Morton codes.
+    const float scale = (1 << MORTON_BITS) / boxSize;
+    const glm::vec3 origin = boxMin;
+    mortonCodes.resize(numParticles);
+    sortedIndices.resize(numParticles);
+    threadPool.parallelFor(numParticles, PARTICLE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int i = begin; i < end; ++i) {
+            glm::vec3 cell = glm::clamp((positions[i] - origin) * scale, glm::vec3(0.0f), glm::vec3((1 << MORTON_BITS) - 1));
+            mortonCodes[i] = (expandBits((unsigned int)cell.x) << 2) | (expandBits((unsigned int)cell.y) << 1) | expandBits((unsigned int)cell.z);
+            sortedIndices[i] = i;
+        }
+    });
+}
+
+// Step 3: a radix sort, RADIX_BITS at a time, starting with the lowest
+// bits. Each pass is a counting sort: the particles are split into
+// blocks, each block counts how many of its particles have each digit,
+// those counts tell each block where its particles go, and then every
+// block moves its particles there. Within a digit, the blocks stay in
+// order, and so do the particles within a block, so each pass keeps
+// the order from the passes before it.
+void BarnesHutSolver::sortByMortonCode(unsigned int numParticles) {
+    const unsigned int numBlocks = threadPool.getNumThreads() * 4;
+    const unsigned int blockSize = (numParticles + numBlocks - 1) / numBlocks;
+    sortCounts.resize(numBlocks * RADIX_SIZE);
+    sortScratchCodes.resize(numParticles);
+    sortScratchIndices.resize(numParticles);
+
+    for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass) {
+        const unsigned int shift = pass * RADIX_BITS;
+
+        threadPool.parallelFor(numBlocks, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+            for (unsigned int block = begin; block < end; ++block) {
+                unsigned int* counts = &sortCounts[block * RADIX_SIZE];
+                std::fill(counts, counts + RADIX_SIZE, 0);
+                unsigned int last = std::min((block + 1) * blockSize, numParticles);
+                for (unsigned int i = block * blockSize; i < last; ++i) {
+                    ++counts[(mortonCodes[i] >> shift) & (RADIX_SIZE - 1)];
+                }
+            }
+        });
+
+        // Turn the counts into where each block's particles
+        // with each digit start: all of the 0s from every block,
+        // then all of the 1s, and so on.
+        unsigned int start = 0;
+        for (unsigned int digit = 0; digit < RADIX_SIZE; ++digit) {
+            for (unsigned int block = 0; block < numBlocks; ++block) {
+                unsigned int count = sortCounts[block * RADIX_SIZE + digit];
+                sortCounts[block * RADIX_SIZE + digit] = start;
+                start += count;
+            }
+        }
+
+        threadPool.parallelFor(numBlocks, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+            for (unsigned int block = begin; block < end; ++block) {
+                unsigned int* starts = &sortCounts[block * RADIX_SIZE];
+                unsigned int last = std::min((block + 1) * blockSize, numParticles);
+                for (unsigned int i = block * blockSize; i < last; ++i) {
+                    unsigned int destination = starts[(mortonCodes[i] >> shift) & (RADIX_SIZE - 1)]++;
+                    sortScratchCodes[destination] = mortonCodes[i];
+                    sortScratchIndices[destination] = sortedIndices[i];
+                }
+            }
+        });
+
+        mortonCodes.swap(sortScratchCodes);
+        sortedIndices.swap(sortScratchIndices);
+    }
+}
+
+// Returns the first of the particles in [begin, end) that are in octant
+// (or a later one). They're sorted, and they're all in the same node at
+// level, so the octants are in order too, and a binary search does it.
+unsigned int BarnesHutSolver::findOctantStart(unsigned int begin, unsigned int end, unsigned int level, unsigned int octant) const {
+    const unsigned int* first = mortonCodes.data() + begin;
+    const unsigned int* last = mortonCodes.data() + end;
+    return begin + (unsigned int)(std::lower_bound(first, last, octant, [level](unsigned int code, unsigned int octant) {
+            return getOctant(code, level) < octant;
+        }) - first);
+}
+
+// Adds up the mass of a node's children, and finds their center of mass.
+void BarnesHutSolver::finishNode(std::vector<Node>& nodeList, unsigned int nodeIndex) const {
+    Node& node = nodeList[nodeIndex];
+    glm::vec3 weightedPositions(0.0f);
+    float mass = 0.0f;
+    for (unsigned int child = nodeIndex + 1; child < node.next; child = nodeList[child].next) {
+        weightedPositions += nodeList[child].centerOfMass * nodeList[child].mass;
+        mass += nodeList[child].mass;
+    }
+    node.mass = mass;
+    node.centerOfMass = weightedPositions / mass;
+}
+
+void BarnesHutSolver::buildSubtree(std::vector<Node>& subtreeNodes, unsigned int begin, unsigned int end, unsigned int level, float size) const {
+    unsigned int nodeIndex = (unsigned int)subtreeNodes.size();
+    Node node = {};
+    node.size = size;
+    node.firstParticle = begin;
+    node.numParticles = end - begin;
+    subtreeNodes.push_back(node);
+
+    // A leaf. One at MAX_LEVEL can have any number of particles in it 
+    // (see computeAccelerations()).
+    if (node.numParticles <= LEAF_SIZE || level == MAX_LEVEL) {
+        glm::vec3 positionSum(0.0f);
+        for (unsigned int i = begin; i < end; ++i) {
+            positionSum += sortedPositions[i];
+        }
+        Node& leaf = subtreeNodes[nodeIndex];
+        leaf.centerOfMass = positionSum / (float)node.numParticles;
+        leaf.mass = node.numParticles * config.particleMass;
+        leaf.next = nodeIndex + 1;
+        return;
+    }
+
+    unsigned int childBegin = begin;
+    for (unsigned int octant = 0; octant < 8; ++octant) {
+        unsigned int childEnd = octant == 7 ? end : findOctantStart(childBegin, end, level, octant + 1);
+        if (childEnd > childBegin) {
+            buildSubtree(subtreeNodes, childBegin, childEnd, level + 1, size * 0.5f);
+        }
+        childBegin = childEnd;
+    }
+
+    subtreeNodes[nodeIndex].next = (unsigned int)subtreeNodes.size();
+    finishNode(subtreeNodes, nodeIndex);
+}
+
+// Splits up the top of the tree, until the nodes have few
+// enough particles that they can be built on their own.
+void BarnesHutSolver::splitTopNode(unsigned int begin, unsigned int end, unsigned int level, float size, unsigned int subtreeSize) {
+    TopNode topNode = {};
+    topNode.node.size = size;
+    topNode.node.firstParticle = begin;
+    topNode.node.numParticles = end - begin;
+    topNode.level = level;
+    topNode.subtree = -1;
+
+    if (end - begin <= subtreeSize || level == MAX_LEVEL) {
+        // The subtrees' node lists are kept around between
+        // updates too, so they only grow when they need to.
+        if (numSubtrees == subtrees.size()) {
+            subtrees.emplace_back();
+        }
+        subtrees[numSubtrees].clear();
+        topNode.subtree = (int)numSubtrees++;
+        topNodes.push_back(topNode);
+        return;
+    }
+
+    unsigned int topNodeIndex = (unsigned int)topNodes.size();
+    topNodes.push_back(topNode);
+
+    unsigned int childBegin = begin;
+    for (unsigned int octant = 0; octant < 8; ++octant) {
+        unsigned int childEnd = octant == 7 ? end : findOctantStart(childBegin, end, level, octant + 1);
+        if (childEnd > childBegin) {
+            splitTopNode(childBegin, childEnd, level + 1, size * 0.5f, subtreeSize);
+        }
+        childBegin = childEnd;
+    }
+
+    // For now, this is an index into topNodes.
+    topNodes[topNodeIndex].node.next = (unsigned int)topNodes.size();
+}
+
+// Step 4: the tree.
+void BarnesHutSolver::buildTree(unsigned int numParticles, float boxSize) {
+    // Plenty of subtrees for every thread to get a few,
+    // so that a big one doesn't hold everybody up.
+    unsigned int subtreeSize = std::max(numParticles / (threadPool.getNumThreads() * 16), (unsigned int)MIN_SUBTREE_SIZE);
+
+    topNodes.clear();
+    numSubtrees = 0;
+    splitTopNode(0, numParticles, 0, boxSize, subtreeSize);
+
+    std::vector<unsigned int> subtreeTopNodes(numSubtrees);
+    for (unsigned int i = 0; i < topNodes.size(); ++i) {
+        if (topNodes[i].subtree >= 0) {
+            subtreeTopNodes[topNodes[i].subtree] = i;
+        }
+    }
+
+    threadPool.parallelFor(numSubtrees, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int subtree = begin; subtree < end; ++subtree) {
+            const TopNode& topNode = topNodes[subtreeTopNodes[subtree]];
+            const Node& node = topNode.node;
+            buildSubtree(subtrees[subtree], node.firstParticle, node.firstParticle + node.numParticles, topNode.level, node.size);
+        }
+    });
+
+    // Now put it all together. The top nodes are already in depth-first
+    // order, so we go through them in order, and each subtree goes
+    // where its top node was.
+    nodes.clear();
+    topNodeFinalIndices.resize(topNodes.size() + 1);
+    for (unsigned int i = 0; i < topNodes.size(); ++i) {
+        unsigned int base = (unsigned int)nodes.size();
+        topNodeFinalIndices[i] = base;
+
+        const TopNode& topNode = topNodes[i];
+        if (topNode.subtree < 0) {
+            nodes.push_back(topNode.node);
+            continue;
+        }
+
+        const std::vector<Node>& subtreeNodes = subtrees[topNode.subtree];
+        nodes.insert(nodes.end(), subtreeNodes.begin(), subtreeNodes.end());
+        for (unsigned int j = base; j < nodes.size(); ++j) {
+            nodes[j].next += base;
+        }
+    }
+    topNodeFinalIndices[topNodes.size()] = (unsigned int)nodes.size();
+
+    // The top nodes' children are always after them, so going
+    // backwards, every node's children are finished before it is.
+    for (unsigned int i = (unsigned int)topNodes.size(); i-- > 0;) {
+        if (topNodes[i].subtree < 0) {
+            unsigned int nodeIndex = topNodeFinalIndices[i];
+            nodes[nodeIndex].next = topNodeFinalIndices[topNodes[i].node.next];
+            finishNode(nodes, nodeIndex);
+        }
+    }
+}
+
+void BarnesHutSolver::computeAccelerations(const glm::vec3* positions, unsigned int numParticles, glm::vec3* accelerations) {
+    if (numParticles == 0) {
+        return;
+    }
+
+    glm::vec3 boxMin;
+    float boxSize;
+    computeMortonCodes(positions, numParticles, boxMin, boxSize);
+    sortByMortonCode(numParticles);
+
+    sortedPositions.resize(numParticles);
+    threadPool.parallelFor(numParticles, PARTICLE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int i = begin; i < end; ++i) {
+            sortedPositions[i] = positions[sortedIndices[i]];
+        }
+    });
+
+    buildTree(numParticles, boxSize);
+
+    // The particles are in Morton order, so the particles that are
+    // handled one after the other are close together, and open up
+    // mostly the same nodes, which keeps those nodes in the cache.
+    const float openingAngleSquared = config.openingAngle * config.openingAngle;
+    const float softeningSquared = config.softening * config.softening;
+    const unsigned int numNodes = (unsigned int)nodes.size();
+    threadPool.parallelFor(numParticles, FORCE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int i = begin; i < end; ++i) {
+            const glm::vec3 position = sortedPositions[i];
+            glm::vec3 acceleration(0.0f);
+
+            unsigned int nodeIndex = 0;
+            while (nodeIndex < numNodes) {
+                const Node& node = nodes[nodeIndex];
+
+                // A leaf: every particle in it pulls on its own...
+                if (node.next == nodeIndex + 1) {
+                    unsigned int last = node.firstParticle + node.numParticles;
+                    if (node.numParticles <= LEAF_SIZE) {
+                        for (unsigned int j = node.firstParticle; j < last; ++j) {
+                            glm::vec3 offset = sortedPositions[j] - position;
+                            float inverseDistance = glm::inversesqrt(glm::dot(offset, offset) + softeningSquared);
+                            // A particle doesn't pull on itself, but its offset is 0 anyway.
+                            acceleration += offset * (config.particleMass * inverseDistance * inverseDistance * inverseDistance);
+                        }
+                        nodeIndex = node.next;
+                        continue;
+                    }
+
+                    // ...unless it's a bigger one that ran out of levels 
+                    // (its particles are all in the same spot, give or 
+                    // take), where going through every pair of them would 
+                    // take forever. That pulls like one big particle, 
+                    // without this one, if it's one of them.
+                    glm::vec3 centerOfMass = node.centerOfMass;
+                    float mass = node.mass;
+                    if (i >= node.firstParticle && i < last) {
+                        centerOfMass = (node.centerOfMass * (float)node.numParticles - position) / (float)(node.numParticles - 1);
+                        mass -= config.particleMass;
+                    }
+                    glm::vec3 offset = centerOfMass - position;
+                    float inverseDistance = glm::inversesqrt(glm::dot(offset, offset) + softeningSquared);
+                    acceleration += offset * (mass * inverseDistance * inverseDistance * inverseDistance);
+                    nodeIndex = node.next;
+                    continue;
+                }
+
+                glm::vec3 offset = node.centerOfMass - position;
+                float distanceSquared = glm::dot(offset, offset);
+                if (node.size * node.size < openingAngleSquared * distanceSquared) {
+                    // Far enough away to pull like one big particle.
+                    float inverseDistance = glm::inversesqrt(distanceSquared + softeningSquared);
+                    acceleration += offset * (node.mass * inverseDistance * inverseDistance * inverseDistance);
+                    nodeIndex = node.next;
+                }
+                else {
+                    // Too close, so open it up and look at its children.
+                    ++nodeIndex;
+                }
+            }
+
+            accelerations[sortedIndices[i]] = acceleration * config.gravitationalConstant;
+        }
+    });
+}
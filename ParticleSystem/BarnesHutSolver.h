@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "ThreadPool.h"
+
+// Works out the gravity that a bunch of particles pull on each other
+// with (an "N-body" simulation), using the Barnes-Hut approximation.
+//
+// Doing it exactly means every particle pulls on every other one, which
+// is n^2 pulls. Barnes-Hut puts the particles into an octree instead,
+// and keeps the total mass and center of mass of every node. A node that
+// is far enough away (compared to how big it is) pulls like a single
+// particle at its center of mass, so we only have to look inside the
+// nodes that are close by. That's about n log n pulls.
+//
+// "Far enough" is the opening angle: a node gets opened up when its
+// size / distance is more than that. 0 is the exact answer (and just as
+// slow), and bigger angles are quicker but less accurate. Around 0.5 to
+// 1 is usual. It can be changed at any time.
+//
+// The tree gets rebuilt from scratch every update:
+//   1. Find the box around all of the particles.
+//   2. Give every particle a Morton code, which is its position in the
+//      box, with the bits of x, y and z interleaved. Sorting by Morton
+//      code puts the particles in octree order: the particles in every
+//      node, at every level, end up next to each other.
+//   3. Sort the particles by Morton code (a radix sort).
+//   4. Split the sorted particles up into nodes, top-down. The top few
+//      levels are split on one thread, until there are enough subtrees
+//      to go around, and then each subtree gets built on its own.
+// Each of these (apart from the top of the tree), and the forces
+// themselves, are split across the threads of a ThreadPool.
+class BarnesHutSolver {
+public:
+	struct Config {
+		float openingAngle = 0.7f;
+		float gravitationalConstant = 0.001f;
+		float particleMass = 1.0f; // every particle has the same mass
+
+		// Two particles that are very close together would pull on
+		// each other very, very hard (infinitely hard, right on top of
+		// each other). Softening makes every pull a bit weaker, as if
+		// the particles were this much further apart.
+		float softening = 0.5f;
+	};
+
+	BarnesHutSolver(const Config& config, ThreadPool& threadPool = ThreadPool::getDefault());
+
+	void setOpeningAngle(float openingAngle) { config.openingAngle = openingAngle; }
+	float getOpeningAngle() const { return config.openingAngle; }
+
+	// Works out each particle's acceleration from the gravity of all of
+	// the others. The arrays both have numParticles elements.
+	void computeAccelerations(const glm::vec3* positions, unsigned int numParticles, glm::vec3* accelerations);
+
+	const Config& getConfig() const { return config; }
+
+private:
+	// The nodes are kept in depth-first order, so a node's first child
+	// (if it has any) comes right after it. next is the node after its
+	// whole subtree, which is where to go when the node doesn't need to
+	// be opened. A leaf doesn't have any children, so its next is the
+	// very next node.
+	struct Node {
+		glm::vec3 centerOfMass;
+		float mass;
+		float size; // the width of the node's cube
+		unsigned int next;
+		unsigned int firstParticle; // the node's particles, in Morton order
+		unsigned int numParticles;
+	};
+
+	// A node near the top of the tree, while it's being split up. A
+	// subtree node is where one of the subtrees gets built (in parallel).
+	struct TopNode {
+		Node node;
+		unsigned int level;
+		int subtree; // -1 when it isn't a subtree node
+	};
+
+	Config config;
+	ThreadPool& threadPool;
+
+	// Kept around between updates, so we aren't re-allocating all the time.
+	std::vector<unsigned int> mortonCodes;
+	std::vector<unsigned int> sortedIndices;
+	std::vector<unsigned int> sortScratchCodes;
+	std::vector<unsigned int> sortScratchIndices;
+	std::vector<unsigned int> sortCounts;
+	std::vector<glm::vec3> sortedPositions;
+	std::vector<glm::vec3> threadMins;
+	std::vector<glm::vec3> threadMaxes;
+	std::vector<TopNode> topNodes;
+	std::vector<std::vector<Node>> subtrees;
+	unsigned int numSubtrees = 0;
+	std::vector<unsigned int> topNodeFinalIndices;
+	std::vector<Node> nodes;
+
+	void computeMortonCodes(const glm::vec3* positions, unsigned int numParticles, glm::vec3& boxMin, float& boxSize);
+	void sortByMortonCode(unsigned int numParticles);
+	void buildTree(unsigned int numParticles, float boxSize);
+	void splitTopNode(unsigned int begin, unsigned int end, unsigned int level, float size, unsigned int subtreeSize);
+	void buildSubtree(std::vector<Node>& subtreeNodes, unsigned int begin, unsigned int end, unsigned int level, float size) const;
+	void finishNode(std::vector<Node>& nodeList, unsigned int nodeIndex) const;
+	unsigned int findOctantStart(unsigned int begin, unsigned int end, unsigned int level, unsigned int octant) const;
+};
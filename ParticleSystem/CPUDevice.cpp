@@ -0,0 +1,19 @@
+#include "CPUDevice.h"
+
+#include <utility>
+
+namespace gfx {
+
+	CPUDevice::CPUDevice(int width, int height)
+		: framebuffers{ CPUFramebuffer(width, height), CPUFramebuffer(width, height) } {
+		backBuffer = &framebuffers[0];
+		frontBuffer = &framebuffers[1];
+	}
+
+	void CPUDevice::makeCurrent() {
+	}
+
+	void CPUDevice::swapBuffers() {
+		std::swap(backBuffer, frontBuffer);
+	}
+}
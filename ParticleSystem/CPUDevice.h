@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CPUFramebuffer.h"
+#include "Device.h"
+
+namespace gfx {
+
+	// A software implementation of the Device class.
+	//
+	// There's no GPU and no window here; the "screen" is just a pair
+	// of CPUFramebuffers in system memory. The CPURenderer draws into
+	// the back buffer, and swapBuffers() makes it the front buffer,
+	// which can then be read back (e.g. to compare against a known-good
+	// image, or to write it to disk).
+	class CPUDevice : public Device {
+	public:
+		CPUDevice(int width, int height);
+
+		// There is no context to make current, so this does nothing.
+		void makeCurrent();
+
+		// Swaps the front and back framebuffers.
+		void swapBuffers();
+
+		CPUFramebuffer& getBackBuffer() { return *backBuffer; }
+		const CPUFramebuffer& getFrontBuffer() const { return *frontBuffer; }
+
+		// Copies the most recently presented frame out as 8-bit RGBA,
+		// bottom row first (the same as glReadPixels).
+		void readPixels(unsigned char* rgba) const { frontBuffer->readPixels(rgba); }
+
+	private:
+		CPUFramebuffer framebuffers[2];
+		CPUFramebuffer* backBuffer;
+		CPUFramebuffer* frontBuffer;
+	};
+}
@@ -0,0 +1,33 @@
+#include "CPUFrameReader.h"
+
+namespace gfx {
+
+	CPUFrameReader::CPUFrameReader(CPUDevice& device, int x, int y, int width, int height, unsigned int ringSize)
+		: device(device), x(x), y(y), width(width), height(height), frames(ringSize) {
+		for (std::vector<unsigned char>& frame : frames) {
+			frame.resize((size_t)width * height * 4);
+		}
+	}
+
+	bool CPUFrameReader::requestFrame() {
+		if (numPending == frames.size()) {
+			return false;
+		}
+
+		device.getBackBuffer().readPixels(x, y, width, height, frames[nextSlot].data());
+		nextSlot = (nextSlot + 1) % frames.size();
+		++numPending;
+		return true;
+	}
+
+	bool CPUFrameReader::readFrame(const FrameCallback& callback, bool wait) {
+		if (numPending == 0) {
+			return false;
+		}
+
+		unsigned int slot = (nextSlot + (unsigned int)frames.size() - numPending) % frames.size();
+		--numPending;
+		callback(frames[slot].data(), width, height);
+		return true;
+	}
+}
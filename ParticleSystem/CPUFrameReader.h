@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "CPUDevice.h"
+#include "FrameReader.h"
+
+namespace gfx {
+
+	// A software implementation of the FrameReader class.
+	//
+	// The CPURenderer has already finished drawing by the time 
+	// requestFrame() is called, so there's nothing to wait for; 
+	// we just copy the back buffer into the next slot of the ring.
+	class CPUFrameReader : public FrameReader {
+	public:
+		CPUFrameReader(CPUDevice& device, int x, int y, int width, int height, unsigned int ringSize);
+
+		bool requestFrame();
+		bool readFrame(const FrameCallback& callback, bool wait);
+		unsigned int getNumPendingFrames() const { return numPending; }
+		unsigned int getNumDroppedFrames() const { return 0; } // they're already in memory
+
+		int getWidth() const { return width; }
+		int getHeight() const { return height; }
+
+	private:
+		CPUDevice& device;
+		int x, y, width, height;
+
+		std::vector<std::vector<unsigned char>> frames;
+		unsigned int nextSlot = 0;
+		unsigned int numPending = 0;
+	};
+}
@@ -0,0 +1,67 @@
+#include "CPUFramebuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gfx {
+
+	CPUFramebuffer::CPUFramebuffer(int width, int height) {
+		resize(width, height);
+	}
+
+	void CPUFramebuffer::resize(int width, int height) {
+		this->width = width;
+		this->height = height;
+		numTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		numTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+		size_t numPixels = (size_t)getNumTiles() * PIXELS_PER_TILE;
+		color.assign(numPixels, 0);
+		depth.assign(numPixels, 1.0f);
+	}
+
+	void CPUFramebuffer::clearTile(int tileIndex, bool clearColor, uint32_t colorValue, bool clearDepth, float depthValue) {
+		if (clearColor) {
+			uint32_t* tileColor = getTileColor(tileIndex);
+			std::fill(tileColor, tileColor + PIXELS_PER_TILE, colorValue);
+		}
+
+		if (clearDepth) {
+			float* tileDepth = getTileDepth(tileIndex);
+			std::fill(tileDepth, tileDepth + PIXELS_PER_TILE, depthValue);
+		}
+	}
+
+	void CPUFramebuffer::readPixels(int x, int y, int width, int height, unsigned char* rgba) const {
+		// Row 0 is the bottom of the image (same as OpenGL window
+		// coordinates), so each row can be copied straight into place,
+		// one tile-wide piece at a time.
+		for (int row = 0; row < height; ++row) {
+			int pixelY = y + row;
+			int tileY = pixelY / TILE_SIZE;
+			int rowInTile = pixelY % TILE_SIZE;
+			unsigned char* dst = rgba + (size_t)row * width * 4;
+
+			int pixelX = x;
+			while (pixelX < x + width) {
+				int tileX = pixelX / TILE_SIZE;
+				int columnInTile = pixelX % TILE_SIZE;
+				int numPixels = std::min(TILE_SIZE - columnInTile, x + width - pixelX);
+
+				int tileIndex = tileY * numTilesX + tileX;
+				const uint32_t* src = &color[(size_t)tileIndex * PIXELS_PER_TILE + rowInTile * TILE_SIZE + columnInTile];
+				memcpy(dst + (pixelX - x) * 4, src, numPixels * sizeof(uint32_t));
+				pixelX += numPixels;
+			}
+		}
+	}
+
+	uint32_t CPUFramebuffer::packColor(float r, float g, float b, float a) {
+		auto toByte = [](float c) -> uint32_t {
+			c = std::min(std::max(c, 0.0f), 1.0f);
+			return (uint32_t)(c * 255.0f + 0.5f);
+		};
+
+		return toByte(r) | (toByte(g) << 8) | (toByte(b) << 16) | (toByte(a) << 24);
+	}
+}
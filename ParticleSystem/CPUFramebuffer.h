@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace gfx {
+
+	// A color + depth framebuffer that lives in regular system memory.
+	//
+	// Rather than storing the pixels one row after another across the
+	// whole image, the framebuffer is chopped up into square tiles, and
+	// each tile's pixels are stored together. A particle usually only
+	// covers a handful of pixels, so this keeps the pixels it touches
+	// close together in memory. It also means that a thread that is
+	// drawing into one tile never touches the same cache lines as a
+	// thread that is drawing into another tile.
+	//
+	// Colors are stored as 8-bit RGBA (red in the lowest byte), depth
+	// is stored as a float in the [0, 1] range, just like the default
+	// OpenGL depth range.
+	class CPUFramebuffer {
+	public:
+		// Width and height of a tile, in pixels.
+		static const int TILE_SIZE = 64;
+		static const int PIXELS_PER_TILE = TILE_SIZE * TILE_SIZE;
+
+		CPUFramebuffer(int width, int height);
+
+		void resize(int width, int height);
+
+		int getWidth() const { return width; }
+		int getHeight() const { return height; }
+		int getNumTilesX() const { return numTilesX; }
+		int getNumTilesY() const { return numTilesY; }
+		int getNumTiles() const { return numTilesX * numTilesY; }
+
+		// The pixels of a single tile, stored row by row. Tiles along
+		// the right and bottom edges are padded out to the full tile size.
+		uint32_t* getTileColor(int tileIndex) { return &color[(size_t)tileIndex * PIXELS_PER_TILE]; }
+		float* getTileDepth(int tileIndex) { return &depth[(size_t)tileIndex * PIXELS_PER_TILE]; }
+
+		// Fills a single tile with the given color and/or depth.
+		void clearTile(int tileIndex, bool clearColor, uint32_t colorValue, bool clearDepth, float depthValue);
+
+		// Copies the image out as tightly-packed 8-bit RGBA rows. To
+		// match glReadPixels(), the bottom row comes first.
+		void readPixels(unsigned char* rgba) const { readPixels(0, 0, width, height, rgba); }
+
+		// Same as above, but only for the given rectangle, which
+		// has to be inside the framebuffer.
+		void readPixels(int x, int y, int width, int height, unsigned char* rgba) const;
+
+		// Packs a floating point color into the framebuffer's format.
+		static uint32_t packColor(float r, float g, float b, float a);
+
+	private:
+		int width = 0, height = 0;
+		int numTilesX = 0, numTilesY = 0;
+		std::vector<uint32_t> color;
+		std::vector<float> depth;
+	};
+}
@@ -0,0 +1,266 @@
+#include "CPURenderer.h"
+#include "CPUFrameReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/ext.hpp>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define CPU_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define INDICES_PER_PARTICLE 6
+#define NUM_SHADER_PROPERTIES 4 // position, previous position, color and size, same as particle.vert
+
+// How many particles each thread works on at a time.
+#define SPLAT_BATCH_SIZE 4096
+#define BIN_BATCH_SIZE 16384
+
+namespace gfx {
+
+	// Fills count pixels of a single row with the same color (and depth).
+	// This is where nearly all of the time goes, so we do 4 pixels
+	// at a time with SSE2 whenever we can.
+	static inline void fillSpan(uint32_t* color, float* depth, int count, uint32_t colorValue, float depthValue, bool depthTest) {
+		int i = 0;
+
+#ifdef CPU_RENDERER_SSE2
+		const __m128i colors4 = _mm_set1_epi32((int)colorValue);
+		if (!depthTest) {
+			for (; i + 4 <= count; i += 4) {
+				_mm_storeu_si128((__m128i*)(color + i), colors4);
+			}
+		}
+		else {
+			const __m128 depths4 = _mm_set1_ps(depthValue);
+			for (; i + 4 <= count; i += 4) {
+				// GL_LESS: only the pixels where we're closer than
+				// what's already there get written.
+				__m128 oldDepth = _mm_loadu_ps(depth + i);
+				__m128 pass = _mm_cmplt_ps(depths4, oldDepth);
+				__m128i passMask = _mm_castps_si128(pass);
+
+				__m128i oldColor = _mm_loadu_si128((const __m128i*)(color + i));
+				__m128i newColor = _mm_or_si128(_mm_and_si128(passMask, colors4), _mm_andnot_si128(passMask, oldColor));
+				__m128 newDepth = _mm_or_ps(_mm_and_ps(pass, depths4), _mm_andnot_ps(pass, oldDepth));
+
+				_mm_storeu_si128((__m128i*)(color + i), newColor);
+				_mm_storeu_ps(depth + i, newDepth);
+			}
+		}
+#endif
+
+		// Whatever is left over (or everything, without SSE2).
+		for (; i < count; ++i) {
+			if (!depthTest) {
+				color[i] = colorValue;
+			}
+			else if (depthValue < depth[i]) {
+				color[i] = colorValue;
+				depth[i] = depthValue;
+			}
+		}
+	}
+
+	CPURenderer::CPURenderer(CPUResourceManager& resourceManager, CPUDevice& device, ThreadPool& threadPool)
+		: resourceManager(resourceManager), device(device), threadPool(threadPool) {
+	}
+
+	void CPURenderer::clear(const ClearOptions& clearOptions) {
+		CPUFramebuffer& framebuffer = device.getBackBuffer();
+		uint32_t color = CPUFramebuffer::packColor(clearOptions.r, clearOptions.g, clearOptions.b, clearOptions.a);
+
+		// There's no stencil buffer, so clearStencil is ignored.
+		threadPool.parallelFor(framebuffer.getNumTiles(), 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int tile = begin; tile < end; ++tile) {
+				framebuffer.clearTile(tile, clearOptions.clearColor, color, clearOptions.clearDepth, clearOptions.depth);
+			}
+		});
+	}
+
+	void CPURenderer::setupCamera(const Camera& camera, const Viewport& viewport) {
+		// Same matrices as GLRenderer::setupCamera, we just
+		// keep them for ourselves rather than sending them to a UBO.
+		this->viewport = viewport;
+		viewMat = glm::inverse(camera.getTransform().getMatrix());
+		projMat = glm::perspectiveFov(
+			camera.getFovy(),
+			(float)viewport.width,
+			(float)viewport.height,
+			camera.getNear(),
+			camera.getFar());
+	}
+
+	void CPURenderer::draw(const std::vector<DrawCall> drawCalls) {
+		for (size_t i = 0; i < drawCalls.size(); i++) {
+			drawParticles(drawCalls[i]);
+		}
+	}
+
+	FrameReader* CPURenderer::createFrameReader(const Viewport& viewport, unsigned int ringSize) {
+		return new CPUFrameReader(device, viewport.x, viewport.y, viewport.width, viewport.height, ringSize);
+	}
+
+	void CPURenderer::drawParticles(const DrawCall& drawCall) {
+		// We only know how to do particle.vert's job. Draws without an index
+		// buffer (like AnalyticParticleSystem's) use a different shader and a
+		// different storage layout, so we leave those out. So do indirect
+		// draws, since their counts only exist on the GPU.
+		if (drawCall.indexType == DrawCall::IndexType::NONE || drawCall.indirectBuffer != 0) {
+			return;
+		}
+
+		const std::vector<unsigned char>& storage = resourceManager.getBufferData(drawCall.storageBuffer);
+
+		// The storage buffer holds 4 arrays (positions, previous positions, colors, sizes) of
+		// vec4s, one after the other, so the buffer size tells us how long
+		// each array is.
+		size_t maxParticles = storage.size() / (sizeof(glm::vec4) * NUM_SHADER_PROPERTIES);
+		unsigned int numParticles = (unsigned int)std::min<size_t>(drawCall.numIndices / INDICES_PER_PARTICLE, maxParticles);
+		if (numParticles == 0) {
+			return;
+		}
+
+		const glm::vec4* positions = (const glm::vec4*)storage.data();
+		const glm::vec4* prevPositions = positions + maxParticles;
+		const glm::vec4* colors = prevPositions + maxParticles;
+		const glm::vec4* sizes = colors + maxParticles;
+
+		// The first float of the ParticleParams block says how far to go from the
+		// previous position to the current one. Without it, we draw the current one.
+		float interpolationAlpha = 1.0f;
+		if (drawCall.uniformBuffer != 0) {
+			const std::vector<unsigned char>& params = resourceManager.getBufferData(drawCall.uniformBuffer);
+			if (params.size() >= sizeof(float)) {
+				memcpy(&interpolationAlpha, params.data(), sizeof(float));
+			}
+		}
+
+		CPUFramebuffer& framebuffer = device.getBackBuffer();
+
+		// We can't draw outside of the viewport, or outside of the framebuffer.
+		const int clipX0 = std::max(viewport.x, 0);
+		const int clipY0 = std::max(viewport.y, 0);
+		const int clipX1 = std::min(viewport.x + viewport.width, framebuffer.getWidth());
+		const int clipY1 = std::min(viewport.y + viewport.height, framebuffer.getHeight());
+
+		// Step 1: project every particle onto the screen. This is the
+		// same math as particle.vert, except that we only need two of
+		// the corners, since the square always faces the camera.
+		splats.resize(numParticles);
+		threadPool.parallelFor(numParticles, SPLAT_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int i = begin; i < end; ++i) {
+				Splat& splat = splats[i];
+				splat.x0 = splat.x1 = 0;
+
+				float size = sizes[i].x;
+				glm::vec4 position = glm::mix(prevPositions[i], positions[i], interpolationAlpha);
+				glm::vec4 viewSpacePos = viewMat * position;
+				glm::vec4 minCorner = projMat * (viewSpacePos + glm::vec4(-0.5f, -0.5f, 0.0f, 1.0f) * size);
+				glm::vec4 maxCorner = projMat * (viewSpacePos + glm::vec4(0.5f, 0.5f, 0.0f, 1.0f) * size);
+
+				// Behind the camera?
+				if (minCorner.w <= 0.0f) {
+					continue;
+				}
+
+				// All four corners are the same distance from the camera, so
+				// the near and far planes either clip all of it or none of it.
+				float ndcZ = minCorner.z / minCorner.w;
+				if (ndcZ < -1.0f || ndcZ > 1.0f) {
+					continue;
+				}
+
+				float xMin = viewport.x + (minCorner.x / minCorner.w + 1.0f) * 0.5f * viewport.width;
+				float yMin = viewport.y + (minCorner.y / minCorner.w + 1.0f) * 0.5f * viewport.height;
+				float xMax = viewport.x + (maxCorner.x / maxCorner.w + 1.0f) * 0.5f * viewport.width;
+				float yMax = viewport.y + (maxCorner.y / maxCorner.w + 1.0f) * 0.5f * viewport.height;
+
+				// A pixel is covered if its center is inside the square.
+				splat.x0 = std::max((int)std::ceil(xMin - 0.5f), clipX0);
+				splat.y0 = std::max((int)std::ceil(yMin - 0.5f), clipY0);
+				splat.x1 = std::min((int)std::ceil(xMax - 0.5f), clipX1);
+				splat.y1 = std::min((int)std::ceil(yMax - 0.5f), clipY1);
+				splat.depth = ndcZ * 0.5f + 0.5f;
+
+				const glm::vec4& color = colors[i];
+				splat.color = CPUFramebuffer::packColor(color.r, color.g, color.b, color.a);
+			}
+		});
+
+		// Step 2: bin the splats. Each batch of splats gets its own set of
+		// bins, so the threads don't have to share anything.
+		const int numTiles = framebuffer.getNumTiles();
+		const int numTilesX = framebuffer.getNumTilesX();
+		unsigned int numBinBatches = (numParticles + BIN_BATCH_SIZE - 1) / BIN_BATCH_SIZE;
+		if (bins.size() < (size_t)numBinBatches * numTiles) {
+			bins.resize((size_t)numBinBatches * numTiles);
+		}
+
+		threadPool.parallelFor(numBinBatches, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int batch = begin; batch < end; ++batch) {
+				std::vector<uint32_t>* batchBins = &bins[(size_t)batch * numTiles];
+				for (int tile = 0; tile < numTiles; ++tile) {
+					batchBins[tile].clear();
+				}
+
+				unsigned int first = batch * BIN_BATCH_SIZE;
+				unsigned int last = std::min(first + BIN_BATCH_SIZE, numParticles);
+				for (unsigned int i = first; i < last; ++i) {
+					const Splat& splat = splats[i];
+					if (splat.x0 >= splat.x1 || splat.y0 >= splat.y1) {
+						continue;
+					}
+
+					int tileX0 = splat.x0 / CPUFramebuffer::TILE_SIZE;
+					int tileY0 = splat.y0 / CPUFramebuffer::TILE_SIZE;
+					int tileX1 = (splat.x1 - 1) / CPUFramebuffer::TILE_SIZE;
+					int tileY1 = (splat.y1 - 1) / CPUFramebuffer::TILE_SIZE;
+					for (int tileY = tileY0; tileY <= tileY1; ++tileY) {
+						for (int tileX = tileX0; tileX <= tileX1; ++tileX) {
+							batchBins[tileY * numTilesX + tileX].push_back(i);
+						}
+					}
+				}
+			}
+		});
+
+		// Step 3: draw every tile.
+		threadPool.parallelFor(numTiles, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int tile = begin; tile < end; ++tile) {
+				rasterizeTile(framebuffer, tile, numBinBatches);
+			}
+		});
+	}
+
+	void CPURenderer::rasterizeTile(CPUFramebuffer& framebuffer, int tileIndex, unsigned int numBinBatches) {
+		const int numTiles = framebuffer.getNumTiles();
+		const int tileX0 = (tileIndex % framebuffer.getNumTilesX()) * CPUFramebuffer::TILE_SIZE;
+		const int tileY0 = (tileIndex / framebuffer.getNumTilesX()) * CPUFramebuffer::TILE_SIZE;
+		const int tileX1 = tileX0 + CPUFramebuffer::TILE_SIZE;
+		const int tileY1 = tileY0 + CPUFramebuffer::TILE_SIZE;
+
+		uint32_t* tileColor = framebuffer.getTileColor(tileIndex);
+		float* tileDepth = framebuffer.getTileDepth(tileIndex);
+
+		// Going through the batches in order means we draw the
+		// splats in the same order that they were submitted.
+		for (unsigned int batch = 0; batch < numBinBatches; ++batch) {
+			const std::vector<uint32_t>& bin = bins[(size_t)batch * numTiles + tileIndex];
+			for (uint32_t splatIndex : bin) {
+				const Splat& splat = splats[splatIndex];
+				int x0 = std::max(splat.x0, tileX0) - tileX0;
+				int x1 = std::min(splat.x1, tileX1) - tileX0;
+				int y0 = std::max(splat.y0, tileY0) - tileY0;
+				int y1 = std::min(splat.y1, tileY1) - tileY0;
+
+				for (int y = y0; y < y1; ++y) {
+					int rowStart = y * CPUFramebuffer::TILE_SIZE + x0;
+					fillSpan(tileColor + rowStart, tileDepth + rowStart, x1 - x0, splat.color, splat.depth, depthTestEnabled);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Camera.h"
+#include "ClearOptions.h"
+#include "CPUDevice.h"
+#include "CPUResourceManager.h"
+#include "DrawCall.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+#include "Viewport.h"
+
+namespace gfx {
+
+	// A software implementation of the Renderer class. It draws
+	// into a CPUDevice's back buffer, using nothing but the CPU.
+	//
+	// We can't run GLSL on the CPU, so instead this class does the
+	// same job as particle.vert and particle.frag by hand: each particle
+	// in a draw call's storage buffer becomes a camera-facing square
+	// (a "splat") that is filled with the particle's color. It expects
+	// the storage buffer to have the same layout as the Particles block
+	// in particle.vert.
+	//
+	// Drawing happens in three steps, and each step is split across
+	// the threads of a ThreadPool:
+	//   1. Work out the screen rectangle, depth and color of every splat.
+	//   2. "Bin" the splats: for every tile of the framebuffer, make a
+	//      list of the splats that overlap it.
+	//   3. Draw the tiles. Each tile is only ever touched by one thread,
+	//      so no locking is needed, and because the bins are filled in
+	//      the same order as the particles, the result is exactly the
+	//      same no matter how many threads we use.
+	class CPURenderer : public Renderer {
+	public:
+		CPURenderer(CPUResourceManager& resourceManager, CPUDevice& device, ThreadPool& threadPool = ThreadPool::getDefault());
+
+		// Clears the back buffer, according to the ClearOptions.
+		void clear(const ClearOptions& clearOptions);
+
+		// Remembers the camera's matrices so that draw() can
+		// project the particles onto the screen.
+		void setupCamera(const Camera& camera, const Viewport& viewport);
+
+		// Takes a list of draw calls and draws them!
+		void draw(const std::vector<DrawCall> drawCalls);
+
+		// GLRenderer never turns on GL_DEPTH_TEST, so by default we don't
+		// either, and later particles simply draw over earlier ones. Turning
+		// this on gives the usual "closest one wins" behavior instead.
+		void setDepthTestEnabled(bool enabled) { depthTestEnabled = enabled; }
+
+		// Creates a CPUFrameReader, which copies out of the back buffer.
+		FrameReader* createFrameReader(const Viewport& viewport, unsigned int ringSize);
+
+	private:
+
+		// A particle, after it has been projected onto the screen.
+		// The rectangle covers the pixels [x0, x1) x [y0, y1).
+		struct Splat {
+			int x0, y0, x1, y1;
+			float depth;
+			uint32_t color;
+		};
+
+		CPUResourceManager& resourceManager;
+		CPUDevice& device;
+		ThreadPool& threadPool;
+
+		glm::mat4 viewMat = glm::mat4(1);
+		glm::mat4 projMat = glm::mat4(1);
+		Viewport viewport = { 0, 0, 0, 0 };
+		bool depthTestEnabled = false;
+
+		// Scratch memory, kept around between frames
+		// so that we aren't re-allocating all the time.
+		std::vector<Splat> splats;
+		std::vector<std::vector<uint32_t>> bins;
+
+		void drawParticles(const DrawCall& drawCall);
+		void rasterizeTile(CPUFramebuffer& framebuffer, int tileIndex, unsigned int numBinBatches);
+	};
+}
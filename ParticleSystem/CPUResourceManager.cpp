@@ -0,0 +1,104 @@
+#include "CPUResourceManager.h"
+
+#include <cstring>
+
+namespace gfx {
+
+	ResourceManager::HPROGRAM CPUResourceManager::createProgramFromSource(const ShaderSource* shaders, unsigned int numShaders) {
+		std::vector<std::string> sources;
+		for (unsigned int i = 0; i < numShaders; ++i) {
+			sources.push_back(shaders[i].source != nullptr ? shaders[i].source : "");
+		}
+
+		HPROGRAM handle = nextHandle++;
+		programs.emplace(handle, std::move(sources));
+		return handle;
+	}
+
+	void CPUResourceManager::deleteProgram(HPROGRAM programHandle) {
+		programs.erase(programHandle);
+	}
+
+	ResourceManager::HBUFFER CPUResourceManager::createStreamingUniformBuffer(unsigned int initialDataSize, unsigned char* initialData) {
+		return createBuffer(initialDataSize, initialData);
+	}
+
+	void CPUResourceManager::streamDataToUniformBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) {
+		streamDataToBuffer(bufferHandle, bufferCallback);
+	}
+
+	ResourceManager::HBUFFER CPUResourceManager::createStreamingStorageBuffer(unsigned int initialDataSize, unsigned char* initialData) {
+		return createBuffer(initialDataSize, initialData);
+	}
+
+	void CPUResourceManager::streamDataToStorageBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) {
+		streamDataToBuffer(bufferHandle, bufferCallback);
+	}
+
+	void CPUResourceManager::updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data) {
+		std::map<HBUFFER, std::vector<unsigned char>>::iterator itr = buffers.find(bufferHandle);
+		if (itr != buffers.end() && (size_t)offset + size <= itr->second.size()) {
+			memcpy(itr->second.data() + offset, data, size);
+		}
+	}
+
+	ResourceManager::HBUFFER CPUResourceManager::createStorageBuffer(unsigned int size, const void* initialData) {
+		return createBuffer(size, initialData);
+	}
+
+	void CPUResourceManager::dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ) {
+	}
+
+	void CPUResourceManager::memoryBarrier(unsigned int barriers) {
+		// Everything already happens in order on the CPU.
+	}
+
+	void CPUResourceManager::deleteBuffer(HBUFFER bufferHandle) {
+		buffers.erase(bufferHandle);
+	}
+
+	const std::vector<unsigned char>& CPUResourceManager::getBufferData(HBUFFER bufferHandle) const {
+		static const std::vector<unsigned char> emptyBuffer;
+
+		std::map<HBUFFER, std::vector<unsigned char>>::const_iterator itr = buffers.find(bufferHandle);
+		if (itr == buffers.end()) {
+			return emptyBuffer;
+		}
+
+		return itr->second;
+	}
+
+	ResourceManager::HVAO CPUResourceManager::createVAO(const VAOConfig& config) {
+		std::vector<unsigned char> indexData;
+		if (config.indexData != nullptr) {
+			const unsigned char* bytes = (const unsigned char*)config.indexData;
+			indexData.assign(bytes, bytes + config.indexBufferSizeBytes);
+		}
+
+		HVAO handle = nextHandle++;
+		vaos.emplace(handle, std::move(indexData));
+		return handle;
+	}
+
+	void CPUResourceManager::deleteVAO(HVAO vaoHandle) {
+		vaos.erase(vaoHandle);
+	}
+
+	ResourceManager::HBUFFER CPUResourceManager::createBuffer(unsigned int initialDataSize, const void* initialData) {
+		std::vector<unsigned char> data(initialDataSize, 0);
+		if (initialData != nullptr) {
+			memcpy(data.data(), initialData, initialDataSize);
+		}
+
+		HBUFFER handle = nextHandle++;
+		buffers.emplace(handle, std::move(data));
+		return handle;
+	}
+
+	void CPUResourceManager::streamDataToBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) {
+		std::map<HBUFFER, std::vector<unsigned char>>::iterator itr = buffers.find(bufferHandle);
+		if (itr != buffers.end()) {
+			bufferCallback(itr->second.data());
+		}
+	}
+}
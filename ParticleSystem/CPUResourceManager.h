@@ -0,0 +1,69 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ResourceManager.h"
+
+namespace gfx {
+
+	/**
+	 * A ResourceManager whose "graphics resources" are just blocks of
+	 * regular system memory. It goes with the CPURenderer.
+	 *
+	 * Buffers are plain byte arrays, so streaming data into them is as
+	 * simple as handing the callback a pointer to the array. Programs
+	 * can't actually be compiled (there's no GPU to run them on), so we
+	 * just hang on to the source code. The CPURenderer knows how to do
+	 * the same job as our particle shaders on its own, but there's no such
+	 * stand-in for compute shaders, so dispatching one does nothing.
+	 */
+	class CPUResourceManager : public ResourceManager {
+	public:
+
+		// Shader Programs
+		HPROGRAM createProgramFromSource(const ShaderSource* shaders, unsigned int numShaders);
+		void deleteProgram(HPROGRAM programHandle);
+
+		// Buffers
+		HBUFFER createStreamingUniformBuffer(unsigned int initialDataSize, unsigned char* initialData);
+		void streamDataToUniformBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+
+		HBUFFER createStreamingStorageBuffer(unsigned int initialDataSize, unsigned char* initialData);
+		void streamDataToStorageBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+		void updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data);
+
+		HBUFFER createStorageBuffer(unsigned int size, const void* initialData);
+
+		void deleteBuffer(HBUFFER bufferHandle);
+
+		void bindUniformBufferBase(HBUFFER bufferHandle, unsigned int index) {}
+		void bindStorageBufferBase(HBUFFER bufferHandle, unsigned int index) {}
+
+		// Compute
+		void dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ);
+		void memoryBarrier(unsigned int barriers);
+
+		// Gets the memory that backs a buffer, or an empty
+		// buffer if the handle isn't valid.
+		const std::vector<unsigned char>& getBufferData(HBUFFER bufferHandle) const;
+
+		// VAOs
+		HVAO createVAO(const VAOConfig& config);
+		void deleteVAO(HVAO vaoHandle);
+
+	private:
+
+		// The source code of each program's shaders.
+		std::map<HPROGRAM, std::vector<std::string>> programs;
+		std::map<HBUFFER, std::vector<unsigned char>> buffers;
+		std::map<HVAO, std::vector<unsigned char>> vaos;
+
+		// Handle 0 means "no resource", so we start at 1.
+		unsigned int nextHandle = 1;
+
+		HBUFFER createBuffer(unsigned int initialDataSize, const void* initialData);
+		void streamDataToBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+	};
+}
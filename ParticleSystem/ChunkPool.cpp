@@ -0,0 +1,330 @@
+#include "ChunkPool.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const size_t CHUNK_ALIGNMENT = 64; // a cache line
+static const size_t MAX_HUGE_PAGES_PER_SLAB = 8;
+
+static size_t roundUp(size_t size, size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+// What a regular mapping gets rounded up to. On Windows, that's the
+// allocation granularity (64 KB), rather than the page size, since
+// VirtualAlloc() can't start anywhere else.
+static size_t getMappingGranularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static size_t getRegularPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+#ifdef _WIN32
+// Large pages can't be paged out, so Windows only hands them to
+// processes whose user has been given the "Lock pages in memory"
+// right, and even then, it has to be switched on first.
+static bool enableLockMemoryPrivilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+        && GetLastError() == ERROR_SUCCESS; // it "succeeds" without the right, too
+    CloseHandle(token);
+    return enabled;
+}
+#endif
+
+// 0 if there aren't any huge pages to be had.
+static size_t getHugePageSize() {
+#ifdef _WIN32
+    static bool enabled = enableLockMemoryPrivilege();
+    return enabled ? GetLargePageMinimum() : 0;
+#else
+    return 2 * 1024 * 1024;
+#endif
+}
+
+#ifndef _WIN32
+// The kernel can only use a transparent huge page for memory that
+// lines up with one, so we take a bit more than we need, and give
+// back the ends. Returns null (with hugePages false) if even that
+// much can't be had.
+static char* mapTransparentHugePages(size_t size, size_t hugePageSize, bool& hugePages) {
+    char* mapped = (char*)mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == (char*)MAP_FAILED) {
+        hugePages = false;
+        return nullptr;
+    }
+    char* aligned = (char*)roundUp((size_t)mapped, hugePageSize);
+    if (aligned != mapped) {
+        munmap(mapped, aligned - mapped);
+    }
+    size_t after = (mapped + size + hugePageSize) - (aligned + size);
+    if (after != 0) {
+        munmap(aligned + size, after);
+    }
+#ifdef MADV_HUGEPAGE
+    hugePages = madvise(aligned, size, MADV_HUGEPAGE) == 0;
+#else
+    hugePages = false;
+#endif
+    return aligned;
+}
+#endif
+
+// Memory that's all zeros, and (apart from Windows' large pages, which
+// are there as soon as they're allocated) doesn't get a page of real
+// memory behind it until it's touched. Sets hugePages to whether it
+// got them.
+static char* mapPages(size_t size, size_t hugePageSize, bool& hugePages) {
+#ifdef _WIN32
+    if (hugePages) {
+        void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (memory != nullptr) {
+            return (char*)memory;
+        }
+        hugePages = false;
+    }
+    (void)hugePageSize;
+    return (char*)VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    if (hugePages) {
+#ifdef MAP_HUGETLB
+        // The huge pages that have been set aside for us...
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            return (char*)memory;
+        }
+#endif
+
+        // ...or, if there aren't any, transparent huge pages (see
+        // mapTransparentHugePages()), or failing that, regular ones.
+        char* aligned = mapTransparentHugePages(size, hugePageSize, hugePages);
+        if (aligned != nullptr) {
+            return aligned;
+        }
+    }
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory != MAP_FAILED ? (char*)memory : nullptr;
+#endif
+}
+
+static void unmapPages(char* memory, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+ChunkPool::ChunkPool(const Config& config) : config(config) {
+    size_t chunkStride = roundUp(config.chunkSize, CHUNK_ALIGNMENT);
+    if (config.hugePages) {
+        hugePageSize = getHugePageSize();
+    }
+
+    if (hugePageSize != 0) {
+        // As few huge pages as we can get away with, without wasting
+        // more than an eighth of them (or the least wasteful, if that
+        // can't be done).
+        double bestWaste = 1.0;
+        for (size_t numHugePages = 1; numHugePages <= MAX_HUGE_PAGES_PER_SLAB; ++numHugePages) {
+            size_t size = numHugePages * hugePageSize;
+            size_t numChunks = size / chunkStride;
+            if (numChunks == 0) {
+                continue;
+            }
+            double waste = (double)(size - numChunks * chunkStride) / size;
+            if (waste < bestWaste) {
+                bestWaste = waste;
+                slabSize = size;
+                chunksPerSlab = numChunks;
+            }
+            if (waste <= 0.125) {
+                break;
+            }
+        }
+    }
+
+    // Too big for any number of huge pages (or not asked for).
+    if (slabSize == 0) {
+        hugePageSize = 0;
+        chunksPerSlab = 1;
+        slabSize = roundUp(chunkStride, getMappingGranularity());
+    }
+}
+
+ChunkPool::~ChunkPool() {
+    // Only the slabs that are completely idle go back. Anything that's
+    // still being used belongs to someone who's outlived us.
+    std::vector<Slab*> idleSlabs;
+    for (const auto& chunkSlab : slabs) {
+        Slab* slab = chunkSlab.second;
+        if (slab->numIdle == chunksPerSlab && chunkSlab.first == slab->memory) {
+            idleSlabs.push_back(slab);
+        }
+    }
+    for (Slab* slab : idleSlabs) {
+        freeSlab(slab);
+    }
+}
+
+void* ChunkPool::allocate() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            void* chunk = takeIdleChunk();
+            if (chunk != nullptr) {
+                return chunk;
+            }
+        }
+
+        // Nothing to reuse, so it's a new slab (and there's no need to
+        // hold on to the lock while the OS finds it for us). Then we go
+        // round again to take one of its chunks.
+        if (!allocateSlab()) {
+            return nullptr;
+        }
+    }
+}
+
+void ChunkPool::release(void* chunk) {
+    if (chunk == nullptr) {
+        return;
+    }
+
+    Slab* slabToFree = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slab* slab = slabs[chunk];
+        idleChunks.push_back(chunk);
+        ++slab->numIdle;
+        ++numIdleChunks;
+        --numChunksInUse;
+        if (numIdleChunks <= config.maxIdleChunks || slab->numIdle < chunksPerSlab) {
+            return;
+        }
+
+        // Take all of the slab's chunks off of the idle list.
+        for (size_t i = idleChunks.size(); i > 0; --i) {
+            char* idleChunk = (char*)idleChunks[i - 1];
+            if (idleChunk >= slab->memory && idleChunk < slab->memory + slab->size) {
+                idleChunks[i - 1] = idleChunks.back();
+                idleChunks.pop_back();
+                slabs.erase(idleChunk);
+            }
+        }
+        numIdleChunks -= chunksPerSlab;
+        stats.numSlabs -= 1;
+        stats.bytesMapped -= slab->size;
+        if (slab->hugePages) {
+            stats.bytesInHugePages -= slab->size;
+        }
+        slabToFree = slab;
+    }
+
+    unmapPages(slabToFree->memory, slabToFree->size);
+    delete slabToFree;
+}
+
+size_t ChunkPool::getNumChunksInUse() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numChunksInUse;
+}
+
+size_t ChunkPool::getNumIdleChunks() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numIdleChunks;
+}
+
+ChunkPool::Stats ChunkPool::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats current = stats;
+    current.numChunksInUse = numChunksInUse;
+    current.numIdleChunks = numIdleChunks;
+    current.numPages = (current.bytesMapped - current.bytesInHugePages) / getRegularPageSize();
+    if (hugePageSize != 0) {
+        current.numPages += current.bytesInHugePages / hugePageSize;
+    }
+    return current;
+}
+
+// Has to be called with the lock held.
+void* ChunkPool::takeIdleChunk() {
+    if (idleChunks.empty()) {
+        return nullptr;
+    }
+    void* chunk = idleChunks.back();
+    idleChunks.pop_back();
+    --slabs[chunk]->numIdle;
+    --numIdleChunks;
+    ++numChunksInUse;
+    return chunk;
+}
+
+// Maps a new slab, and puts all of its chunks on the idle list. Takes
+// the lock itself (but not while it's mapping).
+bool ChunkPool::allocateSlab() {
+    bool hugePages = hugePageSize != 0;
+    char* memory = mapPages(slabSize, hugePageSize, hugePages);
+    if (memory == nullptr) {
+        return false;
+    }
+
+    Slab* slab = new Slab();
+    slab->memory = memory;
+    slab->size = slabSize;
+    slab->hugePages = hugePages;
+    slab->numIdle = (unsigned int)chunksPerSlab;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Backwards, so that the first chunk gets used first.
+    size_t chunkStride = roundUp(config.chunkSize, CHUNK_ALIGNMENT);
+    for (size_t i = chunksPerSlab; i > 0; --i) {
+        void* chunk = memory + (i - 1) * chunkStride;
+        idleChunks.push_back(chunk);
+        slabs[chunk] = slab;
+    }
+    numIdleChunks += chunksPerSlab;
+    stats.numSlabs += 1;
+    stats.bytesMapped += slabSize;
+    if (hugePages) {
+        stats.bytesInHugePages += slabSize;
+    }
+    else if (hugePageSize != 0) {
+        ++stats.numHugePageFailures;
+    }
+    return true;
+}
+
+// Only for the destructor, which doesn't bother with the bookkeeping.
+void ChunkPool::freeSlab(Slab* slab) {
+    unmapPages(slab->memory, slab->size);
+    delete slab;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Fixed-size blocks of memory that get shared between everything that
+// uses the same pool (all of the ParticleSystems, say). A block that
+// gets released is kept around for the next allocate(), up to
+// maxIdleChunks of them, so that a system that's busy one moment and
+// idle the next doesn't keep going back to the OS. Past that, released
+// blocks really are freed, so the memory follows how much is actually
+// being used.
+//
+// The chunks come straight from the OS's pages (rather than malloc), so
+// they always start on a page (which is more than enough for SIMD
+// loads, and for keeping the first cache line to itself), and nothing
+// in them is touched until whoever asked for it writes to it.
+//
+// With hugePages, the chunks come out of 2 MB pages, rather than 4 KB
+// ones, so the CPU needs 512 times fewer TLB entries (its cache of
+// where pages are) to get at them all, and stops missing it once the
+// particles add up to more than a few MB. That needs asking for: on
+// Windows, the user needs the "Lock pages in memory" right, and on
+// Linux, either some pages set aside with vm.nr_hugepages, or
+// transparent huge pages turned on. Without them, we fall back to
+// regular pages (and getStats() says so). A huge page can't be split
+// up, so as many chunks as fit are carved out of a few of them at once
+// (a "slab"), and it only goes back to the OS once all of them are idle.
+//
+// Safe to use from any thread (it's just a mutex, but it only gets
+// locked when a whole chunk is needed or finished with).
+class ChunkPool {
+public:
+	struct Config {
+		size_t chunkSize;
+		size_t maxIdleChunks = 16;
+		bool hugePages = false;
+	};
+
+	// Where the memory has gone. Everything that's been mapped is
+	// counted, including the chunks that are idle, and the bits of the
+	// pages that there wasn't room for another chunk in.
+	struct Stats {
+		size_t numChunksInUse = 0;
+		size_t numIdleChunks = 0;
+		size_t numSlabs = 0;
+		size_t bytesMapped = 0;
+		size_t bytesInHugePages = 0; // of bytesMapped (with transparent huge pages, the ones we asked for)
+		size_t numPages = 0; // TLB entries needed to cover all of it
+		size_t numHugePageFailures = 0; // slabs that had to fall back to regular pages
+	};
+
+	ChunkPool(const Config& config);
+	~ChunkPool();
+
+	// A new chunk is all zeros. A reused one has whatever was in it
+	// when it was released.
+	void* allocate();
+	void release(void* chunk);
+
+	size_t getChunkSize() const { return config.chunkSize; }
+	size_t getNumChunksInUse() const;
+	size_t getNumIdleChunks() const;
+	Stats getStats() const;
+
+private:
+	struct Slab {
+		char* memory;
+		size_t size;
+		bool hugePages;
+		unsigned int numIdle;
+	};
+
+	Config config;
+	size_t chunksPerSlab = 1;
+	size_t slabSize = 0; // with hugePages, a whole number of huge pages
+	size_t hugePageSize = 0; // 0 if huge pages aren't to be had
+
+	std::vector<void*> idleChunks;
+	std::unordered_map<void*, Slab*> slabs; // for each chunk
+	size_t numIdleChunks = 0;
+	size_t numChunksInUse = 0;
+	Stats stats;
+	mutable std::mutex mutex;
+
+	void* takeIdleChunk();
+	bool allocateSlab();
+	void freeSlab(Slab* slab);
+};
@@ -0,0 +1,229 @@
+#include "ColliderSet.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#define MAX_GRID_CELLS_PER_AXIS 64 // the cells get bigger, rather than the grid getting any bigger than this
+#define MAX_QUERY_CELLS 64 // past this many cells, it's quicker to just check every collider's box
+
+void SDFVolume::bake(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec3& resolution, const std::function<float(const glm::vec3&)>& distance) {
+    this->boundsMin = boundsMin;
+    this->boundsMax = boundsMax;
+    this->resolution = glm::max(resolution, glm::ivec3(2));
+
+    glm::vec3 spacing = (boundsMax - boundsMin) / glm::vec3(this->resolution - glm::ivec3(1));
+    distances.resize((size_t)this->resolution.x * this->resolution.y * this->resolution.z);
+    size_t i = 0;
+    for (int z = 0; z < this->resolution.z; ++z) {
+        for (int y = 0; y < this->resolution.y; ++y) {
+            for (int x = 0; x < this->resolution.x; ++x) {
+                distances[i++] = distance(boundsMin + glm::vec3(x, y, z) * spacing);
+            }
+        }
+    }
+}
+
+float SDFVolume::sample(const glm::vec3& point) const {
+    if (distances.empty()) {
+        return FLT_MAX;
+    }
+
+    glm::vec3 outside = glm::max(boundsMin - point, point - boundsMax);
+    if (outside.x > 0.0f || outside.y > 0.0f || outside.z > 0.0f) {
+        return glm::length(glm::max(outside, glm::vec3(0.0f)));
+    }
+
+    // Which grid points we're between, and how far between them we are.
+    glm::vec3 gridPoint = (point - boundsMin) / (boundsMax - boundsMin) * glm::vec3(resolution - glm::ivec3(1));
+    glm::ivec3 corner = glm::min(glm::ivec3(gridPoint), resolution - glm::ivec3(2));
+    glm::vec3 t = gridPoint - glm::vec3(corner);
+
+    size_t rowSize = (size_t)resolution.x;
+    size_t sliceSize = rowSize * resolution.y;
+    const float* d = &distances[corner.x + corner.y * rowSize + corner.z * sliceSize];
+
+    // Blend along x, then y, then z.
+    float d00 = d[0] + (d[1] - d[0]) * t.x;
+    float d10 = d[rowSize] + (d[rowSize + 1] - d[rowSize]) * t.x;
+    float d01 = d[sliceSize] + (d[sliceSize + 1] - d[sliceSize]) * t.x;
+    float d11 = d[sliceSize + rowSize] + (d[sliceSize + rowSize + 1] - d[sliceSize + rowSize]) * t.x;
+    float d0 = d00 + (d10 - d00) * t.y;
+    float d1 = d01 + (d11 - d01) * t.y;
+    return d0 + (d1 - d0) * t.z;
+}
+
+glm::vec3 SDFVolume::getGradient(const glm::vec3& point) const {
+    // Central differences, half a grid cell to either side.
+    glm::vec3 step = (boundsMax - boundsMin) / glm::vec3(glm::max(resolution - glm::ivec3(1), glm::ivec3(1))) * 0.5f;
+    return glm::vec3(
+        sample(point + glm::vec3(step.x, 0.0f, 0.0f)) - sample(point - glm::vec3(step.x, 0.0f, 0.0f)),
+        sample(point + glm::vec3(0.0f, step.y, 0.0f)) - sample(point - glm::vec3(0.0f, step.y, 0.0f)),
+        sample(point + glm::vec3(0.0f, 0.0f, step.z)) - sample(point - glm::vec3(0.0f, 0.0f, step.z))
+    ) / (step * 2.0f);
+}
+
+ColliderSet::ColliderSet(const std::vector<Collider>& colliders, float cellSize) : colliders(colliders), cellSize(cellSize) {
+    // The box around each collider. Planes don't have one.
+    colliderMins.resize(colliders.size());
+    colliderMaxes.resize(colliders.size());
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    bool anyBounded = false;
+    for (unsigned int i = 0; i < colliders.size(); ++i) {
+        const Collider& collider = colliders[i];
+        glm::vec3& colliderMin = colliderMins[i];
+        glm::vec3& colliderMax = colliderMaxes[i];
+        switch (collider.shape) {
+        case Collider::Shape::PLANE:
+            unboundedColliders.push_back(i);
+            continue;
+        case Collider::Shape::SPHERE:
+            colliderMin = collider.position - glm::vec3(collider.radius);
+            colliderMax = collider.position + glm::vec3(collider.radius);
+            break;
+        case Collider::Shape::CAPSULE:
+            colliderMin = glm::min(collider.position, collider.endPosition) - glm::vec3(collider.radius);
+            colliderMax = glm::max(collider.position, collider.endPosition) + glm::vec3(collider.radius);
+            break;
+        case Collider::Shape::BOX:
+            colliderMin = collider.position - collider.halfExtents;
+            colliderMax = collider.position + collider.halfExtents;
+            break;
+        case Collider::Shape::SDF:
+            if (collider.volume == nullptr) {
+                // Nothing to hit, so it's never found.
+                colliderMin = glm::vec3(FLT_MAX);
+                colliderMax = glm::vec3(-FLT_MAX);
+                continue;
+            }
+            colliderMin = collider.position + collider.volume->boundsMin;
+            colliderMax = collider.position + collider.volume->boundsMax;
+            break;
+        }
+        boundsMin = glm::min(boundsMin, colliderMin);
+        boundsMax = glm::max(boundsMax, colliderMax);
+        anyBounded = true;
+    }
+
+    if (!anyBounded) {
+        return;
+    }
+
+    // The grid covers all of the (bounded) colliders. If that's a long way,
+    // the cells get bigger, so that the grid doesn't get too big.
+    gridMin = boundsMin;
+    glm::vec3 extent = boundsMax - boundsMin;
+    float longestSide = glm::max(extent.x, glm::max(extent.y, extent.z));
+    this->cellSize = glm::max(this->cellSize, longestSide / MAX_GRID_CELLS_PER_AXIS);
+    if (this->cellSize <= 0.0f) {
+        this->cellSize = 1.0f;
+    }
+    gridSize = glm::max(glm::ivec3(glm::ceil(extent / this->cellSize)), glm::ivec3(1));
+    unsigned int numCells = (unsigned int)(gridSize.x * gridSize.y * gridSize.z);
+
+    // Two passes over the colliders: the first counts how many colliders
+    // each cell has (so we know where each cell's run starts), and the
+    // second fills the runs in.
+    cellStarts.assign(numCells + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<unsigned int> cellFill;
+        if (pass == 1) {
+            for (unsigned int cell = 0; cell < numCells; ++cell) {
+                cellStarts[cell + 1] += cellStarts[cell];
+            }
+            cellColliders.resize(cellStarts[numCells]);
+            cellFill.assign(cellStarts.begin(), cellStarts.end() - 1);
+        }
+
+        for (unsigned int i = 0; i < colliders.size(); ++i) {
+            if (colliderMins[i].x > colliderMaxes[i].x || colliders[i].shape == Collider::Shape::PLANE) {
+                continue;
+            }
+            glm::ivec3 cellMin = getCellCoords(colliderMins[i]);
+            glm::ivec3 cellMax = getCellCoords(colliderMaxes[i]);
+            for (int z = cellMin.z; z <= cellMax.z; ++z) {
+                for (int y = cellMin.y; y <= cellMax.y; ++y) {
+                    for (int x = cellMin.x; x <= cellMax.x; ++x) {
+                        unsigned int cell = (unsigned int)(x + gridSize.x * (y + gridSize.y * z));
+                        if (pass == 0) {
+                            ++cellStarts[cell + 1];
+                        }
+                        else {
+                            cellColliders[cellFill[cell]++] = i;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+glm::ivec3 ColliderSet::getCellCoords(const glm::vec3& point) const {
+    glm::ivec3 coords = glm::ivec3(glm::floor((point - gridMin) / cellSize));
+    return glm::clamp(coords, glm::ivec3(0), gridSize - glm::ivec3(1));
+}
+
+void ColliderSet::findColliders(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<unsigned int>& found) const {
+    found.clear();
+    found.insert(found.end(), unboundedColliders.begin(), unboundedColliders.end());
+    if (cellStarts.empty()) {
+        return;
+    }
+
+    size_t numUnbounded = found.size();
+    glm::ivec3 cellMin = getCellCoords(boundsMin);
+    glm::ivec3 cellMax = getCellCoords(boundsMax);
+    glm::ivec3 numQueryCells = cellMax - cellMin + glm::ivec3(1);
+    if (numQueryCells.x * numQueryCells.y * numQueryCells.z > MAX_QUERY_CELLS) {
+        // A really spread out chunk, so going through the cells would
+        // find most of the colliders many times over.
+        for (unsigned int i = 0; i < colliders.size(); ++i) {
+            if (colliders[i].shape != Collider::Shape::PLANE) {
+                found.push_back(i);
+            }
+        }
+    }
+    else {
+        for (int z = cellMin.z; z <= cellMax.z; ++z) {
+            for (int y = cellMin.y; y <= cellMax.y; ++y) {
+                for (int x = cellMin.x; x <= cellMax.x; ++x) {
+                    unsigned int cell = (unsigned int)(x + gridSize.x * (y + gridSize.y * z));
+                    found.insert(found.end(), cellColliders.begin() + cellStarts[cell], cellColliders.begin() + cellStarts[cell + 1]);
+                }
+            }
+        }
+
+        // A collider that spans a few cells gets found in each of them.
+        std::sort(found.begin() + numUnbounded, found.end());
+        found.erase(std::unique(found.begin() + numUnbounded, found.end()), found.end());
+    }
+
+    // The cells are coarse, so check that the collider's
+    // box actually overlaps the particles' box too.
+    auto overlaps = [&](unsigned int i) {
+        return colliderMins[i].x <= boundsMax.x && colliderMaxes[i].x >= boundsMin.x
+            && colliderMins[i].y <= boundsMax.y && colliderMaxes[i].y >= boundsMin.y
+            && colliderMins[i].z <= boundsMax.z && colliderMaxes[i].z >= boundsMin.z;
+    };
+    found.erase(std::remove_if(found.begin() + numUnbounded, found.end(), [&](unsigned int i) { return !overlaps(i); }), found.end());
+}
+
+float ColliderSet::getDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal) {
+    switch (collider.shape) {
+    case Collider::Shape::PLANE:
+        return getPlaneDistance(collider, point, normal);
+    case Collider::Shape::SPHERE:
+        return getSphereDistance(collider, point, normal);
+    case Collider::Shape::CAPSULE:
+        return getCapsuleDistance(collider, point, normal);
+    case Collider::Shape::BOX:
+        return getBoxDistance(collider, point, normal);
+    case Collider::Shape::SDF:
+        if (collider.volume != nullptr) {
+            return getSDFDistance(collider, point, normal);
+        }
+        break;
+    }
+    normal = glm::vec3(0.0f, 1.0f, 0.0f);
+    return FLT_MAX;
+}
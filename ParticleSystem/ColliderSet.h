@@ -0,0 +1,229 @@
+#pragma once
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+// A 3D grid of distances to the nearest surface (a "signed distance
+// field"), negative inside of the surface and positive outside, for
+// colliding with shapes that aren't planes, spheres, capsules or boxes.
+// Between the grid points, the distance is blended (trilinearly).
+struct SDFVolume {
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(1.0f);
+	glm::ivec3 resolution = glm::ivec3(0); // the number of grid points along each axis
+	std::vector<float> distances; // x changes fastest, then y, then z
+
+	// Fills in the grid by calling distance() at every grid point.
+	void bake(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::ivec3& resolution, const std::function<float(const glm::vec3&)>& distance);
+
+	// Outside of the bounds, there's nothing to hit, so
+	// this is just the (positive) distance to the bounds.
+	float sample(const glm::vec3& point) const;
+
+	// Which way the distance goes up the fastest, which is the
+	// surface's normal (once normalized) at points near the surface.
+	glm::vec3 getGradient(const glm::vec3& point) const;
+};
+
+// Something that particles bounce off of.
+struct Collider {
+	enum class Shape : unsigned int {
+		PLANE,   // through position, facing normal; everything behind it is inside
+		SPHERE,  // radius around position
+		CAPSULE, // radius around the line from position to endPosition
+		BOX,     // halfExtents around position (lined up with the axes)
+		SDF      // volume, moved over by position
+	};
+
+	Shape shape = Shape::PLANE;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::vec3 endPosition = glm::vec3(0.0f, 1.0f, 0.0f);
+	float radius = 1.0f;
+	glm::vec3 halfExtents = glm::vec3(1.0f);
+	const SDFVolume* volume = nullptr; // not owned, so it has to outlive the ColliderSet
+
+	// How much of a particle's speed into the collider bounces back
+	// out (0 is none, 1 is all of it), and how much of its speed along
+	// the surface gets lost when it hits (0 is none, 1 is all of it).
+	float restitution = 0.5f;
+	float friction = 0.1f;
+};
+
+// All of the colliders that a ParticleSystem's particles bounce off of.
+//
+// Particles get collided a chunk at a time, and most colliders are
+// nowhere near most chunks. So the colliders go into a coarse grid (the
+// "broadphase"), and findColliders() only looks in the cells that a
+// chunk's bounding box overlaps. Planes go on forever, so they're always
+// found.
+//
+// collide() then goes through the chunk's particles for one collider at
+// a time. The shape is picked once per collider rather than once per
+// particle, so each shape gets its own tight loop, with the distance
+// function inlined into it.
+class ColliderSet {
+public:
+	ColliderSet(const std::vector<Collider>& colliders, float cellSize = 4.0f);
+
+	unsigned int getNumColliders() const { return (unsigned int)colliders.size(); }
+
+	// Finds the colliders that could touch anything in the box between
+	// boundsMin and boundsMax.
+	void findColliders(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<unsigned int>& found) const;
+
+	// Pushes any of the particles that are inside of the collider back
+	// out to its surface, and bounces them off of it. Particle can be any
+	// struct with a position (vec4) and velocity (vec3).
+	template <typename Particle>
+	void collide(unsigned int colliderIndex, Particle* const* particles, unsigned int numParticles) const;
+
+	// How far point is from a collider's surface (negative inside), and
+	// the direction straight out of the surface.
+	static float getDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal);
+
+private:
+	std::vector<Collider> colliders;
+	std::vector<unsigned int> unboundedColliders; // the planes
+	std::vector<glm::vec3> colliderMins;
+	std::vector<glm::vec3> colliderMaxes;
+
+	// The broadphase grid. Each cell's colliders are a run of
+	// cellColliders, from cellStarts[cell] to cellStarts[cell + 1].
+	glm::vec3 gridMin = glm::vec3(0.0f);
+	float cellSize = 1.0f;
+	glm::ivec3 gridSize = glm::ivec3(0);
+	std::vector<unsigned int> cellStarts;
+	std::vector<unsigned int> cellColliders;
+
+	// Clamped to the grid, so anything outside of it
+	// lands in the nearest cell along the edge.
+	glm::ivec3 getCellCoords(const glm::vec3& point) const;
+
+	// getDistance() for each shape. They're inline, so that each
+	// shape's loop in collide() gets its distance function inlined.
+	static float getPlaneDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal);
+	static float getSphereDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal);
+	static float getCapsuleDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal);
+	static float getBoxDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal);
+	static float getSDFDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal);
+
+	template <typename Particle, typename GetDistance>
+	static void collide(const Collider& collider, Particle* const* particles, unsigned int numParticles, GetDistance getDistance);
+};
+
+template <typename Particle, typename GetDistance>
+void ColliderSet::collide(const Collider& collider, Particle* const* particles, unsigned int numParticles, GetDistance getDistance) {
+	for (unsigned int i = 0; i < numParticles; ++i) {
+		Particle& particle = *particles[i];
+		glm::vec3 position(particle.position);
+		glm::vec3 normal;
+		float distance = getDistance(collider, position, normal);
+		if (distance >= 0.0f) {
+			continue;
+		}
+
+		// Back out to the surface...
+		position -= normal * distance;
+		particle.position.x = position.x;
+		particle.position.y = position.y;
+		particle.position.z = position.z;
+
+		// ...and if it's still heading in, bounce. The part of the velocity
+		// going into the surface gets turned around (and scaled down by the
+		// restitution), and the part along the surface gets slowed by the
+		// friction.
+		float normalSpeed = glm::dot(particle.velocity, normal);
+		if (normalSpeed < 0.0f) {
+			glm::vec3 normalVelocity = normal * normalSpeed;
+			glm::vec3 tangentVelocity = particle.velocity - normalVelocity;
+			particle.velocity = tangentVelocity * (1.0f - collider.friction) - normalVelocity * collider.restitution;
+		}
+	}
+}
+
+inline float ColliderSet::getPlaneDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal) {
+	normal = glm::normalize(collider.normal);
+	return glm::dot(point - collider.position, normal);
+}
+
+inline float ColliderSet::getSphereDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal) {
+	glm::vec3 offset = point - collider.position;
+	float distance = glm::length(offset);
+	normal = distance > 0.0f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+	return distance - collider.radius;
+}
+
+inline float ColliderSet::getCapsuleDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal) {
+	// The closest point on the line down the middle of the capsule,
+	// and then it's just like a sphere around that point.
+	glm::vec3 axis = collider.endPosition - collider.position;
+	float axisLengthSquared = glm::dot(axis, axis);
+	float t = axisLengthSquared > 0.0f ? glm::clamp(glm::dot(point - collider.position, axis) / axisLengthSquared, 0.0f, 1.0f) : 0.0f;
+	glm::vec3 offset = point - (collider.position + axis * t);
+	float distance = glm::length(offset);
+	normal = distance > 0.0f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+	return distance - collider.radius;
+}
+
+inline float ColliderSet::getBoxDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal) {
+	glm::vec3 offset = point - collider.position;
+	glm::vec3 sides = glm::vec3(offset.x < 0.0f ? -1.0f : 1.0f, offset.y < 0.0f ? -1.0f : 1.0f, offset.z < 0.0f ? -1.0f : 1.0f);
+
+	// How far outside of the box we are along each axis (negative means inside).
+	glm::vec3 outside = glm::abs(offset) - collider.halfExtents;
+	glm::vec3 outsideOnly = glm::max(outside, glm::vec3(0.0f));
+	float outsideDistance = glm::length(outsideOnly);
+	if (outsideDistance > 0.0f) {
+		normal = outsideOnly * sides / outsideDistance;
+		return outsideDistance;
+	}
+
+	// Inside, the way out is through the nearest side.
+	if (outside.x >= outside.y && outside.x >= outside.z) {
+		normal = glm::vec3(sides.x, 0.0f, 0.0f);
+		return outside.x;
+	}
+	if (outside.y >= outside.z) {
+		normal = glm::vec3(0.0f, sides.y, 0.0f);
+		return outside.y;
+	}
+	normal = glm::vec3(0.0f, 0.0f, sides.z);
+	return outside.z;
+}
+
+inline float ColliderSet::getSDFDistance(const Collider& collider, const glm::vec3& point, glm::vec3& normal) {
+	glm::vec3 volumePoint = point - collider.position;
+	float distance = collider.volume->sample(volumePoint);
+	if (distance < 0.0f) {
+		glm::vec3 gradient = collider.volume->getGradient(volumePoint);
+		float gradientLength = glm::length(gradient);
+		normal = gradientLength > 0.0f ? gradient / gradientLength : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+	return distance;
+}
+
+template <typename Particle>
+void ColliderSet::collide(unsigned int colliderIndex, Particle* const* particles, unsigned int numParticles) const {
+	const Collider& collider = colliders[colliderIndex];
+	switch (collider.shape) {
+	case Collider::Shape::PLANE:
+		collide(collider, particles, numParticles, getPlaneDistance);
+		break;
+	case Collider::Shape::SPHERE:
+		collide(collider, particles, numParticles, getSphereDistance);
+		break;
+	case Collider::Shape::CAPSULE:
+		collide(collider, particles, numParticles, getCapsuleDistance);
+		break;
+	case Collider::Shape::BOX:
+		collide(collider, particles, numParticles, getBoxDistance);
+		break;
+	case Collider::Shape::SDF:
+		if (collider.volume != nullptr) {
+			collide(collider, particles, numParticles, getSDFDistance);
+		}
+		break;
+	}
+}
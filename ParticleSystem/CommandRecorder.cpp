@@ -0,0 +1,173 @@
+#include "CommandRecorder.h"
+
+namespace gfx {
+
+	// Written at the start of every log, so that tools can tell
+	// what they're looking at (and which version of the format).
+	static const char LOG_MAGIC[4] = { 'P', 'S', 'C', 'L' };
+	static const uint8_t LOG_VERSION = 4; // 2: DRAW has the uniform buffer and its binding index, 3: DISPATCH and MEMORY_BARRIER, 4: DRAW has the indirect buffer, offset, and draw count
+
+	CommandRecorder::~CommandRecorder() {
+		closeLog();
+	}
+
+	bool CommandRecorder::openLog(const char* filename) {
+		closeLog();
+
+		log.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!log.is_open()) {
+			return false;
+		}
+
+		log.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+		log.put((char)LOG_VERSION);
+		return true;
+	}
+
+	void CommandRecorder::closeLog() {
+		if (log.is_open()) {
+			log.close();
+		}
+	}
+
+	void CommandRecorder::recordEndFrame() {
+		writeOpcode(END_FRAME);
+		writeVarint(total.numFrames);
+
+		count([](Stats& stats) { ++stats.numFrames; });
+		lastFrame = currentFrame;
+		currentFrame = Stats();
+	}
+
+	void CommandRecorder::recordClear(bool color, bool depth, bool stencil) {
+		writeOpcode(CLEAR);
+		writeVarint((color ? 1 : 0) | (depth ? 2 : 0) | (stencil ? 4 : 0));
+
+		count([](Stats& stats) { ++stats.numClears; });
+	}
+
+	void CommandRecorder::recordSetupCamera(int viewportWidth, int viewportHeight) {
+		writeOpcode(SETUP_CAMERA);
+		writeVarint(viewportWidth);
+		writeVarint(viewportHeight);
+
+		count([](Stats& stats) { ++stats.numCameraSetups; });
+	}
+
+	void CommandRecorder::recordDraw(const DrawCall& drawCall) {
+		writeOpcode(DRAW);
+		writeVarint((uint64_t)drawCall.mode);
+		writeVarint((uint64_t)drawCall.indexType);
+		writeVarint(drawCall.numIndices);
+		writeVarint(drawCall.programHandle);
+		writeVarint(drawCall.vaoHandle);
+		writeVarint(drawCall.storageBuffer);
+		writeVarint(drawCall.storageBufferBaseIndex);
+		writeVarint(drawCall.uniformBuffer);
+		writeVarint(drawCall.uniformBufferBaseIndex);
+		writeVarint(drawCall.indirectBuffer);
+		writeVarint(drawCall.indirectOffset);
+		writeVarint(drawCall.indirectDrawCount);
+
+		bool programChanged = drawCall.programHandle != boundProgram;
+		bool vaoChanged = drawCall.vaoHandle != boundVAO;
+		bool storageBufferChanged = drawCall.storageBuffer != boundStorageBuffer
+			|| drawCall.storageBufferBaseIndex != boundStorageBufferIndex;
+
+		// Like GLRenderer, a draw call without a uniform buffer
+		// leaves whatever was bound before in place.
+		bool uniformBufferChanged = drawCall.uniformBuffer != 0
+			&& (drawCall.uniformBuffer != boundUniformBuffer || drawCall.uniformBufferBaseIndex != boundUniformBufferIndex);
+
+		boundProgram = drawCall.programHandle;
+		boundVAO = drawCall.vaoHandle;
+		boundStorageBuffer = drawCall.storageBuffer;
+		boundStorageBufferIndex = drawCall.storageBufferBaseIndex;
+		if (uniformBufferChanged) {
+			boundUniformBuffer = drawCall.uniformBuffer;
+			boundUniformBufferIndex = drawCall.uniformBufferBaseIndex;
+		}
+
+		count([&](Stats& stats) {
+			++stats.numDrawCalls;
+			stats.numIndirectDraws += drawCall.indirectBuffer != 0 ? drawCall.indirectDrawCount : 0;
+			stats.numIndices += drawCall.numIndices;
+			stats.numProgramChanges += programChanged ? 1 : 0;
+			stats.numVAOChanges += vaoChanged ? 1 : 0;
+			stats.numStorageBufferChanges += storageBufferChanged ? 1 : 0;
+			stats.numUniformBufferChanges += uniformBufferChanged ? 1 : 0;
+		});
+	}
+
+	void CommandRecorder::recordStreamBuffer(ResourceManager::HBUFFER bufferHandle, unsigned int numBytes) {
+		writeOpcode(STREAM_BUFFER);
+		writeVarint(bufferHandle);
+		writeVarint(numBytes);
+
+		count([&](Stats& stats) {
+			++stats.numBufferStreams;
+			stats.bytesStreamed += numBytes;
+			stats.bytesStreamedPerBuffer[bufferHandle] += numBytes;
+		});
+	}
+
+	void CommandRecorder::recordDispatch(ResourceManager::HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ) {
+		writeOpcode(DISPATCH);
+		writeVarint(programHandle);
+		writeVarint(numGroupsX);
+		writeVarint(numGroupsY);
+		writeVarint(numGroupsZ);
+
+		// Dispatching uses the program, just like drawing does.
+		bool programChanged = programHandle != boundProgram;
+		boundProgram = programHandle;
+
+		count([&](Stats& stats) {
+			++stats.numDispatches;
+			stats.numGroupsDispatched += (unsigned long long)numGroupsX * numGroupsY * numGroupsZ;
+			stats.numProgramChanges += programChanged ? 1 : 0;
+		});
+	}
+
+	void CommandRecorder::recordMemoryBarrier(unsigned int barriers) {
+		writeOpcode(MEMORY_BARRIER);
+		writeVarint(barriers);
+
+		count([&](Stats& stats) {
+			++stats.numMemoryBarriers;
+		});
+	}
+
+	void CommandRecorder::recordCreate(Opcode opcode, unsigned int handle, unsigned int size) {
+		writeOpcode(opcode);
+		writeVarint(handle);
+		writeVarint(size);
+
+		count([](Stats& stats) { ++stats.numResourcesCreated; });
+	}
+
+	void CommandRecorder::recordDelete(Opcode opcode, unsigned int handle) {
+		writeOpcode(opcode);
+		writeVarint(handle);
+
+		count([](Stats& stats) { ++stats.numResourcesDeleted; });
+	}
+
+	void CommandRecorder::writeOpcode(Opcode opcode) {
+		if (log.is_open()) {
+			log.put((char)opcode);
+		}
+	}
+
+	void CommandRecorder::writeVarint(uint64_t value) {
+		if (!log.is_open()) {
+			return;
+		}
+
+		while (value >= 0x80) {
+			log.put((char)((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+		log.put((char)value);
+	}
+}
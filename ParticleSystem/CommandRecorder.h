@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+
+#include "DrawCall.h"
+#include "ResourceManager.h"
+
+namespace gfx {
+
+	// Keeps count of everything that the application asks the graphics
+	// system to do, without actually doing any of it. This is what the
+	// Null backend (NullDevice, NullResourceManager and NullRenderer)
+	// reports into.
+	//
+	// Optionally, every command can also be written to a compact binary
+	// log. Each command is a one-byte Opcode, followed by its arguments,
+	// which are all unsigned integers written as variable-length
+	// "varints" (7 bits per byte, low bits first, high bit set on every
+	// byte except the last), so small numbers like handles only take a
+	// byte or two.
+	class CommandRecorder {
+	public:
+
+		enum Opcode : uint8_t {
+			END_FRAME,       // frame number
+			CLEAR,           // color? depth? stencil? (as bits 0, 1, 2)
+			SETUP_CAMERA,    // viewport width, viewport height
+			DRAW,            // mode, index type, num indices, program, vao, storage buffer, binding index, uniform buffer, binding index, indirect buffer, offset, draw count
+			STREAM_BUFFER,   // buffer handle, num bytes
+			CREATE_BUFFER,   // buffer handle, num bytes
+			DELETE_BUFFER,   // buffer handle
+			CREATE_PROGRAM,  // program handle, num shaders
+			DELETE_PROGRAM,  // program handle
+			CREATE_VAO,      // vao handle, index buffer size in bytes
+			DELETE_VAO,      // vao handle
+			DISPATCH,        // program, num groups x, y, z
+			MEMORY_BARRIER   // barrier bits (ResourceManager::MemoryBarrierBits)
+		};
+
+		struct Stats {
+			unsigned int numFrames = 0;
+			unsigned int numClears = 0;
+			unsigned int numCameraSetups = 0;
+
+			unsigned int numDrawCalls = 0;
+			unsigned int numIndirectDraws = 0; // the counts of these aren't in numIndices, they're on the GPU
+			unsigned long long numIndices = 0;
+
+			// How many times the state had to change between draw calls,
+			// i.e. how many glUseProgram/glBindVertexArray/glBindBufferBase
+			// calls a real backend would have made.
+			unsigned int numProgramChanges = 0;
+			unsigned int numVAOChanges = 0;
+			unsigned int numStorageBufferChanges = 0;
+			unsigned int numUniformBufferChanges = 0;
+
+			unsigned int numDispatches = 0;
+			unsigned long long numGroupsDispatched = 0;
+			unsigned int numMemoryBarriers = 0;
+
+			unsigned int numBufferStreams = 0;
+			unsigned long long bytesStreamed = 0;
+			std::map<ResourceManager::HBUFFER, unsigned long long> bytesStreamedPerBuffer;
+
+			unsigned int numResourcesCreated = 0;
+			unsigned int numResourcesDeleted = 0;
+		};
+
+		~CommandRecorder();
+
+		// Starts writing commands to the given file (replacing it, if it
+		// already exists). Returns false if the file couldn't be opened.
+		bool openLog(const char* filename);
+		void closeLog();
+
+		// The totals for the frame that is being recorded right now,
+		// for the last complete frame, and since we started recording.
+		const Stats& getCurrentFrameStats() const { return currentFrame; }
+		const Stats& getLastFrameStats() const { return lastFrame; }
+		const Stats& getTotalStats() const { return total; }
+
+		void recordEndFrame();
+		void recordClear(bool color, bool depth, bool stencil);
+		void recordSetupCamera(int viewportWidth, int viewportHeight);
+		void recordDraw(const DrawCall& drawCall);
+		void recordStreamBuffer(ResourceManager::HBUFFER bufferHandle, unsigned int numBytes);
+		void recordDispatch(ResourceManager::HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ);
+		void recordMemoryBarrier(unsigned int barriers);
+		void recordCreate(Opcode opcode, unsigned int handle, unsigned int size);
+		void recordDelete(Opcode opcode, unsigned int handle);
+
+	private:
+		Stats currentFrame, lastFrame, total;
+
+		std::ofstream log;
+
+		// The state a real backend would have bound at the moment,
+		// so we can tell which draw calls would've changed it.
+		ResourceManager::HPROGRAM boundProgram = 0;
+		ResourceManager::HVAO boundVAO = 0;
+		ResourceManager::HBUFFER boundStorageBuffer = 0;
+		unsigned int boundStorageBufferIndex = 0;
+		ResourceManager::HBUFFER boundUniformBuffer = 0;
+		unsigned int boundUniformBufferIndex = 0;
+
+		void writeOpcode(Opcode opcode);
+		void writeVarint(uint64_t value);
+
+		// Applies a change to both the current frame and the totals.
+		template <typename Function>
+		void count(const Function& function) {
+			function(currentFrame);
+			function(total);
+		}
+	};
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// F16C (which every CPU with AVX2 has) turns 4 floats into half floats
+// (or back) in one instruction. Without it, SSE2 (which every x64 CPU
+// has) can still do 4 at a time, just in a few more instructions, and
+// anything else gets glm to do them one at a time.
+#if defined(__F16C__) || defined(__AVX2__)
+#define COMPACT_PARTICLE_F16C
+#endif
+#if defined(COMPACT_PARTICLE_F16C) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPACT_PARTICLE_SSE
+#include <immintrin.h>
+#endif
+#ifndef COMPACT_PARTICLE_F16C
+#include <glm/gtc/packing.hpp>
+#endif
+
+// Particles squeezed into 20 bytes each, rather than the 76 of a full
+// one, for ParticleSystem::Config::compactParticles. The update only
+// ever reads each particle once and writes it once, so the fewer bytes
+// there are, the quicker it goes.
+//
+// The position, velocity, lifetime and size are half floats, and the
+// position is from the middle of the particle's chunk (rather than the
+// middle of the world), so it stays accurate to about a thousandth of
+// how far away it is from that. The age is how much of its life it has
+// lived, in 65535ths. There's no color, since it comes from the
+// emitter's color curve (at the particle's age), and no previous
+// position, since it's just where the velocity says it was.
+//
+// They come in blocks of SIZE, with each value of every particle in the
+// block next to each other (so all of the x positions, then all of the
+// y positions, and so on), so that the compact update kernels (see
+// ParticleUpdateKernels) can load, convert and update a whole row of
+// them at once. Each particle is a "lane" of its block.
+//
+// Particle can be any struct with position, velocity, size, lifetime,
+// maxLife and emitterIndex, like ParticleSystem's.
+struct alignas(16) CompactParticleBlock {
+	enum Half {
+		POSITION_X, POSITION_Y, POSITION_Z,
+		VELOCITY_X, VELOCITY_Y, VELOCITY_Z,
+		MAX_LIFE,
+		SIZE_HALF,
+		NUM_HALVES
+	};
+
+	static const unsigned int SIZE = 8; // particles in a block
+	static const unsigned short DEAD = 0xFFFF; // the age of a dead particle
+	static const unsigned int MAX_EMITTERS = 0x10000; // so that every emitter index fits
+
+	unsigned short halves[NUM_HALVES][SIZE];
+	unsigned short ages[SIZE];
+	unsigned short emitterIndices[SIZE];
+
+	// A particle that's all zeros is dead too (it has no life to live).
+	bool isAlive(unsigned int lane) const { return ages[lane] != DEAD && halves[MAX_LIFE][lane] != 0; }
+
+	// t is the fraction of its life that the particle has lived.
+	float getAge(unsigned int lane) const { return ages[lane] * (1.0f / 65535.0f); }
+
+	// Which lanes have live particles in them (as bits).
+	unsigned int getLiveLanes() const {
+#ifdef COMPACT_PARTICLE_SSE
+		__m128i dead = _mm_or_si128(
+			_mm_cmpeq_epi16(_mm_load_si128((const __m128i*)ages), _mm_set1_epi16((short)DEAD)),
+			_mm_cmpeq_epi16(_mm_load_si128((const __m128i*)halves[MAX_LIFE]), _mm_setzero_si128()));
+		return ~_mm_movemask_epi8(_mm_packs_epi16(dead, dead)) & 0xFF;
+#else
+		unsigned int lanes = 0;
+		for (unsigned int lane = 0; lane < SIZE; ++lane) {
+			lanes |= isAlive(lane) ? 1 << lane : 0;
+		}
+		return lanes;
+#endif
+	}
+
+	// Which lanes belong to an emitter (whether they're alive or not).
+	unsigned int getLanesFromEmitter(unsigned int emitterIndex) const {
+#ifdef COMPACT_PARTICLE_SSE
+		__m128i same = _mm_cmpeq_epi16(_mm_load_si128((const __m128i*)emitterIndices), _mm_set1_epi16((short)emitterIndex));
+		return _mm_movemask_epi8(_mm_packs_epi16(same, same)) & 0xFF;
+#else
+		unsigned int lanes = 0;
+		for (unsigned int lane = 0; lane < SIZE; ++lane) {
+			lanes |= emitterIndices[lane] == emitterIndex ? 1 << lane : 0;
+		}
+		return lanes;
+#endif
+	}
+
+	template <typename Particle>
+	void unpack(unsigned int lane, Particle& particle, const glm::vec3& origin) const {
+		float values[NUM_HALVES];
+		for (unsigned int i = 0; i < NUM_HALVES; ++i) {
+			values[i] = toFloat(halves[i][lane]);
+		}
+		particle.position = glm::vec4(origin.x + values[POSITION_X], origin.y + values[POSITION_Y], origin.z + values[POSITION_Z], 1.0f);
+		particle.velocity = glm::vec3(values[VELOCITY_X], values[VELOCITY_Y], values[VELOCITY_Z]);
+		particle.maxLife = values[MAX_LIFE];
+		particle.size = values[SIZE_HALF];
+		particle.lifetime = ages[lane] != DEAD ? getAge(lane) * particle.maxLife : particle.maxLife;
+		particle.emitterIndex = emitterIndices[lane];
+	}
+
+	template <typename Particle>
+	void pack(unsigned int lane, const Particle& particle, const glm::vec3& origin) {
+		float values[NUM_HALVES] = {
+			particle.position.x - origin.x, particle.position.y - origin.y, particle.position.z - origin.z,
+			particle.velocity.x, particle.velocity.y, particle.velocity.z,
+			particle.maxLife,
+			particle.size
+		};
+		for (unsigned int i = 0; i < NUM_HALVES; ++i) {
+			halves[i][lane] = toHalf(values[i]);
+		}
+		ages[lane] = particle.lifetime < particle.maxLife ? toAge(particle.lifetime / particle.maxLife) : DEAD;
+		emitterIndices[lane] = (unsigned short)particle.emitterIndex;
+	}
+
+	// Rounded, and never quite DEAD.
+	static unsigned short toAge(float t) {
+		float scaledAge = t * 65535.0f + 0.5f;
+		return scaledAge <= 0.0f ? 0 : scaledAge < (float)(DEAD - 1) ? (unsigned short)scaledAge : (unsigned short)(DEAD - 1);
+	}
+
+	static float toFloat(unsigned short half) {
+#ifdef COMPACT_PARTICLE_F16C
+		return _cvtsh_ss(half);
+#else
+		return glm::unpackHalf1x16(half);
+#endif
+	}
+
+	static unsigned short toHalf(float value) {
+#ifdef COMPACT_PARTICLE_F16C
+		return (unsigned short)_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+		return glm::packHalf1x16(value);
+#endif
+	}
+
+#ifdef COMPACT_PARTICLE_SSE
+	// 4 lanes' worth of a row (all SIZE of the particles' values for one 
+	// Half) as floats.
+	static __m128 loadQuad(const unsigned short* row) {
+		__m128i packed = _mm_loadl_epi64((const __m128i*)row);
+#ifdef COMPACT_PARTICLE_F16C
+		return _mm_cvtph_ps(packed);
+#else
+		return toFloats(_mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+#endif
+	}
+
+	// And back again, in the bottom 64 bits, ready to be stored.
+	static __m128i packQuad(__m128 values) {
+#ifdef COMPACT_PARTICLE_F16C
+		return _mm_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+#else
+		__m128i converted = toHalves(values);
+		return _mm_packs_epi32(converted, converted);
+#endif
+	}
+
+#ifndef COMPACT_PARTICLE_F16C
+	// Half floats (in the bottom of each 32 bits) to floats. Shifting a
+	// half's exponent and mantissa up to where a float's are, and then
+	// multiplying by 2^112, makes up for the difference between their
+	// exponent biases (and gets tiny "denormal" halves right too). Only
+	// infinity and NaN need their exponents filling in by hand.
+	static __m128 toFloats(__m128i halves) {
+		__m128i exponentAndMantissa = _mm_and_si128(halves, _mm_set1_epi32(0x7FFF));
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(halves, exponentAndMantissa), 16);
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentAndMantissa, 13)), _mm_castsi128_ps(_mm_set1_epi32((127 + 112) << 23)));
+		__m128i isInfOrNaN = _mm_cmpgt_epi32(exponentAndMantissa, _mm_set1_epi32(0x7BFF));
+		__m128i infOrNaNExponent = _mm_and_si128(isInfOrNaN, _mm_set1_epi32(0xFF << 23));
+		return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infOrNaNExponent)));
+	}
+
+	// And back, the other way round: multiplying by 2^-112 moves the
+	// exponent down to a half's (and rounds whatever's too small to a
+	// denormal one), and anything too big for a half (including infinity,
+	// and NaN, since min() gives back its second argument for one) is
+	// clamped to just past its largest, so that it ends up as infinity.
+	// The bits that won't fit in a half's mantissa are rounded off first,
+	// by adding half of the last bit that will. The sign is shifted down
+	// with the sign extended, so that it packs into 16 bits as it is.
+	static __m128i toHalves(__m128 values) {
+		__m128 sign = _mm_and_ps(values, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+		__m128i magnitude = _mm_castps_si128(_mm_xor_ps(values, sign));
+		__m128 truncated = _mm_castsi128_ps(_mm_and_si128(magnitude, _mm_set1_epi32(~0xFFF)));
+		__m128 scaled = _mm_mul_ps(truncated, _mm_castsi128_ps(_mm_set1_epi32((127 - 112) << 23)));
+		scaled = _mm_min_ps(scaled, _mm_castsi128_ps(_mm_set1_epi32((31 << 23) - 0x1000)));
+		__m128i rounded = _mm_srli_epi32(_mm_add_epi32(_mm_castps_si128(scaled), _mm_set1_epi32(0x1000)), 13);
+		return _mm_or_si128(rounded, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+	}
+#endif
+#endif
+};
@@ -12,6 +12,8 @@ namespace gfx {
 	// or DX11Device.
 	class Device {
 	public:
+		virtual ~Device() {}
+
 		// Tells the underlying graphics API that 
 		// this is the device we're currently using.
 		virtual void makeCurrent()=0;
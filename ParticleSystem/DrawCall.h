@@ -21,17 +21,31 @@ namespace gfx {
 
 		enum class IndexType {
 			USHORT,
-			UINT
+			UINT,
+			NONE // no index buffer: vertices 0 to numIndices-1 are drawn in order
 		};
 
 		Mode mode;
 		IndexType indexType;
-		int numIndices;
+		int numIndices; // or the number of vertices, for IndexType::NONE
 		const void* indices;
 
 		ResourceManager::HPROGRAM programHandle;
 		ResourceManager::HVAO vaoHandle;
 		ResourceManager::HBUFFER storageBuffer;
 		unsigned int storageBufferBaseIndex;
+
+		// An optional uniform buffer with per-draw parameters 
+		// (0 means there isn't one).
+		ResourceManager::HBUFFER uniformBuffer = 0;
+		unsigned int uniformBufferBaseIndex = 0;
+
+		// An optional buffer of indirect draw commands (0 means there
+		// isn't one). When there is one, the counts come from the GPU
+		// instead of numIndices, and indirectDrawCount commands are drawn,
+		// starting indirectOffset bytes into the buffer.
+		ResourceManager::HBUFFER indirectBuffer = 0;
+		unsigned int indirectOffset = 0;
+		unsigned int indirectDrawCount = 1;
 	};
 }
\ No newline at end of file
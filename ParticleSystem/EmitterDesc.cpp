@@ -0,0 +1,476 @@
+#include "EmitterDesc.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// The binary format is this, then the number of emitters (a uint32),
+// then each emitter's fields, one after the other, in the order that
+// visitFields() visits them. Every field is 4 bytes (or a vector of
+// them), in the machine's byte order, apart from strings, which are their
+// length (a uint32) and then their characters. Only the keys that are
+// used are saved.
+static const char BINARY_MAGIC[4] = { 'P', 'S', 'E', 'M' };
+static const uint32_t MAX_STRING_LENGTH = 4096;
+static const uint32_t BINARY_VERSION = 7; // 2: features, 3: color and size keys, 4: paths, 5: meshes, 6: sub-emitters, 7: scripts
+
+// Calls visit() on every field of an EmitterDesc, so that reading
+// and writing the binary format can't get out of sync.
+template <typename Desc, typename Visitor>
+static void visitFields(Desc& desc, Visitor& visit) {
+    visit(desc.shape);
+    visit(desc.radius);
+    visit(desc.halfExtents);
+    visit(desc.meshFilename);
+    visit(desc.meshNormalSpeed);
+    visit(desc.meshColors);
+    visit(desc.motion);
+    visit(desc.worldPos);
+    visit(desc.velocity);
+    visit(desc.velocityJitter);
+    visit(desc.circleRadius);
+    visit(desc.numHops);
+    visit(desc.hopHeight);
+    visit(desc.horizontalSpeed);
+    visit(desc.pathType);
+    visit(desc.pathSpeed);
+    visit(desc.pathLoops);
+    visit(desc.particlesPerSecond);
+    visit(desc.particleMinLifetime);
+    visit(desc.particleMaxLifetime);
+    visit(desc.drag);
+    visit(desc.particleStartColor);
+    visit(desc.particleMidColor);
+    visit(desc.particleEndColor);
+    visit(desc.particleStartSize);
+    visit(desc.particleEndSize);
+    visit(desc.features);
+    visit(desc.updateScriptFilename);
+    visit(desc.spawnScriptFilename);
+
+    // The number of keys comes before the keys, so by the time 
+    // the reader gets to the loop, it knows how many there are.
+    visit(desc.numColorKeys);
+    for (unsigned int i = 0; i < desc.numColorKeys && i < EmitterDesc::MAX_CURVE_KEYS; ++i) {
+        visit(desc.colorKeys[i].time);
+        visit(desc.colorKeys[i].easing);
+        visit(desc.colorKeys[i].color);
+    }
+    visit(desc.numSizeKeys);
+    for (unsigned int i = 0; i < desc.numSizeKeys && i < EmitterDesc::MAX_CURVE_KEYS; ++i) {
+        visit(desc.sizeKeys[i].time);
+        visit(desc.sizeKeys[i].easing);
+        visit(desc.sizeKeys[i].size);
+    }
+    visit(desc.numPathPoints);
+    for (unsigned int i = 0; i < desc.numPathPoints && i < EmitterDesc::MAX_PATH_POINTS; ++i) {
+        visit(desc.pathPoints[i]);
+    }
+    visit(desc.numSubEmitters);
+    for (unsigned int i = 0; i < desc.numSubEmitters && i < EmitterDesc::MAX_SUB_EMITTERS; ++i) {
+        visit(desc.subEmitters[i].trigger);
+        visit(desc.subEmitters[i].interval);
+        visit(desc.subEmitters[i].emitterIndex);
+        visit(desc.subEmitters[i].count);
+        visit(desc.subEmitters[i].speed);
+        visit(desc.subEmitters[i].minLifetime);
+        visit(desc.subEmitters[i].maxLifetime);
+        visit(desc.subEmitters[i].inheritVelocity);
+    }
+}
+
+struct BinaryWriter {
+    std::ofstream& file;
+
+    void write(const void* data, size_t size) { file.write((const char*)data, size); }
+
+    void operator()(float value) { write(&value, sizeof(value)); }
+    void operator()(int value) { write(&value, sizeof(value)); }
+    void operator()(unsigned int value) { write(&value, sizeof(value)); }
+    void operator()(bool value) { uint32_t value32 = value ? 1 : 0; write(&value32, sizeof(value32)); }
+    void operator()(EmitterDesc::Shape value) { write(&value, sizeof(value)); }
+    void operator()(EmitterDesc::Motion value) { write(&value, sizeof(value)); }
+    void operator()(EmitterDesc::PathType value) { write(&value, sizeof(value)); }
+    void operator()(EmitterDesc::Easing value) { write(&value, sizeof(value)); }
+    void operator()(EmitterDesc::SubEmitterTrigger value) { write(&value, sizeof(value)); }
+    void operator()(const glm::vec3& value) { write(&value, sizeof(value)); }
+    void operator()(const glm::vec4& value) { write(&value, sizeof(value)); }
+
+    void operator()(const std::string& value) {
+        uint32_t length = (uint32_t)value.size();
+        write(&length, sizeof(length));
+        write(value.data(), length);
+    }
+};
+
+struct BinaryReader {
+    std::ifstream& file;
+
+    void read(void* data, size_t size) { file.read((char*)data, size); }
+
+    void operator()(float& value) { read(&value, sizeof(value)); }
+    void operator()(int& value) { read(&value, sizeof(value)); }
+    void operator()(unsigned int& value) { read(&value, sizeof(value)); }
+    void operator()(bool& value) { uint32_t value32 = 0; read(&value32, sizeof(value32)); value = value32 != 0; }
+    void operator()(EmitterDesc::Shape& value) { read(&value, sizeof(value)); }
+    void operator()(EmitterDesc::Motion& value) { read(&value, sizeof(value)); }
+    void operator()(EmitterDesc::PathType& value) { read(&value, sizeof(value)); }
+    void operator()(EmitterDesc::Easing& value) { read(&value, sizeof(value)); }
+    void operator()(EmitterDesc::SubEmitterTrigger& value) { read(&value, sizeof(value)); }
+    void operator()(glm::vec3& value) { read(&value, sizeof(value)); }
+    void operator()(glm::vec4& value) { read(&value, sizeof(value)); }
+
+    void operator()(std::string& value) {
+        uint32_t length = 0;
+        read(&length, sizeof(length));
+        // A bad length (from a broken file) shouldn't allocate gigabytes.
+        if (!file || length > MAX_STRING_LENGTH) {
+            file.setstate(std::ios::failbit);
+            return;
+        }
+        value.resize(length);
+        read(&value[0], length);
+    }
+};
+
+// Adds up how many bytes an EmitterDesc takes in the binary format.
+struct BinarySizer {
+    size_t size = 0;
+
+    template <typename T>
+    void operator()(const T& value) { size += sizeof(value); }
+    void operator()(bool) { size += sizeof(uint32_t); }
+    void operator()(const std::string& value) { size += sizeof(uint32_t) + value.size(); }
+};
+
+// Whether everything that the ParticleSystem uses as a number of 
+// something (or an index) is something that it can use, so that a 
+// broken file can't have it dividing by zero, or shifting by more 
+// bits than there are.
+static bool isValidEmitterDesc(const EmitterDesc& emitter) {
+    if (emitter.shape > EmitterDesc::Shape::MESH
+        || emitter.motion > EmitterDesc::Motion::PATH
+        || emitter.pathType > EmitterDesc::PathType::BEZIER
+        || emitter.numHops < 1) {
+        return false;
+    }
+    for (unsigned int i = 0; i < emitter.numColorKeys; ++i) {
+        if (emitter.colorKeys[i].easing > EmitterDesc::Easing::STEP) {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < emitter.numSizeKeys; ++i) {
+        if (emitter.sizeKeys[i].easing > EmitterDesc::Easing::STEP) {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < emitter.numSubEmitters; ++i) {
+        if (emitter.subEmitters[i].trigger > EmitterDesc::SubEmitterTrigger::INTERVAL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool loadBinaryEmitterDescs(std::ifstream& file, std::vector<EmitterDesc>& emitters) {
+    uint32_t version = 0;
+    uint32_t numEmitters = 0;
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&numEmitters, sizeof(numEmitters));
+    if (!file || version != BINARY_VERSION) {
+        return false;
+    }
+
+    // Every emitter takes at least as many bytes as one with no keys, 
+    // points, sub-emitters or filenames, so a bad count (from a broken 
+    // file) that there can't be room for shouldn't allocate gigabytes.
+    EmitterDesc smallest;
+    smallest.numColorKeys = 0;
+    smallest.numSizeKeys = 0;
+    smallest.numPathPoints = 0;
+    smallest.numSubEmitters = 0;
+    smallest.meshFilename.clear();
+    smallest.updateScriptFilename.clear();
+    smallest.spawnScriptFilename.clear();
+    BinarySizer sizer;
+    visitFields(smallest, sizer);
+    std::streampos start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff remaining = file.tellg() - start;
+    file.seekg(start);
+    if (!file || (uint64_t)numEmitters * sizer.size > (uint64_t)remaining) {
+        return false;
+    }
+
+    std::vector<EmitterDesc> loaded(numEmitters);
+    BinaryReader reader = { file };
+    for (EmitterDesc& emitter : loaded) {
+        visitFields(emitter, reader);
+        if (!file) {
+            return false;
+        }
+        if (emitter.numColorKeys > EmitterDesc::MAX_CURVE_KEYS) {
+            emitter.numColorKeys = EmitterDesc::MAX_CURVE_KEYS;
+        }
+        if (emitter.numSizeKeys > EmitterDesc::MAX_CURVE_KEYS) {
+            emitter.numSizeKeys = EmitterDesc::MAX_CURVE_KEYS;
+        }
+        if (emitter.numPathPoints > EmitterDesc::MAX_PATH_POINTS) {
+            emitter.numPathPoints = EmitterDesc::MAX_PATH_POINTS;
+        }
+        if (emitter.numSubEmitters > EmitterDesc::MAX_SUB_EMITTERS) {
+            emitter.numSubEmitters = EmitterDesc::MAX_SUB_EMITTERS;
+        }
+        if (!isValidEmitterDesc(emitter)) {
+            return false;
+        }
+    }
+
+    // If the file was cut short, we'd rather not load half of it.
+    if (!file) {
+        return false;
+    }
+
+    emitters.swap(loaded);
+    return true;
+}
+
+static glm::vec3 readVec3(std::istringstream& line) {
+    glm::vec3 value(0.0f);
+    line >> value.x >> value.y >> value.z;
+    return value;
+}
+
+static glm::vec4 readVec4(std::istringstream& line) {
+    glm::vec4 value(0.0f);
+    line >> value.x >> value.y >> value.z >> value.w;
+    return value;
+}
+
+// Reads an (optional) easing off of the end of a line.
+static EmitterDesc::Easing readEasing(std::istringstream& line) {
+    std::string easing;
+    line >> easing;
+    if (easing == "ease_in") {
+        return EmitterDesc::Easing::EASE_IN;
+    }
+    else if (easing == "ease_out") {
+        return EmitterDesc::Easing::EASE_OUT;
+    }
+    else if (easing == "smooth") {
+        return EmitterDesc::Easing::SMOOTH;
+    }
+    else if (easing == "step") {
+        return EmitterDesc::Easing::STEP;
+    }
+    return EmitterDesc::Easing::LINEAR;
+}
+
+static bool loadTextEmitterDescs(std::ifstream& file, std::vector<EmitterDesc>& emitters) {
+    std::vector<EmitterDesc> loaded;
+
+    std::string text;
+    while (std::getline(file, text)) {
+        // Throw away any comment
+        size_t commentStart = text.find('#');
+        if (commentStart != std::string::npos) {
+            text.resize(commentStart);
+        }
+
+        std::istringstream line(text);
+        std::string setting;
+        if (!(line >> setting)) {
+            continue; // blank line
+        }
+
+        if (setting == "emitter") {
+            loaded.push_back(EmitterDesc());
+            continue;
+        }
+
+        // Settings before the first "emitter" line don't belong to anything.
+        if (loaded.empty()) {
+            continue;
+        }
+        EmitterDesc& emitter = loaded.back();
+
+        if (setting == "shape") {
+            std::string shape;
+            line >> shape;
+            if (shape == "point") {
+                emitter.shape = EmitterDesc::Shape::POINT;
+            }
+            else if (shape == "sphere") {
+                emitter.shape = EmitterDesc::Shape::SPHERE;
+                line >> emitter.radius;
+            }
+            else if (shape == "box") {
+                emitter.shape = EmitterDesc::Shape::BOX;
+                emitter.halfExtents = readVec3(line);
+            }
+            else if (shape == "mesh") {
+                emitter.shape = EmitterDesc::Shape::MESH;
+                std::string colors;
+                line >> emitter.meshFilename >> emitter.meshNormalSpeed >> colors;
+                emitter.meshColors = colors == "colors";
+            }
+        }
+        else if (setting == "motion") {
+            std::string motion;
+            line >> motion;
+            if (motion == "static") {
+                emitter.motion = EmitterDesc::Motion::STATIC;
+            }
+            else if (motion == "hop") {
+                emitter.motion = EmitterDesc::Motion::HOP;
+                line >> emitter.circleRadius >> emitter.numHops >> emitter.hopHeight >> emitter.horizontalSpeed;
+                if (emitter.numHops < 1) {
+                    emitter.numHops = 1; // it has to hop somewhere
+                }
+            }
+            else if (motion == "path") {
+                emitter.motion = EmitterDesc::Motion::PATH;
+                std::string pathType;
+                std::string loops;
+                line >> pathType >> emitter.pathSpeed >> loops;
+                emitter.pathType = pathType == "bezier" ? EmitterDesc::PathType::BEZIER : EmitterDesc::PathType::CATMULL_ROM;
+                emitter.pathLoops = loops != "once";
+            }
+        }
+        else if (setting == "point") {
+            if (emitter.numPathPoints < EmitterDesc::MAX_PATH_POINTS) {
+                emitter.pathPoints[emitter.numPathPoints++] = readVec3(line);
+            }
+        }
+        else if (setting == "script") {
+            std::string when;
+            line >> when;
+            if (when == "update") {
+                line >> emitter.updateScriptFilename;
+            }
+            else if (when == "spawn") {
+                line >> emitter.spawnScriptFilename;
+            }
+        }
+        else if (setting == "sub") {
+            if (emitter.numSubEmitters < EmitterDesc::MAX_SUB_EMITTERS) {
+                EmitterDesc::SubEmitter subEmitter;
+                std::string trigger;
+                line >> trigger;
+                if (trigger == "collision") {
+                    subEmitter.trigger = EmitterDesc::SubEmitterTrigger::COLLISION;
+                }
+                else if (trigger == "interval") {
+                    subEmitter.trigger = EmitterDesc::SubEmitterTrigger::INTERVAL;
+                    line >> subEmitter.interval;
+                }
+                line >> subEmitter.emitterIndex >> subEmitter.count >> subEmitter.speed
+                    >> subEmitter.minLifetime >> subEmitter.maxLifetime >> subEmitter.inheritVelocity;
+                emitter.subEmitters[emitter.numSubEmitters++] = subEmitter;
+            }
+        }
+        else if (setting == "position") {
+            emitter.worldPos = readVec3(line);
+        }
+        else if (setting == "velocity") {
+            emitter.velocity = readVec3(line);
+            line >> emitter.velocityJitter;
+        }
+        else if (setting == "rate") {
+            line >> emitter.particlesPerSecond;
+        }
+        else if (setting == "lifetime") {
+            line >> emitter.particleMinLifetime >> emitter.particleMaxLifetime;
+        }
+        else if (setting == "drag") {
+            line >> emitter.drag;
+        }
+        else if (setting == "colors") {
+            emitter.particleStartColor = readVec4(line);
+            emitter.particleMidColor = readVec4(line);
+            emitter.particleEndColor = readVec4(line);
+        }
+        else if (setting == "sizes") {
+            line >> emitter.particleStartSize >> emitter.particleEndSize;
+        }
+        else if (setting == "color") {
+            if (emitter.numColorKeys < EmitterDesc::MAX_CURVE_KEYS) {
+                EmitterDesc::ColorKey& key = emitter.colorKeys[emitter.numColorKeys++];
+                line >> key.time;
+                key.color = readVec4(line);
+                key.easing = readEasing(line);
+            }
+        }
+        else if (setting == "size") {
+            if (emitter.numSizeKeys < EmitterDesc::MAX_CURVE_KEYS) {
+                EmitterDesc::SizeKey& key = emitter.sizeKeys[emitter.numSizeKeys++];
+                line >> key.time >> key.size;
+                key.easing = readEasing(line);
+            }
+        }
+        else if (setting == "features") {
+            emitter.features = 0;
+            std::string feature;
+            while (line >> feature) {
+                if (feature == "gravity") {
+                    emitter.features |= EmitterDesc::GRAVITY;
+                }
+                else if (feature == "drag") {
+                    emitter.features |= EmitterDesc::DRAG;
+                }
+                else if (feature == "floor") {
+                    emitter.features |= EmitterDesc::FLOOR_COLLISION;
+                }
+                else if (feature == "color") {
+                    emitter.features |= EmitterDesc::COLOR_CURVE;
+                }
+                else if (feature == "size") {
+                    emitter.features |= EmitterDesc::SIZE_CURVE;
+                }
+            }
+        }
+    }
+
+    emitters.swap(loaded);
+    return true;
+}
+
+bool loadEmitterDescs(const char* filename, std::vector<EmitterDesc>& emitters) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // The binary format starts with a magic number,
+    // which a text file is pretty unlikely to.
+    char magic[sizeof(BINARY_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    if (file && memcmp(magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0) {
+        return loadBinaryEmitterDescs(file, emitters);
+    }
+
+    file.clear();
+    file.seekg(0);
+    return loadTextEmitterDescs(file, emitters);
+}
+
+bool saveEmitterDescs(const char* filename, const std::vector<EmitterDesc>& emitters) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    uint32_t numEmitters = (uint32_t)emitters.size();
+    file.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    file.write((const char*)&BINARY_VERSION, sizeof(BINARY_VERSION));
+    file.write((const char*)&numEmitters, sizeof(numEmitters));
+
+    BinaryWriter writer = { file };
+    for (const EmitterDesc& emitter : emitters) {
+        visitFields(emitter, writer);
+    }
+
+    return (bool)file;
+}
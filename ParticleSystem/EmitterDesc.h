@@ -0,0 +1,216 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+class EmitterMesh;
+class ParticleScript;
+
+// Everything that makes one emitter different from another. A
+// ParticleSystem can have as many of these as we like, all sharing its
+// pool of particles (and its draw call), so a scene with hundreds of
+// small effects doesn't need hundreds of particle systems.
+//
+// The defaults are the emitter that hops around in a circle.
+struct EmitterDesc {
+	// Where around the emitter the particles start out.
+	enum class Shape : unsigned int {
+		POINT,
+		SPHERE, // within radius of the emitter
+		BOX,    // within halfExtents of the emitter
+		MESH    // on the surface of a triangle mesh (see EmitterMesh)
+	};
+
+	// How the emitter itself moves.
+	enum class Motion : unsigned int {
+		STATIC, // stays at worldPos, and emits with velocity
+		HOP,    // hops around a circle centered on worldPos
+		PATH    // follows pathPoints at pathSpeed (see EmitterPath)
+	};
+
+	// How a path gets from one of its points to the next.
+	enum class PathType : unsigned int {
+		CATMULL_ROM, // through every point
+		BEZIER       // through points 0, 3, 6 and so on, pulled towards the ones in between
+	};
+
+	// What happens to the particles as they move. Anything that's
+	// turned off costs nothing at all (see ParticleUpdateKernels).
+	enum Features : unsigned int {
+		GRAVITY = 1 << 0,
+		DRAG = 1 << 1,
+		FLOOR_COLLISION = 1 << 2, // bounce off of y = 0
+		COLOR_CURVE = 1 << 3,     // without it, particles keep their start color
+		SIZE_CURVE = 1 << 4,      // without it, particles keep their start size
+		ALL_FEATURES = (1 << 5) - 1
+	};
+
+	// How a curve gets from one key to the next.
+	enum class Easing : unsigned int {
+		LINEAR,
+		EASE_IN,  // starts slow
+		EASE_OUT, // ends slow
+		SMOOTH,   // both (smoothstep)
+		STEP      // jumps straight to the next key's value at the end
+	};
+
+	// What sets off a sub-emitter. COLLISION is the bounce off of 
+	// the floor (so it needs FLOOR_COLLISION), and INTERVAL is every 
+	// interval seconds for as long as the particle is alive.
+	enum class SubEmitterTrigger : unsigned int {
+		DEATH,
+		COLLISION,
+		INTERVAL
+	};
+
+	// A burst of child particles, from wherever a particle is when 
+	// trigger happens. The children are emitterIndex's particles, in 
+	// whichever ParticleSystem they get spawned into (see 
+	// ParticleSystem::Config::subEmitterTarget), so they can have 
+	// sub-emitters of their own.
+	struct SubEmitter {
+		SubEmitterTrigger trigger = SubEmitterTrigger::DEATH;
+		float interval = 0.5f; // only for INTERVAL
+		unsigned int emitterIndex = 0;
+		unsigned int count = 20; // children per burst
+		float speed = 3.0f; // how fast the children fly away from the parent
+		float minLifetime = 0.5f;
+		float maxLifetime = 1.0f;
+		float inheritVelocity = 0.0f; // how much of the parent's velocity the children keep
+	};
+
+	// A key in the color or size "over lifetime" curves. time is the
+	// fraction of the particle's life (0 to 1), and easing is for the
+	// stretch between this key and the next one.
+	struct ColorKey {
+		float time = 0.0f;
+		Easing easing = Easing::LINEAR;
+		glm::vec4 color = glm::vec4(1.0f);
+	};
+
+	struct SizeKey {
+		float time = 0.0f;
+		Easing easing = Easing::LINEAR;
+		float size = 0.1f;
+	};
+
+	static const unsigned int MAX_CURVE_KEYS = 8;
+	static const unsigned int MAX_PATH_POINTS = 16;
+	static const unsigned int MAX_SUB_EMITTERS = 4;
+
+	Shape shape = Shape::SPHERE;
+	float radius = 1.0f;
+	glm::vec3 halfExtents = glm::vec3(1.0f);
+
+	// Only for Shape::MESH. The mesh is moved over by the emitter's 
+	// position. If mesh is null, the ParticleSystem loads it from 
+	// meshFilename (an OBJ file) instead. With meshColors, particles 
+	// start out with the mesh's vertex colors (until a COLOR_CURVE 
+	// changes them), and meshNormalSpeed is how fast they start out 
+	// going away from the surface.
+	std::string meshFilename;
+	const EmitterMesh* mesh = nullptr; // not owned, so it has to outlive the ParticleSystem
+	float meshNormalSpeed = 0.0f;
+	bool meshColors = false;
+
+	Motion motion = Motion::HOP;
+	glm::vec3 worldPos = glm::vec3(0.0f, 0.0f, -10.0f);
+	glm::vec3 velocity = glm::vec3(0.0f);
+	float velocityJitter = 1.5f; // a random amount up to this much is added to each axis
+
+	// Only for Motion::HOP
+	float circleRadius = 20.0f;
+	int numHops = 8;
+	float hopHeight = 3.0f;
+	float horizontalSpeed = 25.0f;
+
+	// Only for Motion::PATH. The points are relative to worldPos. A path 
+	// that loops goes back to the start when it gets to the end (a 
+	// Catmull-Rom one joins its last point back up to its first), and 
+	// one that doesn't stops there.
+	PathType pathType = PathType::CATMULL_ROM;
+	float pathSpeed = 10.0f;
+	bool pathLoops = true;
+	unsigned int numPathPoints = 0;
+	glm::vec3 pathPoints[MAX_PATH_POINTS];
+
+	float particlesPerSecond = 30000.0f;
+	float particleMinLifetime = 2.7f;
+	float particleMaxLifetime = 3.0f;
+	float drag = 0.9f;
+
+	// These are the color and size curves when there aren't any keys:
+	// start, mid and end colors at 0, 0.5 and 1, and start and end sizes
+	// at 0 and 1. Either way, the curves get baked into lookup tables
+	// (see LifetimeCurves.h), so more keys don't cost anything per particle.
+	glm::vec4 particleStartColor = glm::vec4(1.0f, 1.0f, 0.1f, 1.0f);
+	glm::vec4 particleMidColor = glm::vec4(1.0f, 0.1f, 0.1f, 1.0f);
+	glm::vec4 particleEndColor = glm::vec4(0.2f, 0.1f, 0.2f, 1.0f);
+
+	float particleStartSize = 0.1f;
+	float particleEndSize = 0.1f;
+
+	unsigned int numColorKeys = 0;
+	ColorKey colorKeys[MAX_CURVE_KEYS];
+	unsigned int numSizeKeys = 0;
+	SizeKey sizeKeys[MAX_CURVE_KEYS];
+
+	unsigned int features = ALL_FEATURES;
+
+	// Scripts (see ParticleScript) for anything the features can't do. 
+	// The update script runs on every particle after its kernel, every 
+	// update, and the spawn script runs on each particle once, when it's 
+	// emitted. If a script is null, the ParticleSystem compiles it from 
+	// its file instead (if there is one). Not used with SimulationMode::GPU.
+	std::string updateScriptFilename;
+	std::string spawnScriptFilename;
+	const ParticleScript* updateScript = nullptr; // not owned, so it has to outlive the ParticleSystem
+	const ParticleScript* spawnScript = nullptr; // same
+
+	unsigned int numSubEmitters = 0;
+	SubEmitter subEmitters[MAX_SUB_EMITTERS];
+};
+
+// Loads a list of emitters from a file, which is either text or binary
+// (see saveEmitterDescs()). Returns false if the file couldn't be read,
+// in which case emitters is left as it was.
+//
+// The text format is one setting per line, with a line that just says
+// "emitter" before each emitter. Anything that isn't set keeps its
+// default, and anything after a # is ignored. For example:
+//
+//   emitter
+//     shape sphere 0.5
+//     motion static
+//     position 0 0 -10
+//     velocity 0 5 0 1.5      # x y z jitter
+//     rate 2000
+//     lifetime 1 2
+//     drag 0.5
+//     colors 1 1 0.1 1  1 0.1 0.1 1  0.2 0.1 0.2 1
+//     sizes 0.1 0.05
+//     features gravity drag color   # just these ones, or "none"
+//     color 0 1 1 1 1                # a color key: time r g b a [easing]
+//     color 0.2 1 0.5 0 1 smooth
+//     color 1 0 0 0 0
+//     size 0 0.05 ease_out           # a size key: time size [easing]
+//     size 1 0.2
+//
+// The other settings are "shape box x y z", "shape point",
+// "shape mesh filename.obj [normalSpeed] [colors]",
+// "motion hop circleRadius numHops hopHeight horizontalSpeed", and
+// "motion path catmull_rom|bezier speed [loop|once]", followed by
+// "point x y z" for each point of the path (up to MAX_PATH_POINTS),
+// "script update|spawn filename",
+// "sub death|collision|interval [seconds] emitter count speed
+// minLifetime maxLifetime [inheritVelocity]" for each sub-emitter (up
+// to MAX_SUB_EMITTERS), where seconds is only there for interval. The
+// features are gravity, drag, floor, color and size, and the easings
+// are linear (the default), ease_in, ease_out, smooth and step. Keys
+// go in order of time, up to MAX_CURVE_KEYS of each.
+bool loadEmitterDescs(const char* filename, std::vector<EmitterDesc>& emitters);
+
+// Saves a list of emitters in the binary format, which is a lot more
+// compact than the text one (and much quicker to load).
+bool saveEmitterDescs(const char* filename, const std::vector<EmitterDesc>& emitters);
@@ -0,0 +1,227 @@
+#include "EmitterMesh.h"
+#include "Utils.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+EmitterMesh::EmitterMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const std::vector<glm::vec4>* colors) {
+    bool withColors = colors != nullptr && colors->size() >= positions.size();
+    size_t numTriangles = indices.size() / 3;
+    triangles.reserve(numTriangles);
+    if (withColors) {
+        triangleColors.reserve(numTriangles * 3);
+    }
+
+    std::vector<float> areas;
+    areas.reserve(numTriangles);
+    for (size_t i = 0; i < numTriangles; ++i) {
+        unsigned int i0 = indices[i * 3];
+        unsigned int i1 = indices[i * 3 + 1];
+        unsigned int i2 = indices[i * 3 + 2];
+        if (i0 >= positions.size() || i1 >= positions.size() || i2 >= positions.size()) {
+            continue;
+        }
+
+        Triangle triangle;
+        triangle.corner = positions[i0];
+        triangle.edge1 = positions[i1] - positions[i0];
+        triangle.edge2 = positions[i2] - positions[i0];
+
+        // The cross product of the edges is as long as twice the area.
+        glm::vec3 cross = glm::cross(triangle.edge1, triangle.edge2);
+        float doubleArea = glm::length(cross);
+        if (doubleArea <= 0.0f) {
+            continue; // it can't ever get picked anyway
+        }
+        triangle.normal = cross / doubleArea;
+        triangles.push_back(triangle);
+        areas.push_back(doubleArea * 0.5f);
+
+        if (withColors) {
+            triangleColors.push_back((*colors)[i0]);
+            triangleColors.push_back((*colors)[i1]);
+            triangleColors.push_back((*colors)[i2]);
+        }
+    }
+
+    buildAliasTable(areas);
+}
+
+void EmitterMesh::buildAliasTable(const std::vector<float>& areas) {
+    unsigned int n = (unsigned int)areas.size();
+    surfaceArea = 0.0f;
+    for (float area : areas) {
+        surfaceArea += area;
+    }
+    aliasTable.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    // Scale the areas so that they average 1. Then every slot that's under
+    // 1 (small) gets topped up to 1 by a slot that's over 1 (large), which
+    // becomes its alias. Whatever's left of the large slot goes back on one
+    // of the lists, depending on whether it's still over 1.
+    std::vector<float> scaled(n);
+    std::vector<unsigned int> small;
+    std::vector<unsigned int> large;
+    for (unsigned int i = 0; i < n; ++i) {
+        scaled[i] = areas[i] * n / surfaceArea;
+        if (scaled[i] < 1.0f) {
+            small.push_back(i);
+        }
+        else {
+            large.push_back(i);
+        }
+    }
+
+    while (!small.empty() && !large.empty()) {
+        unsigned int smallSlot = small.back();
+        small.pop_back();
+        unsigned int largeSlot = large.back();
+        large.pop_back();
+
+        aliasTable[smallSlot].threshold = scaled[smallSlot];
+        aliasTable[smallSlot].alias = largeSlot;
+
+        scaled[largeSlot] = (scaled[largeSlot] + scaled[smallSlot]) - 1.0f;
+        if (scaled[largeSlot] < 1.0f) {
+            small.push_back(largeSlot);
+        }
+        else {
+            large.push_back(largeSlot);
+        }
+    }
+
+    // Whatever's left is (give or take some rounding) exactly 1,
+    // so it always picks its own triangle.
+    for (unsigned int slot : small) {
+        aliasTable[slot].threshold = 1.0f;
+        aliasTable[slot].alias = slot;
+    }
+    for (unsigned int slot : large) {
+        aliasTable[slot].threshold = 1.0f;
+        aliasTable[slot].alias = slot;
+    }
+}
+
+void EmitterMesh::sampleSurface(unsigned int numPoints, unsigned int& randomState, SurfacePoint* points) const {
+    unsigned int n = (unsigned int)triangles.size();
+    if (n == 0) {
+        for (unsigned int i = 0; i < numPoints; ++i) {
+            points[i].position = glm::vec3(0.0f);
+            points[i].normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            points[i].color = glm::vec4(1.0f);
+        }
+        return;
+    }
+
+    // xorshift never gives 0 (and gets stuck there if it starts there).
+    unsigned int state = randomState != 0 ? randomState : 0x9e3779b9u;
+    bool withColors = hasColors();
+    for (unsigned int i = 0; i < numPoints; ++i) {
+        // Pick a slot, and then the slot's triangle or its alias.
+        unsigned int slot = (unsigned int)(((uint64_t)nextRandom(state) * n) >> 32);
+        const AliasSlot& aliasSlot = aliasTable[slot];
+        unsigned int triangleIndex = nextRandomFloat(state) < aliasSlot.threshold ? slot : aliasSlot.alias;
+        const Triangle& triangle = triangles[triangleIndex];
+
+        // Two random numbers pick a point in the parallelogram made by the
+        // edges. If it's in the half that isn't the triangle, folding it
+        // back over puts it in the triangle.
+        float u = nextRandomFloat(state);
+        float v = nextRandomFloat(state);
+        if (u + v > 1.0f) {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+
+        SurfacePoint& point = points[i];
+        point.position = triangle.corner + triangle.edge1 * u + triangle.edge2 * v;
+        point.normal = triangle.normal;
+        if (withColors) {
+            const glm::vec4* colors = &triangleColors[triangleIndex * 3];
+            point.color = colors[0] * (1.0f - u - v) + colors[1] * u + colors[2] * v;
+        }
+        else {
+            point.color = glm::vec4(1.0f);
+        }
+    }
+    randomState = state;
+}
+
+// An OBJ index is either counted from 1, or (if it's negative)
+// back from the last vertex so far. Turns it into a normal index.
+static bool parseOBJIndex(const std::string& corner, size_t numPositions, unsigned int& index) {
+    // Just the position's index, which is before any slash.
+    long value = strtol(corner.c_str(), nullptr, 10);
+    if (value > 0) {
+        index = (unsigned int)(value - 1);
+    }
+    else if (value < 0) {
+        index = (unsigned int)((long)numPositions + value);
+    }
+    else {
+        return false;
+    }
+    return index < numPositions;
+}
+
+EmitterMesh* EmitterMesh::loadOBJ(const char* filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec4> colors;
+    std::vector<unsigned int> indices;
+    bool withColors = true; // unless a vertex doesn't have one
+
+    std::string text;
+    std::vector<unsigned int> face;
+    while (std::getline(file, text)) {
+        std::istringstream line(text);
+        std::string type;
+        if (!(line >> type)) {
+            continue;
+        }
+
+        if (type == "v") {
+            glm::vec3 position(0.0f);
+            line >> position.x >> position.y >> position.z;
+            positions.push_back(position);
+
+            glm::vec4 color(1.0f);
+            if (line >> color.r >> color.g >> color.b) {
+                colors.push_back(color);
+            }
+            else {
+                colors.push_back(glm::vec4(1.0f));
+                withColors = false;
+            }
+        }
+        else if (type == "f") {
+            face.clear();
+            std::string corner;
+            while (line >> corner) {
+                unsigned int index;
+                if (parseOBJIndex(corner, positions.size(), index)) {
+                    face.push_back(index);
+                }
+            }
+
+            // A fan of triangles, all from the first corner.
+            for (size_t i = 2; i < face.size(); ++i) {
+                indices.push_back(face[0]);
+                indices.push_back(face[i - 1]);
+                indices.push_back(face[i]);
+            }
+        }
+    }
+
+    return new EmitterMesh(positions, indices, withColors && !colors.empty() ? &colors : nullptr);
+}
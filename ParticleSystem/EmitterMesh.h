@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// A triangle mesh that an emitter with EmitterDesc::Shape::MESH emits
+// from, anywhere on its surface.
+//
+// For the particles to be spread out evenly, a triangle that's twice as
+// big has to be picked twice as often. That's done with an "alias table"
+// (Walker's alias method, as set up by Vose), which is built once, when
+// the mesh is loaded. The table has a slot for every triangle, and each
+// slot has a threshold and a second ("alias") triangle. To pick a
+// triangle, pick a slot (evenly), and then pick either the slot's own
+// triangle or its alias, depending on whether a second random number is
+// under the threshold. That's the same amount of work for 10 triangles as
+// for 100,000.
+//
+// Then a random point on the triangle is just two more random numbers,
+// without any trig (or square roots) at all.
+//
+// Only the CPU simulation emits from meshes. With SimulationMode::GPU,
+// mesh emitters emit from the emitter's position, like Shape::POINT.
+class EmitterMesh {
+public:
+	// Somewhere on the surface of the mesh.
+	struct SurfacePoint {
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec4 color; // blended from the vertex colors, or white if there aren't any
+	};
+
+	// Three indices for each triangle. colors can be null, or have a
+	// color for each position.
+	EmitterMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const std::vector<glm::vec4>* colors = nullptr);
+
+	// Loads the triangles out of a Wavefront OBJ file. Faces with more than
+	// 3 corners are split into triangles, and vertices can have colors
+	// ("v x y z r g b"). Everything else (normals, texture coordinates,
+	// materials) is ignored. Returns null if the file couldn't be read.
+	static EmitterMesh* loadOBJ(const char* filename);
+
+	unsigned int getNumTriangles() const { return (unsigned int)triangles.size(); }
+	bool hasColors() const { return !triangleColors.empty(); }
+	float getSurfaceArea() const { return surfaceArea; }
+
+	// Picks numPoints random points on the surface, all at once.
+	// randomState is any number, and gets moved along.
+	void sampleSurface(unsigned int numPoints, unsigned int& randomState, SurfacePoint* points) const;
+
+private:
+	// Everything that picking a point on a triangle needs, together.
+	struct Triangle {
+		glm::vec3 corner;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+		glm::vec3 normal;
+	};
+
+	struct AliasSlot {
+		float threshold; // under this, it's the slot's own triangle, and otherwise it's the alias
+		unsigned int alias;
+	};
+
+	std::vector<Triangle> triangles;
+	std::vector<glm::vec4> triangleColors; // 3 for each triangle, if there are any
+	std::vector<AliasSlot> aliasTable;
+	float surfaceArea = 0.0f;
+
+	void buildAliasTable(const std::vector<float>& areas);
+};
@@ -0,0 +1,126 @@
+#include "EmitterPath.h"
+
+#include <cmath>
+
+#define SAMPLES_PER_SEGMENT 256 // how finely each segment gets measured
+#define TABLE_ENTRIES_PER_SEGMENT 128 // enough to keep the speed within a couple of percent
+
+EmitterPath::EmitterPath(const EmitterDesc& emitter) : loops(emitter.pathLoops) {
+    const glm::vec3* points = emitter.pathPoints;
+    int numPoints = (int)(emitter.numPathPoints < EmitterDesc::MAX_PATH_POINTS ? emitter.numPathPoints : EmitterDesc::MAX_PATH_POINTS);
+
+    if (emitter.pathType == EmitterDesc::PathType::BEZIER) {
+        // Every segment shares its first point with the last one's last point.
+        for (int i = 0; i + 3 < numPoints; i += 3) {
+            addSegment(points[i], points[i + 1], points[i + 2], points[i + 3]);
+        }
+    }
+    else if (numPoints >= 2) {
+        // A Catmull-Rom segment goes from point i to point i + 1, heading
+        // the way from point i - 1 to point i + 1 at the start, and from
+        // point i to point i + 2 at the end. At the ends of a path that
+        // doesn't loop, there's no point before (or after), so the end
+        // point stands in for it.
+        int numSegments = loops ? numPoints : numPoints - 1;
+        auto getPoint = [&](int i) {
+            if (loops) {
+                return points[(i + numPoints) % numPoints];
+            }
+            return points[glm::clamp(i, 0, numPoints - 1)];
+        };
+        for (int i = 0; i < numSegments; ++i) {
+            glm::vec3 p0 = getPoint(i - 1);
+            glm::vec3 p1 = getPoint(i);
+            glm::vec3 p2 = getPoint(i + 1);
+            glm::vec3 p3 = getPoint(i + 2);
+            addSegment(p1, p1 + (p2 - p0) / 6.0f, p2 - (p3 - p1) / 6.0f, p2);
+        }
+    }
+
+    if (!isEmpty()) {
+        buildTable();
+    }
+}
+
+void EmitterPath::addSegment(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3) {
+    segmentPoints.push_back(p0);
+    segmentPoints.push_back(p1);
+    segmentPoints.push_back(p2);
+    segmentPoints.push_back(p3);
+}
+
+void EmitterPath::evaluateSegment(float parameter, glm::vec3& position, glm::vec3& tangent) const {
+    unsigned int numSegments = (unsigned int)segmentPoints.size() / 4;
+    unsigned int segment = glm::min((unsigned int)glm::max(parameter, 0.0f), numSegments - 1);
+    float t = glm::clamp(parameter - (float)segment, 0.0f, 1.0f);
+    float s = 1.0f - t;
+
+    const glm::vec3* p = &segmentPoints[segment * 4];
+    position = p[0] * (s * s * s) + p[1] * (3.0f * s * s * t) + p[2] * (3.0f * s * t * t) + p[3] * (t * t * t);
+    tangent = (p[1] - p[0]) * (3.0f * s * s) + (p[2] - p[1]) * (6.0f * s * t) + (p[3] - p[2]) * (3.0f * t * t);
+}
+
+void EmitterPath::buildTable() {
+    // First, measure the path, by adding up lots of short straight lines
+    // along it. lengths[i] is how far it is to the i-th one of them.
+    unsigned int numSegments = (unsigned int)segmentPoints.size() / 4;
+    unsigned int numSamples = numSegments * SAMPLES_PER_SEGMENT;
+    std::vector<float> lengths(numSamples + 1, 0.0f);
+    glm::vec3 lastPosition;
+    glm::vec3 tangent;
+    evaluateSegment(0.0f, lastPosition, tangent);
+    for (unsigned int i = 1; i <= numSamples; ++i) {
+        glm::vec3 position;
+        evaluateSegment((float)i / SAMPLES_PER_SEGMENT, position, tangent);
+        lengths[i] = lengths[i - 1] + glm::length(position - lastPosition);
+        lastPosition = position;
+    }
+    length = lengths[numSamples];
+
+    // Then, for every entry in the table, find the two samples on either
+    // side of its distance, and blend their parameters. The distances only
+    // ever go up, so the search carries on from wherever the last one
+    // stopped.
+    unsigned int numEntries = numSegments * TABLE_ENTRIES_PER_SEGMENT + 1;
+    tableParameters.resize(numEntries);
+    tableSpacing = length / (numEntries - 1);
+    unsigned int sample = 0;
+    for (unsigned int i = 0; i < numEntries; ++i) {
+        float distance = tableSpacing * i;
+        while (sample + 1 < numSamples && lengths[sample + 1] < distance) {
+            ++sample;
+        }
+        float sampleLength = lengths[sample + 1] - lengths[sample];
+        float t = sampleLength > 0.0f ? glm::clamp((distance - lengths[sample]) / sampleLength, 0.0f, 1.0f) : 0.0f;
+        tableParameters[i] = (sample + t) / SAMPLES_PER_SEGMENT;
+    }
+}
+
+void EmitterPath::evaluate(double distance, glm::vec3& position, glm::vec3& direction) const {
+    if (isEmpty()) {
+        position = glm::vec3(0.0f);
+        direction = glm::vec3(0.0f);
+        return;
+    }
+
+    if (loops && length > 0.0f) {
+        distance = std::fmod(distance, (double)length);
+        if (distance < 0.0) {
+            distance += length;
+        }
+    }
+    else {
+        distance = glm::clamp(distance, 0.0, (double)length);
+    }
+
+    float entry = tableSpacing > 0.0f ? (float)distance / tableSpacing : 0.0f;
+    unsigned int lastEntry = (unsigned int)tableParameters.size() - 1;
+    unsigned int entryIndex = glm::min((unsigned int)entry, lastEntry - 1);
+    float t = entry - (float)entryIndex;
+    float parameter = tableParameters[entryIndex] + (tableParameters[entryIndex + 1] - tableParameters[entryIndex]) * t;
+
+    glm::vec3 tangent;
+    evaluateSegment(parameter, position, tangent);
+    float tangentLength = glm::length(tangent);
+    direction = tangentLength > 0.0f ? tangent / tangentLength : glm::vec3(0.0f);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "EmitterDesc.h"
+
+// The path that an emitter with EmitterDesc::Motion::PATH follows.
+//
+// A spline's parameter doesn't go up at a steady rate as you go along it:
+// it speeds up where the points are far apart and slows down where they're
+// close together. To move at a steady speed, we need to know what the
+// parameter is at a given distance along the path, and there isn't a
+// formula for that. So it's worked out once, when the path is built, and
+// kept in a table of the parameter at evenly spaced distances. Finding
+// where the emitter is is then one look up in the table (blending the two
+// nearest entries), and one evaluation of the spline.
+//
+// Both kinds of path are stored as cubic Bezier segments (a Catmull-Rom
+// segment is just a Bezier segment with different control points), so
+// there's only one kind of spline to evaluate.
+class EmitterPath {
+public:
+	// A path that doesn't go anywhere.
+	EmitterPath() {}
+
+	// The path for emitter, with its points relative to worldPos. Catmull-Rom
+	// paths need at least 2 points, and Bezier paths at least 4 (and then 3
+	// more for each segment after the first). With fewer, the path is empty.
+	EmitterPath(const EmitterDesc& emitter);
+
+	bool isEmpty() const { return segmentPoints.empty(); }
+	float getLength() const { return length; }
+
+	// Where the emitter is once it has gone distance along the path (which
+	// wraps around for paths that loop, and stops at the end for ones that
+	// don't), and which way it's heading.
+	void evaluate(double distance, glm::vec3& position, glm::vec3& direction) const;
+
+private:
+	bool loops = false;
+	float length = 0.0f;
+
+	// 4 for each segment.
+	std::vector<glm::vec3> segmentPoints;
+
+	// The parameter (the segment number, plus how far along it we are)
+	// every tableSpacing along the path.
+	std::vector<float> tableParameters;
+	float tableSpacing = 1.0f;
+
+	void addSegment(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3);
+	void evaluateSegment(float parameter, glm::vec3& position, glm::vec3& tangent) const;
+	void buildTable();
+};
@@ -0,0 +1,29 @@
+#include "FixedTimestep.h"
+
+FixedTimestep::FixedTimestep(const Config& config)
+	: stepSize(1.0 / config.stepsPerSecond), maxStepsPerFrame(config.maxStepsPerFrame) {
+}
+
+unsigned int FixedTimestep::advance(double frameDeltaT) {
+	accumulator += frameDeltaT;
+
+	unsigned int numSteps = (unsigned int)(accumulator / stepSize);
+	if (numSteps > maxStepsPerFrame) {
+		double extraTime = (numSteps - maxStepsPerFrame) * stepSize;
+		droppedTime += extraTime;
+		accumulator -= extraTime;
+		numSteps = maxStepsPerFrame;
+	}
+
+	accumulator -= numSteps * stepSize;
+
+	// Floating point rounding could leave us a hair outside of [0, stepSize).
+	if (accumulator < 0.0) {
+		accumulator = 0.0;
+	}
+	else if (accumulator >= stepSize) {
+		accumulator = stepSize * 0.999999;
+	}
+
+	return numSteps;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Turns the frame times we get from the Timer (which can be anything, 
+// including huge, if the app hitches) into a whole number of equally 
+// sized simulation steps.
+//
+// Each frame, the frame time is added to an "accumulator", and we take 
+// as many whole steps out of it as will fit. Whatever is left over 
+// carries on to the next frame. Since the leftover time hasn't been 
+// simulated yet, what we draw is a blend between the last two simulated 
+// states, which is what getInterpolationAlpha() is for.
+//
+// If a frame takes so long that we'd need more than maxStepsPerFrame 
+// steps to catch up, the extra time is thrown away. Otherwise a slow 
+// frame would cause more simulation next frame, which would make that 
+// frame slow too, and so on (the "spiral of death").
+class FixedTimestep {
+public:
+	struct Config {
+		double stepsPerSecond;
+		unsigned int maxStepsPerFrame;
+	};
+
+	FixedTimestep(const Config& config);
+
+	// Adds this frame's time and returns how many steps to simulate.
+	unsigned int advance(double frameDeltaT);
+
+	// The length of a single step, in seconds.
+	double getStepSize() const { return stepSize; }
+
+	// How far we are from the previous step to the latest one, from 
+	// 0 (draw the previous state) to 1 (draw the latest state).
+	float getInterpolationAlpha() const { return (float)(accumulator / stepSize); }
+
+	// The total amount of time that was thrown away 
+	// because of the maxStepsPerFrame limit.
+	double getDroppedTime() const { return droppedTime; }
+
+private:
+	double stepSize;
+	unsigned int maxStepsPerFrame;
+	double accumulator = 0.0;
+	double droppedTime = 0.0;
+};
@@ -0,0 +1,154 @@
+#include "ForceFieldSet.h"
+
+#include <algorithm>
+
+#define MIN_CURL_NOISE_RESOLUTION 8
+
+// The random field that the curl noise is the curl of is made of a couple
+// of layers ("octaves") of smoothly blended random values. The first layer
+// has a random value every LATTICE_SPACING grid points, and each layer
+// after that has them twice as often (at half the strength).
+#define LATTICE_SPACING 8
+#define NUM_OCTAVES 2
+
+// A random number between -1 and 1 for every lattice point (and
+// each of the 3 parts of the field).
+static float latticeValue(unsigned int x, unsigned int y, unsigned int z, unsigned int component, unsigned int seed) {
+    unsigned int hash = x * 73856093u ^ y * 19349663u ^ z * 83492791u ^ component * 2654435761u ^ seed * 374761393u;
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    hash *= 0x297a2d39u;
+    hash ^= hash >> 15;
+    return (float)(hash & 0xffffff) / (float)0x800000 - 1.0f;
+}
+
+static float smooth(float t) {
+    return t * t * (3.0f - 2.0f * t);
+}
+
+CurlNoiseVolume::CurlNoiseVolume(unsigned int resolution, unsigned int seed) {
+    this->resolution = MIN_CURL_NOISE_RESOLUTION;
+    while (this->resolution < resolution) {
+        this->resolution *= 2;
+    }
+    mask = this->resolution - 1;
+    unsigned int n = this->resolution;
+
+    // First, the smooth random field (a "vector potential"), at every grid
+    // point. Its lattice repeats along with the grid, so the noise tiles.
+    std::vector<glm::vec3> potential(n * n * n, glm::vec3(0.0f));
+    unsigned int spacing = std::min((unsigned int)LATTICE_SPACING, n);
+    float amplitude = 1.0f;
+    for (unsigned int octave = 0; octave < NUM_OCTAVES && spacing > 0; ++octave) {
+        unsigned int latticeSize = n / spacing;
+        for (unsigned int z = 0; z < n; ++z) {
+            for (unsigned int y = 0; y < n; ++y) {
+                for (unsigned int x = 0; x < n; ++x) {
+                    unsigned int lx = x / spacing, ly = y / spacing, lz = z / spacing;
+                    unsigned int lx1 = (lx + 1) % latticeSize, ly1 = (ly + 1) % latticeSize, lz1 = (lz + 1) % latticeSize;
+                    float tx = smooth((float)(x % spacing) / spacing);
+                    float ty = smooth((float)(y % spacing) / spacing);
+                    float tz = smooth((float)(z % spacing) / spacing);
+
+                    glm::vec3& value = potential[x + n * (y + n * z)];
+                    for (unsigned int c = 0; c < 3; ++c) {
+                        unsigned int componentSeed = seed + octave * 3;
+                        float v00 = glm::mix(latticeValue(lx, ly, lz, c, componentSeed), latticeValue(lx1, ly, lz, c, componentSeed), tx);
+                        float v10 = glm::mix(latticeValue(lx, ly1, lz, c, componentSeed), latticeValue(lx1, ly1, lz, c, componentSeed), tx);
+                        float v01 = glm::mix(latticeValue(lx, ly, lz1, c, componentSeed), latticeValue(lx1, ly, lz1, c, componentSeed), tx);
+                        float v11 = glm::mix(latticeValue(lx, ly1, lz1, c, componentSeed), latticeValue(lx1, ly1, lz1, c, componentSeed), tx);
+                        value[c] += amplitude * glm::mix(glm::mix(v00, v10, ty), glm::mix(v01, v11, ty), tz);
+                    }
+                }
+            }
+        }
+        spacing /= 2;
+        amplitude *= 0.5f;
+    }
+
+    // Then its curl, with central differences (wrapping around at the edges):
+    // (dPz/dy - dPy/dz, dPx/dz - dPz/dx, dPy/dx - dPx/dy)
+    directions.resize(n * n * n);
+    float longest = 0.0f;
+    for (unsigned int z = 0; z < n; ++z) {
+        for (unsigned int y = 0; y < n; ++y) {
+            for (unsigned int x = 0; x < n; ++x) {
+                const glm::vec3& px0 = potential[((x + mask) & mask) + n * (y + n * z)];
+                const glm::vec3& px1 = potential[((x + 1) & mask) + n * (y + n * z)];
+                const glm::vec3& py0 = potential[x + n * (((y + mask) & mask) + n * z)];
+                const glm::vec3& py1 = potential[x + n * (((y + 1) & mask) + n * z)];
+                const glm::vec3& pz0 = potential[x + n * (y + n * ((z + mask) & mask))];
+                const glm::vec3& pz1 = potential[x + n * (y + n * ((z + 1) & mask))];
+
+                glm::vec3 curl(
+                    (py1.z - py0.z) - (pz1.y - pz0.y),
+                    (pz1.x - pz0.x) - (px1.z - px0.z),
+                    (px1.y - px0.y) - (py1.x - py0.x)
+                );
+                directions[x + n * (y + n * z)] = curl;
+                longest = std::max(longest, glm::length(curl));
+            }
+        }
+    }
+
+    // The spacing between grid points doesn't matter, since we
+    // scale everything so that the longest direction is 1 anyway.
+    if (longest > 0.0f) {
+        for (glm::vec3& direction : directions) {
+            direction /= longest;
+        }
+    }
+}
+
+ForceFieldSet::ForceFieldSet(const std::vector<ForceField>& fields, unsigned int curlNoiseResolution) : fields(fields) {
+    for (const ForceField& field : fields) {
+        if (field.type == ForceField::Type::TURBULENCE) {
+            curlNoise = new CurlNoiseVolume(curlNoiseResolution);
+            break;
+        }
+    }
+}
+
+ForceFieldSet::~ForceFieldSet() {
+    if (curlNoise != nullptr) {
+        delete curlNoise;
+        curlNoise = nullptr;
+    }
+}
+
+void ForceFieldSet::findFields(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<unsigned int>& found) const {
+    // There are only ever a handful of fields, so
+    // just checking every one of them is quick enough.
+    found.clear();
+    for (unsigned int i = 0; i < fields.size(); ++i) {
+        const ForceField& field = fields[i];
+        if (field.boundsMin.x <= boundsMax.x && field.boundsMax.x >= boundsMin.x
+            && field.boundsMin.y <= boundsMax.y && field.boundsMax.y >= boundsMin.y
+            && field.boundsMin.z <= boundsMax.z && field.boundsMax.z >= boundsMin.z) {
+            found.push_back(i);
+        }
+    }
+}
+
+glm::vec3 ForceFieldSet::getAcceleration(const ForceField& field, const glm::vec3& point) const {
+    if (point.x < field.boundsMin.x || point.y < field.boundsMin.y || point.z < field.boundsMin.z
+        || point.x > field.boundsMax.x || point.y > field.boundsMax.y || point.z > field.boundsMax.z) {
+        return glm::vec3(0.0f);
+    }
+
+    switch (field.type) {
+    case ForceField::Type::WIND:
+        return glm::normalize(field.direction) * field.strength;
+    case ForceField::Type::ATTRACTOR:
+        return getFalloffAcceleration(field.position - point, field.strength, 1.0f / field.radius);
+    case ForceField::Type::VORTEX:
+        return getFalloffAcceleration(glm::cross(glm::normalize(field.direction), point - field.position), field.strength, 1.0f / field.radius);
+    case ForceField::Type::TURBULENCE:
+        if (curlNoise != nullptr) {
+            return curlNoise->sample((point - field.position) * field.frequency) * field.strength;
+        }
+        break;
+    }
+    return glm::vec3(0.0f);
+}
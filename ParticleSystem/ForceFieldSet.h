@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cfloat>
+#include <glm/glm.hpp>
+#include <vector>
+
+// A grid of swirly, random directions that repeats every 1 unit in x, y
+// and z, for turbulence. Between the grid points, the directions are
+// blended (trilinearly).
+//
+// It's "curl noise" (from "Curl-Noise for Procedural Fluid Flow", Bridson
+// et al.): the curl of a smooth random field. That makes it divergence
+// free, so the particles swirl around instead of bunching up (or
+// spreading out) like they would with plain random directions.
+//
+// Working out curl noise takes a lot of math, far too much to do for every
+// particle, every update. So it's all done up front, and looking it up is
+// just a blend of 8 grid points.
+class CurlNoiseVolume {
+public:
+	// resolution is rounded up to a power of 2 (so wrapping around is just
+	// a mask). The longest of the directions is 1.
+	CurlNoiseVolume(unsigned int resolution = 32, unsigned int seed = 1);
+
+	unsigned int getResolution() const { return resolution; }
+
+	glm::vec3 sample(const glm::vec3& point) const;
+
+private:
+	unsigned int resolution;
+	unsigned int mask;
+	std::vector<glm::vec3> directions; // x changes fastest, then y, then z
+};
+
+// Something that pushes particles around (on top of their emitter's
+// gravity and drag). strength is an acceleration.
+struct ForceField {
+	enum class Type : unsigned int {
+		WIND,       // strength along direction, everywhere
+		ATTRACTOR,  // strength towards position (away from it, if strength is negative)
+		VORTEX,     // strength around the line through position along direction (anticlockwise, seen from the end that direction points to)
+		TURBULENCE  // strength along the curl noise, which repeats every 1 / frequency
+	};
+
+	Type type = Type::WIND;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 direction = glm::vec3(0.0f, 1.0f, 0.0f);
+	float strength = 1.0f;
+
+	// An attractor (or vortex) would pull unbelievably hard on particles
+	// right next to its center, so within this distance of it, the pull
+	// fades away to nothing instead.
+	float radius = 1.0f;
+
+	// Only for Type::TURBULENCE. Bigger frequencies make smaller swirls.
+	float frequency = 0.1f;
+
+	// Particles outside of this box don't feel the field at all. By
+	// default, that's everywhere.
+	glm::vec3 boundsMin = glm::vec3(-FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(FLT_MAX);
+};
+
+// All of the force fields that push a ParticleSystem's particles around.
+//
+// Like the colliders (see ColliderSet), the particles are pushed a chunk
+// at a time. findFields() skips any field whose box doesn't overlap the
+// chunk's, and apply() goes through the chunk's particles for one field at
+// a time, with a tight loop (and the force inlined into it) for each type.
+class ForceFieldSet {
+public:
+	ForceFieldSet(const std::vector<ForceField>& fields, unsigned int curlNoiseResolution = 32);
+	~ForceFieldSet();
+
+	unsigned int getNumFields() const { return (unsigned int)fields.size(); }
+
+	// Finds the fields that reach into the box between boundsMin and boundsMax.
+	void findFields(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<unsigned int>& found) const;
+
+	// Speeds the particles up by the field's force over deltaT. Particle
+	// can be any struct with a position (vec4) and velocity (vec3), and
+	// boundsMin and boundsMax are the box around them. When that's all
+	// inside of the field's box, the particles don't each get checked.
+	template <typename Particle>
+	void apply(unsigned int fieldIndex, Particle* const* particles, unsigned int numParticles, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float deltaT) const;
+
+	// The field's acceleration at point.
+	glm::vec3 getAcceleration(const ForceField& field, const glm::vec3& point) const;
+
+private:
+	std::vector<ForceField> fields;
+	CurlNoiseVolume* curlNoise = nullptr; // only when there's turbulence
+
+	// strength along offset, fading away to nothing once
+	// offset is shorter than the field's radius.
+	static glm::vec3 getFalloffAcceleration(const glm::vec3& offset, float strength, float inverseRadius);
+
+	template <typename Particle, typename GetAcceleration>
+	static void apply(const ForceField& field, Particle* const* particles, unsigned int numParticles, bool checkBounds, float deltaT, GetAcceleration getAcceleration);
+};
+
+inline glm::vec3 CurlNoiseVolume::sample(const glm::vec3& point) const {
+	float gridX = point.x * (float)resolution;
+	float gridY = point.y * (float)resolution;
+	float gridZ = point.z * (float)resolution;
+	// floor(), done by hand, since std::floor() can be a function call.
+	// Negative numbers wrap around too, since they're two's complement.
+	int cornerX = (int)gridX - (gridX < (float)(int)gridX);
+	int cornerY = (int)gridY - (gridY < (float)(int)gridY);
+	int cornerZ = (int)gridZ - (gridZ < (float)(int)gridZ);
+	float tx = gridX - (float)cornerX;
+	float ty = gridY - (float)cornerY;
+	float tz = gridZ - (float)cornerZ;
+	unsigned int x0 = (unsigned int)cornerX & mask;
+	unsigned int y0 = (unsigned int)cornerY & mask;
+	unsigned int z0 = (unsigned int)cornerZ & mask;
+	unsigned int x1 = (x0 + 1) & mask;
+	unsigned int y1 = ((y0 + 1) & mask) * resolution;
+	unsigned int z1 = ((z0 + 1) & mask) * resolution * resolution;
+	y0 *= resolution;
+	z0 *= resolution * resolution;
+
+	// Blend along x, then y, then z. It's written out a component at a
+	// time, so that the compiler can keep it all in registers.
+	const glm::vec3* d = directions.data();
+	const glm::vec3& d000 = d[x0 + y0 + z0];
+	const glm::vec3& d100 = d[x1 + y0 + z0];
+	const glm::vec3& d010 = d[x0 + y1 + z0];
+	const glm::vec3& d110 = d[x1 + y1 + z0];
+	const glm::vec3& d001 = d[x0 + y0 + z1];
+	const glm::vec3& d101 = d[x1 + y0 + z1];
+	const glm::vec3& d011 = d[x0 + y1 + z1];
+	const glm::vec3& d111 = d[x1 + y1 + z1];
+	auto blend = [&](float v000, float v100, float v010, float v110, float v001, float v101, float v011, float v111) {
+		float v00 = v000 + (v100 - v000) * tx;
+		float v10 = v010 + (v110 - v010) * tx;
+		float v01 = v001 + (v101 - v001) * tx;
+		float v11 = v011 + (v111 - v011) * tx;
+		float v0 = v00 + (v10 - v00) * ty;
+		float v1 = v01 + (v11 - v01) * ty;
+		return v0 + (v1 - v0) * tz;
+	};
+	return glm::vec3(
+		blend(d000.x, d100.x, d010.x, d110.x, d001.x, d101.x, d011.x, d111.x),
+		blend(d000.y, d100.y, d010.y, d110.y, d001.y, d101.y, d011.y, d111.y),
+		blend(d000.z, d100.z, d010.z, d110.z, d001.z, d101.z, d011.z, d111.z)
+	);
+}
+
+inline glm::vec3 ForceFieldSet::getFalloffAcceleration(const glm::vec3& offset, float strength, float inverseRadius) {
+	float distance = glm::length(offset);
+	return offset * (strength * glm::min(inverseRadius, 1.0f / glm::max(distance, FLT_MIN)));
+}
+
+template <typename Particle, typename GetAcceleration>
+void ForceFieldSet::apply(const ForceField& field, Particle* const* particles, unsigned int numParticles, bool checkBounds, float deltaT, GetAcceleration getAcceleration) {
+	if (!checkBounds) {
+		for (unsigned int i = 0; i < numParticles; ++i) {
+			Particle& particle = *particles[i];
+			particle.velocity += getAcceleration(glm::vec3(particle.position)) * deltaT;
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < numParticles; ++i) {
+		Particle& particle = *particles[i];
+		glm::vec3 position(particle.position);
+		if (position.x < field.boundsMin.x || position.y < field.boundsMin.y || position.z < field.boundsMin.z
+			|| position.x > field.boundsMax.x || position.y > field.boundsMax.y || position.z > field.boundsMax.z) {
+			continue;
+		}
+		particle.velocity += getAcceleration(position) * deltaT;
+	}
+}
+
+template <typename Particle>
+void ForceFieldSet::apply(unsigned int fieldIndex, Particle* const* particles, unsigned int numParticles, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float deltaT) const {
+	const ForceField& field = fields[fieldIndex];
+	bool checkBounds = boundsMin.x < field.boundsMin.x || boundsMin.y < field.boundsMin.y || boundsMin.z < field.boundsMin.z
+		|| boundsMax.x > field.boundsMax.x || boundsMax.y > field.boundsMax.y || boundsMax.z > field.boundsMax.z;
+	switch (field.type) {
+	case ForceField::Type::WIND: {
+		glm::vec3 acceleration = glm::normalize(field.direction) * field.strength;
+		apply(field, particles, numParticles, checkBounds, deltaT, [&](const glm::vec3&) {
+			return acceleration;
+		});
+		break;
+	}
+	case ForceField::Type::ATTRACTOR: {
+		float inverseRadius = 1.0f / field.radius;
+		apply(field, particles, numParticles, checkBounds, deltaT, [&](const glm::vec3& point) {
+			return getFalloffAcceleration(field.position - point, field.strength, inverseRadius);
+		});
+		break;
+	}
+	case ForceField::Type::VORTEX: {
+		glm::vec3 axis = glm::normalize(field.direction);
+		float inverseRadius = 1.0f / field.radius;
+		apply(field, particles, numParticles, checkBounds, deltaT, [&](const glm::vec3& point) {
+			// The cross product is as long as the distance from the axis.
+			return getFalloffAcceleration(glm::cross(axis, point - field.position), field.strength, inverseRadius);
+		});
+		break;
+	}
+	case ForceField::Type::TURBULENCE: {
+		const CurlNoiseVolume& noise = *curlNoise;
+		apply(field, particles, numParticles, checkBounds, deltaT, [&](const glm::vec3& point) {
+			return noise.sample((point - field.position) * field.frequency) * field.strength;
+		});
+		break;
+	}
+	}
+}
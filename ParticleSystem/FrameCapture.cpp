@@ -0,0 +1,193 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "ImageWriter.h"
+
+// Splits a filename pattern into what comes before its one integer 
+// conversion, the conversion itself, and what comes after (with any 
+// %% turned into %). Returns false if there isn't exactly one 
+// conversion, or there's a % that isn't one, since handing a pattern 
+// like that to snprintf would have it reading arguments that aren't there.
+static bool splitFilenamePattern(const std::string& pattern, std::string& prefix, std::string& numberFormat, std::string& suffix) {
+	prefix.clear();
+	numberFormat.clear();
+	suffix.clear();
+	for (size_t i = 0; i < pattern.size(); ++i) {
+		std::string& text = numberFormat.empty() ? prefix : suffix;
+		if (pattern[i] != '%') {
+			text += pattern[i];
+			continue;
+		}
+		if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+			text += '%';
+			++i;
+			continue;
+		}
+		if (!numberFormat.empty()) {
+			return false;
+		}
+
+		size_t end = i + 1;
+		while (end < pattern.size() && strchr("-+ #0", pattern[end]) != nullptr) {
+			++end;
+		}
+		while (end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9') {
+			++end;
+		}
+		if (end == pattern.size() || strchr("diuxXo", pattern[end]) == nullptr) {
+			return false;
+		}
+		numberFormat = pattern.substr(i, end + 1 - i);
+		i = end;
+	}
+	return !numberFormat.empty();
+}
+
+FrameCapture::FrameCapture(gfx::Renderer& renderer, const Viewport& viewport, const Config& config)
+	: config(config), numFramesWritten(0), numWriteErrors(0) {
+	// We need at least one of each, or nothing could ever get through.
+	this->config.maxQueuedFrames = std::max(config.maxQueuedFrames, 1u);
+	this->config.readbackRingSize = std::max(config.readbackRingSize, 1u);
+
+	if (!splitFilenamePattern(config.filenamePattern, filenamePrefix, numberFormat, filenameSuffix)) {
+		return;
+	}
+
+	reader = renderer.createFrameReader(viewport, this->config.readbackRingSize);
+	if (reader == nullptr) {
+		return;
+	}
+
+	frameStorage.resize(this->config.maxQueuedFrames);
+	for (std::vector<unsigned char>& frame : frameStorage) {
+		frame.resize((size_t)viewport.width * viewport.height * 4);
+		freeFrames.push_back(&frame);
+	}
+
+	writerThread = std::thread(&FrameCapture::writerMain, this);
+}
+
+FrameCapture::~FrameCapture() {
+	if (reader == nullptr) {
+		return;
+	}
+
+	finish();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frameQueued.notify_one();
+	writerThread.join();
+
+	delete reader;
+	reader = nullptr;
+}
+
+void FrameCapture::captureFrame() {
+	if (reader == nullptr) {
+		return;
+	}
+
+	// Grab whatever has already arrived, so that the
+	// readback slots are free for the new frame.
+	collectFrames(false);
+
+	if (!reader->requestFrame()) {
+		// Every slot is still in flight, so we have no choice but
+		// to wait for the oldest one. A bigger ring would avoid this.
+		++numStalls;
+		collectFrames(true);
+		reader->requestFrame();
+	}
+}
+
+void FrameCapture::finish() {
+	if (reader == nullptr) {
+		return;
+	}
+
+	while (reader->getNumPendingFrames() > 0) {
+		collectFrames(true);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	frameFreed.wait(lock, [this] { return queue.empty() && freeFrames.size() == frameStorage.size(); });
+}
+
+void FrameCapture::collectFrames(bool wait) {
+	gfx::FrameReader::FrameCallback enqueue = [this](const unsigned char* rgba, int width, int height) {
+		std::vector<unsigned char>* frame = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (freeFrames.empty()) {
+				// The writer is behind, and every frame buffer is full.
+				++numStalls;
+				frameFreed.wait(lock, [this] { return !freeFrames.empty(); });
+			}
+			frame = freeFrames.back();
+			freeFrames.pop_back();
+		}
+
+		// The copy happens outside of the lock, so the
+		// writer thread can keep going in the meantime.
+		memcpy(frame->data(), rgba, (size_t)width * height * 4);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			QueuedFrame queuedFrame = { nextFrameNumber++, frame };
+			queue.push_back(queuedFrame);
+		}
+		frameQueued.notify_one();
+	};
+
+	if (wait) {
+		reader->readFrame(enqueue, true);
+	}
+
+	while (reader->readFrame(enqueue, false)) {
+	}
+}
+
+void FrameCapture::writerMain() {
+	const int width = reader->getWidth();
+	const int height = reader->getHeight();
+	char number[32];
+	std::string filename;
+
+	while (true) {
+		QueuedFrame frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frameQueued.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				return;
+			}
+			frame = queue.front();
+			queue.pop_front();
+		}
+
+		snprintf(number, sizeof(number), numberFormat.c_str(), frame.frameNumber);
+		filename = filenamePrefix + number + filenameSuffix;
+
+		bool written = config.format == Format::PNG
+			? writePNG(filename.c_str(), frame.pixels->data(), width, height)
+			: writeRawRGBA(filename.c_str(), frame.pixels->data(), width, height);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (written) {
+				++numFramesWritten;
+			}
+			else {
+				++numWriteErrors;
+			}
+			freeFrames.push_back(frame.pixels);
+		}
+		frameFreed.notify_all();
+	}
+}
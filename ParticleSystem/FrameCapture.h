@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameReader.h"
+#include "Renderer.h"
+#include "Viewport.h"
+
+// Saves every frame we draw to disk as a numbered sequence of images, 
+// e.g. for rendering effect previews offline.
+//
+// Getting a frame to disk happens in three stages, and none of them 
+// hold up drawing the next frame:
+//   1. A FrameReader reads the frame back from the Renderer, in the 
+//      background (for OpenGL, through a ring of Pixel Buffer Objects).
+//   2. A few frames later, once the pixels have arrived, they are 
+//      copied into one of a fixed number of frame buffers and queued up.
+//   3. A writer thread takes frames off the queue, encodes them, and 
+//      writes them to disk.
+//
+// The only time drawing has to wait is when the writer falls so far 
+// behind that every frame buffer is full. That also puts a hard limit 
+// on how much memory the capture can use.
+class FrameCapture {
+public:
+	enum class Format {
+		PNG,
+		RAW // 8-bit RGBA, top row first, no header
+	};
+
+	struct Config {
+		// A printf-style pattern for the file names, which is given the 
+		// frame number, e.g. "capture/frame_%05d.png". It has to have 
+		// exactly one integer conversion (%d, %i, %u, %x, %X or %o, with 
+		// any flags and width), and any other % has to be %%. The 
+		// directory has to exist already.
+		std::string filenamePattern;
+		Format format;
+
+		// How many frames can be waiting to be written.
+		unsigned int maxQueuedFrames;
+
+		// How many frames can be in the middle of being read back.
+		unsigned int readbackRingSize;
+	};
+
+	FrameCapture(gfx::Renderer& renderer, const Viewport& viewport, const Config& config);
+
+	// Writes out any frames that are still on their way.
+	~FrameCapture();
+
+	// False if the Renderer can't read frames back, or the filename 
+	// pattern isn't one we can use, in which case nothing will be 
+	// captured.
+	bool isSupported() const { return reader != nullptr; }
+
+	// Captures the frame that has just been drawn. Call this after 
+	// drawing, but before swapping buffers.
+	void captureFrame();
+
+	// Waits until every captured frame has been written to disk.
+	void finish();
+
+	unsigned int getNumFramesWritten() const { return numFramesWritten; }
+	unsigned int getNumWriteErrors() const { return numWriteErrors; }
+
+	// Frames that were captured, but never arrived from the Renderer.
+	unsigned int getNumDroppedFrames() const { return reader != nullptr ? reader->getNumDroppedFrames() : 0; }
+
+	// How many times drawing had to wait, either for the GPU (because 
+	// every readback slot was in use) or for the writer thread.
+	unsigned int getNumStalls() const { return numStalls; }
+
+private:
+	struct QueuedFrame {
+		unsigned int frameNumber;
+		std::vector<unsigned char>* pixels;
+	};
+
+	Config config;
+	gfx::FrameReader* reader = nullptr;
+
+	// The filename pattern, split up around its conversion, so that 
+	// only the conversion ever gets used as a format.
+	std::string filenamePrefix;
+	std::string numberFormat;
+	std::string filenameSuffix;
+
+	unsigned int nextFrameNumber = 0;
+	unsigned int numStalls = 0;
+
+	// Every frame buffer we'll ever use is allocated up front.
+	// Each one is either in freeFrames, in the queue, or
+	// being written by the writer thread.
+	std::vector<std::vector<unsigned char>> frameStorage;
+	std::vector<std::vector<unsigned char>*> freeFrames;
+	std::deque<QueuedFrame> queue;
+
+	std::thread writerThread;
+	std::mutex mutex;
+	std::condition_variable frameQueued;
+	std::condition_variable frameFreed;
+	bool stopping = false;
+	std::atomic<unsigned int> numFramesWritten;
+	std::atomic<unsigned int> numWriteErrors;
+
+	// Moves any frames that have finished reading back into the queue.
+	// If wait is true, waits for at least one frame.
+	void collectFrames(bool wait);
+
+	void writerMain();
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+
+namespace gfx {
+
+	// Reads finished frames back from wherever the Renderer draws them 
+	// (GPU memory, for GLRenderer) into system memory, without making 
+	// the app wait for it.
+	//
+	// Reading pixels back from the GPU the obvious way forces the CPU to 
+	// wait until the GPU has finished drawing the frame, which throws away 
+	// all of the overlap between the two. Instead, a FrameReader starts 
+	// the copy with requestFrame() and lets it finish in the background. 
+	// A few frames later, readFrame() can hand over the pixels without 
+	// any waiting. The number of frames that can be in flight at once is 
+	// set when the reader is created (see Renderer::createFrameReader).
+	class FrameReader {
+	public:
+		// The pixels are tightly-packed 8-bit RGBA, with the bottom row 
+		// first (the same as glReadPixels). The memory is only valid 
+		// until the callback returns.
+		typedef std::function<void(const unsigned char* rgba, int width, int height)> FrameCallback;
+
+		virtual ~FrameReader() {}
+
+		// Starts reading back what has been drawn so far this frame. Call 
+		// this after drawing, but before swapping buffers. Returns false 
+		// (and does nothing) if every slot is already in use, in which case 
+		// the oldest frame has to be read with readFrame() first.
+		virtual bool requestFrame() = 0;
+
+		// If the oldest requested frame has arrived, passes it to the 
+		// callback and returns true. If it hasn't arrived yet, returns 
+		// false straight away, unless wait is true, in which case it waits 
+		// for it. Also returns false if no frames have been requested.
+		virtual bool readFrame(const FrameCallback& callback, bool wait) = 0;
+
+		// The number of frames that have been requested but not read yet.
+		virtual unsigned int getNumPendingFrames() const = 0;
+
+		// The number of frames that were requested, but couldn't be read 
+		// back after all (if the driver lost them, say). They're taken off 
+		// the pending ones, and never get passed to a callback.
+		virtual unsigned int getNumDroppedFrames() const = 0;
+
+		virtual int getWidth() const = 0;
+		virtual int getHeight() const = 0;
+	};
+}
@@ -0,0 +1,87 @@
+#include "GLFrameReader.h"
+
+namespace gfx {
+
+	GLFrameReader::GLFrameReader(int x, int y, int width, int height, unsigned int ringSize)
+		: x(x), y(y), width(width), height(height), pixelBuffers(ringSize, 0), fences(ringSize, nullptr) {
+
+		glGenBuffers(ringSize, pixelBuffers.data());
+		for (GLuint pixelBuffer : pixelBuffers) {
+			// GL_STREAM_READ: written by the GPU once, read by the CPU once.
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	GLFrameReader::~GLFrameReader() {
+		for (GLsync fence : fences) {
+			if (fence != nullptr) {
+				glDeleteSync(fence);
+			}
+		}
+
+		glDeleteBuffers((GLsizei)pixelBuffers.size(), pixelBuffers.data());
+	}
+
+	bool GLFrameReader::requestFrame() {
+		if (numPending == pixelBuffers.size()) {
+			return false;
+		}
+
+		unsigned int slot = nextSlot;
+		nextSlot = (nextSlot + 1) % pixelBuffers.size();
+		++numPending;
+
+		// With a PBO bound, the last argument to glReadPixels is an 
+		// offset into the PBO rather than a pointer to CPU memory.
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+		glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		return true;
+	}
+
+	bool GLFrameReader::readFrame(const FrameCallback& callback, bool wait) {
+		if (numPending == 0) {
+			return false;
+		}
+
+		unsigned int slot = (nextSlot + (unsigned int)pixelBuffers.size() - numPending) % pixelBuffers.size();
+
+		// A timeout of 0 just checks the fence without waiting. When we 
+		// do wait, we also have to flush, or the fence may never be 
+		// submitted to the GPU at all.
+		GLbitfield flags = wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+		GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+		GLenum result = glClientWaitSync(fences[slot], flags, timeout);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			return false;
+		}
+
+		// Whatever happens from here on, the slot is finished with. If 
+		// the wait (or the map) failed, the frame is lost, and waiting 
+		// for it again would only fail again, so it's dropped.
+		glDeleteSync(fences[slot]);
+		fences[slot] = nullptr;
+		--numPending;
+		if (result == GL_WAIT_FAILED) {
+			++numDropped;
+			return false;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+		const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 4, GL_MAP_READ_BIT);
+		if (pixels != nullptr) {
+			callback(pixels, width, height);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		else {
+			++numDropped;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		return pixels != nullptr;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <GL/glew.h>
+#include <vector>
+
+#include "FrameReader.h"
+
+namespace gfx {
+
+	// An OpenGL implementation of the FrameReader class.
+	//
+	// Each frame is read into its own Pixel Buffer Object (PBO). When a 
+	// PBO is bound to GL_PIXEL_PACK_BUFFER, glReadPixels() doesn't copy 
+	// the pixels to the CPU straight away; it just queues up a copy into 
+	// the PBO, on the GPU, and returns immediately. We drop a "fence" into 
+	// the command stream right after it, so that later on we can ask 
+	// OpenGL whether the GPU has got that far yet. Once it has, mapping 
+	// the PBO gives us the pixels without any waiting.
+	//
+	// The PBOs are used round-robin, as a ring.
+	class GLFrameReader : public FrameReader {
+	public:
+		GLFrameReader(int x, int y, int width, int height, unsigned int ringSize);
+		~GLFrameReader();
+
+		bool requestFrame();
+		bool readFrame(const FrameCallback& callback, bool wait);
+		unsigned int getNumPendingFrames() const { return numPending; }
+		unsigned int getNumDroppedFrames() const { return numDropped; }
+
+		int getWidth() const { return width; }
+		int getHeight() const { return height; }
+
+	private:
+		int x, y, width, height;
+
+		std::vector<GLuint> pixelBuffers;
+		std::vector<GLsync> fences;
+
+		// The next slot to be written, and the number of 
+		// slots (starting from the oldest) that are in use.
+		unsigned int nextSlot = 0;
+		unsigned int numPending = 0;
+		unsigned int numDropped = 0;
+	};
+}
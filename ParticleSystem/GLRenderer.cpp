@@ -1,10 +1,21 @@
 #include <glm/ext.hpp>
 #include "GLRenderer.h"
+#include "GLFrameReader.h"
 
 namespace gfx {
 
 	const GLuint CAMERA_UNIFORM_BLOCK_INDEX = 0;
 
+	static GLenum lookUpMode(DrawCall::Mode mode) {
+		switch (mode) {
+		case DrawCall::Mode::TRIANGLE_STRIP: return GL_TRIANGLE_STRIP;
+		case DrawCall::Mode::TRIANGLE_FAN:   return GL_TRIANGLE_FAN;
+		case DrawCall::Mode::POINTS:         return GL_POINTS;
+		case DrawCall::Mode::LINES:          return GL_LINES;
+		default:                             return GL_TRIANGLES;
+		}
+	}
+
 	GLRenderer::GLRenderer(GLResourceManager& resourceManager) : resourceManager(resourceManager) {
 		cameraUniformBuffer = resourceManager.createStreamingUniformBuffer(sizeof(CameraUBOData), NULL);
 	}
@@ -80,10 +91,40 @@ namespace gfx {
 			if (!done) {
 				resourceManager.useProgram(drawCall.programHandle);
 				resourceManager.bindStorageBufferBase(drawCall.storageBuffer, drawCall.storageBufferBaseIndex);
+				if (drawCall.uniformBuffer != 0) {
+					resourceManager.bindUniformBufferBase(drawCall.uniformBuffer, drawCall.uniformBufferBaseIndex);
+				}
 				resourceManager.bindVAO(drawCall.vaoHandle);
 				done = true;
 			}
-			glDrawElements(GL_TRIANGLES, drawCall.numIndices, GL_UNSIGNED_INT, NULL);
+
+			GLenum mode = lookUpMode(drawCall.mode);
+			if (drawCall.indirectBuffer != 0) {
+				// The counts (and everything else) are already on the GPU,
+				// so all we do is point OpenGL at them.
+				resourceManager.bindIndirectBuffer(drawCall.indirectBuffer);
+				const void* offset = (const void*)(size_t)drawCall.indirectOffset;
+				if (drawCall.indexType == DrawCall::IndexType::NONE) {
+					glMultiDrawArraysIndirect(mode, offset, drawCall.indirectDrawCount, 0);
+				}
+				else {
+					GLenum indexType = drawCall.indexType == DrawCall::IndexType::USHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+					glMultiDrawElementsIndirect(mode, indexType, offset, drawCall.indirectDrawCount, 0);
+				}
+			}
+			else if (drawCall.indexType == DrawCall::IndexType::NONE) {
+				// No index buffer, the shader works out 
+				// everything it needs from gl_VertexID.
+				glDrawArrays(mode, 0, drawCall.numIndices);
+			}
+			else {
+				GLenum indexType = drawCall.indexType == DrawCall::IndexType::USHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+				glDrawElements(mode, drawCall.numIndices, indexType, NULL);
+			}
 		}
 	}
+
+	FrameReader* GLRenderer::createFrameReader(const Viewport& viewport, unsigned int ringSize) {
+		return new GLFrameReader(viewport.x, viewport.y, viewport.width, viewport.height, ringSize);
+	}
 }
@@ -35,6 +35,10 @@ namespace gfx {
 		// Takes a list of draw calls and draws them!
 		void draw(const std::vector<DrawCall> drawCalls);
 
+		// Creates a GLFrameReader, which reads the back buffer 
+		// back through a ring of Pixel Buffer Objects.
+		FrameReader* createFrameReader(const Viewport& viewport, unsigned int ringSize);
+
 	private:
 
 		// This struct has the exact same memory 
@@ -120,10 +120,53 @@ namespace gfx {
 		streamDataToBuffer(GL_SHADER_STORAGE_BUFFER, bufferHandle, bufferCallback);
 	}
 
+	void GLResourceManager::updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data) {
+		std::map<HBUFFER, BufferDesc>::const_iterator itr = buffers.find(bufferHandle);
+		if (itr != buffers.end() && offset + size <= itr->second.initialSize) {
+			// Unlike streamDataToBuffer, we don't orphan the buffer 
+			// here, since we want to keep everything we didn't overwrite.
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferHandle);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
+		}
+	}
+
 	void GLResourceManager::bindStorageBufferBase(HBUFFER handle, unsigned int index) {
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, handle);
 	}
 
+	void GLResourceManager::bindIndirectBuffer(HBUFFER handle) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, handle);
+	}
+
+	GLResourceManager::HBUFFER GLResourceManager::createStorageBuffer(unsigned int size, const void* initialData) {
+		// DYNAMIC_COPY is the hint for "the GPU writes it, and the GPU reads it, many times".
+		return createBuffer(GL_SHADER_STORAGE_BUFFER, size, initialData, GL_DYNAMIC_COPY);
+	}
+
+	void GLResourceManager::dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ) {
+		useProgram(programHandle);
+		glDispatchCompute(numGroupsX, numGroupsY, numGroupsZ);
+	}
+
+	void GLResourceManager::memoryBarrier(unsigned int barriers) {
+		GLbitfield glBarriers = 0;
+		if (barriers == ALL_BARRIERS) {
+			glBarriers = GL_ALL_BARRIER_BITS;
+		}
+		else {
+			if (barriers & STORAGE_BARRIER) {
+				glBarriers |= GL_SHADER_STORAGE_BARRIER_BIT;
+			}
+			if (barriers & COMMAND_BARRIER) {
+				glBarriers |= GL_COMMAND_BARRIER_BIT;
+			}
+		}
+
+		if (glBarriers != 0) {
+			glMemoryBarrier(glBarriers);
+		}
+	}
+
 	void GLResourceManager::deleteBuffer(HBUFFER bufferHandle) {
 		std::map<HBUFFER, BufferDesc>::const_iterator itr = buffers.find(bufferHandle);
 		if (itr != buffers.end()) {
@@ -167,13 +210,17 @@ namespace gfx {
 	}
 
 	GLuint GLResourceManager::createStreamingBuffer(GLenum target, unsigned int initialDataSize, unsigned char* initialData) {
+		return createBuffer(target, initialDataSize, initialData, GL_STREAM_DRAW);
+	}
+
+	GLuint GLResourceManager::createBuffer(GLenum target, unsigned int size, const void* initialData, GLenum usage) {
 		GLuint buffer;
 		glGenBuffers(1, &buffer);
 		glBindBuffer(target, buffer);
-		glBufferData(target, initialDataSize, initialData, GL_STREAM_DRAW);
+		glBufferData(target, size, initialData, usage);
 		BufferDesc bufferDescription;
 		bufferDescription.bufferHandle = buffer;
-		bufferDescription.initialSize = initialDataSize;
+		bufferDescription.initialSize = size;
 		buffers.emplace(buffer, bufferDescription);
 		return buffer;
 	}
@@ -202,7 +249,7 @@ namespace gfx {
 	ResourceManager::HVAO GLResourceManager::createVAO(const VAOConfig& config) {
 		GLuint vao;
 		glGenVertexArrays(1, &vao);
-		glBindVertexArray(1);
+		glBindVertexArray(vao);
 
 		if (config.indexData != NULL) {
 			GLuint indexBuffer;
@@ -211,6 +258,9 @@ namespace gfx {
 			glBufferData(GL_ELEMENT_ARRAY_BUFFER, config.indexBufferSizeBytes, config.indexData, GL_STATIC_DRAW);
 		}
 
+		// Leave the previously bound VAO (if any) bound.
+		glBindVertexArray(curVao);
+
 		return vao;
 	}
 
@@ -48,10 +48,20 @@ namespace gfx {
 
 		HBUFFER createStreamingStorageBuffer(unsigned int initialDataSize, unsigned char* initialData);
 		void streamDataToStorageBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+		void updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data);
 		void bindStorageBufferBase(HBUFFER handle, unsigned int index);
 
+		// For indirect draws: the buffer that the draw's arguments come from.
+		void bindIndirectBuffer(HBUFFER handle);
+
+		HBUFFER createStorageBuffer(unsigned int size, const void* initialData);
+
 		void deleteBuffer(HBUFFER bufferHandle);
 
+		// Compute
+		void dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ);
+		void memoryBarrier(unsigned int barriers);
+
 		// VAOs
 		virtual HVAO createVAO(const VAOConfig& config);
 		virtual void deleteVAO(HVAO vaoHandle);
@@ -101,6 +111,7 @@ namespace gfx {
 		void setLastError(const GLchar* error);
 
 		GLuint createStreamingBuffer(GLenum target, unsigned int initialDataSize, unsigned char* initialData);
+		GLuint createBuffer(GLenum target, unsigned int size, const void* initialData, GLenum usage);
 		void streamDataToBuffer(GLenum target, HBUFFER bufferHandle, const BufferCallback &bufferCallback);
 
 		std::map<HVAO, BufferDesc> vaos;
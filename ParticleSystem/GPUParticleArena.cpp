@@ -0,0 +1,161 @@
+#include "GPUParticleArena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "Utils.h"
+
+#define VERTS_PER_PARTICLE 6 // two triangles, without an index buffer
+#define NUM_SHADER_PROPERTIES 4 // position, previous position, color, and size, same as particle.vert
+#define PARAMS_BINDING_INDEX 1 // matches the binding of ParticleParams in particle.vert
+
+// The bindings in particle_compact.comp
+#define COMPACT_SOURCE_BINDING_INDEX 0
+#define COMPACT_STATES_BINDING_INDEX 1
+#define COMPACT_DEST_BINDING_INDEX 3
+#define COMPACT_COMMANDS_BINDING_INDEX 4
+#define COMPACT_PARAMS_BINDING_INDEX 3
+#define COMPACT_GROUP_SIZE 256 // local_size_x in particle_compact.comp
+
+GPUParticleArena::GPUParticleArena(const Config& config) : config(config) {
+    this->config.maxParticles = std::max(config.maxParticles, 1u);
+    this->config.maxSystems = std::max(config.maxSystems, 1u);
+}
+
+void GPUParticleArena::initGraphicsResources(gfx::ResourceManager& resourceManager) {
+    // Every shader that touches the particles needs to know how
+    // many there are, so that it can find where each array starts.
+    std::string numParticlesDefine = "#define NUM_PARTICLES " + std::to_string(config.maxParticles) + "\n";
+
+    // The simulation. See particle_sim.comp.
+    std::string simShaderSource = loadAsciiFile("particle_sim.comp");
+    std::string updateShaderSource = insertShaderDefines(simShaderSource, numParticlesDefine);
+    std::string emitShaderSource = insertShaderDefines(simShaderSource, numParticlesDefine + "#define EMIT_PASS\n");
+    gfx::ResourceManager::ShaderSource updateShader = { gfx::ResourceManager::ShaderType::COMPUTE_SHADER, updateShaderSource.c_str() };
+    gfx::ResourceManager::ShaderSource emitShader = { gfx::ResourceManager::ShaderType::COMPUTE_SHADER, emitShaderSource.c_str() };
+    updateProgramHandle = resourceManager.createProgramFromSource(&updateShader, 1);
+    emitProgramHandle = resourceManager.createProgramFromSource(&emitShader, 1);
+
+    // The compaction. See particle_compact.comp.
+    std::string compactShaderSource = loadAsciiFile("particle_compact.comp");
+    std::string resetShaderSource = insertShaderDefines(compactShaderSource, numParticlesDefine + "#define RESET_PASS\n");
+    compactShaderSource = insertShaderDefines(compactShaderSource, numParticlesDefine);
+    gfx::ResourceManager::ShaderSource resetShader = { gfx::ResourceManager::ShaderType::COMPUTE_SHADER, resetShaderSource.c_str() };
+    gfx::ResourceManager::ShaderSource compactShader = { gfx::ResourceManager::ShaderType::COMPUTE_SHADER, compactShaderSource.c_str() };
+    resetProgramHandle = resourceManager.createProgramFromSource(&resetShader, 1);
+    compactProgramHandle = resourceManager.createProgramFromSource(&compactShader, 1);
+
+    // The drawing. This is the same vertex shader that ParticleSystem
+    // uses, except that without an index buffer, it takes 6 vertices
+    // (rather than 4) per particle.
+    std::string vertShaderSource = insertShaderDefines(loadAsciiFile("particle.vert"), numParticlesDefine + "#define VERTS_PER_PARTICLE 6\n");
+    std::string fragShaderSource = loadAsciiFile("particle.frag");
+    gfx::ResourceManager::ShaderSource drawShaders[2] = {
+        { gfx::ResourceManager::ShaderType::VERTEX_SHADER, vertShaderSource.c_str() },
+        { gfx::ResourceManager::ShaderType::FRAGMENT_SHADER, fragShaderSource.c_str() }
+    };
+    drawProgramHandle = resourceManager.createProgramFromSource(drawShaders, 2);
+
+    // The particles, which start out as all zeroes. That's a dead
+    // particle (maxLife = 0), and an invisible one (size = 0).
+    unsigned int particleDataSize = sizeof(glm::vec4) * NUM_SHADER_PROPERTIES * config.maxParticles;
+    std::vector<unsigned char> zeroes(std::max<size_t>(particleDataSize, sizeof(ParticleState) * config.maxParticles), 0);
+    particleBufferHandle = resourceManager.createStorageBuffer(particleDataSize, zeroes.data());
+    compactedBufferHandle = resourceManager.createStorageBuffer(particleDataSize, zeroes.data());
+    stateBufferHandle = resourceManager.createStorageBuffer(sizeof(ParticleState) * config.maxParticles, zeroes.data());
+
+    // One draw command per system. They all draw nothing until a system
+    // is added, and compaction fills in the counts after that.
+    std::vector<DrawArraysIndirectCommand> commands(config.maxSystems);
+    memset(commands.data(), 0, sizeof(DrawArraysIndirectCommand) * commands.size());
+    indirectBufferHandle = resourceManager.createStorageBuffer(sizeof(DrawArraysIndirectCommand) * config.maxSystems, commands.data());
+
+    CompactParams compactParams = {};
+    compactParams.numParticles = config.maxParticles;
+    compactParamsBufferHandle = resourceManager.createStreamingUniformBuffer(sizeof(CompactParams), (unsigned char*)&compactParams);
+    drawParamsBufferHandle = resourceManager.createStreamingUniformBuffer(sizeof(ShaderParams), nullptr);
+
+    // We still need a VAO to draw with, even though it's empty.
+    gfx::ResourceManager::VAOConfig vaoConfig;
+    vaoConfig.indexBufferSizeBytes = 0;
+    vaoConfig.indexData = nullptr;
+    vaoHandle = resourceManager.createVAO(vaoConfig);
+}
+
+unsigned int GPUParticleArena::addSystem(gfx::ResourceManager& resourceManager, unsigned int numParticles) {
+    if (systems.size() >= config.maxSystems || numParticles > config.maxParticles - numParticlesAllocated) {
+        return INVALID_SYSTEM;
+    }
+
+    SystemDesc system;
+    system.particleBase = numParticlesAllocated;
+    system.numParticles = numParticles;
+    numParticlesAllocated += numParticles;
+
+    unsigned int systemIndex = (unsigned int)systems.size();
+    systems.push_back(system);
+
+    // The system's draw command always starts at its first particle,
+    // only the count changes from frame to frame.
+    DrawArraysIndirectCommand command;
+    command.count = 0;
+    command.instanceCount = 1;
+    command.first = system.particleBase * VERTS_PER_PARTICLE;
+    command.baseInstance = 0;
+    resourceManager.updateStorageBuffer(indirectBufferHandle, systemIndex * sizeof(DrawArraysIndirectCommand), sizeof(DrawArraysIndirectCommand), &command);
+
+    CompactParams compactParams = {};
+    compactParams.numParticles = numParticlesAllocated;
+    compactParams.numSystems = (unsigned int)systems.size();
+    resourceManager.streamDataToUniformBuffer(compactParamsBufferHandle, [&compactParams](void* buffer) {
+            memcpy_s(buffer, sizeof(CompactParams), &compactParams, sizeof(CompactParams));
+        });
+
+    return systemIndex;
+}
+
+void GPUParticleArena::getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls, float interpolationAlpha) {
+    if (systems.empty()) {
+        return;
+    }
+
+    resourceManager.bindStorageBufferBase(particleBufferHandle, COMPACT_SOURCE_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(stateBufferHandle, COMPACT_STATES_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(compactedBufferHandle, COMPACT_DEST_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(indirectBufferHandle, COMPACT_COMMANDS_BINDING_INDEX);
+    resourceManager.bindUniformBufferBase(compactParamsBufferHandle, COMPACT_PARAMS_BINDING_INDEX);
+
+    // First, zero out every system's count...
+    unsigned int numResetGroups = ((unsigned int)systems.size() + COMPACT_GROUP_SIZE - 1) / COMPACT_GROUP_SIZE;
+    resourceManager.dispatchCompute(resetProgramHandle, numResetGroups, 1, 1);
+    resourceManager.memoryBarrier(gfx::ResourceManager::STORAGE_BARRIER);
+
+    // ...then count (and copy) the live particles. Once that's done, the
+    // vertex shader reads the copies, and the draw reads the counts.
+    unsigned int numCompactGroups = (numParticlesAllocated + COMPACT_GROUP_SIZE - 1) / COMPACT_GROUP_SIZE;
+    resourceManager.dispatchCompute(compactProgramHandle, numCompactGroups, 1, 1);
+    resourceManager.memoryBarrier(gfx::ResourceManager::STORAGE_BARRIER | gfx::ResourceManager::COMMAND_BARRIER);
+
+    ShaderParams params = {};
+    params.interpolationAlpha = interpolationAlpha;
+    resourceManager.streamDataToUniformBuffer(drawParamsBufferHandle, [&params](void* buffer) {
+            memcpy_s(buffer, sizeof(ShaderParams), &params, sizeof(ShaderParams));
+        });
+
+    gfx::DrawCall call;
+    call.mode = gfx::DrawCall::Mode::TRIANGLES;
+    call.numIndices = 0; // it's in the indirect buffer
+    call.indexType = gfx::DrawCall::IndexType::NONE;
+    call.indices = nullptr;
+    call.programHandle = drawProgramHandle;
+    call.storageBuffer = compactedBufferHandle;
+    call.vaoHandle = vaoHandle;
+    call.storageBufferBaseIndex = 0;
+    call.uniformBuffer = drawParamsBufferHandle;
+    call.uniformBufferBaseIndex = PARAMS_BINDING_INDEX;
+    call.indirectBuffer = indirectBufferHandle;
+    call.indirectOffset = 0;
+    call.indirectDrawCount = (unsigned int)systems.size();
+
+    drawCalls.push_back(call);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "DrawCall.h"
+#include "ResourceManager.h"
+
+// The GPU memory that GPU-simulated ParticleSystems (SimulationMode::GPU)
+// keep their particles in, shared between as many systems as we like.
+//
+// Each system gets its own range of particles in the arena, which it
+// updates with particle_sim.comp. Dead particles are left where they
+// are, so a system's range ends up with live and dead particles all
+// mixed together. To draw them, getDrawCalls() runs a compute pass
+// (particle_compact.comp) over the whole arena, which copies every live
+// particle to the front of its system's range in a second buffer, and
+// counts them. The counts go straight into an array of "indirect draw
+// commands" (one per system), which is a buffer that the GPU reads the
+// arguments of a draw call from. So the CPU never finds out how many
+// particles there are, and all of the systems get drawn with a single
+// multi-draw call, no matter how many of them there are.
+class GPUParticleArena {
+public:
+	struct Config {
+		unsigned int maxParticles; // for all of the systems together
+		unsigned int maxSystems;
+	};
+
+	// What addSystem() returns when there's no more room.
+	static const unsigned int INVALID_SYSTEM = 0xFFFFFFFF;
+
+	// These have the same memory layout as ParticleState in
+	// particle_sim.comp and DrawArraysIndirectCommand in OpenGL.
+	struct ParticleState {
+		glm::vec4 velocity;
+		float lifetime;
+		float maxLife; // 0 means that the particle is dead
+		unsigned int systemIndex;
+		unsigned int emitterIndex; // within its system
+
+	};
+
+	struct DrawArraysIndirectCommand {
+		unsigned int count;
+		unsigned int instanceCount;
+		unsigned int first;
+		unsigned int baseInstance;
+	};
+
+	GPUParticleArena(const Config& config);
+
+	void initGraphicsResources(gfx::ResourceManager& resourceManager);
+
+	// Hands out a range of numParticles particles to a new system.
+	// Returns the system's index, or INVALID_SYSTEM if there isn't room.
+	unsigned int addSystem(gfx::ResourceManager& resourceManager, unsigned int numParticles);
+
+	// Where a system's particles start in the arena.
+	unsigned int getParticleBase(unsigned int systemIndex) const { return systems[systemIndex].particleBase; }
+
+	// The buffers and programs that particle_sim.comp runs with.
+	gfx::ResourceManager::HBUFFER getParticleBuffer() const { return particleBufferHandle; }
+	gfx::ResourceManager::HBUFFER getStateBuffer() const { return stateBufferHandle; }
+	gfx::ResourceManager::HPROGRAM getUpdateProgram() const { return updateProgramHandle; }
+	gfx::ResourceManager::HPROGRAM getEmitProgram() const { return emitProgramHandle; }
+
+	// Compacts every system's live particles, and adds a
+	// single (indirect) draw call that draws all of them.
+	void getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls, float interpolationAlpha = 1.0f);
+
+private:
+
+	// This struct has the same memory layout as the
+	// CompactParams interface block in particle_compact.comp.
+	struct CompactParams {
+		unsigned int numParticles;
+		unsigned int numSystems;
+		unsigned int padding[2];
+	};
+
+	// Same as ParticleSystem::ShaderParams.
+	struct ShaderParams {
+		float interpolationAlpha;
+		float padding[3];
+	};
+
+	struct SystemDesc {
+		unsigned int particleBase;
+		unsigned int numParticles;
+	};
+
+	Config config;
+	std::vector<SystemDesc> systems;
+	unsigned int numParticlesAllocated = 0;
+
+	gfx::ResourceManager::HBUFFER particleBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER stateBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER compactedBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER indirectBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER compactParamsBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER drawParamsBufferHandle = 0;
+
+	gfx::ResourceManager::HPROGRAM updateProgramHandle = 0;
+	gfx::ResourceManager::HPROGRAM emitProgramHandle = 0;
+	gfx::ResourceManager::HPROGRAM resetProgramHandle = 0;
+	gfx::ResourceManager::HPROGRAM compactProgramHandle = 0;
+	gfx::ResourceManager::HPROGRAM drawProgramHandle = 0;
+	gfx::ResourceManager::HVAO vaoHandle = 0;
+};
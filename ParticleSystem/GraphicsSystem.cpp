@@ -1,24 +1,71 @@
 #include "GraphicsSystem.h"
+#include "CPUDevice.h"
+#include "CPUResourceManager.h"
+#include "CPURenderer.h"
 #include "GLDevice.h"
 #include "GLResourceManager.h"
 #include "GLRenderer.h"
+#include "NullDevice.h"
+#include "NullResourceManager.h"
+#include "NullRenderer.h"
 
 namespace gfx {
 	GraphicsSystem::GraphicsSystem(API api, const Window& window) {
 		switch (api) {
-		case OpenGL:
+		case OpenGL: {
 			_device = new GLDevice(window.getHandle());
 			GLResourceManager* glResourceManager = new GLResourceManager();
 			_resourceManager = glResourceManager;
 			_renderer = new GLRenderer(*glResourceManager);
 			break;
 		}
+		case Software:
+			// Nothing is shown in the window, but we still draw 
+			// a frame that is the same size as it.
+			initSoftware(window.getClientWidth(), window.getClientHeight());
+			break;
+		case Null:
+			initNull();
+			break;
+		}
+	}
+
+	GraphicsSystem::GraphicsSystem(API api, int width, int height) {
+		switch (api) {
+		case Software:
+			initSoftware(width, height);
+			break;
+		case Null:
+			initNull();
+			break;
+		case OpenGL:
+			// OpenGL needs a window to draw to, so we leave everything 
+			// null, and isValid() says so.
+			break;
+		}
+	}
+
+	void GraphicsSystem::initSoftware(int width, int height) {
+		CPUDevice* cpuDevice = new CPUDevice(width, height);
+		CPUResourceManager* cpuResourceManager = new CPUResourceManager();
+		_device = cpuDevice;
+		_resourceManager = cpuResourceManager;
+		_renderer = new CPURenderer(*cpuResourceManager, *cpuDevice);
+	}
+
+	void GraphicsSystem::initNull() {
+		NullDevice* nullDevice = new NullDevice();
+		_device = nullDevice;
+		_resourceManager = new NullResourceManager(nullDevice->getRecorder());
+		_renderer = new NullRenderer(nullDevice->getRecorder());
 	}
 
 	GraphicsSystem::~GraphicsSystem() {
-		if (_device != nullptr) {
-			delete _device;
-			_device = nullptr;		
+		// The renderer uses the resource manager (and the resource 
+		// manager uses the device), so we delete them in reverse order.
+		if (_renderer != nullptr) {
+			delete _renderer;
+			_renderer = nullptr;
 		}
 
 		if (_resourceManager != nullptr) {
@@ -26,9 +73,9 @@ namespace gfx {
 			_resourceManager = nullptr;
 		}
 
-		if (_renderer != nullptr) {
-			delete _renderer;
-			_renderer = nullptr;
+		if (_device != nullptr) {
+			delete _device;
+			_device = nullptr;		
 		}
 	}
 }
\ No newline at end of file
@@ -10,19 +10,38 @@ namespace gfx {
 	class GraphicsSystem {
 	public:
 		enum API {
-			OpenGL // The only supported API at the moment.
+			OpenGL,  // Draws to a window, using the GPU.
+			Software, // Draws to an off-screen framebuffer, using only the CPU.
+			Null      // Doesn't draw anything, just counts (and optionally logs) commands.
 		};
 
+		// Creates a GraphicsSystem that draws to a window.
 		GraphicsSystem(API api, const Window& window);
+
+		// Creates a GraphicsSystem that draws to an off-screen framebuffer 
+		// of the given size, without any window (e.g. for benchmarks and 
+		// image comparison tests on machines that don't have a GPU). 
+		// Only for Software and Null: OpenGL needs a window, so asking for 
+		// it here leaves us without anything to draw with (see isValid()).
+		GraphicsSystem(API api, int width, int height);
+
 		~GraphicsSystem();
 
+		// False if there's nothing to draw with, because the API can't be 
+		// used the way it was asked for. None of the functions below can 
+		// be called then.
+		bool isValid() const { return _device != nullptr; }
+
 		Device& device() { return *_device; }
 		ResourceManager& resourceManager() { return *_resourceManager; }
 		Renderer& renderer() { return *_renderer; }
 
 	private:
-		Device* _device;
-		ResourceManager* _resourceManager;
-		Renderer* _renderer;
+		Device* _device = nullptr;
+		ResourceManager* _resourceManager = nullptr;
+		Renderer* _renderer = nullptr;
+
+		void initSoftware(int width, int height);
+		void initNull();
 	};
 }
\ No newline at end of file
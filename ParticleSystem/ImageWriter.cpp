@@ -0,0 +1,228 @@
+#include "ImageWriter.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// The CRC that PNG uses to check each chunk.
+static uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+	static uint32_t table[256];
+	static bool tableInitialized = false;
+	if (!tableInitialized) {
+		for (uint32_t n = 0; n < 256; ++n) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		tableInitialized = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; ++i) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// Writes the bits of a Deflate stream, lowest bit first.
+class BitWriter {
+public:
+	std::vector<unsigned char> bytes;
+
+	void writeBits(uint32_t value, int numBits) {
+		bitBuffer |= (uint64_t)value << bitCount;
+		bitCount += numBits;
+		while (bitCount >= 8) {
+			bytes.push_back((unsigned char)bitBuffer);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	// Huffman codes are the one thing in Deflate that is
+	// written highest bit first, so they need reversing.
+	void writeCode(uint32_t code, int numBits) {
+		uint32_t reversed = 0;
+		for (int i = 0; i < numBits; ++i) {
+			reversed |= ((code >> i) & 1) << (numBits - 1 - i);
+		}
+		writeBits(reversed, numBits);
+	}
+
+	void flush() {
+		if (bitCount > 0) {
+			bytes.push_back((unsigned char)bitBuffer);
+		}
+		bitBuffer = 0;
+		bitCount = 0;
+	}
+
+private:
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+};
+
+// Writes a literal/length symbol using Deflate's fixed Huffman codes.
+static void writeFixedSymbol(BitWriter& bits, int symbol) {
+	if (symbol < 144) {
+		bits.writeCode(0x30 + symbol, 8);
+	}
+	else if (symbol < 256) {
+		bits.writeCode(0x190 + (symbol - 144), 9);
+	}
+	else if (symbol < 280) {
+		bits.writeCode(symbol - 256, 7);
+	}
+	else {
+		bits.writeCode(0xc0 + (symbol - 280), 8);
+	}
+}
+
+// Writes "repeat the previous byte length times" (3 <= length <= 258).
+static void writeRepeat(BitWriter& bits, int length) {
+	static const int baseLengths[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const int extraBits[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+
+	int code = 28;
+	while (baseLengths[code] > length) {
+		--code;
+	}
+
+	writeFixedSymbol(bits, 257 + code);
+	bits.writeBits(length - baseLengths[code], extraBits[code]);
+
+	// Distance code 0 (a distance of 1 byte), which is 5 zero bits.
+	bits.writeCode(0, 5);
+}
+
+// Compresses data into a zlib stream, using a single fixed-Huffman block
+// where the only kind of match is a run of the same byte.
+static std::vector<unsigned char> compress(const std::vector<unsigned char>& data) {
+	BitWriter bits;
+
+	// zlib header: deflate, 32K window, no dictionary, fastest.
+	bits.writeBits(0x78, 8);
+	bits.writeBits(0x01, 8);
+
+	// BFINAL = 1, BTYPE = 01 (fixed Huffman codes).
+	bits.writeBits(1, 1);
+	bits.writeBits(1, 2);
+
+	size_t i = 0;
+	while (i < data.size()) {
+		unsigned char value = data[i];
+		writeFixedSymbol(bits, value);
+
+		size_t runEnd = i + 1;
+		while (runEnd < data.size() && data[runEnd] == value) {
+			++runEnd;
+		}
+
+		size_t numRepeats = runEnd - i - 1;
+		while (numRepeats >= 3) {
+			int length = numRepeats > 258 ? 258 : (int)numRepeats;
+			writeRepeat(bits, length);
+			numRepeats -= length;
+		}
+
+		while (numRepeats > 0) {
+			writeFixedSymbol(bits, value);
+			--numRepeats;
+		}
+
+		i = runEnd;
+	}
+
+	// End of block.
+	writeFixedSymbol(bits, 256);
+	bits.flush();
+
+	// zlib ends with the Adler-32 checksum of the uncompressed data.
+	uint32_t a = 1, b = 0;
+	for (size_t j = 0; j < data.size(); ++j) {
+		a = (a + data[j]) % 65521;
+		b = (b + a) % 65521;
+	}
+	uint32_t adler = (b << 16) | a;
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		bits.bytes.push_back((unsigned char)(adler >> shift));
+	}
+
+	return bits.bytes;
+}
+
+static void writeChunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data) {
+	std::vector<unsigned char> chunk(4 + data.size());
+	memcpy(chunk.data(), type, 4);
+	if (!data.empty()) {
+		memcpy(chunk.data() + 4, data.data(), data.size());
+	}
+
+	uint32_t length = (uint32_t)data.size();
+	uint32_t crc = crc32(chunk.data(), chunk.size());
+	unsigned char lengthBytes[4] = { (unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length };
+	unsigned char crcBytes[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+
+	file.write((const char*)lengthBytes, 4);
+	file.write((const char*)chunk.data(), chunk.size());
+	file.write((const char*)crcBytes, 4);
+}
+
+bool writePNG(const char* filename, const unsigned char* rgba, int width, int height) {
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	file.write((const char*)signature, sizeof(signature));
+
+	// 8 bits per channel, color type 6 (RGBA), no interlacing.
+	std::vector<unsigned char> header = {
+		(unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+		(unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+		8, 6, 0, 0, 0
+	};
+	writeChunk(file, "IHDR", header);
+
+	// PNG wants the top row first, and every row starts with
+	// a byte that says which filter it uses (1 = "Sub").
+	size_t rowSize = (size_t)width * 4;
+	std::vector<unsigned char> filtered((rowSize + 1) * height);
+	for (int row = 0; row < height; ++row) {
+		const unsigned char* src = rgba + (size_t)(height - 1 - row) * rowSize;
+		unsigned char* dst = &filtered[row * (rowSize + 1)];
+		dst[0] = 1;
+		for (size_t i = 0; i < rowSize; ++i) {
+			unsigned char left = i >= 4 ? src[i - 4] : 0;
+			dst[i + 1] = (unsigned char)(src[i] - left);
+		}
+	}
+	writeChunk(file, "IDAT", compress(filtered));
+	writeChunk(file, "IEND", std::vector<unsigned char>());
+
+	return file.good();
+}
+
+bool writeRawRGBA(const char* filename, const unsigned char* rgba, int width, int height) {
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	size_t rowSize = (size_t)width * 4;
+	for (int row = height - 1; row >= 0; --row) {
+		file.write((const char*)rgba + row * rowSize, rowSize);
+	}
+
+	return file.good();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Functions for saving images to disk.
+//
+// The pixels are tightly-packed 8-bit RGBA, with the bottom row first 
+// (the way OpenGL hands them to us). Both functions return false if the 
+// file couldn't be written.
+
+// Saves a PNG file. There's no zlib here, so the compression is very 
+// basic: each row is stored as the difference from the pixel to its left 
+// (PNG's "Sub" filter), and then runs of repeated bytes are squashed. 
+// That does a good job on our frames, which are mostly flat background.
+bool writePNG(const char* filename, const unsigned char* rgba, int width, int height);
+
+// Saves the pixels exactly as they are, with no header, top row first.
+bool writeRawRGBA(const char* filename, const unsigned char* rgba, int width, int height);
@@ -0,0 +1,71 @@
+#include "LifetimeCurves.h"
+
+#include <algorithm>
+#include <vector>
+
+static float ease(EmitterDesc::Easing easing, float u) {
+    switch (easing) {
+    case EmitterDesc::Easing::EASE_IN:  return u * u;
+    case EmitterDesc::Easing::EASE_OUT: return 1.0f - (1.0f - u) * (1.0f - u);
+    case EmitterDesc::Easing::SMOOTH:   return u * u * (3.0f - 2.0f * u);
+    case EmitterDesc::Easing::STEP:     return u < 1.0f ? 0.0f : 1.0f;
+    default:                            return u;
+    }
+}
+
+// Fills in table with the curve through keys. Before the first key, the
+// curve is flat at the first key's value, and after the last one it's
+// flat at the last one's value.
+template <typename Key, typename Value, typename GetValue>
+static void bakeCurve(std::vector<Key> keys, Value* table, GetValue getValue) {
+    // The keys are supposed to be in order already, but just in case...
+    std::stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.time < b.time; });
+
+    size_t nextKey = 0;
+    for (unsigned int i = 0; i < LIFETIME_CURVE_SIZE; ++i) {
+        float t = (float)i / (LIFETIME_CURVE_SIZE - 1);
+        while (nextKey < keys.size() && keys[nextKey].time <= t) {
+            ++nextKey;
+        }
+
+        if (nextKey == 0) {
+            table[i] = getValue(keys.front());
+        }
+        else if (nextKey == keys.size()) {
+            table[i] = getValue(keys.back());
+        }
+        else {
+            const Key& from = keys[nextKey - 1];
+            const Key& to = keys[nextKey];
+            float u = (t - from.time) / (to.time - from.time);
+            table[i] = glm::mix(getValue(from), getValue(to), ease(from.easing, u));
+        }
+    }
+}
+
+void bakeLifetimeCurves(const EmitterDesc& emitter, LifetimeCurves& curves) {
+    // Without any keys, we make some out of the start, mid and end
+    // colors, and the start and end sizes.
+    std::vector<EmitterDesc::ColorKey> colorKeys(emitter.colorKeys, emitter.colorKeys + emitter.numColorKeys);
+    if (colorKeys.empty()) {
+        colorKeys.resize(3);
+        colorKeys[0].time = 0.0f;
+        colorKeys[0].color = emitter.particleStartColor;
+        colorKeys[1].time = 0.5f;
+        colorKeys[1].color = emitter.particleMidColor;
+        colorKeys[2].time = 1.0f;
+        colorKeys[2].color = emitter.particleEndColor;
+    }
+
+    std::vector<EmitterDesc::SizeKey> sizeKeys(emitter.sizeKeys, emitter.sizeKeys + emitter.numSizeKeys);
+    if (sizeKeys.empty()) {
+        sizeKeys.resize(2);
+        sizeKeys[0].time = 0.0f;
+        sizeKeys[0].size = emitter.particleStartSize;
+        sizeKeys[1].time = 1.0f;
+        sizeKeys[1].size = emitter.particleEndSize;
+    }
+
+    bakeCurve(colorKeys, curves.colors, [](const EmitterDesc::ColorKey& key) { return key.color; });
+    bakeCurve(sizeKeys, curves.sizes, [](const EmitterDesc::SizeKey& key) { return key.size; });
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "EmitterDesc.h"
+
+// An emitter's color and size curves, "baked" into lookup tables. Each
+// table has the value of the curve at LIFETIME_CURVE_SIZE evenly spaced
+// points in the particle's life, so finding a particle's color or size
+// is a single array lookup, no matter how many keys the curve has or
+// how they're eased.
+//
+// This has the same memory layout as LifetimeCurves in particle_sim.comp
+// (std430), so the GPU simulation can use the very same tables.
+#define LIFETIME_CURVE_SIZE 256
+
+struct LifetimeCurves {
+	glm::vec4 colors[LIFETIME_CURVE_SIZE];
+	float sizes[LIFETIME_CURVE_SIZE];
+
+	// t is the fraction of the particle's life that it has lived.
+	static unsigned int getIndex(float t) {
+		float index = t * (LIFETIME_CURVE_SIZE - 1) + 0.5f;
+		return index <= 0.0f ? 0 : index >= LIFETIME_CURVE_SIZE - 1 ? LIFETIME_CURVE_SIZE - 1 : (unsigned int)index;
+	}
+};
+
+void bakeLifetimeCurves(const EmitterDesc& emitter, LifetimeCurves& curves);
@@ -0,0 +1,11 @@
+#include "NullDevice.h"
+
+namespace gfx {
+
+	void NullDevice::makeCurrent() {
+	}
+
+	void NullDevice::swapBuffers() {
+		recorder.recordEndFrame();
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CommandRecorder.h"
+#include "Device.h"
+
+namespace gfx {
+
+	// A Device that doesn't draw anything at all. It's one third of the 
+	// "Null" backend (along with NullResourceManager and NullRenderer), 
+	// which takes every command the app sends it, counts it and throws 
+	// it away. That lets us measure what the app itself costs on the 
+	// CPU, without any driver or GPU time mixed in.
+	//
+	// The device owns the CommandRecorder that the other two report into, 
+	// since it is the first thing created and the last thing destroyed.
+	class NullDevice : public Device {
+	public:
+		// Nothing to make current.
+		void makeCurrent();
+
+		// Marks the end of a frame.
+		void swapBuffers();
+
+		CommandRecorder& getRecorder() { return recorder; }
+
+	private:
+		CommandRecorder recorder;
+	};
+}
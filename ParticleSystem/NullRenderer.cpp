@@ -0,0 +1,21 @@
+#include "NullRenderer.h"
+
+namespace gfx {
+
+	NullRenderer::NullRenderer(CommandRecorder& recorder) : recorder(recorder) {
+	}
+
+	void NullRenderer::clear(const ClearOptions& clearOptions) {
+		recorder.recordClear(clearOptions.clearColor, clearOptions.clearDepth, clearOptions.clearStencil);
+	}
+
+	void NullRenderer::setupCamera(const Camera& camera, const Viewport& viewport) {
+		recorder.recordSetupCamera(viewport.width, viewport.height);
+	}
+
+	void NullRenderer::draw(const std::vector<DrawCall> drawCalls) {
+		for (size_t i = 0; i < drawCalls.size(); i++) {
+			recorder.recordDraw(drawCalls[i]);
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "Camera.h"
+#include "ClearOptions.h"
+#include "CommandRecorder.h"
+#include "DrawCall.h"
+#include "Renderer.h"
+#include "Viewport.h"
+
+namespace gfx {
+
+	// A Renderer that records every command it is given in a 
+	// CommandRecorder, and doesn't draw anything.
+	class NullRenderer : public Renderer {
+	public:
+		NullRenderer(CommandRecorder& recorder);
+
+		void clear(const ClearOptions& clearOptions);
+		void setupCamera(const Camera& camera, const Viewport& viewport);
+		void draw(const std::vector<DrawCall> drawCalls);
+
+	private:
+		CommandRecorder& recorder;
+	};
+}
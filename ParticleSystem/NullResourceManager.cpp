@@ -0,0 +1,93 @@
+#include "NullResourceManager.h"
+
+#include <cstring>
+
+namespace gfx {
+
+	NullResourceManager::NullResourceManager(CommandRecorder& recorder) : recorder(recorder) {
+	}
+
+	ResourceManager::HPROGRAM NullResourceManager::createProgramFromSource(const ShaderSource* shaders, unsigned int numShaders) {
+		HPROGRAM handle = nextHandle++;
+		recorder.recordCreate(CommandRecorder::CREATE_PROGRAM, handle, numShaders);
+		return handle;
+	}
+
+	void NullResourceManager::deleteProgram(HPROGRAM programHandle) {
+		recorder.recordDelete(CommandRecorder::DELETE_PROGRAM, programHandle);
+	}
+
+	ResourceManager::HBUFFER NullResourceManager::createStreamingUniformBuffer(unsigned int initialDataSize, unsigned char* initialData) {
+		return createBuffer(initialDataSize, initialData);
+	}
+
+	void NullResourceManager::streamDataToUniformBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) {
+		streamDataToBuffer(bufferHandle, bufferCallback);
+	}
+
+	ResourceManager::HBUFFER NullResourceManager::createStreamingStorageBuffer(unsigned int initialDataSize, unsigned char* initialData) {
+		return createBuffer(initialDataSize, initialData);
+	}
+
+	void NullResourceManager::streamDataToStorageBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) {
+		streamDataToBuffer(bufferHandle, bufferCallback);
+	}
+
+	void NullResourceManager::updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data) {
+		std::map<HBUFFER, std::vector<unsigned char>>::iterator itr = buffers.find(bufferHandle);
+		if (itr != buffers.end() && (size_t)offset + size <= itr->second.size()) {
+			memcpy(itr->second.data() + offset, data, size);
+			recorder.recordStreamBuffer(bufferHandle, size);
+		}
+	}
+
+	ResourceManager::HBUFFER NullResourceManager::createStorageBuffer(unsigned int size, const void* initialData) {
+		return createBuffer(size, initialData);
+	}
+
+	void NullResourceManager::dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ) {
+		recorder.recordDispatch(programHandle, numGroupsX, numGroupsY, numGroupsZ);
+	}
+
+	void NullResourceManager::memoryBarrier(unsigned int barriers) {
+		recorder.recordMemoryBarrier(barriers);
+	}
+
+	void NullResourceManager::deleteBuffer(HBUFFER bufferHandle) {
+		if (buffers.erase(bufferHandle) > 0) {
+			recorder.recordDelete(CommandRecorder::DELETE_BUFFER, bufferHandle);
+		}
+	}
+
+	ResourceManager::HVAO NullResourceManager::createVAO(const VAOConfig& config) {
+		HVAO handle = nextHandle++;
+		recorder.recordCreate(CommandRecorder::CREATE_VAO, handle, config.indexBufferSizeBytes);
+		return handle;
+	}
+
+	void NullResourceManager::deleteVAO(HVAO vaoHandle) {
+		recorder.recordDelete(CommandRecorder::DELETE_VAO, vaoHandle);
+	}
+
+	ResourceManager::HBUFFER NullResourceManager::createBuffer(unsigned int initialDataSize, const void* initialData) {
+		std::vector<unsigned char> data(initialDataSize, 0);
+		if (initialData != nullptr) {
+			memcpy(data.data(), initialData, initialDataSize);
+		}
+
+		HBUFFER handle = nextHandle++;
+		buffers.emplace(handle, std::move(data));
+		recorder.recordCreate(CommandRecorder::CREATE_BUFFER, handle, initialDataSize);
+		return handle;
+	}
+
+	void NullResourceManager::streamDataToBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) {
+		std::map<HBUFFER, std::vector<unsigned char>>::iterator itr = buffers.find(bufferHandle);
+		if (itr != buffers.end()) {
+			// Just like GLResourceManager, the whole buffer 
+			// is re-specified every time it is streamed.
+			bufferCallback(itr->second.data());
+			recorder.recordStreamBuffer(bufferHandle, (unsigned int)itr->second.size());
+		}
+	}
+}
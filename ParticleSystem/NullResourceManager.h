@@ -0,0 +1,63 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "CommandRecorder.h"
+#include "ResourceManager.h"
+
+namespace gfx {
+
+	/**
+	 * A ResourceManager that hands out handles and records what was 
+	 * asked of it, but doesn't create any real graphics resources.
+	 * 
+	 * Buffers are still backed by real system memory, though. When 
+	 * somebody streams data into a buffer, their callback gets a block 
+	 * of memory that's the full size of the buffer to write into, so the 
+	 * cost of packing the data is still measured, just not the cost of 
+	 * sending it anywhere.
+	 */
+	class NullResourceManager : public ResourceManager {
+	public:
+		NullResourceManager(CommandRecorder& recorder);
+
+		// Shader Programs
+		HPROGRAM createProgramFromSource(const ShaderSource* shaders, unsigned int numShaders);
+		void deleteProgram(HPROGRAM programHandle);
+
+		// Buffers
+		HBUFFER createStreamingUniformBuffer(unsigned int initialDataSize, unsigned char* initialData);
+		void streamDataToUniformBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+
+		HBUFFER createStreamingStorageBuffer(unsigned int initialDataSize, unsigned char* initialData);
+		void streamDataToStorageBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+		void updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data);
+
+		HBUFFER createStorageBuffer(unsigned int size, const void* initialData);
+
+		void deleteBuffer(HBUFFER bufferHandle);
+
+		void bindUniformBufferBase(HBUFFER bufferHandle, unsigned int index) {}
+		void bindStorageBufferBase(HBUFFER bufferHandle, unsigned int index) {}
+
+		// Compute
+		void dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ);
+		void memoryBarrier(unsigned int barriers);
+
+		// VAOs
+		HVAO createVAO(const VAOConfig& config);
+		void deleteVAO(HVAO vaoHandle);
+
+	private:
+		CommandRecorder& recorder;
+
+		std::map<HBUFFER, std::vector<unsigned char>> buffers;
+
+		// Handle 0 means "no resource", so we start at 1.
+		unsigned int nextHandle = 1;
+
+		HBUFFER createBuffer(unsigned int initialDataSize, const void* initialData);
+		void streamDataToBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback);
+	};
+}
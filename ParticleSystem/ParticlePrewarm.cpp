@@ -0,0 +1,264 @@
+#include "ParticlePrewarm.h"
+#include "ParticleSystem.h"
+#include "Utils.h"
+
+#include <cmath>
+
+#define PREWARM_STEPS_PER_SECOND 60.0 // how often prewarm() pretends that update() was called
+#define PREWARM_SMALL_BOUNCE_STEPS 16 // how short (in updates) a particle's bounces have to be for prewarm() to skip to its last one
+
+// The fraction of an emitter's particles that live for longer than age.
+static double getFractionAlive(const EmitterDesc& emitter, double age) {
+    if (age < emitter.particleMinLifetime) {
+        return 1.0;
+    }
+    if (age >= emitter.particleMaxLifetime) {
+        return 0.0;
+    }
+    return (emitter.particleMaxLifetime - age) / (emitter.particleMaxLifetime - emitter.particleMinLifetime);
+}
+
+// Rather than running update() over and over, this works out which 
+// particles would be alive at the end, and where each one would be.
+//
+// Only the last particleMaxLifetime of emitting can have left anything 
+// alive, so that's all that gets looked at. The particles from any one 
+// of those updates that are still alive are the ones with a 
+// particleMaxLifetime longer than their age (see getFractionAlive()), 
+// so that's how many each update gets, and they get one of those 
+// lifetimes, rather than picking them at random and throwing away the 
+// ones that would have died. They get started off by the emitter as it 
+// was during that update, and then moved along by however many updates 
+// they would have had since.
+//
+// The kernels' gravity and drag just multiply the velocity by 
+// (1 - drag * deltaT), and add to it, every update, so after n updates, 
+// the velocity (and how far it's gone) are sums of geometric series, 
+// that only depend on n (see PrewarmStep). Those get worked out once 
+// for each emitter, which makes moving a particle on by any number of 
+// updates only a couple of multiplies and adds, and puts it where 
+// update() would have (give or take some rounding). Only the particles 
+// that would have hit the floor need any more than that.
+//
+// They're set up a chunk's worth at a time, and go straight into the 
+// chunks (see addParticles()) once they're finished with.
+void ParticleSystem::prewarm(double seconds) {
+    if (config.simulationMode == SimulationMode::GPU || seconds <= 0.0) {
+        return;
+    }
+    removeAllParticles();
+
+    // As close to PREWARM_STEPS_PER_SECOND as we can get, 
+    // with a whole number of updates.
+    unsigned int numSteps = (unsigned int)ceil(seconds * PREWARM_STEPS_PER_SECOND);
+    double deltaT = seconds / numSteps;
+
+    // How many of each emitter's particles would be alive at the end, 
+    // out of the ones from the updates that could have left any. If 
+    // there isn't room for them all, they all get cut back by the same 
+    // fraction (like they would have been by update()).
+    std::vector<unsigned int> numWindowSteps(emitters.size());
+    double totalAlive = 0.0;
+    for (unsigned int emitterIndex = 0; emitterIndex < emitters.size(); ++emitterIndex) {
+        const EmitterDesc& emitter = emitters[emitterIndex];
+        double windowSteps = emitter.particleMaxLifetime > 0.0f ? ceil(emitter.particleMaxLifetime / deltaT) : 0.0;
+        numWindowSteps[emitterIndex] = windowSteps < numSteps ? (unsigned int)windowSteps : numSteps;
+        double numAlive = 0.0;
+        for (unsigned int step = 0; step < numWindowSteps[emitterIndex]; ++step) {
+            numAlive += getFractionAlive(emitter, step * deltaT);
+        }
+        totalAlive += numAlive * emitter.particlesPerSecond * deltaT;
+    }
+    double room = (double)getNumFreeParticles();
+    double scale = totalAlive > room ? room / totalAlive : 1.0;
+
+    std::vector<PrewarmStep> steps;
+    std::vector<Particle> batch;
+    std::vector<Particle*> batchParticles;
+    std::vector<unsigned int> batchSteps;
+    batch.reserve(PARTICLES_PER_CHUNK);
+    batchSteps.reserve(PARTICLES_PER_CHUNK);
+    for (unsigned int emitterIndex = 0; emitterIndex < emitters.size(); ++emitterIndex) {
+        const EmitterDesc& emitter = emitters[emitterIndex];
+        const LifetimeCurves& curves = emitterCurves[emitterIndex];
+        unsigned int windowSteps = numWindowSteps[emitterIndex];
+
+        // Gravity and drag, for every number of updates.
+        const float g = -9.8f; // as in ParticleUpdateKernels
+        double gravity = (emitter.features & EmitterDesc::GRAVITY) != 0 ? g * deltaT : 0.0;
+        double damping = (emitter.features & EmitterDesc::DRAG) != 0 ? glm::max(0.0, 1.0 - emitter.drag * deltaT) : 1.0;
+        double velocityScale = 1.0;
+        double positionScale = 0.0;
+        double gravityVelocity = 0.0;
+        double gravityPosition = 0.0;
+        double bounceGain = 0.0;
+        steps.resize(windowSteps);
+        for (unsigned int step = 0; step < windowSteps; ++step) {
+            steps[step].velocityScale = (float)velocityScale;
+            steps[step].positionScale = (float)positionScale;
+            steps[step].gravityVelocity = (float)gravityVelocity;
+            steps[step].gravityPosition = (float)gravityPosition;
+            steps[step].bounceGain = (float)bounceGain;
+            gravityVelocity = (gravityVelocity + gravity) * damping;
+            velocityScale *= damping;
+            positionScale += velocityScale * deltaT;
+            gravityPosition += gravityVelocity * deltaT;
+            bounceGain = bounceGain * damping * damping + 0.5 * gravity * gravity;
+        }
+
+        // How many updates it'll be before a particle goes under the 
+        // floor (or maxSteps, if it won't have by then). Without drag, 
+        // how high it is after n of them is y + (vy * deltaT + a) * n + 
+        // a * n^2 (with this a), so that's where we start looking, and 
+        // drag only moves it by a few updates from there.
+        float a = (float)(0.5 * gravity * deltaT);
+        auto getStepsToFloor = [&](const glm::vec3& position, const glm::vec3& velocity, unsigned int maxSteps) {
+            float b = velocity.y * (float)deltaT + a;
+            float under = (float)maxSteps;
+            if (a < 0.0f) {
+                under = (-b - sqrtf(glm::max(b * b - 4.0f * a * position.y, 0.0f))) / (2.0f * a);
+            }
+            else if (b < 0.0f) {
+                under = position.y / -b;
+            }
+            unsigned int stepsToFloor = under < 1.0f ? 1 : under < (float)maxSteps ? (unsigned int)under + 1 : maxSteps;
+            while (stepsToFloor > 1 && steps[stepsToFloor - 1].getY(position, velocity) < 0.0f) {
+                --stepsToFloor;
+            }
+            while (stepsToFloor < maxSteps && steps[stepsToFloor].getY(position, velocity) >= 0.0f) {
+                ++stepsToFloor;
+            }
+            return stepsToFloor;
+        };
+
+        const ParticleScript* spawnScript = emitterSpawnScripts[emitterIndex];
+        auto finishBatch = [&]() {
+            // The spawn script gets the particles when they've just been 
+            // emitted, like it always does.
+            if (spawnScript != nullptr && !batch.empty()) {
+                batchParticles.resize(batch.size());
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    batchParticles[i] = &batch[i];
+                }
+                spawnScript->run(batchParticles.data(), (unsigned int)batch.size(), (float)deltaT, scriptRandomState);
+            }
+
+            for (size_t i = 0; i < batch.size(); ++i) {
+                Particle& particle = batch[i];
+                unsigned int stepsLeft = batchSteps[i];
+
+                glm::vec3 position = glm::vec3(particle.position);
+                glm::vec3 velocity = particle.velocity;
+                if ((emitter.features & EmitterDesc::FLOOR_COLLISION) == 0) {
+                    steps[stepsLeft].apply(position, velocity);
+                }
+                else {
+                    // Its y velocity only ever changes direction once (at 
+                    // the top of its arc), so if it's above the floor at 
+                    // both ends, it can't have gone under it in between. 
+                    // Otherwise, once it's under, it stays under, so we 
+                    // find the update where it went under, bounce it there 
+                    // like its kernel would have, and carry on from there.
+                    //
+                    // Once it's bouncing off of the floor in little hops, 
+                    // it'd take far too many of them to get to the end, 
+                    // so it skips to the last one. Drag takes some of its 
+                    // speed away, and landing part way through an update 
+                    // (and being put back above the floor) gives some 
+                    // back, so the hops settle down to a size that only 
+                    // depends on the emitter's drag (see PrewarmStep), and 
+                    // a particle that's resting on the floor just hops an 
+                    // update or two at a time. Where it is in the last one 
+                    // is as good as random, by then.
+                    unsigned int stepsToGo = stepsLeft;
+                    bool bounced = false;
+                    while (stepsToGo > 0) {
+                        if (steps[stepsToGo].getY(position, velocity) >= 0.0f) {
+                            steps[stepsToGo].apply(position, velocity);
+                            break;
+                        }
+                        unsigned int stepsToFloor = getStepsToFloor(position, velocity, stepsToGo);
+
+                        if (bounced && stepsToFloor <= PREWARM_SMALL_BOUNCE_STEPS) {
+                            const PrewarmStep& step = steps[stepsToGo];
+                            float speedSquared = velocity.y * velocity.y * step.velocityScale * step.velocityScale + step.bounceGain;
+                            glm::vec3 hopPosition(0.0f);
+                            glm::vec3 hopVelocity(0.0f, sqrtf(speedSquared), 0.0f);
+                            unsigned int hopSteps = getStepsToFloor(hopPosition, hopVelocity, windowSteps - 1);
+                            unsigned int hopStep = (unsigned int)randomFloat(0.0f, (float)hopSteps);
+                            steps[hopStep < hopSteps ? hopStep : hopSteps - 1].apply(hopPosition, hopVelocity);
+
+                            step.apply(position, velocity);
+                            position.y = hopPosition.y;
+                            velocity.y = hopVelocity.y;
+                            break;
+                        }
+
+                        steps[stepsToFloor].apply(position, velocity);
+                        position.y = -position.y;
+                        velocity.y = -velocity.y;
+                        stepsToGo -= stepsToFloor;
+                        bounced = true;
+                    }
+                }
+
+                particle.position = glm::vec4(position, 1.0f);
+                particle.prevPosition = glm::vec4(position - velocity * (float)deltaT, 1.0f);
+                particle.velocity = velocity;
+                particle.lifetime = (float)(stepsLeft * deltaT);
+                if (!(particle.lifetime < particle.maxLife)) {
+                    particle.maxLife = nextafterf(particle.lifetime, emitter.particleMaxLifetime + 1.0f);
+                }
+                if ((emitter.features & (EmitterDesc::COLOR_CURVE | EmitterDesc::SIZE_CURVE)) != 0) {
+                    unsigned int curveIndex = LifetimeCurves::getIndex(particle.lifetime / particle.maxLife);
+                    if ((emitter.features & EmitterDesc::COLOR_CURVE) != 0) {
+                        particle.color = curves.colors[curveIndex];
+                    }
+                    if ((emitter.features & EmitterDesc::SIZE_CURVE) != 0) {
+                        particle.size = curves.sizes[curveIndex];
+                    }
+                }
+            }
+
+            addParticles(batch.data(), (unsigned int)batch.size());
+            batch.clear();
+            batchSteps.clear();
+        };
+
+        // The emitter has to go through every update anyway (it might 
+        // be on a path), and it emits during the ones that its 
+        // particles could still be alive from, like it would have then. 
+        // Any fraction of a particle is carried over to the next update.
+        const EmitterMesh* mesh = emitterMeshes[emitterIndex];
+        double particlesPerStep = emitter.particlesPerSecond * deltaT * scale;
+        double particlesDue = 0.0;
+        for (unsigned int step = 0; step < numSteps; ++step) {
+            updateEmitter(emitterIndex, deltaT);
+            unsigned int stepsLeft = numSteps - 1 - step;
+            if (stepsLeft >= windowSteps) {
+                continue;
+            }
+
+            double age = stepsLeft * deltaT;
+            particlesDue += particlesPerStep * getFractionAlive(emitter, age);
+            int numToEmit = (int)particlesDue;
+            particlesDue -= numToEmit;
+            if (mesh != nullptr && numToEmit > 0) {
+                surfacePoints.resize(numToEmit);
+                mesh->sampleSurface((unsigned int)numToEmit, surfaceRandomState, surfacePoints.data());
+            }
+
+            // Only the ones that live for longer than 
+            // they would have by now are still alive.
+            for (int i = 0; i < numToEmit; ++i) {
+                batch.emplace_back();
+                emitParticle(batch.back(), emitterIndex, deltaT, mesh != nullptr ? &surfacePoints[i] : nullptr, (float)age);
+                batchSteps.push_back(stepsLeft);
+                if (batch.size() == PARTICLES_PER_CHUNK) {
+                    finishBatch();
+                }
+            }
+        }
+        finishBatch();
+    }
+}
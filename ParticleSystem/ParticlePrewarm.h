@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// How far gravity and drag move a particle in some number of updates 
+// (see ParticleSystem::prewarm()). Its velocity gets multiplied by 
+// velocityScale, and it moves by its starting velocity times 
+// positionScale, and then gravity adds to its y velocity and y. A 
+// particle that's bouncing off of the floor the whole time has its 
+// speed (squared) at the bottom of its bounces multiplied by 
+// velocityScale twice, and bounceGain added on.
+struct PrewarmStep {
+	float velocityScale;
+	float positionScale;
+	float gravityVelocity;
+	float gravityPosition;
+	float bounceGain;
+
+	void apply(glm::vec3& position, glm::vec3& velocity) const {
+		position += velocity * positionScale;
+		position.y += gravityPosition;
+		velocity *= velocityScale;
+		velocity.y += gravityVelocity;
+	}
+
+	float getY(const glm::vec3& position, const glm::vec3& velocity) const {
+		return position.y + velocity.y * positionScale + gravityPosition;
+	}
+};
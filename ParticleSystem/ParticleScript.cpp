@@ -0,0 +1,801 @@
+#include "ParticleScript.h"
+#include "Utils.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+// While it's compiling, the compiler has as many registers as it likes,
+// with these numbers. The attributes and dt keep their own numbers. Every
+// constant gets one, and so does every result (including each new value
+// of a variable, so nothing but an attribute is ever written twice).
+// Once the optimizer's done, they're all packed down into real registers.
+#define CONSTANT_BASE 0x10000u
+#define TEMPORARY_BASE 0x20000u
+
+static bool isConstantRegister(unsigned int reg) { return reg >= CONSTANT_BASE && reg < TEMPORARY_BASE; }
+static bool isTemporaryRegister(unsigned int reg) { return reg >= TEMPORARY_BASE; }
+static bool isAttributeRegister(unsigned int reg) { return reg < ParticleScript::NUM_ATTRIBUTES; }
+
+class ParticleScriptCompiler {
+public:
+    typedef ParticleScript::Op Op;
+
+    // An instruction with the compiler's register numbers, which
+    // don't fit in an unsigned short.
+    struct Instruction {
+        Op op;
+        unsigned int dst;
+        unsigned int a;
+        unsigned int b;
+        unsigned int c;
+    };
+
+    // The result of (part of) an expression. Anything that only
+    // involves numbers is worked out there and then, so it's
+    // just a number, without a register.
+    struct Value {
+        bool isConstant;
+        float constant;
+        unsigned int reg;
+    };
+
+    std::vector<Instruction> code;
+    std::vector<float> constants;
+    std::string error;
+
+    bool compile(const std::string& source) {
+        std::istringstream lines(source);
+        std::string text;
+        while (std::getline(lines, text)) {
+            ++lineNumber;
+            size_t commentStart = text.find('#');
+            if (commentStart != std::string::npos) {
+                text.resize(commentStart);
+            }
+            if (!tokenize(text) || tokens.empty()) {
+                if (!error.empty()) {
+                    return false;
+                }
+                continue;
+            }
+            position = 0;
+            if (!compileStatement()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static float evaluate(Op op, float a, float b, float c) {
+        switch (op) {
+        case Op::MOV: return a;
+        case Op::ADD: return a + b;
+        case Op::SUB: return a - b;
+        case Op::MUL: return a * b;
+        case Op::DIV: return a / b;
+        case Op::NEG: return -a;
+        case Op::MAD: return a * b + c;
+        case Op::NMAD: return c - a * b;
+        case Op::MIN: return a < b ? a : b;
+        case Op::MAX: return a > b ? a : b;
+        case Op::LESS: return a < b ? 1.0f : 0.0f;
+        case Op::GREATER: return a > b ? 1.0f : 0.0f;
+        case Op::STEP: return b < a ? 0.0f : 1.0f;
+        case Op::SQRT: return std::sqrt(a);
+        case Op::ABS: return std::fabs(a);
+        case Op::FLOOR: return std::floor(a);
+        case Op::FRACT: return a - std::floor(a);
+        case Op::SIN: return std::sin(a);
+        case Op::COS: return std::cos(a);
+        case Op::MIX: return a + (b - a) * c;
+        case Op::CLAMP: return a < b ? b : (a > c ? c : a);
+        case Op::RAND: break;
+        }
+        return 0.0f;
+    }
+
+    static unsigned int getNumOperands(Op op) {
+        switch (op) {
+        case Op::RAND:
+            return 0;
+        case Op::MOV: case Op::NEG: case Op::SQRT: case Op::ABS: case Op::FLOOR: case Op::FRACT: case Op::SIN: case Op::COS:
+            return 1;
+        case Op::MAD: case Op::NMAD: case Op::MIX: case Op::CLAMP:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+
+    // Throws away every instruction whose result never gets used, going
+    // backwards from the end, where the only thing that's still wanted
+    // is the final value of each attribute.
+    void removeDeadCode() {
+        std::set<unsigned int> live;
+        for (unsigned int attribute = 0; attribute < ParticleScript::NUM_ATTRIBUTES; ++attribute) {
+            live.insert(attribute);
+        }
+
+        std::vector<Instruction> kept;
+        for (size_t i = code.size(); i-- > 0;) {
+            const Instruction& instruction = code[i];
+            if (live.count(instruction.dst) == 0) {
+                continue;
+            }
+            // Whatever was in dst before this doesn't matter, unless
+            // this reads it too (which gets added straight back).
+            live.erase(instruction.dst);
+            const unsigned int* operands = &instruction.a;
+            for (unsigned int j = 0; j < getNumOperands(instruction.op); ++j) {
+                live.insert(operands[j]);
+            }
+            kept.push_back(instruction);
+        }
+        code.assign(kept.rbegin(), kept.rend());
+    }
+
+    // A multiply that's only used by the add (or subtract) after it
+    // gets folded into it, as long as nothing in between changes what
+    // it multiplied.
+    void fuseMultiplyAdds() {
+        std::map<unsigned int, unsigned int> numUses;
+        for (const Instruction& instruction : code) {
+            const unsigned int* operands = &instruction.a;
+            for (unsigned int j = 0; j < getNumOperands(instruction.op); ++j) {
+                ++numUses[operands[j]];
+            }
+        }
+
+        std::vector<bool> removed(code.size(), false);
+        for (size_t i = 0; i < code.size(); ++i) {
+            Instruction& instruction = code[i];
+            if (instruction.op != Op::ADD && instruction.op != Op::SUB) {
+                continue;
+            }
+            for (unsigned int side = 0; side < 2; ++side) {
+                unsigned int product = side == 0 ? instruction.a : instruction.b;
+                unsigned int other = side == 0 ? instruction.b : instruction.a;
+                if (!isTemporaryRegister(product) || numUses[product] != 1) {
+                    continue;
+                }
+                // x * y - z doesn't fit either instruction.
+                if (instruction.op == Op::SUB && side == 0) {
+                    continue;
+                }
+
+                size_t multiply = findDefinition(product, i);
+                if (multiply == code.size() || code[multiply].op != Op::MUL || isWrittenBetween(code[multiply], multiply, i)) {
+                    continue;
+                }
+                instruction.op = instruction.op == Op::ADD ? Op::MAD : Op::NMAD;
+                instruction.c = other;
+                instruction.a = code[multiply].a;
+                instruction.b = code[multiply].b;
+                removed[multiply] = true;
+                break;
+            }
+        }
+
+        std::vector<Instruction> kept;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (!removed[i]) {
+                kept.push_back(code[i]);
+            }
+        }
+        code.swap(kept);
+    }
+
+    // Packs the compiler's registers down into real ones. A register
+    // can be reused as soon as the last instruction that reads it
+    // has read it (even by that same instruction's result, since the
+    // instructions go a lane at a time).
+    bool allocateRegisters(ParticleScript& script) {
+        std::map<unsigned int, unsigned int> constantRegisters;
+        std::map<float, unsigned int> constantsByValue;
+        for (unsigned int i = 0; i < constants.size(); ++i) {
+            std::map<float, unsigned int>::iterator found = constantsByValue.find(constants[i]);
+            if (found == constantsByValue.end()) {
+                found = constantsByValue.insert(std::make_pair(constants[i], (unsigned int)script.constants.size())).first;
+                script.constants.push_back(constants[i]);
+            }
+            constantRegisters[CONSTANT_BASE + i] = ParticleScript::DELTA_T_REGISTER + 1 + found->second;
+        }
+
+        std::map<unsigned int, size_t> lastUse;
+        for (size_t i = 0; i < code.size(); ++i) {
+            const unsigned int* operands = &code[i].a;
+            for (unsigned int j = 0; j < getNumOperands(code[i].op); ++j) {
+                lastUse[operands[j]] = i;
+            }
+        }
+
+        unsigned int firstFree = ParticleScript::DELTA_T_REGISTER + 1 + (unsigned int)script.constants.size();
+        unsigned int numRegisters = firstFree;
+        std::vector<unsigned int> freeRegisters;
+        std::map<unsigned int, unsigned int> temporaryRegisters;
+        auto getFinalRegister = [&](unsigned int reg) -> unsigned short {
+            if (isConstantRegister(reg)) {
+                return (unsigned short)constantRegisters[reg];
+            }
+            if (isTemporaryRegister(reg)) {
+                return (unsigned short)temporaryRegisters[reg];
+            }
+            return (unsigned short)reg;
+        };
+
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instruction& instruction = code[i];
+            ParticleScript::Instruction allocated = { instruction.op, 0, 0, 0, 0 };
+            unsigned short* finalOperands = &allocated.a;
+            const unsigned int* operands = &instruction.a;
+            unsigned int numOperands = getNumOperands(instruction.op);
+            for (unsigned int j = 0; j < numOperands; ++j) {
+                finalOperands[j] = getFinalRegister(operands[j]);
+            }
+            for (unsigned int j = 0; j < numOperands; ++j) {
+                unsigned int reg = operands[j];
+                if (isTemporaryRegister(reg) && lastUse[reg] == i && temporaryRegisters.count(reg) != 0) {
+                    freeRegisters.push_back(temporaryRegisters[reg]);
+                    temporaryRegisters.erase(reg);
+                }
+            }
+
+            if (isTemporaryRegister(instruction.dst)) {
+                unsigned int physical;
+                if (!freeRegisters.empty()) {
+                    physical = freeRegisters.back();
+                    freeRegisters.pop_back();
+                }
+                else {
+                    physical = numRegisters++;
+                }
+                if (physical >= ParticleScript::MAX_REGISTERS) {
+                    error = "the script needs too many registers";
+                    return false;
+                }
+                temporaryRegisters[instruction.dst] = physical;
+            }
+            allocated.dst = getFinalRegister(instruction.dst);
+            script.instructions.push_back(allocated);
+        }
+        script.numRegisters = numRegisters;
+        if (numRegisters > ParticleScript::MAX_REGISTERS) {
+            error = "the script has too many constants";
+            return false;
+        }
+
+        // The attributes that get read before they're written have to be
+        // copied in, and the ones that get written have to be copied out.
+        bool read[ParticleScript::NUM_ATTRIBUTES] = {};
+        bool written[ParticleScript::NUM_ATTRIBUTES] = {};
+        for (const Instruction& instruction : code) {
+            const unsigned int* operands = &instruction.a;
+            for (unsigned int j = 0; j < getNumOperands(instruction.op); ++j) {
+                if (isAttributeRegister(operands[j]) && !written[operands[j]]) {
+                    read[operands[j]] = true;
+                }
+            }
+            if (isAttributeRegister(instruction.dst)) {
+                written[instruction.dst] = true;
+            }
+        }
+        for (unsigned int attribute = 0; attribute < ParticleScript::NUM_ATTRIBUTES; ++attribute) {
+            if (read[attribute]) {
+                script.readAttributes.push_back(attribute);
+            }
+            if (written[attribute]) {
+                script.writtenAttributes.push_back(attribute);
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Token {
+        enum Type { NUMBER, NAME, SYMBOL } type;
+        std::string text;
+        float number;
+    };
+
+    struct Expression {
+        Op op;
+        unsigned int a;
+        unsigned int b;
+        unsigned int c;
+
+        bool operator<(const Expression& other) const {
+            if (op != other.op) {
+                return op < other.op;
+            }
+            if (a != other.a) {
+                return a < other.a;
+            }
+            return b != other.b ? b < other.b : c < other.c;
+        }
+    };
+
+    // What's in each variable right now, and everything that's been
+    // worked out so far (that could be used again).
+    std::map<std::string, Value> variables;
+    std::map<Expression, unsigned int> expressions;
+    unsigned int nextTemporary = TEMPORARY_BASE;
+    unsigned int lineNumber = 0;
+    std::vector<Token> tokens;
+    size_t position = 0;
+
+    bool fail(const std::string& message) {
+        error = "line " + std::to_string(lineNumber) + ": " + message;
+        return false;
+    }
+
+    bool tokenize(const std::string& text) {
+        tokens.clear();
+        size_t i = 0;
+        while (i < text.size()) {
+            char c = text[i];
+            if (isspace((unsigned char)c)) {
+                ++i;
+            }
+            else if (isdigit((unsigned char)c) || (c == '.' && i + 1 < text.size() && isdigit((unsigned char)text[i + 1]))) {
+                const char* start = text.c_str() + i;
+                char* end = nullptr;
+                Token token = { Token::NUMBER, "", strtof(start, &end) };
+                token.text.assign(start, (const char*)end);
+                i += end - start;
+                tokens.push_back(token);
+            }
+            else if (isalpha((unsigned char)c) || c == '_') {
+                size_t start = i;
+                while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_' || text[i] == '.')) {
+                    ++i;
+                }
+                Token token = { Token::NAME, text.substr(start, i - start), 0.0f };
+                tokens.push_back(token);
+            }
+            else if (strchr("+-*/<>=(),", c) != nullptr) {
+                Token token = { Token::SYMBOL, std::string(1, c), 0.0f };
+                // += -= *= /=
+                if (c != '=' && strchr("+-*/", c) != nullptr && i + 1 < text.size() && text[i + 1] == '=') {
+                    token.text += '=';
+                    ++i;
+                }
+                ++i;
+                tokens.push_back(token);
+            }
+            else {
+                return fail(std::string("unexpected '") + c + "'");
+            }
+        }
+        return true;
+    }
+
+    bool isSymbol(const char* symbol) const {
+        return position < tokens.size() && tokens[position].type == Token::SYMBOL && tokens[position].text == symbol;
+    }
+
+    bool expect(const char* symbol) {
+        if (!isSymbol(symbol)) {
+            return fail(std::string("expected '") + symbol + "'");
+        }
+        ++position;
+        return true;
+    }
+
+    static int getAttribute(const std::string& name) {
+        static const char* names[ParticleScript::NUM_ATTRIBUTES] = {
+            "pos.x", "pos.y", "pos.z",
+            "vel.x", "vel.y", "vel.z",
+            "color.r", "color.g", "color.b", "color.a",
+            "size", "age", "life"
+        };
+        for (int i = 0; i < (int)ParticleScript::NUM_ATTRIBUTES; ++i) {
+            if (name == names[i]) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    static Value constant(float value) {
+        Value result = { true, value, 0 };
+        return result;
+    }
+
+    static Value reg(unsigned int reg) {
+        Value result = { false, 0.0f, reg };
+        return result;
+    }
+
+    unsigned int getRegister(const Value& value) {
+        if (!value.isConstant) {
+            return value.reg;
+        }
+        for (unsigned int i = 0; i < constants.size(); ++i) {
+            if (memcmp(&constants[i], &value.constant, sizeof(float)) == 0) {
+                return CONSTANT_BASE + i;
+            }
+        }
+        constants.push_back(value.constant);
+        return CONSTANT_BASE + (unsigned int)constants.size() - 1;
+    }
+
+    // Adds an instruction, unless it can be worked out now (because
+    // it only involves numbers, or it's something like x * 1).
+    Value emit(Op op, Value a, Value b = constant(0.0f), Value c = constant(0.0f)) {
+        unsigned int numOperands = getNumOperands(op);
+        if (op != Op::RAND && a.isConstant && (numOperands < 2 || b.isConstant) && (numOperands < 3 || c.isConstant)) {
+            return constant(evaluate(op, a.constant, b.constant, c.constant));
+        }
+        if ((op == Op::MUL && b.isConstant && b.constant == 1.0f) || (op == Op::DIV && b.isConstant && b.constant == 1.0f)
+            || ((op == Op::ADD || op == Op::SUB) && b.isConstant && b.constant == 0.0f)) {
+            return a;
+        }
+        if ((op == Op::MUL && a.isConstant && a.constant == 1.0f) || (op == Op::ADD && a.isConstant && a.constant == 0.0f)) {
+            return b;
+        }
+
+        Instruction instruction = { op, 0, 0, 0, 0 };
+        if (numOperands > 0) {
+            instruction.a = getRegister(a);
+        }
+        if (numOperands > 1) {
+            instruction.b = getRegister(b);
+        }
+        if (numOperands > 2) {
+            instruction.c = getRegister(c);
+        }
+
+        // If exactly the same thing has already been worked out, it can
+        // just be used again. That's only safe if none of its operands
+        // could have changed since, which is everything but an attribute
+        // (every other register only ever gets written once).
+        bool reusable = op != Op::RAND;
+        const unsigned int* operands = &instruction.a;
+        for (unsigned int i = 0; i < numOperands; ++i) {
+            if (isAttributeRegister(operands[i])) {
+                reusable = false;
+            }
+        }
+        Expression expression = { op, instruction.a, instruction.b, instruction.c };
+        if (reusable) {
+            std::map<Expression, unsigned int>::const_iterator found = expressions.find(expression);
+            if (found != expressions.end()) {
+                return reg(found->second);
+            }
+        }
+
+        instruction.dst = nextTemporary++;
+        code.push_back(instruction);
+        if (reusable) {
+            expressions[expression] = instruction.dst;
+        }
+        return reg(instruction.dst);
+    }
+
+    bool compileStatement() {
+        if (tokens[0].type != Token::NAME) {
+            return fail("expected a name at the start of the line");
+        }
+        std::string name = tokens[0].text;
+        int attribute = getAttribute(name);
+        if (name == "dt") {
+            return fail("dt can't be changed");
+        }
+        position = 1;
+
+        Op op = Op::MOV;
+        if (isSymbol("=")) {
+        }
+        else if (isSymbol("+=")) {
+            op = Op::ADD;
+        }
+        else if (isSymbol("-=")) {
+            op = Op::SUB;
+        }
+        else if (isSymbol("*=")) {
+            op = Op::MUL;
+        }
+        else if (isSymbol("/=")) {
+            op = Op::DIV;
+        }
+        else {
+            return fail("expected '=' after " + name);
+        }
+        ++position;
+
+        Value value;
+        if (!compileExpression(value)) {
+            return false;
+        }
+        if (position != tokens.size()) {
+            return fail("unexpected '" + tokens[position].text + "'");
+        }
+        if (op != Op::MOV) {
+            value = emit(op, getVariable(name), value);
+        }
+
+        if (attribute < 0) {
+            // A variable just takes on the value (a new register, or a 
+            // number). An attribute's register can change, though, so 
+            // the variable needs a copy of what's in it now.
+            if (!value.isConstant && isAttributeRegister(value.reg)) {
+                value = emit(Op::MOV, value);
+            }
+            variables[name] = value;
+            return true;
+        }
+
+        // An attribute has to end up in its own register. If the value
+        // was just worked out by the last instruction, that instruction
+        // can put it there itself.
+        if (!value.isConstant && isTemporaryRegister(value.reg) && !code.empty() && code.back().dst == value.reg && !isVariable(value.reg)) {
+            code.back().dst = (unsigned int)attribute;
+            forgetExpression(value.reg);
+        }
+        else if (value.isConstant || value.reg != (unsigned int)attribute) {
+            Instruction instruction = { Op::MOV, (unsigned int)attribute, getRegister(value), 0, 0 };
+            code.push_back(instruction);
+        }
+        return true;
+    }
+
+    // The register's gone (its instruction writes somewhere else
+    // now), so whatever it held can't be used again.
+    void forgetExpression(unsigned int reg) {
+        for (std::map<Expression, unsigned int>::iterator i = expressions.begin(); i != expressions.end();) {
+            if (i->second == reg) {
+                i = expressions.erase(i);
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+    bool isVariable(unsigned int reg) const {
+        for (const auto& variable : variables) {
+            if (!variable.second.isConstant && variable.second.reg == reg) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Value getVariable(const std::string& name) {
+        int attribute = getAttribute(name);
+        if (attribute >= 0) {
+            return reg((unsigned int)attribute);
+        }
+        if (name == "dt") {
+            return reg(ParticleScript::DELTA_T_REGISTER);
+        }
+        std::map<std::string, Value>::const_iterator found = variables.find(name);
+        return found != variables.end() ? found->second : constant(0.0f);
+    }
+
+    // comparison: sum [< or > sum]
+    bool compileExpression(Value& value) {
+        if (!compileSum(value)) {
+            return false;
+        }
+        if (isSymbol("<") || isSymbol(">")) {
+            Op op = isSymbol("<") ? Op::LESS : Op::GREATER;
+            ++position;
+            Value right;
+            if (!compileSum(right)) {
+                return false;
+            }
+            value = emit(op, value, right);
+        }
+        return true;
+    }
+
+    bool compileSum(Value& value) {
+        if (!compileProduct(value)) {
+            return false;
+        }
+        while (isSymbol("+") || isSymbol("-")) {
+            Op op = isSymbol("+") ? Op::ADD : Op::SUB;
+            ++position;
+            Value right;
+            if (!compileProduct(right)) {
+                return false;
+            }
+            value = emit(op, value, right);
+        }
+        return true;
+    }
+
+    bool compileProduct(Value& value) {
+        if (!compileUnary(value)) {
+            return false;
+        }
+        while (isSymbol("*") || isSymbol("/")) {
+            Op op = isSymbol("*") ? Op::MUL : Op::DIV;
+            ++position;
+            Value right;
+            if (!compileUnary(right)) {
+                return false;
+            }
+            value = emit(op, value, right);
+        }
+        return true;
+    }
+
+    bool compileUnary(Value& value) {
+        if (isSymbol("-")) {
+            ++position;
+            if (!compileUnary(value)) {
+                return false;
+            }
+            value = emit(Op::NEG, value);
+            return true;
+        }
+        return compilePrimary(value);
+    }
+
+    bool compilePrimary(Value& value) {
+        if (position >= tokens.size()) {
+            return fail("the line ends too soon");
+        }
+        const Token& token = tokens[position++];
+        if (token.type == Token::NUMBER) {
+            value = constant(token.number);
+            return true;
+        }
+        if (token.type == Token::SYMBOL) {
+            if (token.text != "(") {
+                return fail("unexpected '" + token.text + "'");
+            }
+            return compileExpression(value) && expect(")");
+        }
+        if (!isSymbol("(")) {
+            value = getVariable(token.text);
+            return true;
+        }
+
+        // A function call
+        struct Function {
+            const char* name;
+            Op op;
+            unsigned int numArguments;
+        };
+        static const Function functions[] = {
+            { "sin", Op::SIN, 1 }, { "cos", Op::COS, 1 }, { "sqrt", Op::SQRT, 1 }, { "abs", Op::ABS, 1 },
+            { "floor", Op::FLOOR, 1 }, { "fract", Op::FRACT, 1 }, { "min", Op::MIN, 2 }, { "max", Op::MAX, 2 },
+            { "step", Op::STEP, 2 }, { "mix", Op::MIX, 3 }, { "clamp", Op::CLAMP, 3 }, { "rand", Op::RAND, 0 }
+        };
+        const Function* function = nullptr;
+        for (const Function& candidate : functions) {
+            if (token.text == candidate.name) {
+                function = &candidate;
+            }
+        }
+        if (function == nullptr) {
+            return fail("there's no function called " + token.text);
+        }
+
+        ++position;
+        Value arguments[3] = { constant(0.0f), constant(0.0f), constant(0.0f) };
+        for (unsigned int i = 0; i < function->numArguments; ++i) {
+            if (i > 0 && !expect(",")) {
+                return false;
+            }
+            if (!compileExpression(arguments[i])) {
+                return false;
+            }
+        }
+        if (!expect(")")) {
+            return false;
+        }
+        value = emit(function->op, arguments[0], arguments[1], arguments[2]);
+        return true;
+    }
+
+    size_t findDefinition(unsigned int reg, size_t before) const {
+        for (size_t i = before; i-- > 0;) {
+            if (code[i].dst == reg) {
+                return i;
+            }
+        }
+        return code.size();
+    }
+
+    bool isWrittenBetween(const Instruction& multiply, size_t first, size_t last) const {
+        for (size_t i = first + 1; i < last; ++i) {
+            if (code[i].dst == multiply.a || code[i].dst == multiply.b) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+ParticleScript* ParticleScript::compile(const std::string& source, std::string* error) {
+    ParticleScriptCompiler compiler;
+    ParticleScript* script = new ParticleScript();
+    if (!compiler.compile(source)) {
+        if (error != nullptr) {
+            *error = compiler.error;
+        }
+        delete script;
+        return nullptr;
+    }
+
+    compiler.removeDeadCode();
+    compiler.fuseMultiplyAdds();
+    if (!compiler.allocateRegisters(*script)) {
+        if (error != nullptr) {
+            *error = compiler.error;
+        }
+        delete script;
+        return nullptr;
+    }
+    return script;
+}
+
+ParticleScript* ParticleScript::load(const char* filename, std::string* error) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        if (error != nullptr) {
+            *error = std::string("couldn't open ") + filename;
+        }
+        return nullptr;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+    return compile(source.str(), error);
+}
+
+void ParticleScript::setUpRegisters(float (*registers)[LANES], float deltaT) const {
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        registers[DELTA_T_REGISTER][lane] = deltaT;
+    }
+    for (unsigned int i = 0; i < constants.size(); ++i) {
+        for (unsigned int lane = 0; lane < LANES; ++lane) {
+            registers[DELTA_T_REGISTER + 1 + i][lane] = constants[i];
+        }
+    }
+}
+
+// Each instruction is a loop over the lanes that's simple enough
+// for the compiler to turn into a few SIMD instructions.
+#define FOR_EACH_LANE(expression) for (unsigned int lane = 0; lane < LANES; ++lane) { d[lane] = expression; } break
+
+void ParticleScript::execute(float (*registers)[LANES], unsigned int& randomState) const {
+    for (const Instruction& instruction : instructions) {
+        float* d = registers[instruction.dst];
+        const float* a = registers[instruction.a];
+        const float* b = registers[instruction.b];
+        const float* c = registers[instruction.c];
+        switch (instruction.op) {
+        case Op::MOV: FOR_EACH_LANE(a[lane]);
+        case Op::ADD: FOR_EACH_LANE(a[lane] + b[lane]);
+        case Op::SUB: FOR_EACH_LANE(a[lane] - b[lane]);
+        case Op::MUL: FOR_EACH_LANE(a[lane] * b[lane]);
+        case Op::DIV: FOR_EACH_LANE(a[lane] / b[lane]);
+        case Op::NEG: FOR_EACH_LANE(-a[lane]);
+        case Op::MAD: FOR_EACH_LANE(a[lane] * b[lane] + c[lane]);
+        case Op::NMAD: FOR_EACH_LANE(c[lane] - a[lane] * b[lane]);
+        case Op::MIN: FOR_EACH_LANE(a[lane] < b[lane] ? a[lane] : b[lane]);
+        case Op::MAX: FOR_EACH_LANE(a[lane] > b[lane] ? a[lane] : b[lane]);
+        case Op::LESS: FOR_EACH_LANE(a[lane] < b[lane] ? 1.0f : 0.0f);
+        case Op::GREATER: FOR_EACH_LANE(a[lane] > b[lane] ? 1.0f : 0.0f);
+        case Op::STEP: FOR_EACH_LANE(b[lane] < a[lane] ? 0.0f : 1.0f);
+        case Op::SQRT: FOR_EACH_LANE(std::sqrt(a[lane]));
+        case Op::ABS: FOR_EACH_LANE(std::fabs(a[lane]));
+        case Op::FLOOR: FOR_EACH_LANE(std::floor(a[lane]));
+        case Op::FRACT: FOR_EACH_LANE(a[lane] - std::floor(a[lane]));
+        case Op::SIN: FOR_EACH_LANE(std::sin(a[lane]));
+        case Op::COS: FOR_EACH_LANE(std::cos(a[lane]));
+        case Op::MIX: FOR_EACH_LANE(a[lane] + (b[lane] - a[lane]) * c[lane]);
+        case Op::CLAMP: FOR_EACH_LANE(a[lane] < b[lane] ? b[lane] : (a[lane] > c[lane] ? c[lane] : a[lane]));
+        case Op::RAND: FOR_EACH_LANE(nextRandomFloat(randomState));
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// A little language for making particles do things that the emitter
+// features (see ParticleUpdateKernels) can't, without having to change
+// (and rebuild) the C++. An emitter can have an update script, which runs
+// on its particles every update, after its kernel, and a spawn script,
+// which runs on each particle once, when it's emitted.
+//
+// A script is a list of assignments, one per line, like this:
+//
+//   # Wobble from side to side, and fade out
+//   wobble = sin(age * 6 + pos.y) * 2
+//   vel.x += wobble * dt
+//   color.a = 1 - age / life
+//
+// The particle's values are pos.x, pos.y, pos.z, vel.x, vel.y, vel.z,
+// color.r, color.g, color.b, color.a, size, age and life (how long it
+// lives for, in seconds), and they can all be changed. dt is the length
+// of the update (read only). Any other name is a variable of our own,
+// which starts out at 0 for each particle. There's +, -, *, / and unary
+// -, < and > (which give 1 or 0), = += -= *= /=, and the functions
+// sin, cos, sqrt, abs, floor, fract, min, max, step(edge, x),
+// mix(a, b, t), clamp(x, low, high) and rand() (between 0 and 1).
+//
+// It gets compiled into the instructions of a small virtual machine,
+// which works on "registers" that hold a value for LANES particles at
+// once, so every instruction does a whole chunk of particles in one go.
+// That way the cost of working out what each instruction is (which is
+// where an interpreter spends its time) is shared out between all of
+// them, and the loop inside each instruction is simple enough for the
+// compiler to turn into SIMD instructions.
+//
+// Before it runs, the compiler works out anything that only involves
+// numbers (so "9.8 * 0.5" is just 4.9), throws away anything whose
+// result never gets used (or gets overwritten before it's used), turns
+// a multiply followed by an add into a single instruction, and only
+// copies in (and back out) the particle values that the script uses.
+class ParticleScript {
+public:
+	// The particle values, which are the first registers.
+	enum Attribute : unsigned int {
+		POSITION_X, POSITION_Y, POSITION_Z,
+		VELOCITY_X, VELOCITY_Y, VELOCITY_Z,
+		COLOR_R, COLOR_G, COLOR_B, COLOR_A,
+		SIZE,
+		AGE,
+		LIFE,
+		NUM_ATTRIBUTES
+	};
+
+	static const unsigned int LANES = 16; // particles per instruction
+	static const unsigned int MAX_REGISTERS = 256;
+
+	// Returns null if the script doesn't compile, with what went
+	// wrong (and where) in error.
+	static ParticleScript* compile(const std::string& source, std::string* error = nullptr);
+	static ParticleScript* load(const char* filename, std::string* error = nullptr);
+
+	unsigned int getNumInstructions() const { return (unsigned int)instructions.size(); }
+
+	// Runs the script on count particles. Particle is anything with
+	// position, velocity, color, size, lifetime and maxLife, like
+	// ParticleSystem's. randomState is any number, and gets moved
+	// along by rand().
+	template <typename Particle>
+	void run(Particle* const* particles, unsigned int count, float deltaT, unsigned int& randomState) const {
+		if (count == 0) {
+			return;
+		}
+		alignas(64) float registers[MAX_REGISTERS][LANES];
+		setUpRegisters(registers, deltaT);
+
+		// Where each of the values is in a particle, so that copying 
+		// them doesn't have to work it out for every particle.
+		size_t offsets[NUM_ATTRIBUTES];
+		for (unsigned int attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute) {
+			offsets[attribute] = (const char*)&getAttribute(**particles, attribute) - (const char*)*particles;
+		}
+
+		for (unsigned int first = 0; first < count; first += LANES) {
+			unsigned int numLanes = count - first < LANES ? count - first : LANES;
+			Particle* const* chunk = particles + first;
+
+			// Copy the particles' values into the registers (only the ones
+			// that get read), run the instructions, and then copy back the
+			// ones that changed. The lanes at the end of a short chunk just
+			// repeat the last particle, so that they hold sensible numbers.
+			for (unsigned int attribute : readAttributes) {
+				float* lanes = registers[attribute];
+				size_t offset = offsets[attribute];
+				for (unsigned int lane = 0; lane < LANES; ++lane) {
+					lanes[lane] = *(const float*)((const char*)chunk[lane < numLanes ? lane : numLanes - 1] + offset);
+				}
+			}
+
+			execute(registers, randomState);
+
+			for (unsigned int attribute : writtenAttributes) {
+				const float* lanes = registers[attribute];
+				size_t offset = offsets[attribute];
+				for (unsigned int lane = 0; lane < numLanes; ++lane) {
+					*(float*)((char*)chunk[lane] + offset) = lanes[lane];
+				}
+			}
+		}
+	}
+
+private:
+	enum class Op : unsigned char {
+		MOV, ADD, SUB, MUL, DIV, NEG,
+		MAD,  // a * b + c
+		NMAD, // c - a * b
+		MIN, MAX, LESS, GREATER, STEP,
+		SQRT, ABS, FLOOR, FRACT, SIN, COS,
+		MIX, CLAMP,
+		RAND
+	};
+
+	struct Instruction {
+		Op op;
+		unsigned short dst;
+		unsigned short a;
+		unsigned short b;
+		unsigned short c;
+	};
+
+	std::vector<Instruction> instructions;
+	std::vector<float> constants; // in the registers straight after DELTA_T_REGISTER
+	unsigned int numRegisters = 0;
+	std::vector<unsigned int> readAttributes;
+	std::vector<unsigned int> writtenAttributes;
+
+	static const unsigned int DELTA_T_REGISTER = NUM_ATTRIBUTES;
+
+	friend class ParticleScriptCompiler;
+
+	template <typename Particle>
+	static float& getAttribute(Particle& particle, unsigned int attribute) {
+		switch (attribute) {
+		case POSITION_X: return particle.position.x;
+		case POSITION_Y: return particle.position.y;
+		case POSITION_Z: return particle.position.z;
+		case VELOCITY_X: return particle.velocity.x;
+		case VELOCITY_Y: return particle.velocity.y;
+		case VELOCITY_Z: return particle.velocity.z;
+		case COLOR_R: return particle.color.r;
+		case COLOR_G: return particle.color.g;
+		case COLOR_B: return particle.color.b;
+		case COLOR_A: return particle.color.a;
+		case SIZE: return particle.size;
+		case AGE: return particle.lifetime;
+		default: return particle.maxLife;
+		}
+	}
+
+	void setUpRegisters(float (*registers)[LANES], float deltaT) const;
+	void execute(float (*registers)[LANES], unsigned int& randomState) const;
+};
@@ -0,0 +1,215 @@
+#include "ParticleSnapshot.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[4] = { 'P', 'S', 'S', 'N' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const uint64_t ARRAY_ALIGNMENT = 64;
+
+// The arrays, in the order that they're in in the file.
+enum SnapshotArray {
+    EMITTERS,
+    POSITIONS,
+    PREV_POSITIONS,
+    VELOCITIES,
+    COLORS,
+    SIZES,
+    LIFETIMES,
+    MAX_LIVES,
+    EMITTER_INDICES,
+    NUM_ARRAYS
+};
+
+// The offsets are from the start of the file.
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numParticles;
+    uint32_t numEmitters;
+    uint32_t scriptRandomState;
+    uint32_t surfaceRandomState;
+    uint32_t emitRandomState;
+    uint32_t padding;
+    uint64_t offsets[NUM_ARRAYS];
+};
+
+// So that the file is the same wherever it's saved.
+static_assert(sizeof(ParticleSnapshot::Emitter) == 48, "ParticleSnapshot::Emitter has changed size");
+static_assert(sizeof(SnapshotHeader) == 32 + 8 * NUM_ARRAYS, "SnapshotHeader has padding in it");
+
+static uint64_t getElementSize(unsigned int array) {
+    switch (array) {
+    case EMITTERS: return sizeof(ParticleSnapshot::Emitter);
+    case POSITIONS:
+    case PREV_POSITIONS:
+    case VELOCITIES: return sizeof(glm::vec3);
+    case COLORS: return sizeof(glm::vec4);
+    default: return sizeof(float); // or unsigned int, for the emitter indices
+    }
+}
+
+static uint64_t getNumElements(unsigned int array, uint64_t numParticles, uint64_t numEmitters) {
+    return array == EMITTERS ? numEmitters : numParticles;
+}
+
+static const void* getArray(const ParticleSnapshot::Contents& contents, unsigned int array) {
+    switch (array) {
+    case EMITTERS: return contents.emitters;
+    case POSITIONS: return contents.positions;
+    case PREV_POSITIONS: return contents.prevPositions;
+    case VELOCITIES: return contents.velocities;
+    case COLORS: return contents.colors;
+    case SIZES: return contents.sizes;
+    case LIFETIMES: return contents.lifetimes;
+    case MAX_LIVES: return contents.maxLives;
+    default: return contents.emitterIndices;
+    }
+}
+
+bool ParticleSnapshot::save(const char* filename, const Contents& contents) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.numParticles = contents.numParticles;
+    header.numEmitters = contents.numEmitters;
+    header.scriptRandomState = contents.scriptRandomState;
+    header.surfaceRandomState = contents.surfaceRandomState;
+    header.emitRandomState = contents.emitRandomState;
+
+    uint64_t offset = sizeof(header);
+    for (unsigned int array = 0; array < NUM_ARRAYS; ++array) {
+        offset = (offset + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+        header.offsets[array] = offset;
+        offset += getElementSize(array) * getNumElements(array, contents.numParticles, contents.numEmitters);
+    }
+    file.write((const char*)&header, sizeof(header));
+
+    static const char padding[ARRAY_ALIGNMENT] = {};
+    uint64_t written = sizeof(header);
+    for (unsigned int array = 0; array < NUM_ARRAYS; ++array) {
+        file.write(padding, (std::streamsize)(header.offsets[array] - written));
+        uint64_t size = getElementSize(array) * getNumElements(array, contents.numParticles, contents.numEmitters);
+        if (size != 0) {
+            file.write((const char*)getArray(contents, array), (std::streamsize)size);
+        }
+        written = header.offsets[array] + size;
+    }
+
+    return (bool)file;
+}
+
+// Maps the whole file, read only. Returns null if it can't be.
+static const char* mapFile(const char* filename, size_t& size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    const char* mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        // The view keeps the mapping (and the file) open, so neither
+        // handle has to be kept.
+        HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (fileMapping != nullptr) {
+            mapping = (const char*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(fileMapping);
+        }
+        size = (size_t)fileSize.QuadPart;
+    }
+    CloseHandle(file);
+    return mapping;
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    const char* mapping = nullptr;
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+        void* memory = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (memory != MAP_FAILED) {
+            mapping = (const char*)memory;
+            size = (size_t)status.st_size;
+        }
+    }
+    close(file);
+    return mapping;
+#endif
+}
+
+static void unmapFile(const char* mapping, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(mapping);
+#else
+    munmap((void*)mapping, size);
+#endif
+}
+
+ParticleSnapshot* ParticleSnapshot::load(const char* filename) {
+    size_t size = 0;
+    const char* mapping = mapFile(filename, size);
+    if (mapping == nullptr) {
+        return nullptr;
+    }
+
+    // Everything has to be where the header says, and inside the
+    // file, so that a broken file can't send us off the end of it.
+    const SnapshotHeader* header = (const SnapshotHeader*)mapping;
+    bool valid = size >= sizeof(SnapshotHeader)
+        && memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+        && header->version == SNAPSHOT_VERSION;
+    for (unsigned int array = 0; array < NUM_ARRAYS && valid; ++array) {
+        uint64_t offset = header->offsets[array];
+        uint64_t arraySize = getElementSize(array) * getNumElements(array, header->numParticles, header->numEmitters);
+        valid = offset % ARRAY_ALIGNMENT == 0 && offset >= sizeof(SnapshotHeader) && offset <= size && arraySize <= size - offset;
+    }
+    if (!valid) {
+        unmapFile(mapping, size);
+        return nullptr;
+    }
+
+    ParticleSnapshot* snapshot = new ParticleSnapshot();
+    snapshot->mapping = mapping;
+    snapshot->mappingSize = size;
+
+    Contents& contents = snapshot->contents;
+    contents.numParticles = header->numParticles;
+    contents.positions = (const glm::vec3*)(mapping + header->offsets[POSITIONS]);
+    contents.prevPositions = (const glm::vec3*)(mapping + header->offsets[PREV_POSITIONS]);
+    contents.velocities = (const glm::vec3*)(mapping + header->offsets[VELOCITIES]);
+    contents.colors = (const glm::vec4*)(mapping + header->offsets[COLORS]);
+    contents.sizes = (const float*)(mapping + header->offsets[SIZES]);
+    contents.lifetimes = (const float*)(mapping + header->offsets[LIFETIMES]);
+    contents.maxLives = (const float*)(mapping + header->offsets[MAX_LIVES]);
+    contents.emitterIndices = (const unsigned int*)(mapping + header->offsets[EMITTER_INDICES]);
+    contents.numEmitters = header->numEmitters;
+    contents.emitters = (const Emitter*)(mapping + header->offsets[EMITTERS]);
+    contents.scriptRandomState = header->scriptRandomState;
+    contents.surfaceRandomState = header->surfaceRandomState;
+    contents.emitRandomState = header->emitRandomState;
+    return snapshot;
+}
+
+ParticleSnapshot::~ParticleSnapshot() {
+    unmapFile(mapping, mappingSize);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Everything about a ParticleSystem that changes as it runs (its live
+// particles, where its emitters are and how long they've been going,
+// and its random number states), saved to a file. That way, an effect
+// that only looks right once it's been running for a few seconds can
+// be run for those few seconds once, ahead of time, and shipped like
+// any other asset, rather than every system having to catch up when
+// it's made (see ParticleSystem::saveSnapshot() and loadSnapshot()).
+//
+// The file is a header, then one array for each of the particles'
+// values (all of the positions, then all of the velocities, and so on),
+// each starting on a 64 byte boundary. Everything is in the machine's
+// byte order, so loading it is just mapping the file into memory and
+// pointing at the arrays: there's nothing to read through or convert,
+// and the OS only reads in the parts that get used. The same snapshot
+// can be loaded into as many systems as we like.
+class ParticleSnapshot {
+public:
+	// An EmitterState, without anything that's worked out from the
+	// EmitterDesc.
+	struct Emitter {
+		double lifetime;
+		glm::vec3 position;
+		glm::vec3 velocity;
+		glm::vec3 startPosition;
+		float emissionRemainder;
+	};
+
+	// What's in a snapshot, as pointers to somebody else's arrays (the
+	// caller's, to save, or the file's, once it's loaded). Every particle
+	// array has numParticles values in it.
+	struct Contents {
+		unsigned int numParticles = 0;
+		const glm::vec3* positions = nullptr;
+		const glm::vec3* prevPositions = nullptr; // where they were before the last update
+		const glm::vec3* velocities = nullptr;
+		const glm::vec4* colors = nullptr;
+		const float* sizes = nullptr;
+		const float* lifetimes = nullptr;
+		const float* maxLives = nullptr;
+		const unsigned int* emitterIndices = nullptr;
+
+		unsigned int numEmitters = 0;
+		const Emitter* emitters = nullptr;
+
+		unsigned int emitRandomState = 1;
+		unsigned int scriptRandomState = 1;
+		unsigned int surfaceRandomState = 1;
+	};
+
+	// Returns false if the file couldn't be written.
+	static bool save(const char* filename, const Contents& contents);
+
+	// Returns null if the file couldn't be opened, or isn't a snapshot
+	// (of this version), or has been cut short.
+	static ParticleSnapshot* load(const char* filename);
+
+	~ParticleSnapshot();
+
+	// Only good for as long as the snapshot is.
+	const Contents& getContents() const { return contents; }
+
+private:
+	Contents contents;
+	const char* mapping = nullptr;
+	size_t mappingSize = 0;
+
+	ParticleSnapshot() {}
+	ParticleSnapshot(const ParticleSnapshot&) = delete;
+	ParticleSnapshot& operator=(const ParticleSnapshot&) = delete;
+};
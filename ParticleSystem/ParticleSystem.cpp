@@ -5,9 +5,27 @@
 #include "ResourceManager.h"
 #include "Utils.h"
 
+#include <climits>
+#include <cmath>
+
 #define VERTS_PER_PARTICLE 4 // the particles will be square, these are the 4 corners
 #define INDICES_PER_PARTICLE 6 
-#define NUM_SHADER_PROPERTIES 3 // 3 properties: position, color, and size
+#define NUM_SHADER_PROPERTIES 4 // 4 properties: position, previous position, color, and size
+#define PARAMS_BINDING_INDEX 1 // matches the binding of ParticleParams in particle.vert
+
+// The bindings in particle_sim.comp
+#define SIM_PARTICLES_BINDING_INDEX 0
+#define SIM_STATES_BINDING_INDEX 1
+#define SIM_FREE_LIST_BINDING_INDEX 2
+#define SIM_PARAMS_BINDING_INDEX 2
+#define SIM_EMITTERS_BINDING_INDEX 3
+#define SIM_CURVES_BINDING_INDEX 4
+#define SIM_GROUP_SIZE 256 // local_size_x in particle_sim.comp
+#define COLLISION_CHUNK_SIZE 256 // how many particles get collided together
+#define FORCE_FIELD_CHUNK_SIZE 1024 // how many particles (alive or not) get pushed by the force fields together
+#define SCRIPT_CHUNK_SIZE 256 // how many of an emitter's particles go through its update script together
+#define MAX_IDLE_PARTICLE_CHUNKS 16 // how many empty chunks the shared pool keeps for whoever needs one next
+#define COMPACT_BATCH_SIZE 1024 // how many compact particles get unpacked (and updated) together
 
 // Linear intERPolation
 template <typename T>
@@ -22,41 +40,417 @@ float lerp(T start, T mid, T end, float t) {
         : lerp(mid, end, (t - 0.5f) / 0.5f);
 }
 
-float randomFloat(float min, float max) {
-    float t = (float)(rand() % 10000) / 10000.f; // gives us a value between 0.0 and 1.0
+float ParticleSystem::randomFloat(float min, float max) {
+    // Each system has its own generator (see nextRandom()), which gives 
+    // 24 bits rather than rand() % 10000, and can be saved in a snapshot.
+    float t = nextRandomFloat(emitRandomState);
     return lerp(min, max, t);
 }
 
 ParticleSystem::ParticleSystem(const ParticleSystem::Config& config): config(config) {
-	particles = new Particle[config.maxParticles];
-    memset(particles, 0, sizeof(Particle) * config.maxParticles);
-
-    emitter.circleRadius = 20.0f;
-    emitter.numHops = 8;
-    emitter.hopHeight = 3.0f;
-    emitter.horizontalSpeed = 25.0f;
-    emitter.lifetime;
-    emitter.offsetRadius = 1;
-    emitter.drag = 0.9;
-    emitter.worldPos = glm::vec4(0, 0, -10, 1);
-    emitter.particleMinLifetime = 2.7;
-    emitter.particleMinLifetime = 3.0;
-    emitter.particlesPerSecond = 30000;
-    emitter.particleStartSize = 0.1;
-    emitter.particleEndSize = 0.1;
-    emitter.particleStartColor = glm::vec4(1.0, 1.0, 0.1, 1.0);
-    emitter.particleMidColor   = glm::vec4(1.0, 0.1, 0.1, 1.0);
-    emitter.particleEndColor   = glm::vec4(0.2, 0.1, 0.2, 1.0);
+    // Seeded from rand(), so that srand() still decides what happens, 
+    // and no two systems are the same. It can never be 0 (which 
+    // xorshift would never get out of).
+    emitRandomState = (unsigned int)rand() * 2654435761u | 1u;
+
+    emitters = config.emitters;
+    if (emitters.empty()) {
+        emitters.push_back(EmitterDesc());
+    }
+
+    EmitterState initialState = {};
+    emitterStates.resize(emitters.size(), initialState);
+    numToEmitPerEmitter.resize(emitters.size(), 0);
+    emitterCurves.resize(emitters.size());
+    scriptChunks.resize(emitters.size());
+
+    // Scripts are only for the CPU simulation.
+    auto getScript = [this, &config](const ParticleScript* script, const std::string& filename) -> const ParticleScript* {
+        if (config.simulationMode == SimulationMode::GPU) {
+            return nullptr;
+        }
+        if (script != nullptr || filename.empty()) {
+            return script;
+        }
+        std::string error;
+        ParticleScript* loadedScript = ParticleScript::load(filename.c_str(), &error);
+        if (loadedScript == nullptr) {
+            scriptErrors += filename + ": " + error + "\n";
+            return nullptr;
+        }
+        loadedScripts.push_back(loadedScript);
+        return loadedScript;
+    };
+
+    for (size_t i = 0; i < emitters.size(); ++i) {
+        emitterStates[i].position = emitters[i].worldPos;
+        emitterKernels.push_back(ParticleUpdateKernels<Particle>::get(emitters[i].features));
+        emitterCompactKernels.push_back(ParticleUpdateKernels<Particle>::getCompact(emitters[i].features));
+        bakeLifetimeCurves(emitters[i], emitterCurves[i]);
+        emitterPaths.push_back(emitters[i].motion == EmitterDesc::Motion::PATH ? EmitterPath(emitters[i]) : EmitterPath());
+
+        unsigned int triggers = 0;
+        unsigned int numSubEmitters = emitters[i].numSubEmitters < EmitterDesc::MAX_SUB_EMITTERS ? emitters[i].numSubEmitters : EmitterDesc::MAX_SUB_EMITTERS;
+        for (unsigned int j = 0; j < numSubEmitters; ++j) {
+            triggers |= 1 << (unsigned int)emitters[i].subEmitters[j].trigger;
+        }
+        emitterTriggers.push_back(config.simulationMode != SimulationMode::GPU ? triggers : 0);
+
+        const EmitterMesh* mesh = nullptr;
+        if (emitters[i].shape == EmitterDesc::Shape::MESH) {
+            mesh = emitters[i].mesh;
+            if (mesh == nullptr && !emitters[i].meshFilename.empty()) {
+                EmitterMesh* loadedMesh = EmitterMesh::loadOBJ(emitters[i].meshFilename.c_str());
+                if (loadedMesh != nullptr) {
+                    loadedMeshes.push_back(loadedMesh);
+                    mesh = loadedMesh;
+                }
+            }
+        }
+        emitterMeshes.push_back(mesh);
+
+        emitterUpdateScripts.push_back(getScript(emitters[i].updateScript, emitters[i].updateScriptFilename));
+        emitterSpawnScripts.push_back(getScript(emitters[i].spawnScript, emitters[i].spawnScriptFilename));
+
+        // Put the emitter at the start of its path (or hop), so that 
+        // the first update doesn't start from somewhere else.
+        updateEmitter((unsigned int)i, 0.0);
+        emitterStates[i].startPosition = emitterStates[i].position;
+    }
+
+    if (config.simulationMode == SimulationMode::SPH) {
+        fluidSolver = new SPHSolver(config.fluid);
+    }
+    else if (config.simulationMode == SimulationMode::NBODY) {
+        nbodySolver = new BarnesHutSolver(config.nbody);
+    }
+
+    if (!config.forceFields.empty() && config.simulationMode != SimulationMode::GPU) {
+        forceFieldSet = new ForceFieldSet(config.forceFields);
+        unsigned int numThreads = ThreadPool::getDefault().getNumThreads();
+        threadChunkParticles.resize(numThreads);
+        threadChunkFields.resize(numThreads);
+        for (std::vector<Particle*>& chunkParticles : threadChunkParticles) {
+            chunkParticles.reserve(FORCE_FIELD_CHUNK_SIZE);
+        }
+    }
+
+    if (!config.colliders.empty() && config.simulationMode != SimulationMode::GPU) {
+        colliderSet = new ColliderSet(config.colliders, config.colliderCellSize);
+        chunkParticles.reserve(COLLISION_CHUNK_SIZE);
+    }
+
+    // A compact particle only has room for 16 bits of emitterIndex, 
+    // so a system with more emitters than that gets full-size ones.
+    if (config.simulationMode != SimulationMode::CPU || emitters.size() > CompactParticleBlock::MAX_EMITTERS) {
+        this->config.compactParticles = false;
+    }
+    if (this->config.compactParticles) {
+        batchCompactUpdates = forceFieldSet != nullptr || colliderSet != nullptr;
+        for (size_t i = 0; i < emitters.size(); ++i) {
+            if (emitterUpdateScripts[i] != nullptr || emitterTriggers[i] != 0) {
+                batchCompactUpdates = true;
+            }
+        }
+        if (batchCompactUpdates) {
+            compactBatch.resize(COMPACT_BATCH_SIZE);
+        }
+    }
+
+    if (config.simulationMode != SimulationMode::GPU) {
+        // No chunks to start with; they get taken as the particles 
+        // need them. Touching the pool here makes sure that it's 
+        // around for longer than we are.
+        getChunkPool();
+        chunks.resize((config.maxParticles + PARTICLES_PER_CHUNK - 1) >> CHUNK_SHIFT, nullptr);
+        numUnallocatedParticles = config.maxParticles;
+
+        if (config.overflowPolicy != OverflowPolicy::DROP_NEW) {
+            evictionBuckets.resize(NUM_EVICTION_BUCKETS);
+        }
+
+        spawnQueue = new SpawnQueue<ParticleSpawn>(config.maxQueuedSpawns);
+        burstQueue = new SpawnQueue<QueuedBurst>(config.maxQueuedBursts);
+    }
 }
 
 ParticleSystem::~ParticleSystem() {
-    if (particles != nullptr) {
-        delete[] particles;
-        particles = nullptr;
+    for (EmitterMesh* mesh : loadedMeshes) {
+        delete mesh;
+    }
+    loadedMeshes.clear();
+    for (ParticleScript* script : loadedScripts) {
+        delete script;
+    }
+    loadedScripts.clear();
+    if (spawnQueue != nullptr) {
+        delete spawnQueue;
+        spawnQueue = nullptr;
+    }
+    if (burstQueue != nullptr) {
+        delete burstQueue;
+        burstQueue = nullptr;
+    }
+    if (colliderSet != nullptr) {
+        delete colliderSet;
+        colliderSet = nullptr;
+    }
+    if (forceFieldSet != nullptr) {
+        delete forceFieldSet;
+        forceFieldSet = nullptr;
+    }
+    if (fluidSolver != nullptr) {
+        delete fluidSolver;
+        fluidSolver = nullptr;
+    }
+    if (nbodySolver != nullptr) {
+        delete nbodySolver;
+        nbodySolver = nullptr;
+    }
+    if (ownsArena) {
+        delete arena;
+        arena = nullptr;
+    }
+    removeAllParticles();
+}
+
+// Every system shares the same pool of chunks, so a chunk that one 
+// system has finished with can go straight to another that needs one. 
+// Compact chunks are smaller, and huge page chunks are carved out of 
+// different memory, so they each have a pool of their own.
+ChunkPool& ParticleSystem::getChunkPool(bool compact, bool hugePages) {
+    ChunkPool::Config poolConfig;
+    poolConfig.chunkSize = sizeof(ParticleChunk) + (compact ? sizeof(CompactParticleBlock) / CompactParticleBlock::SIZE : sizeof(Particle)) * PARTICLES_PER_CHUNK;
+    poolConfig.maxIdleChunks = MAX_IDLE_PARTICLE_CHUNKS;
+    poolConfig.hugePages = hugePages;
+    if (compact && hugePages) {
+        static ChunkPool compactHugePool(poolConfig);
+        return compactHugePool;
+    }
+    if (compact) {
+        static ChunkPool compactPool(poolConfig);
+        return compactPool;
+    }
+    if (hugePages) {
+        static ChunkPool hugePool(poolConfig);
+        return hugePool;
     }
+    static ChunkPool pool(poolConfig);
+    return pool;
+}
+
+unsigned int ParticleSystem::getChunkSize(unsigned int chunkIndex) const {
+    unsigned int first = chunkIndex << CHUNK_SHIFT;
+    unsigned int remaining = config.maxParticles - first;
+    return remaining < PARTICLES_PER_CHUNK ? remaining : PARTICLES_PER_CHUNK;
+}
+
+// The free particles in the chunks that we have, plus however many 
+// would fit in the chunks that we don't.
+unsigned int ParticleSystem::getNumFreeParticles() const {
+    return (unsigned int)freeParticles.size() + numUnallocatedParticles;
+}
+
+// Returns null once the pool is full.
+ParticleSystem::Particle* ParticleSystem::takeFreeParticle() {
+    if (freeParticles.empty() && !allocateChunk()) {
+        return nullptr;
+    }
+    unsigned int index = freeParticles.back();
+    freeParticles.pop_back();
+
+    ParticleChunk* chunk = chunks[index >> CHUNK_SHIFT];
+    ++chunk->numLive;
+    if ((index & (PARTICLES_PER_CHUNK - 1)) >= chunk->numUsed) {
+        chunk->numUsed = (index & (PARTICLES_PER_CHUNK - 1)) + 1;
+    }
+    return getNewParticle(index);
+}
+
+// Where a new particle gets set up. With compactParticles, that's 
+// somewhere of its own (that stays put until it's been stored), 
+// rather than the particle itself.
+ParticleSystem::Particle* ParticleSystem::getNewParticle(unsigned int index) {
+    if (!config.compactParticles) {
+        return &getParticle(index);
+    }
+    stagedParticles.emplace_back();
+    stagedParticleIndices.push_back(index);
+    return &stagedParticles.back();
+}
+
+// Packs up the new particles (with compactParticles), once they've 
+// been set up, and run through any spawn scripts. A chunk that's only 
+// just been taken gets its origin from its first particle, since the 
+// particles' positions only fit in a half float (up to 65504) from it.
+void ParticleSystem::storeStagedParticles() {
+    for (size_t i = 0; i < stagedParticles.size(); ++i) {
+        unsigned int index = stagedParticleIndices[i];
+        ParticleChunk* chunk = chunks[index >> CHUNK_SHIFT];
+        if (chunk->needsOrigin) {
+            chunk->origin = glm::vec3(stagedParticles[i].position);
+            chunk->nextOrigin = chunk->origin;
+            chunk->needsOrigin = false;
+        }
+        unsigned int j = index & (PARTICLES_PER_CHUNK - 1);
+        chunk->getCompactBlocks()[j / CompactParticleBlock::SIZE].pack(j % CompactParticleBlock::SIZE, stagedParticles[i], chunk->origin);
+    }
+    stagedParticles.clear();
+    stagedParticleIndices.clear();
+}
+
+// Takes a free particle or, if there aren't any (and the overflow 
+// policy says so), throws out a live one to make room. Returns null 
+// (and counts it as dropped) if it can't do either.
+ParticleSystem::Particle* ParticleSystem::takeParticle() {
+    Particle* particle = takeFreeParticle();
+    if (particle == nullptr && evictionIndexReady) {
+        particle = evictParticle();
+    }
+    if (particle == nullptr) {
+        ++numDroppedParticles;
+    }
+    return particle;
+}
+
+// The particle that gets thrown out just gets started over by whoever 
+// asked for it, so its chunk has as many live particles as before. It 
+// doesn't set off any DEATH sub-emitters, since it didn't really die.
+ParticleSystem::Particle* ParticleSystem::evictParticle() {
+    while (firstEvictionBucket < NUM_EVICTION_BUCKETS) {
+        std::vector<unsigned int>& bucket = evictionBuckets[firstEvictionBucket];
+        if (bucket.empty()) {
+            ++firstEvictionBucket;
+            continue;
+        }
+        unsigned int index = bucket.back();
+        bucket.pop_back();
+        --numEvictableParticles;
+        ++numEvictedParticles;
+        return getNewParticle(index);
+    }
+    return nullptr;
+}
+
+// Which eviction bucket a live particle goes in, and makes a note of 
+// how big its age (or time left, or distance) is for next time.
+unsigned int ParticleSystem::getEvictionBucket(const Particle& particle) {
+    float key;
+    bool biggestFirst = true;
+    switch (config.overflowPolicy) {
+    case OverflowPolicy::EVICT_NEAREST_DEATH:
+        key = particle.maxLife - particle.lifetime;
+        biggestFirst = false;
+        break;
+    case OverflowPolicy::EVICT_FARTHEST:
+        key = glm::length(glm::vec3(particle.position) - cameraPosition);
+        break;
+    default:
+        key = particle.lifetime;
+        break;
+    }
+    if (key > nextEvictionScale) {
+        nextEvictionScale = key;
+    }
+
+    unsigned int bucket = NUM_EVICTION_BUCKETS - 1;
+    if (key < evictionScale) {
+        bucket = (unsigned int)(key * (NUM_EVICTION_BUCKETS / evictionScale));
+        if (bucket > NUM_EVICTION_BUCKETS - 1) {
+            bucket = NUM_EVICTION_BUCKETS - 1;
+        }
+    }
+    return biggestFirst ? NUM_EVICTION_BUCKETS - 1 - bucket : bucket;
+}
+
+// Takes the lowest chunk that we don't have yet, and puts all of its 
+// particles on the free list. A new chunk from the pool is all zeros, 
+// and one that's being reused only went back when everything in it 
+// was dead, so either way, all of its particles are dead.
+bool ParticleSystem::allocateChunk() {
+    for (unsigned int chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+        if (chunks[chunkIndex] != nullptr) {
+            continue;
+        }
+
+        ParticleChunk* chunk = (ParticleChunk*)getChunkPool().allocate();
+        if (chunk == nullptr) {
+            return false;
+        }
+        chunk->numLive = 0;
+        chunk->numUsed = 0;
+        chunk->origin = glm::vec3(0.0f);
+        chunk->nextOrigin = glm::vec3(0.0f);
+        chunk->needsOrigin = true;
+        chunks[chunkIndex] = chunk;
+        ++numAllocatedChunks;
+
+        // Backwards, so that the chunk's first particles get used first.
+        unsigned int chunkSize = getChunkSize(chunkIndex);
+        unsigned int first = chunkIndex << CHUNK_SHIFT;
+        numUnallocatedParticles -= chunkSize;
+        for (unsigned int i = chunkSize; i > 0; --i) {
+            freeParticles.push_back(first + i - 1);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Doesn't touch the free list, so any of the chunk's particles 
+// need taking off of it first.
+void ParticleSystem::releaseChunk(unsigned int chunkIndex) {
+    getChunkPool().release(chunks[chunkIndex]);
+    chunks[chunkIndex] = nullptr;
+    --numAllocatedChunks;
+    numUnallocatedParticles += getChunkSize(chunkIndex);
+}
+
+// Gives back every chunk, with everything in it.
+void ParticleSystem::removeAllParticles() {
+    // Whoever gets our chunks next expects everything in them to be 
+    // dead (see allocateChunk()). Only the particles up to numUsed can 
+    // be alive, and the rest of the chunk might never have been 
+    // touched, so we leave it be (rather than have the OS find memory 
+    // for it).
+    for (unsigned int chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+        ParticleChunk* chunk = chunks[chunkIndex];
+        if (chunk != nullptr) {
+            if (chunk->numLive > 0) {
+                if (config.compactParticles) {
+                    CompactParticleBlock* blocks = chunk->getCompactBlocks();
+                    for (unsigned int i = 0; i < chunk->numUsed; ++i) {
+                        blocks[i / CompactParticleBlock::SIZE].ages[i % CompactParticleBlock::SIZE] = CompactParticleBlock::DEAD;
+                    }
+                }
+                else {
+                    Particle* particles = chunk->getParticles();
+                    for (unsigned int i = 0; i < chunk->numUsed; ++i) {
+                        particles[i].lifetime = particles[i].maxLife;
+                    }
+                }
+                chunk->numLive = 0;
+            }
+            releaseChunk(chunkIndex);
+        }
+    }
+    freeParticles.clear();
+    stagedParticles.clear();
+    stagedParticleIndices.clear();
+    numActiveParticles = 0;
+
+    // The eviction buckets had the old particles in them.
+    evictionIndexReady = false;
 }
 
 void ParticleSystem::initGraphicsResources(gfx::ResourceManager& resourceManager) {
+    // When the GPU does the simulating, the particles live in a 
+    // GPUParticleArena, which also takes care of drawing them.
+    if (config.simulationMode == SimulationMode::GPU) {
+        initGPUSimulation(resourceManager);
+        return;
+    }
+
     // First, we're going to create our Shader pipeline, also known as a *Program*
     // This Program will contain two shaders:
     // - Vertex Shader: This is a small program that processes each vertex. At a 
@@ -76,7 +470,10 @@ void ParticleSystem::initGraphicsResources(gfx::ResourceManager& resourceManager
     //   The same is true for all properties, e.g. texture coordinates, normals, etc.
     // Once we compile each shader, we "link" them together into a single program.
 
-    std::string vertShaderSource = loadAsciiFile("particle.vert"); // load from file
+    // The shader needs to know how many particles there are, so 
+    // that it can find where each array starts.
+    std::string numParticlesDefine = "#define NUM_PARTICLES " + std::to_string(config.maxParticles) + "\n";
+    std::string vertShaderSource = insertShaderDefines(loadAsciiFile("particle.vert"), numParticlesDefine); // load from file
     std::string fragShaderSource = loadAsciiFile("particle.frag"); // load from file
     gfx::ResourceManager::ShaderSource vertexShaderSource = {
         gfx::ResourceManager::ShaderType::VERTEX_SHADER,
@@ -114,8 +511,8 @@ void ParticleSystem::initGraphicsResources(gfx::ResourceManager& resourceManager
     // 
     // So let's us an SSBO!
 
-    // Each particle has 3 properties (position, color, and size) and we'll need 16 
-    // bytes for each property. We could get away with just a float (4 bytes) for the 
+    // Each particle has 4 properties (position, previous position, color, and size) 
+    // and we'll need 16 bytes for each property. We could get away with just a float (4 bytes) for the 
     // size, but the memory layout we're using requires 16-byte alignment for each 
     // property.
     int storageDataSize = sizeof(glm::vec4) * NUM_SHADER_PROPERTIES * config.maxParticles;
@@ -124,6 +521,10 @@ void ParticleSystem::initGraphicsResources(gfx::ResourceManager& resourceManager
     // every frame as the properties of the particles change.
     storageBufferHandle = resourceManager.createStreamingStorageBuffer(storageDataSize, nullptr);
 
+    // We also need a (tiny) uniform buffer for the properties that are the same 
+    // for every particle, like how far between the last two updates we are.
+    paramsBufferHandle = resourceManager.createStreamingUniformBuffer(sizeof(ShaderParams), nullptr);
+
     // Next, we need to create an index buffer. The index buffer is just an array of integers 
     // that tells the vertex shader which vertices to draw, and in what order. So pretend that 
     // we have an array of vertices [a,b,c,d]. If we create an index buffer with [0,1,2,0,2,3],
@@ -166,80 +567,89 @@ void ParticleSystem::initGraphicsResources(gfx::ResourceManager& resourceManager
 
     // createVAO will create the VAO and actually transfer the index buffer to the GPU
 	vaoHandle = resourceManager.createVAO(vaoConfig);    
+    delete[] indices;
 }
 
-// A method for updating a single particle.
-inline void ParticleSystem::updateParticle(Particle& particle, double deltaT) {
-    const float g = -9.8; // gravity (acceleration)
-    float deltaVy = g * deltaT; // change in velocity due to gravity for this frame
+void ParticleSystem::initGPUSimulation(gfx::ResourceManager& resourceManager) {
+    gpuResourceManager = &resourceManager;
 
-    // Update the velocity
-    particle.velocity.y += deltaVy; // gravity
-    particle.velocity *= 1.0f - (emitter.drag * deltaT);
+    // Without an arena to share, we get one all to ourselves.
+    arena = config.arena;
+    if (arena == nullptr) {
+        GPUParticleArena::Config arenaConfig;
+        arenaConfig.maxParticles = config.maxParticles;
+        arenaConfig.maxSystems = 1;
+        arena = new GPUParticleArena(arenaConfig);
+        arena->initGraphicsResources(resourceManager);
+        ownsArena = true;
+    }
 
-    // Update the position
-    particle.position.x += particle.velocity.x * deltaT;
-    particle.position.y += particle.velocity.y * deltaT;
-    particle.position.z += particle.velocity.z * deltaT;
+    arenaSystemIndex = arena->addSystem(resourceManager, config.maxParticles);
+    if (arenaSystemIndex == GPUParticleArena::INVALID_SYSTEM) {
+        // The arena is full, so this system just won't do anything.
+        return;
+    }
 
-    // Do a little collision detect with the floor.
-    if (particle.position.y < 0) {
-        // Flip the particle about the xz plane.
-        particle.position.y = -particle.position.y;
-        // Flip the y-velocity too so the particle goes upward.
-        particle.velocity.y = -particle.velocity.y;
+    // Every particle starts out dead (maxLife = 0), so every particle is 
+    // on the free list. The list is a count, followed by the indices of 
+    // the free particles (within our range of the arena).
+    std::vector<unsigned int> freeList(config.maxParticles + 1);
+    freeList[0] = config.maxParticles;
+    for (unsigned int i = 0; i < config.maxParticles; ++i) {
+        freeList[i + 1] = i;
     }
+    freeListBufferHandle = resourceManager.createStorageBuffer(sizeof(unsigned int) * (unsigned int)freeList.size(), freeList.data());
 
-    // What percentage of the particle's lifetime has it lived?
-    float t = particle.lifetime / particle.maxLife;
+    simParamsBufferHandle = resourceManager.createStreamingUniformBuffer(sizeof(SimParams), nullptr);
 
-    // Interpolate the colors
-    particle.color.r = lerp(emitter.particleStartColor.r, emitter.particleMidColor.r, emitter.particleEndColor.r, t);
-    particle.color.g = lerp(emitter.particleStartColor.g, emitter.particleMidColor.g, emitter.particleEndColor.g, t);
-    particle.color.b = lerp(emitter.particleStartColor.b, emitter.particleMidColor.b, emitter.particleEndColor.b, t);
+    // Each emitter's settings, which the shaders look up 
+    // by the particle's (or the emit pass thread's) emitter.
+    emitterParams.resize(emitters.size());
+    emitterParamsBufferHandle = resourceManager.createStreamingStorageBuffer(sizeof(EmitterParams) * (unsigned int)emitters.size(), nullptr);
 
-    // Interpolate the size
-    particle.size = lerp(emitter.particleStartSize, emitter.particleEndSize, t);
+    // The curves never change, so they only need to be sent once.
+    curvesBufferHandle = resourceManager.createStorageBuffer(sizeof(LifetimeCurves) * (unsigned int)emitterCurves.size(), emitterCurves.data());
 }
 
-// Updates the entire particle system
-void ParticleSystem::update(double deltaT) {
-    // Update any existing particles that are still alive
-    const float g = -9.8; // gravity (acceleration)
-    float deltaVy = g * deltaT; // change in velocity due to gravity for this frame
-    int activeParticleCount = 0; 
-    for (int i = 0; i < config.maxParticles; ++i) {
-        Particle& particle = particles[i];
-        particle.lifetime += deltaT;
-        if (particle.lifetime < particle.maxLife) {
-            ++activeParticleCount;
-            updateParticle(particle, deltaT);
-        }
+void ParticleSystem::setEmitterPosition(unsigned int emitterIndex, const glm::vec3& worldPos) {
+    if (emitterIndex < emitters.size()) {
+        emitters[emitterIndex].worldPos = worldPos;
     }
+}
 
-    // Emit new particles
-
-    // Word of caution here. We are potentially going to 
-    // emit several dozen particles each frame.
-
-    // Technically, a frame represents a range of time that is 
-    // between t0 and t1=t0+deltaT. We need our particles to 
-    // look as though they've been emitted at various times 
-    // during that range.
+void ParticleSystem::setOpeningAngle(float openingAngle) {
+    if (nbodySolver != nullptr) {
+        nbodySolver->setOpeningAngle(openingAngle);
+    }
+    config.nbody.openingAngle = openingAngle;
+}
 
-    // We do this by choosing a random time during that range 
-    // and updating the particle as though it has been alive 
-    // for that long.
+float ParticleSystem::getOpeningAngle() const {
+    return config.nbody.openingAngle;
+}
 
-    // If we don't do this, the eye will be able to perceive 
-    // that the particles are being emitted in batches instead 
-    // of continuously.
+// Moves an emitter along, and works out where it is 
+// and how fast it's going at the end of the update.
+void ParticleSystem::updateEmitter(unsigned int emitterIndex, double deltaT) {
+    const EmitterDesc& emitter = emitters[emitterIndex];
+    EmitterState& state = emitterStates[emitterIndex];
+    state.lifetime += deltaT;
+    state.startPosition = state.position;
 
-    int numParticlesToEmit = emitter.particlesPerSecond * deltaT;
-    int availableNewParticles = config.maxParticles - activeParticleCount;
+    if (emitter.motion == EmitterDesc::Motion::STATIC) {
+        state.position = emitter.worldPos;
+        state.velocity = emitter.velocity;
+        return;
+    }
 
-    if (numParticlesToEmit > availableNewParticles) {
-        numParticlesToEmit = availableNewParticles;
+    if (emitter.motion == EmitterDesc::Motion::PATH) {
+        // The path's table does all of the hard work (see EmitterPath).
+        glm::vec3 pathPosition;
+        glm::vec3 pathDirection;
+        emitterPaths[emitterIndex].evaluate(state.lifetime * emitter.pathSpeed, pathPosition, pathDirection);
+        state.position = emitter.worldPos + pathPosition;
+        state.velocity = pathDirection * emitter.pathSpeed + emitter.velocity;
+        return;
     }
 
     // Calculate the emitter location
@@ -250,8 +660,7 @@ void ParticleSystem::update(double deltaT) {
     float hopLength = hopHalfLength * 2;
     float totalPerimeter = hopLength * emitter.numHops;
 
-    emitter.lifetime += deltaT;
-    float totalHorizontalDistanceTraveled = emitter.horizontalSpeed * emitter.lifetime;
+    float totalHorizontalDistanceTraveled = emitter.horizontalSpeed * state.lifetime;
 
     int hopsTraveled = totalHorizontalDistanceTraveled / hopLength;
     float distanceTraveledThisHop = totalHorizontalDistanceTraveled - (hopsTraveled * hopLength);
@@ -280,11 +689,9 @@ void ParticleSystem::update(double deltaT) {
     float h = emitter.hopHeight;
     emitterPosition.y = 4*h*t - 4*h*t*t;
 
-    int particleIndex = 0;
     float s = pow((1 - (4 * t - 4 * t * t)), 4);
     bool justUseTangential = (1 - s) < FLT_EPSILON;
 
-    float angle = atan2(emitterPosition.x, emitterPosition.z);
     glm::vec3 normalizedEmitterPos = glm::normalize(emitterPosition);
     glm::vec3 tangentialVelocity(0,0,0);
     tangentialVelocity.x = -normalizedEmitterPos.z * emitter.horizontalSpeed;
@@ -299,72 +706,1083 @@ void ParticleSystem::update(double deltaT) {
 
     emitterVelocity.y = 4*h - 8*h*t;
 
-    for (int i = 0; i < numParticlesToEmit; ++i) {
-        // Find an unused particle
-        Particle* particle = nullptr;
-        for (; particleIndex < config.maxParticles; ++particleIndex) {
-            if (particles[particleIndex].lifetime >= particles[particleIndex].maxLife) {
-                particle = &particles[particleIndex];
-                break;
+    state.position = emitter.worldPos + emitterPosition;
+    state.velocity = emitterVelocity + emitter.velocity;
+}
+
+// Where an emitter was timeIntoUpdate into this update (which 
+// updateEmitter() has already moved it to the end of).
+glm::vec3 ParticleSystem::getEmitterPosition(unsigned int emitterIndex, double timeIntoUpdate, double deltaT) const {
+    const EmitterDesc& emitter = emitters[emitterIndex];
+    const EmitterState& state = emitterStates[emitterIndex];
+
+    // A path can bend a lot in one update, so it's worth going back to 
+    // the path itself. It's only a look up and an evaluation anyway.
+    if (emitter.motion == EmitterDesc::Motion::PATH) {
+        glm::vec3 pathPosition;
+        glm::vec3 pathDirection;
+        double lifetime = state.lifetime - (deltaT - timeIntoUpdate);
+        emitterPaths[emitterIndex].evaluate(lifetime * emitter.pathSpeed, pathPosition, pathDirection);
+        return emitter.worldPos + pathPosition;
+    }
+
+    // Anything else moves little enough in one update 
+    // that a straight line is close enough.
+    float t = deltaT > 0.0 ? (float)(timeIntoUpdate / deltaT) : 1.0f;
+    return lerp(state.startPosition, state.position, t);
+}
+
+// How many new particles one emitter is due this update.
+int ParticleSystem::getNumParticlesToEmit(unsigned int emitterIndex, double deltaT) {
+    EmitterState& state = emitterStates[emitterIndex];
+
+    // With short updates, we might be due for, say, 2.7 particles. We 
+    // emit 2 of them, and carry the 0.7 over to the next update.
+    float particlesDue = emitters[emitterIndex].particlesPerSecond * deltaT + state.emissionRemainder;
+    int numParticlesToEmit = (int)particlesDue;
+    state.emissionRemainder = particlesDue - numParticlesToEmit;
+    return numParticlesToEmit;
+}
+
+// Works out how many particles every emitter gets to emit this update 
+// (in numParticlesToEmit), and returns how many that is altogether.
+int ParticleSystem::getNumParticlesToEmit(double deltaT, int maxParticlesToEmit) {
+    long long totalParticlesToEmit = 0;
+    for (unsigned int i = 0; i < emitters.size(); ++i) {
+        numToEmitPerEmitter[i] = getNumParticlesToEmit(i, deltaT);
+        totalParticlesToEmit += numToEmitPerEmitter[i];
+    }
+
+    // If there isn't room for all of them, every emitter gets cut back by 
+    // the same fraction, so that the first emitters don't starve the rest.
+    if (totalParticlesToEmit > maxParticlesToEmit) {
+        long long scaledTotal = 0;
+        for (int& numToEmit : numToEmitPerEmitter) {
+            numToEmit = (int)(numToEmit * (long long)maxParticlesToEmit / totalParticlesToEmit);
+            scaledTotal += numToEmit;
+        }
+        numDroppedParticles += (unsigned long long)(totalParticlesToEmit - scaledTotal);
+        totalParticlesToEmit = scaledTotal;
+    }
+
+    return (int)totalParticlesToEmit;
+}
+
+// Starts a new particle off at its emitter. Its lifetime is never 
+// any shorter than minLifetime (see prewarm()), as well as the 
+// emitter's particleMinLifetime.
+void ParticleSystem::emitParticle(Particle& particle, unsigned int emitterIndex, double deltaT, const EmitterMesh::SurfacePoint* surfacePoint, float minLifetime) {
+    const EmitterDesc& emitter = emitters[emitterIndex];
+    const EmitterState& state = emitterStates[emitterIndex];
+
+    // When during this frame did the particle emit?
+    float dT = randomFloat(0, deltaT);
+
+    glm::vec3 offset(0, 0, 0);
+    if (emitter.shape == EmitterDesc::Shape::SPHERE) {
+        float offsetRadius = randomFloat(0, emitter.radius);
+        float offsetTheta = randomFloat(0, glm::pi<float>());
+        float offsetPhi = randomFloat(-glm::pi<float>(), glm::pi<float>());
+
+        offset.x = cos(offsetPhi) * sin(offsetTheta) * offsetRadius;
+        offset.y = cos(offsetTheta) * offsetRadius;
+        offset.z = sin(offsetPhi) * sin(offsetTheta) * offsetRadius;
+    }
+    else if (emitter.shape == EmitterDesc::Shape::BOX) {
+        offset.x = randomFloat(-emitter.halfExtents.x, emitter.halfExtents.x);
+        offset.y = randomFloat(-emitter.halfExtents.y, emitter.halfExtents.y);
+        offset.z = randomFloat(-emitter.halfExtents.z, emitter.halfExtents.z);
+    }
+    else if (surfacePoint != nullptr) {
+        offset = surfacePoint->position;
+    }
+
+    // The emitter was somewhere else (on its way to where it is 
+    // now) when the particle was emitted.
+    particle.position = glm::vec4(getEmitterPosition(emitterIndex, dT, deltaT) + offset, 1);
+
+    // It didn't exist before this update, so we'll just 
+    // say that it was at the spot where it was emitted.
+    particle.prevPosition = particle.position;
+
+    particle.color = emitterCurves[emitterIndex].colors[0];
+
+    particle.velocity.x = state.velocity.x + randomFloat(-emitter.velocityJitter, emitter.velocityJitter);
+    particle.velocity.y = state.velocity.y + randomFloat(-emitter.velocityJitter, emitter.velocityJitter);
+    particle.velocity.z = state.velocity.z + randomFloat(-emitter.velocityJitter, emitter.velocityJitter);
+
+    if (surfacePoint != nullptr) {
+        particle.velocity += surfacePoint->normal * emitter.meshNormalSpeed;
+        if (emitter.meshColors) {
+            particle.color = surfacePoint->color;
+        }
+    }
+
+    particle.size = emitterCurves[emitterIndex].sizes[0];
+    particle.lifetime = 0.0f;
+    particle.maxLife = randomFloat(glm::max(minLifetime, emitter.particleMinLifetime), emitter.particleMaxLifetime);
+    particle.emitterIndex = emitterIndex;
+
+    // Update the particle as if it has already been 
+    // alive for deltaT - dT
+    emitterKernels[emitterIndex](particle, emitter, emitterCurves[emitterIndex], (float)(deltaT - dT));
+}
+
+// Queues the particles up, to go in at the start of the next update 
+// (see addQueuedSpawns()).
+bool ParticleSystem::spawn(const ParticleSpawn* spawns, unsigned int count) {
+    if (spawnQueue == nullptr) {
+        return false;
+    }
+    return spawnQueue->push(spawns, count);
+}
+
+bool ParticleSystem::spawnBurst(const ParticleBurst& burst, unsigned int count) {
+    if (burstQueue == nullptr) {
+        return false;
+    }
+
+    // Just the burst gets queued, not its particles, so a big 
+    // burst is as quick to queue as a small one.
+    QueuedBurst queuedBurst;
+    queuedBurst.burst = burst;
+    queuedBurst.count = count;
+    return burstQueue->push(queuedBurst);
+}
+
+bool ParticleSystem::saveSnapshot(const char* filename) const {
+    if (config.simulationMode == SimulationMode::GPU) {
+        return false;
+    }
+
+    // The particles get packed together (without the dead ones), and 
+    // split up into one array for each of their values.
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> prevPositions;
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::vec4> colors;
+    std::vector<float> sizes;
+    std::vector<float> lifetimes;
+    std::vector<float> maxLives;
+    std::vector<unsigned int> emitterIndices;
+    positions.reserve(numActiveParticles);
+    prevPositions.reserve(numActiveParticles);
+    velocities.reserve(numActiveParticles);
+    colors.reserve(numActiveParticles);
+    sizes.reserve(numActiveParticles);
+    lifetimes.reserve(numActiveParticles);
+    maxLives.reserve(numActiveParticles);
+    emitterIndices.reserve(numActiveParticles);
+
+    for (unsigned int chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+        const ParticleChunk* chunk = chunks[chunkIndex];
+        if (chunk == nullptr || chunk->numLive == 0) {
+            continue;
+        }
+        unsigned int chunkSize = getChunkSize(chunkIndex);
+        for (unsigned int i = 0; i < chunkSize; ++i) {
+            // Compact particles get their colors (and where they were) 
+            // the same way as they do when they're drawn.
+            Particle particle;
+            if (config.compactParticles) {
+                const CompactParticleBlock& block = chunk->getCompactBlocks()[i / CompactParticleBlock::SIZE];
+                unsigned int lane = i % CompactParticleBlock::SIZE;
+                if (!block.isAlive(lane)) {
+                    continue;
+                }
+                block.unpack(lane, particle, chunk->origin);
+                particle.prevPosition = particle.position - glm::vec4(particle.velocity * lastDeltaT, 0.0f);
+                particle.color = emitterCurves[particle.emitterIndex].colors[LifetimeCurves::getIndex(block.getAge(lane))];
             }
+            else {
+                particle = chunk->getParticles()[i];
+                if (!(particle.lifetime < particle.maxLife)) {
+                    continue;
+                }
+            }
+            positions.push_back(glm::vec3(particle.position));
+            prevPositions.push_back(glm::vec3(particle.prevPosition));
+            velocities.push_back(particle.velocity);
+            colors.push_back(particle.color);
+            sizes.push_back(particle.size);
+            lifetimes.push_back(particle.lifetime);
+            maxLives.push_back(particle.maxLife);
+            emitterIndices.push_back(particle.emitterIndex);
         }
+    }
+
+    std::vector<ParticleSnapshot::Emitter> savedEmitters(emitterStates.size());
+    for (unsigned int emitterIndex = 0; emitterIndex < emitterStates.size(); ++emitterIndex) {
+        const EmitterState& state = emitterStates[emitterIndex];
+        ParticleSnapshot::Emitter& saved = savedEmitters[emitterIndex];
+        saved.lifetime = state.lifetime;
+        saved.position = state.position;
+        saved.velocity = state.velocity;
+        saved.startPosition = state.startPosition;
+        saved.emissionRemainder = state.emissionRemainder;
+    }
 
+    ParticleSnapshot::Contents contents;
+    contents.numParticles = (unsigned int)positions.size();
+    contents.positions = positions.data();
+    contents.prevPositions = prevPositions.data();
+    contents.velocities = velocities.data();
+    contents.colors = colors.data();
+    contents.sizes = sizes.data();
+    contents.lifetimes = lifetimes.data();
+    contents.maxLives = maxLives.data();
+    contents.emitterIndices = emitterIndices.data();
+    contents.numEmitters = (unsigned int)savedEmitters.size();
+    contents.emitters = savedEmitters.data();
+    contents.emitRandomState = emitRandomState;
+    contents.scriptRandomState = scriptRandomState;
+    contents.surfaceRandomState = surfaceRandomState;
+    return ParticleSnapshot::save(filename, contents);
+}
+
+bool ParticleSystem::loadSnapshot(const ParticleSnapshot& snapshot) {
+    const ParticleSnapshot::Contents& contents = snapshot.getContents();
+    if (config.simulationMode == SimulationMode::GPU || contents.numEmitters != emitters.size()) {
+        return false;
+    }
+
+    removeAllParticles();
+    for (unsigned int emitterIndex = 0; emitterIndex < emitterStates.size(); ++emitterIndex) {
+        const ParticleSnapshot::Emitter& saved = contents.emitters[emitterIndex];
+        EmitterState& state = emitterStates[emitterIndex];
+        state.lifetime = saved.lifetime;
+        state.position = saved.position;
+        state.velocity = saved.velocity;
+        state.startPosition = saved.startPosition;
+        state.emissionRemainder = saved.emissionRemainder;
+    }
+    emitRandomState = contents.emitRandomState;
+    scriptRandomState = contents.scriptRandomState;
+    surfaceRandomState = contents.surfaceRandomState;
+
+    // The particles go into the free ones in order, so they end up 
+    // packed into as few chunks as they'll fit in. Anything that's 
+    // already dead (or belongs to an emitter that we haven't got, in 
+    // a broken file) is left out.
+    for (unsigned int i = 0; i < contents.numParticles; ++i) {
+        if (!(contents.lifetimes[i] < contents.maxLives[i]) || contents.emitterIndices[i] >= emitters.size()) {
+            continue;
+        }
+        Particle* particle = takeFreeParticle();
         if (particle == nullptr) {
-            // We've run out of room for new particles.
-            // This shouldn't ever happen because we were careful to make 
-            // sure that the number of new particles to emit is not greater 
-            // that the number of available particles. However, it is always 
-            // good to double-check when it comes to null pointers.
             break;
         }
+        particle->position = glm::vec4(contents.positions[i], 1.0f);
+        particle->prevPosition = glm::vec4(contents.prevPositions[i], 1.0f);
+        particle->velocity = contents.velocities[i];
+        particle->color = contents.colors[i];
+        particle->size = contents.sizes[i];
+        particle->lifetime = contents.lifetimes[i];
+        particle->maxLife = contents.maxLives[i];
+        particle->emitterIndex = contents.emitterIndices[i];
+        ++numActiveParticles;
+    }
 
-        // When during this frame did the particle emit?
-        float dT = randomFloat(0, deltaT);
-                
-        float offsetRadius = randomFloat(0, emitter.offsetRadius);
-        float offsetTheta = randomFloat(0, glm::pi<float>());
-        float offsetPhi = randomFloat(-glm::pi<float>(), glm::pi<float>());
+    storeStartingParticles();
+    return true;
+}
 
-        float offsetX = cos(offsetPhi) * sin(offsetTheta) * offsetRadius;
-        float offsetY = cos(offsetTheta) * offsetRadius;
-        float offsetZ = sin(offsetPhi) * sin(offsetTheta) * offsetRadius;
-        
-        particle->position.x = emitter.worldPos.x + emitterPosition.x + offsetX;
-        particle->position.y = emitter.worldPos.y + emitterPosition.y + offsetY;
-        particle->position.z = emitter.worldPos.z + emitterPosition.z + offsetZ;
-        particle->position.w = 1;
+// Packs up the particles that loadSnapshot() started us 
+// off with (with compactParticles). Compact particles are packed 
+// around their chunk's origin, so that has to be somewhere near them 
+// before they can be, and all of the chunks are new. Until the next 
+// update moves it, the middle of them will do.
+void ParticleSystem::storeStartingParticles() {
+    if (!config.compactParticles) {
+        return;
+    }
+    std::vector<glm::vec3> sums(chunks.size(), glm::vec3(0.0f));
+    std::vector<unsigned int> counts(chunks.size(), 0);
+    for (size_t i = 0; i < stagedParticles.size(); ++i) {
+        unsigned int chunkIndex = stagedParticleIndices[i] >> CHUNK_SHIFT;
+        sums[chunkIndex] += glm::vec3(stagedParticles[i].position);
+        ++counts[chunkIndex];
+    }
+    for (unsigned int chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+        if (counts[chunkIndex] != 0) {
+            chunks[chunkIndex]->origin = sums[chunkIndex] / (float)counts[chunkIndex];
+            chunks[chunkIndex]->nextOrigin = chunks[chunkIndex]->origin;
+            chunks[chunkIndex]->needsOrigin = false;
+        }
+    }
+    storeStagedParticles();
+}
 
-        particle->color = emitter.particleStartColor;
+// Puts particles that have already been set up straight into free 
+// ones, a chunk at a time, without staging them, and returns how many 
+// there was room for. Compact particles are packed around the middle 
+// of the ones that went into their chunk, if it's only just been taken.
+unsigned int ParticleSystem::addParticles(const Particle* particles, unsigned int count) {
+    unsigned int numAdded = 0;
+    while (numAdded < count) {
+        if (freeParticles.empty() && !allocateChunk()) {
+            break;
+        }
 
-        particle->velocity.x = emitterVelocity.x + randomFloat(-1.5f, 1.5f);
-        particle->velocity.y = emitterVelocity.y + randomFloat(-1.5f, 1.5f);
-        particle->velocity.z = emitterVelocity.z + randomFloat(-1.5f, 1.5f);
+        // As many as will go in the chunk at the back of the free list.
+        unsigned int chunkIndex = freeParticles.back() >> CHUNK_SHIFT;
+        ParticleChunk* chunk = chunks[chunkIndex];
+        unsigned int numInChunk = 0;
+        while (numAdded + numInChunk < count && numInChunk < freeParticles.size() && 
+               (freeParticles[freeParticles.size() - 1 - numInChunk] >> CHUNK_SHIFT) == chunkIndex) {
+            ++numInChunk;
+        }
 
-        particle->size = emitter.particleStartSize;
-        particle->lifetime = 0.0f;
-        particle->maxLife = randomFloat(emitter.particleMinLifetime, emitter.particleMaxLifetime);
+        const Particle* chunkParticles = particles + numAdded;
+        if (config.compactParticles && chunk->needsOrigin) {
+            glm::vec3 sum(0.0f);
+            for (unsigned int i = 0; i < numInChunk; ++i) {
+                sum += glm::vec3(chunkParticles[i].position);
+            }
+            chunk->origin = sum / (float)numInChunk;
+            chunk->nextOrigin = chunk->origin;
+            chunk->needsOrigin = false;
+        }
+        for (unsigned int i = 0; i < numInChunk; ++i) {
+            unsigned int j = freeParticles.back() & (PARTICLES_PER_CHUNK - 1);
+            freeParticles.pop_back();
+            if (j >= chunk->numUsed) {
+                chunk->numUsed = j + 1;
+            }
+            if (config.compactParticles) {
+                chunk->getCompactBlocks()[j / CompactParticleBlock::SIZE].pack(j % CompactParticleBlock::SIZE, chunkParticles[i], chunk->origin);
+            }
+            else {
+                chunk->getParticles()[j] = chunkParticles[i];
+            }
+        }
+        chunk->numLive += numInChunk;
+        numActiveParticles += (int)numInChunk;
+        numAdded += numInChunk;
+    }
+    return numAdded;
+}
+
+void ParticleSystem::addQueuedSpawns() {
+    // Every new particle takes the next free one, so adding them all 
+    // costs the same however many particles there are in the pool. 
+    // Once the pool's full, the rest still get taken off of the 
+    // queue (and dropped), so that the queue doesn't fill up.
+    spawnQueue->popAll([this](const ParticleSpawn& spawn) {
+        Particle* freeParticle = takeParticle();
+        if (freeParticle == nullptr) {
+            return;
+        }
+        Particle& particle = *freeParticle;
+
+        particle.position = glm::vec4(spawn.position, 1);
+        particle.prevPosition = particle.position;
+        particle.velocity = spawn.velocity;
+        particle.color = spawn.color;
+        particle.size = spawn.size;
+        particle.lifetime = 0.0f;
+        particle.maxLife = spawn.lifetime;
+        particle.emitterIndex = spawn.emitterIndex < emitters.size() ? spawn.emitterIndex : 0;
+    });
+
+    burstQueue->popAll([this](const QueuedBurst& queuedBurst) {
+        spawnBurstParticles(queuedBurst.burst, queuedBurst.count);
+    });
+    storeStagedParticles();
+}
+
+unsigned int ParticleSystem::spawnBurstParticles(const ParticleBurst& burst, unsigned int count) {
+    unsigned int emitterIndex = burst.emitterIndex < emitters.size() ? burst.emitterIndex : 0;
+    const LifetimeCurves& curves = emitterCurves[emitterIndex];
+
+    unsigned int numAvailable = getNumFreeParticles() + (evictionIndexReady ? numEvictableParticles : 0);
+    if (count > numAvailable) {
+        numDroppedParticles += count - numAvailable;
+        count = numAvailable;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+        Particle* freeParticle = takeParticle();
+        if (freeParticle == nullptr) {
+            return i; // the chunk pool couldn't get any more memory
+        }
+        Particle& particle = *freeParticle;
+
+        // A random point in a sphere (try points in the cube around 
+        // it until one lands inside), which also gives us which way 
+        // the particle flies off.
+        glm::vec3 offset;
+        float lengthSquared;
+        do {
+            offset = glm::vec3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1));
+            lengthSquared = glm::dot(offset, offset);
+        } while (lengthSquared > 1.0f || lengthSquared < 0.0001f);
+        glm::vec3 direction = offset / sqrtf(lengthSquared);
+
+        particle.position = glm::vec4(burst.position + offset * burst.radius, 1);
+        particle.prevPosition = particle.position;
+        particle.velocity = burst.velocity + direction * (burst.speed + randomFloat(-burst.speedJitter, burst.speedJitter));
+        particle.color = curves.colors[0];
+        particle.size = curves.sizes[0];
+        particle.lifetime = 0.0f;
+        particle.maxLife = randomFloat(burst.minLifetime, burst.maxLifetime);
+        particle.emitterIndex = emitterIndex;
+    }
+    return count;
+}
+
+void ParticleSystem::addParticleEvents(const Particle& particle, float previousLifetime, unsigned int kernelEvents) {
+    const EmitterDesc& emitter = emitters[particle.emitterIndex];
+    bool died = particle.lifetime >= particle.maxLife;
+    unsigned int numSubEmitters = emitter.numSubEmitters < EmitterDesc::MAX_SUB_EMITTERS ? emitter.numSubEmitters : EmitterDesc::MAX_SUB_EMITTERS;
+    for (unsigned int i = 0; i < numSubEmitters; ++i) {
+        const EmitterDesc::SubEmitter& subEmitter = emitter.subEmitters[i];
+        bool triggered = false;
+        switch (subEmitter.trigger) {
+        case EmitterDesc::SubEmitterTrigger::DEATH:
+            triggered = died;
+            break;
+        case EmitterDesc::SubEmitterTrigger::COLLISION:
+            triggered = !died && (kernelEvents & ParticleUpdateKernels<Particle>::BOUNCED) != 0;
+            break;
+        case EmitterDesc::SubEmitterTrigger::INTERVAL:
+            // Did the particle's age go past a multiple of the interval?
+            triggered = !died && subEmitter.interval > 0.0f
+                && floorf(particle.lifetime / subEmitter.interval) > floorf(previousLifetime / subEmitter.interval);
+            break;
+        }
+
+        if (triggered) {
+            ParticleEvent event;
+            event.position = glm::vec3(particle.position);
+            event.velocity = particle.velocity;
+            event.emitterIndex = particle.emitterIndex;
+            event.subEmitterIndex = i;
+            particleEvents.push_back(event);
+        }
+    }
+}
+
+int ParticleSystem::processParticleEvents() {
+    // The children are just a burst from wherever the parent was.
+    ParticleSystem* target = config.subEmitterTarget != nullptr ? config.subEmitterTarget : this;
+    int numSpawned = 0;
+    for (const ParticleEvent& event : particleEvents) {
+        const EmitterDesc::SubEmitter& subEmitter = emitters[event.emitterIndex].subEmitters[event.subEmitterIndex];
+        ParticleBurst burst;
+        burst.position = event.position;
+        burst.velocity = event.velocity * subEmitter.inheritVelocity;
+        burst.speed = subEmitter.speed;
+        burst.minLifetime = subEmitter.minLifetime;
+        burst.maxLifetime = subEmitter.maxLifetime;
+        burst.emitterIndex = subEmitter.emitterIndex;
+
+        // Another system might be updating on another thread, so its 
+        // children go through its queue (and show up next update). If 
+        // its queue is full, they're dropped, and since we can't touch 
+        // its count from here, they go on ours.
+        if (target == this) {
+            numSpawned += (int)spawnBurstParticles(burst, subEmitter.count);
+        }
+        else if (!target->spawnBurst(burst, subEmitter.count)) {
+            numDroppedParticles += subEmitter.count;
+        }
+    }
+    particleEvents.clear();
+    storeStagedParticles();
+    return numSpawned;
+}
+
+// Updates the entire particle system
+void ParticleSystem::update(double deltaT) {
+    if (config.simulationMode == SimulationMode::GPU) {
+        updateGPU(deltaT);
+        return;
+    }
+
+    // Anything that's been spawned since the last update goes in first, 
+    // so that it gets moved along with everything else.
+    addQueuedSpawns();
 
-        // Update the particle as if it has already been 
-        // alive for deltaT - dT
-        updateParticle(*particle, deltaT - dT);
+    // The fluid (or gravity) forces only change the velocities, so 
+    // that the particles still get moved (and bounced off of the floor, 
+    // and so on) by their emitter's kernel, just like any other particles.
+    if (config.simulationMode == SimulationMode::SPH || config.simulationMode == SimulationMode::NBODY) {
+        applyInteractionForces(deltaT);
+    }
 
-        ++activeParticleCount;
+    // Same for the force fields. With compactParticles, they get done 
+    // in the update loop instead, while the particles are unpacked.
+    if (forceFieldSet != nullptr && !config.compactParticles) {
+        applyForceFields(deltaT);
     }
 
+    // Update any existing particles that are still alive, and 
+    // make a note of the ones that aren't.
+    //
+    // Anything that sets off a sub-emitter just gets written down 
+    // (in particleEvents), and dealt with once the loop's finished.
+    //
+    // Only the chunks that we have get looked at, and any that end up 
+    // with nothing alive in them go back to the pool. They go from the 
+    // last one to the first, so that the first chunk's free particles 
+    // end up at the back of the free list.
+    //
+    // With an overflow policy that evicts, the live particles get put 
+    // in the eviction buckets as we go, while they're in the cache.
+    //
+    // With compactParticles, each particle gets unpacked, updated, and 
+    // packed up again by its emitter's compact kernel (or a batch at a 
+    // time, if it needs to be a full-size Particle for a while; see 
+    // updateCompactChunk()).
+    int activeParticleCount = 0;
+    freeParticles.clear();
+    bool indexForEviction = !evictionBuckets.empty();
+    if (indexForEviction) {
+        for (std::vector<unsigned int>& bucket : evictionBuckets) {
+            bucket.clear();
+        }
+        firstEvictionBucket = 0;
+        evictionScale = nextEvictionScale;
+        nextEvictionScale = 0.0f;
+    }
+    for (unsigned int chunkIndex = (unsigned int)chunks.size(); chunkIndex-- > 0;) {
+        ParticleChunk* chunk = chunks[chunkIndex];
+        if (chunk == nullptr) {
+            continue;
+        }
+        size_t firstFree = freeParticles.size();
+        unsigned int numLive = 0;
+
+        if (config.compactParticles) {
+            numLive = updateCompactChunk(chunkIndex, deltaT, indexForEviction);
+        }
+        else {
+            unsigned int chunkSize = getChunkSize(chunkIndex);
+            unsigned int first = chunkIndex << CHUNK_SHIFT;
+            Particle* particles = chunk->getParticles();
+            for (unsigned int j = 0; j < chunkSize; ++j) {
+                if (updateParticle(particles[j], first + j, deltaT, indexForEviction)) {
+                    ++numLive;
+                }
+            }
+        }
+
+        // None of an empty chunk's particles are waiting to be scripted 
+        // or collided, so it can go straight back.
+        chunk->numLive = numLive;
+        activeParticleCount += (int)numLive;
+        if (numLive == 0) {
+            freeParticles.resize(firstFree);
+            releaseChunk(chunkIndex);
+        }
+    }
+    finishUpdateBatches(deltaT);
+    lastDeltaT = (float)deltaT;
+    if (indexForEviction) {
+        numEvictableParticles = (unsigned int)activeParticleCount;
+        evictionIndexReady = true;
+    }
+
+    // Anything that gets evicted from here on is replaced by a new 
+    // particle, so it shouldn't be counted twice.
+    unsigned long long numEvictedBefore = numEvictedParticles;
+
+    // The sub-emitters' children go in before anything gets emitted, 
+    // so they can't be crowded out by the emitters.
+    if (!particleEvents.empty()) {
+        activeParticleCount += processParticleEvents();
+    }
+
+    // Emit new particles
+
+    // Word of caution here. We are potentially going to 
+    // emit several dozen particles each frame.
+
+    // Technically, a frame represents a range of time that is 
+    // between t0 and t1=t0+deltaT. We need our particles to 
+    // look as though they've been emitted at various times 
+    // during that range.
+
+    // We do this by choosing a random time during that range 
+    // and updating the particle as though it has been alive 
+    // for that long.
+
+    // If we don't do this, the eye will be able to perceive 
+    // that the particles are being emitted in batches instead 
+    // of continuously.
+
+    // All of the emitters take their particles from the free 
+    // list, so none of them have to go looking for unused ones. 
+    // Once that runs out, the overflow policy decides whether they 
+    // get any more.
+    long long availableNewParticles = (long long)getNumFreeParticles() + (evictionIndexReady ? numEvictableParticles : 0);
+    if (availableNewParticles > INT_MAX) {
+        availableNewParticles = INT_MAX;
+    }
+    getNumParticlesToEmit(deltaT, (int)availableNewParticles);
+
+    for (unsigned int emitterIndex = 0; emitterIndex < emitters.size(); ++emitterIndex) {
+        updateEmitter(emitterIndex, deltaT);
+
+        // All of the points on a mesh get picked in one go, which 
+        // keeps the mesh's tables in the cache while it's at it.
+        const ParticleScript* spawnScript = emitterSpawnScripts[emitterIndex];
+        const EmitterMesh* mesh = emitterMeshes[emitterIndex];
+        if (mesh != nullptr && numToEmitPerEmitter[emitterIndex] > 0) {
+            surfacePoints.resize(numToEmitPerEmitter[emitterIndex]);
+            mesh->sampleSurface((unsigned int)numToEmitPerEmitter[emitterIndex], surfaceRandomState, surfacePoints.data());
+        }
+
+        for (int i = 0; i < numToEmitPerEmitter[emitterIndex]; ++i) {
+            Particle* freeParticle = takeParticle();
+            if (freeParticle == nullptr) {
+                // We've run out of room for new particles.
+                // This shouldn't ever happen because we were careful to make 
+                // sure that the number of new particles to emit is not greater 
+                // that the number of available particles. However, it is always 
+                // good to double-check.
+                break;
+            }
+            Particle& particle = *freeParticle;
+
+            emitParticle(particle, emitterIndex, deltaT, mesh != nullptr ? &surfacePoints[i] : nullptr);
+            ++activeParticleCount;
+
+            if (spawnScript != nullptr) {
+                spawnedParticles.push_back(&particle);
+            }
+        }
+
+        if (spawnScript != nullptr) {
+            spawnScript->run(spawnedParticles.data(), (unsigned int)spawnedParticles.size(), (float)deltaT, scriptRandomState);
+            spawnedParticles.clear();
+        }
+    }
+    storeStagedParticles();
+
+    // The buckets are out of date as soon as anything else moves.
+    evictionIndexReady = false;
+    activeParticleCount -= (int)(numEvictedParticles - numEvictedBefore);
+
     numActiveParticles = activeParticleCount;
 }
 
-void ParticleSystem::getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls) {
+// Moves one particle along (if it's still alive), and returns whether 
+// it is. index is where it goes on the free list if it isn't.
+bool ParticleSystem::updateParticle(Particle& particle, unsigned int index, double deltaT, bool indexForEviction) {
+    const unsigned int deathTrigger = 1 << (unsigned int)EmitterDesc::SubEmitterTrigger::DEATH;
+    const unsigned int liveTriggers = ~deathTrigger;
+
+    float previousLifetime = particle.lifetime;
+    particle.lifetime += deltaT;
+    if (particle.lifetime < particle.maxLife) {
+        particle.prevPosition = particle.position;
+        unsigned int emitterIndex = particle.emitterIndex;
+        unsigned int events = emitterKernels[emitterIndex](particle, emitters[emitterIndex], emitterCurves[emitterIndex], (float)deltaT);
+        if ((emitterTriggers[emitterIndex] & liveTriggers) != 0) {
+            addParticleEvents(particle, previousLifetime, events);
+        }
+        if (indexForEviction) {
+            evictionBuckets[getEvictionBucket(particle)].push_back(index);
+        }
+
+        if (emitterUpdateScripts[emitterIndex] != nullptr) {
+            std::vector<Particle*>& scriptChunk = scriptChunks[emitterIndex];
+            scriptChunk.push_back(&particle);
+            if (scriptChunk.size() == SCRIPT_CHUNK_SIZE) {
+                runUpdateScript(emitterIndex, (float)deltaT);
+            }
+        }
+
+        // The particles that have just moved get collided in chunks, 
+        // while they're still in the cache.
+        if (colliderSet != nullptr) {
+            chunkParticles.push_back(&particle);
+            if (chunkParticles.size() == COLLISION_CHUNK_SIZE) {
+                collideChunk();
+            }
+        }
+        return true;
+    }
+
+    freeParticles.push_back(index);
+
+    // It's only just died.
+    if (previousLifetime < particle.maxLife
+        && (emitterTriggers[particle.emitterIndex] & deathTrigger) != 0) {
+        addParticleEvents(particle, previousLifetime, ParticleUpdateKernels<Particle>::NO_EVENTS);
+    }
+    return false;
+}
+
+// Runs whatever's left waiting for the update scripts and the colliders.
+void ParticleSystem::finishUpdateBatches(double deltaT) {
+    for (unsigned int emitterIndex = 0; emitterIndex < emitters.size(); ++emitterIndex) {
+        if (!scriptChunks[emitterIndex].empty()) {
+            runUpdateScript(emitterIndex, (float)deltaT);
+        }
+    }
+    if (colliderSet != nullptr) {
+        collideChunk();
+    }
+}
+
+// Updates a chunk's particles where they are, a block at a time, with 
+// their emitters' compact kernels, which pack them up again around the 
+// chunk's new origin. Returns how many are still alive.
+unsigned int ParticleSystem::updateCompactChunk(unsigned int chunkIndex, double deltaT, bool indexForEviction) {
+    if (batchCompactUpdates) {
+        return updateCompactChunkInBatches(chunkIndex, deltaT, indexForEviction);
+    }
+
+    ParticleChunk* chunk = chunks[chunkIndex];
+    CompactParticleBlock* blocks = chunk->getCompactBlocks();
+    unsigned int chunkSize = getChunkSize(chunkIndex);
+    unsigned int first = chunkIndex << CHUNK_SHIFT;
+    glm::vec3 origin = chunk->origin;
+    glm::vec3 newOrigin = chunk->nextOrigin;
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    unsigned int numLive = 0;
+
+    for (unsigned int begin = 0; begin < chunkSize; begin += CompactParticleBlock::SIZE) {
+        CompactParticleBlock& block = blocks[begin / CompactParticleBlock::SIZE];
+        unsigned int blockSize = chunkSize - begin < CompactParticleBlock::SIZE ? chunkSize - begin : CompactParticleBlock::SIZE;
+
+        // Usually, every particle in a block comes from the same 
+        // emitter, but where they don't, each emitter's kernel does 
+        // its own lanes.
+        unsigned int liveLanes = block.getLiveLanes();
+        unsigned int aliveLanes = 0;
+        for (unsigned int lanesLeft = liveLanes; lanesLeft != 0;) {
+            unsigned int lane = 0;
+            while (!(lanesLeft & (1 << lane))) {
+                ++lane;
+            }
+            unsigned int emitterIndex = block.emitterIndices[lane];
+            unsigned int lanes = lanesLeft & block.getLanesFromEmitter(emitterIndex);
+            lanesLeft &= ~lanes;
+            aliveLanes |= emitterCompactKernels[emitterIndex](block, lanes, origin, newOrigin,
+                emitters[emitterIndex], emitterCurves[emitterIndex], (float)deltaT, boundsMin, boundsMax);
+        }
+
+        for (unsigned int lane = 0; lane < blockSize; ++lane) {
+            if (!(aliveLanes & (1 << lane))) {
+                freeParticles.push_back(first + begin + lane);
+                continue;
+            }
+            ++numLive;
+            if (indexForEviction) {
+                Particle particle;
+                block.unpack(lane, particle, newOrigin);
+                evictionBuckets[getEvictionBucket(particle)].push_back(first + begin + lane);
+            }
+        }
+    }
+
+    chunk->origin = newOrigin;
+    if (numLive > 0 && boundsMin.x <= boundsMax.x && boundsMin.y <= boundsMax.y && boundsMin.z <= boundsMax.z) {
+        chunk->nextOrigin = (boundsMin + boundsMax) * 0.5f;
+    }
+    return numLive;
+}
+
+// Unpacks a chunk's particles a batch at a time, updates them just like 
+// full-size ones (force fields, kernels, scripts, colliders and all), 
+// and packs them up again, around the chunk's new origin. Returns how 
+// many are still alive.
+unsigned int ParticleSystem::updateCompactChunkInBatches(unsigned int chunkIndex, double deltaT, bool indexForEviction) {
+    ParticleChunk* chunk = chunks[chunkIndex];
+    CompactParticleBlock* blocks = chunk->getCompactBlocks();
+    unsigned int chunkSize = getChunkSize(chunkIndex);
+    unsigned int first = chunkIndex << CHUNK_SHIFT;
+    glm::vec3 origin = chunk->origin;
+    glm::vec3 newOrigin = chunk->nextOrigin;
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    unsigned int numLive = 0;
+
+    for (unsigned int begin = 0; begin < chunkSize; begin += COMPACT_BATCH_SIZE) {
+        unsigned int batchSize = chunkSize - begin < COMPACT_BATCH_SIZE ? chunkSize - begin : COMPACT_BATCH_SIZE;
+        // Dead particles don't need unpacking (or packing up again), 
+        // just something that the update will see is dead. Only the 
+        // scripts ever look at the color, since it doesn't get kept.
+        for (unsigned int i = 0; i < batchSize; ++i) {
+            const CompactParticleBlock& block = blocks[(begin + i) / CompactParticleBlock::SIZE];
+            unsigned int lane = (begin + i) % CompactParticleBlock::SIZE;
+            Particle& particle = compactBatch[i];
+            if (!block.isAlive(lane)) {
+                particle.lifetime = 0.0f;
+                particle.maxLife = 0.0f;
+                continue;
+            }
+            block.unpack(lane, particle, origin);
+            if (emitterUpdateScripts[particle.emitterIndex] != nullptr) {
+                particle.color = emitterCurves[particle.emitterIndex].colors[LifetimeCurves::getIndex(block.getAge(lane))];
+            }
+        }
+
+        if (forceFieldSet != nullptr) {
+            pushByForceFields(compactBatch.data(), batchSize, deltaT, 0);
+        }
+
+        for (unsigned int i = 0; i < batchSize; ++i) {
+            Particle& particle = compactBatch[i];
+            if (updateParticle(particle, first + begin + i, deltaT, indexForEviction)) {
+                ++numLive;
+            }
+        }
+
+        // The scripts and colliders need to be done with the batch 
+        // before it gets reused.
+        finishUpdateBatches(deltaT);
+
+        // While we're at it, find where the live ones are, for the 
+        // next origin.
+        for (unsigned int i = 0; i < batchSize; ++i) {
+            CompactParticleBlock& block = blocks[(begin + i) / CompactParticleBlock::SIZE];
+            unsigned int lane = (begin + i) % CompactParticleBlock::SIZE;
+            if (block.isAlive(lane)) {
+                const Particle& particle = compactBatch[i];
+                block.pack(lane, particle, newOrigin);
+                if (particle.lifetime < particle.maxLife) {
+                    for (int axis = 0; axis < 3; ++axis) {
+                        float value = particle.position[axis];
+                        if (std::isfinite(value)) {
+                            boundsMin[axis] = value < boundsMin[axis] ? value : boundsMin[axis];
+                            boundsMax[axis] = value > boundsMax[axis] ? value : boundsMax[axis];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    chunk->origin = newOrigin;
+    if (numLive > 0 && boundsMin.x <= boundsMax.x && boundsMin.y <= boundsMax.y && boundsMin.z <= boundsMax.z) {
+        chunk->nextOrigin = (boundsMin + boundsMax) * 0.5f;
+    }
+    return numLive;
+}
+
+// Works out how the live particles push and pull on each other (as 
+// a fluid, or with gravity), and speeds them up (or slows them down) 
+// to match.
+void ParticleSystem::applyInteractionForces(double deltaT) {
+    interactingParticles.clear();
+    interactingPositions.clear();
+    interactingVelocities.clear();
+    for (unsigned int chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+        const ParticleChunk* chunk = chunks[chunkIndex];
+        if (chunk == nullptr || chunk->numLive == 0) {
+            continue;
+        }
+        unsigned int chunkSize = getChunkSize(chunkIndex);
+        unsigned int first = chunkIndex << CHUNK_SHIFT;
+        for (unsigned int j = 0; j < chunkSize; ++j) {
+            const Particle& particle = chunk->getParticles()[j];
+            if (particle.lifetime < particle.maxLife) {
+                interactingParticles.push_back(first + j);
+                interactingPositions.push_back(glm::vec3(particle.position));
+                interactingVelocities.push_back(particle.velocity);
+            }
+        }
+    }
+
+    unsigned int numInteracting = (unsigned int)interactingParticles.size();
+    if (numInteracting == 0) {
+        return;
+    }
+
+    interactingAccelerations.resize(numInteracting);
+    if (fluidSolver != nullptr) {
+        fluidSolver->computeAccelerations(interactingPositions.data(), interactingVelocities.data(), numInteracting, interactingAccelerations.data());
+    }
+    else {
+        nbodySolver->computeAccelerations(interactingPositions.data(), numInteracting, interactingAccelerations.data());
+    }
+
+    for (unsigned int i = 0; i < numInteracting; ++i) {
+        getParticle(interactingParticles[i]).velocity += interactingAccelerations[i] * (float)deltaT;
+    }
+}
+
+// Speeds the live particles up (or slows them down) by the force fields. 
+// Each chunk is a range of the pool, and only the fields that reach the 
+// live particles in it get looked at. PARTICLES_PER_CHUNK is a multiple 
+// of FORCE_FIELD_CHUNK_SIZE, so every range is inside one ParticleChunk, 
+// and the ranges in chunks that we don't have (or that are empty) get 
+// skipped straight away.
+void ParticleSystem::applyForceFields(double deltaT) {
+    unsigned int numRanges = (config.maxParticles + FORCE_FIELD_CHUNK_SIZE - 1) / FORCE_FIELD_CHUNK_SIZE;
+    ThreadPool::getDefault().parallelFor(numRanges, 1, [&](unsigned int firstRange, unsigned int endRange, unsigned int threadIndex) {
+        for (unsigned int range = firstRange; range < endRange; ++range) {
+            unsigned int begin = range * FORCE_FIELD_CHUNK_SIZE;
+            unsigned int end = begin + FORCE_FIELD_CHUNK_SIZE < (unsigned int)config.maxParticles ? begin + FORCE_FIELD_CHUNK_SIZE : (unsigned int)config.maxParticles;
+            ParticleChunk* particleChunk = chunks[begin >> CHUNK_SHIFT];
+            if (particleChunk != nullptr && particleChunk->numLive > 0) {
+                pushByForceFields(&getParticle(begin), end - begin, deltaT, threadIndex);
+            }
+        }
+    });
+}
+
+// Pushes count particles (alive or not) by the force fields that reach 
+// them, using threadIndex's lists.
+void ParticleSystem::pushByForceFields(Particle* particles, unsigned int count, double deltaT, unsigned int threadIndex) {
+    std::vector<Particle*>& chunkParticles = threadChunkParticles[threadIndex];
+    std::vector<unsigned int>& chunkFields = threadChunkFields[threadIndex];
+
+    // The particles that are still going to be alive after this update.
+    chunkParticles.clear();
+    glm::vec3 chunkMin(FLT_MAX);
+    glm::vec3 chunkMax(-FLT_MAX);
+    for (unsigned int i = 0; i < count; ++i) {
+        Particle& particle = particles[i];
+        if (particle.lifetime + deltaT < particle.maxLife) {
+            chunkParticles.push_back(&particle);
+            glm::vec3 position(particle.position);
+            chunkMin = glm::min(chunkMin, position);
+            chunkMax = glm::max(chunkMax, position);
+        }
+    }
+    if (chunkParticles.empty()) {
+        return;
+    }
+
+    forceFieldSet->findFields(chunkMin, chunkMax, chunkFields);
+    for (unsigned int fieldIndex : chunkFields) {
+        forceFieldSet->apply(fieldIndex, chunkParticles.data(), (unsigned int)chunkParticles.size(), chunkMin, chunkMax, (float)deltaT);
+    }
+}
+
+// Bounces the particles in chunkParticles off of any colliders that 
+// they've gone into, and empties it out.
+void ParticleSystem::collideChunk() {
+    unsigned int numChunkParticles = (unsigned int)chunkParticles.size();
+    if (numChunkParticles == 0) {
+        return;
+    }
+
+    glm::vec3 chunkMin(chunkParticles[0]->position);
+    glm::vec3 chunkMax = chunkMin;
+    for (unsigned int i = 1; i < numChunkParticles; ++i) {
+        glm::vec3 position(chunkParticles[i]->position);
+        chunkMin = glm::min(chunkMin, position);
+        chunkMax = glm::max(chunkMax, position);
+    }
+
+    colliderSet->findColliders(chunkMin, chunkMax, chunkColliders);
+    for (unsigned int colliderIndex : chunkColliders) {
+        colliderSet->collide(colliderIndex, chunkParticles.data(), numChunkParticles);
+    }
+
+    chunkParticles.clear();
+}
+
+// Runs the particles that are waiting in an emitter's script chunk 
+// through its update script, and empties the chunk out.
+void ParticleSystem::runUpdateScript(unsigned int emitterIndex, float deltaT) {
+    std::vector<Particle*>& scriptChunk = scriptChunks[emitterIndex];
+    emitterUpdateScripts[emitterIndex]->run(scriptChunk.data(), (unsigned int)scriptChunk.size(), deltaT, scriptRandomState);
+    scriptChunk.clear();
+}
+
+// Updates the entire particle system, on the GPU. The particles never 
+// come back to the CPU, so all we do here is move the emitters along and 
+// tell the compute shaders about them.
+void ParticleSystem::updateGPU(double deltaT) {
+    if (gpuResourceManager == nullptr || arenaSystemIndex == GPUParticleArena::INVALID_SYSTEM) {
+        return;
+    }
+
+    gfx::ResourceManager& resourceManager = *gpuResourceManager;
+
+    // We can't know how many particles are free without asking the GPU 
+    // (which would mean waiting for it), so we ask for all of the ones 
+    // that are due, and the emit pass emits as many as it can.
+    int numParticlesToEmit = getNumParticlesToEmit(deltaT, INT_MAX);
+
+    // Each emitter's particles are a range of the emit pass's threads, 
+    // so the emit pass can find which emitter it's emitting for.
+    unsigned int firstToEmit = 0;
+    for (unsigned int i = 0; i < emitters.size(); ++i) {
+        updateEmitter(i, deltaT);
+
+        const EmitterDesc& emitter = emitters[i];
+        const EmitterState& state = emitterStates[i];
+        EmitterParams& emitterParam = emitterParams[i];
+        emitterParam.position = glm::vec4(state.position, emitter.velocityJitter);
+        emitterParam.velocity = glm::vec4(state.velocity, emitter.drag);
+        emitterParam.shapeSize = glm::vec4(emitter.halfExtents, emitter.radius);
+        emitterParam.startPosition = glm::vec4(state.startPosition, 0.0f);
+        emitterParam.minLifetime = emitter.particleMinLifetime;
+        emitterParam.maxLifetime = emitter.particleMaxLifetime;
+        emitterParam.shape = (unsigned int)emitter.shape;
+        emitterParam.firstToEmit = firstToEmit;
+        emitterParam.numToEmit = (unsigned int)numToEmitPerEmitter[i];
+        emitterParam.features = emitter.features;
+        firstToEmit += emitterParam.numToEmit;
+    }
+    resourceManager.streamDataToStorageBuffer(emitterParamsBufferHandle, [this](void* buffer) {
+            memcpy_s(buffer, sizeof(EmitterParams) * emitterParams.size(), emitterParams.data(), sizeof(EmitterParams) * emitterParams.size());
+        });
+
+    SimParams params = {};
+    params.deltaT = (float)deltaT;
+    params.numToEmit = (unsigned int)numParticlesToEmit;
+    params.randomSeed = ++numGPUUpdates;
+    params.particleBase = arena->getParticleBase(arenaSystemIndex);
+    params.numParticles = config.maxParticles;
+    params.systemIndex = arenaSystemIndex;
+    params.numEmitters = (unsigned int)emitters.size();
+    resourceManager.streamDataToUniformBuffer(simParamsBufferHandle, [&params](void* buffer) {
+            memcpy_s(buffer, sizeof(SimParams), &params, sizeof(SimParams));
+        });
+
+    resourceManager.bindStorageBufferBase(arena->getParticleBuffer(), SIM_PARTICLES_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(arena->getStateBuffer(), SIM_STATES_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(freeListBufferHandle, SIM_FREE_LIST_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(emitterParamsBufferHandle, SIM_EMITTERS_BINDING_INDEX);
+    resourceManager.bindStorageBufferBase(curvesBufferHandle, SIM_CURVES_BINDING_INDEX);
+    resourceManager.bindUniformBufferBase(simParamsBufferHandle, SIM_PARAMS_BINDING_INDEX);
+
+    // First update the particles that are already alive, which also 
+    // puts the ones that die onto the free list...
+    unsigned int numUpdateGroups = (config.maxParticles + SIM_GROUP_SIZE - 1) / SIM_GROUP_SIZE;
+    resourceManager.dispatchCompute(arena->getUpdateProgram(), numUpdateGroups, 1, 1);
+    resourceManager.memoryBarrier(gfx::ResourceManager::STORAGE_BARRIER);
+
+    // ...then emit the new ones into the free spots.
+    if (numParticlesToEmit > 0) {
+        unsigned int numEmitGroups = (numParticlesToEmit + SIM_GROUP_SIZE - 1) / SIM_GROUP_SIZE;
+        resourceManager.dispatchCompute(arena->getEmitProgram(), numEmitGroups, 1, 1);
+        resourceManager.memoryBarrier(gfx::ResourceManager::STORAGE_BARRIER);
+    }
+}
+
+void ParticleSystem::getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls, float interpolationAlpha) {
+    // A GPU-simulated system gets drawn by its arena, along with 
+    // every other system in it. If the arena is shared, whoever 
+    // owns it adds its draw calls.
+    if (config.simulationMode == SimulationMode::GPU) {
+        if (ownsArena) {
+            arena->getDrawCalls(resourceManager, drawCalls, interpolationAlpha);
+        }
+        return;
+    }
+
     // Here we're basically copying the particle data to memory that the shader can access.
     resourceManager.streamDataToStorageBuffer(storageBufferHandle, [this](void* buffer) {
-            // The shader needs 3 properties:
+            // The shader needs 4 properties:
             // - position (p)
+            // - previous position (q)
             // - color (c)
             // - size (s)
             // These properties need to be sent to the shader using a specific memory layout 
             // called std140. There are two basic rules.
             // 1. The properties need to be contigious, i.e. if there are four particles, 
-            //    then we need to send the data like pppp|cccc|ssss, NOT pcs|pcs|pcs|pcs
+            //    then we need to send the data like pppp|qqqq|cccc|ssss, NOT pqcs|pqcs|pqcs|pqcs
             // 2. The properties need to be aligned to 4 floats. This is fine for 
             //    p and c, because they are already vec4s. However, the size is just 
             //    a single float. So we'll have to allocate 4 floats per size, and just 
@@ -372,21 +1790,59 @@ void ParticleSystem::getDrawCalls(gfx::ResourceManager& resourceManager, std::ve
             //    some memory, but we have plenty, and the nice alignment makes the
             //    GPU go brrrrr.
             glm::vec4* position = (glm::vec4*)buffer;
-            glm::vec4* color = position + config.maxParticles;
+            glm::vec4* prevPosition = position + config.maxParticles;
+            glm::vec4* color = prevPosition + config.maxParticles;
             glm::vec4* size = color + config.maxParticles;
 
-            for (int i = 0; i < config.maxParticles; i++) {
-                const Particle& particle = particles[i];
-                bool isAlive = particle.lifetime < particle.maxLife;
-                if (isAlive) {
-                    // For some reason, memcpy seems faster than assignment. I should investigate.
-                    memcpy_s(position++, sizeof(glm::vec4), &particle.position, sizeof(glm::vec4));
-                    memcpy_s(color++, sizeof(glm::vec4), &particle.color, sizeof(glm::vec4));
-                    memcpy_s(size++, sizeof(float), &particle.size, sizeof(float));
+            // Only the chunks with something alive in them need looking at.
+            for (unsigned int chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex) {
+                const ParticleChunk* chunk = chunks[chunkIndex];
+                if (chunk == nullptr || chunk->numLive == 0) {
+                    continue;
+                }
+                unsigned int chunkSize = getChunkSize(chunkIndex);
+
+                // Compact particles get unpacked as they go. Where they 
+                // were is just where their velocity says.
+                if (config.compactParticles) {
+                    const CompactParticleBlock* blocks = chunk->getCompactBlocks();
+                    for (unsigned int i = 0; i < chunkSize; i++) {
+                        const CompactParticleBlock& block = blocks[i / CompactParticleBlock::SIZE];
+                        unsigned int lane = i % CompactParticleBlock::SIZE;
+                        if (block.isAlive(lane)) {
+                            Particle particle;
+                            block.unpack(lane, particle, chunk->origin);
+                            glm::vec4 particlePrevPosition = particle.position - glm::vec4(particle.velocity * lastDeltaT, 0.0f);
+                            const glm::vec4& particleColor = emitterCurves[particle.emitterIndex].colors[LifetimeCurves::getIndex(block.getAge(lane))];
+                            memcpy_s(position++, sizeof(glm::vec4), &particle.position, sizeof(glm::vec4));
+                            memcpy_s(prevPosition++, sizeof(glm::vec4), &particlePrevPosition, sizeof(glm::vec4));
+                            memcpy_s(color++, sizeof(glm::vec4), &particleColor, sizeof(glm::vec4));
+                            memcpy_s(size++, sizeof(float), &particle.size, sizeof(float));
+                        }
+                    }
+                    continue;
+                }
+
+                for (unsigned int i = 0; i < chunkSize; i++) {
+                    const Particle& particle = chunk->getParticles()[i];
+                    bool isAlive = particle.lifetime < particle.maxLife;
+                    if (isAlive) {
+                        // For some reason, memcpy seems faster than assignment. I should investigate.
+                        memcpy_s(position++, sizeof(glm::vec4), &particle.position, sizeof(glm::vec4));
+                        memcpy_s(prevPosition++, sizeof(glm::vec4), &particle.prevPosition, sizeof(glm::vec4));
+                        memcpy_s(color++, sizeof(glm::vec4), &particle.color, sizeof(glm::vec4));
+                        memcpy_s(size++, sizeof(float), &particle.size, sizeof(float));
+                    }
                 }
             }
         });
 
+    ShaderParams params = {};
+    params.interpolationAlpha = interpolationAlpha;
+    resourceManager.streamDataToUniformBuffer(paramsBufferHandle, [&params](void* buffer) {
+            memcpy_s(buffer, sizeof(ShaderParams), &params, sizeof(ShaderParams));
+        });
+
     gfx::DrawCall call;
     call.mode = gfx::DrawCall::Mode::TRIANGLES;
     call.numIndices = numActiveParticles * INDICES_PER_PARTICLE;
@@ -396,6 +1852,8 @@ void ParticleSystem::getDrawCalls(gfx::ResourceManager& resourceManager, std::ve
     call.storageBuffer = storageBufferHandle;
     call.vaoHandle = vaoHandle;
     call.storageBufferBaseIndex = 0;
+    call.uniformBuffer = paramsBufferHandle;
+    call.uniformBufferBaseIndex = PARAMS_BINDING_INDEX;
 
     drawCalls.push_back(call);
 }
@@ -1,8 +1,24 @@
 #pragma once
 
+#include <deque>
 #include <glm/glm.hpp>
 #include <vector>
 #include "DrawCall.h"
+#include "EmitterDesc.h"
+#include "EmitterMesh.h"
+#include "EmitterPath.h"
+#include "GPUParticleArena.h"
+#include "LifetimeCurves.h"
+#include "ParticleScript.h"
+#include "ParticleSnapshot.h"
+#include "ParticleUpdateKernels.h"
+#include "BarnesHutSolver.h"
+#include "ChunkPool.h"
+#include "ColliderSet.h"
+#include "CompactParticle.h"
+#include "ForceFieldSet.h"
+#include "SPHSolver.h"
+#include "SpawnQueue.h"
 
 namespace gfx {
 	class ResourceManager;
@@ -10,8 +26,126 @@ namespace gfx {
 
 class ParticleSystem {
 public:
+	// Where the particles get simulated. With GPU, the particles live 
+	// on the GPU the whole time (in a GPUParticleArena), and are updated 
+	// by particle_sim.comp, so the only thing we send each update is the 
+	// emitter's settings. 
+	// That needs OpenGL 4.3 (for compute shaders); the Software and Null 
+	// backends can't run compute shaders, so nothing moves there.
+	// SPH is the CPU simulation, plus the forces that make the particles 
+	// behave like a fluid (see SPHSolver), and NBODY is the CPU simulation 
+	// with every particle's gravity pulling on every other particle (see 
+	// BarnesHutSolver).
+	enum class SimulationMode {
+		CPU,
+		GPU,
+		SPH,
+		NBODY
+	};
+
+	// What happens when there isn't room in the pool for a new particle 
+	// (from an emitter, a sub-emitter, or a burst). With DROP_NEW, the 
+	// new particle just doesn't get added, so the emitters stall until 
+	// some room frees up. The others throw out a live particle to make 
+	// room for it: the one that's been alive the longest, the one 
+	// that's closest to dying anyway, or the one that's furthest from 
+	// the camera (see setCameraPosition()). They're picked from buckets 
+	// of particles that have about the same age (or time left, or 
+	// distance), so they're roughly, but not exactly, in order. Anything 
+	// from spawn() or spawnBurst() is always dropped, since it goes in 
+	// before we know which particles to throw out.
+	enum class OverflowPolicy {
+		DROP_NEW,
+		EVICT_OLDEST,
+		EVICT_NEAREST_DEATH,
+		EVICT_FARTHEST
+	};
+
 	struct Config {
 		unsigned int maxParticles;
+		SimulationMode simulationMode = SimulationMode::CPU;
+
+		// Only used with SimulationMode::GPU. Systems that share an arena 
+		// get drawn together, by whoever owns the arena. Without one, the 
+		// system makes (and draws) its own.
+		GPUParticleArena* arena = nullptr;
+
+		// Only used with SimulationMode::SPH.
+		SPHSolver::Config fluid;
+
+		// Only used with SimulationMode::NBODY.
+		BarnesHutSolver::Config nbody;
+
+		// Wind, attractors, vortices and turbulence (see ForceFieldSet), 
+		// which push every emitter's particles around. Not used with 
+		// SimulationMode::GPU.
+		std::vector<ForceField> forceFields;
+
+		// Everything that the particles bounce off of (see ColliderSet), 
+		// and how big the cells of the collider grid are. Not used with 
+		// SimulationMode::GPU.
+		std::vector<Collider> colliders;
+		float colliderCellSize = 4.0f;
+
+		// Every emitter shares the same pool of maxParticles particles, 
+		// and they're all drawn together. With none, the system gets 
+		// a single emitter with the default settings.
+		std::vector<EmitterDesc> emitters;
+
+		// Where the emitters' sub-emitters spawn their children (see 
+		// EmitterDesc::SubEmitter). With none, they go into this system. 
+		// Not owned. Sub-emitters aren't used with SimulationMode::GPU.
+		ParticleSystem* subEmitterTarget = nullptr;
+
+		// How many particles (and bursts) can be waiting to be 
+		// spawned at once (see spawn()).
+		unsigned int maxQueuedSpawns = 65536;
+		unsigned int maxQueuedBursts = 1024;
+
+		// Not used with SimulationMode::GPU (which always drops new 
+		// particles).
+		OverflowPolicy overflowPolicy = OverflowPolicy::DROP_NEW;
+
+		// Keeps the particles in a quarter of the memory (see 
+		// CompactParticleBlock), which makes the update quicker, but less 
+		// accurate. The particles' colors always come from their 
+		// emitter's color curve (so a spawn's color, a mesh's colors, or 
+		// a script that changes the color, don't stick). Only used with 
+		// SimulationMode::CPU, and up to 
+		// CompactParticleBlock::MAX_EMITTERS emitters.
+		bool compactParticles = false;
+
+		// Takes the chunks of particles out of 2 MB pages, rather than 
+		// 4 KB ones, if the OS will let us have them (see ChunkPool). 
+		// Worth it for big systems, whose particles wouldn't otherwise 
+		// fit in the CPU's TLB. Not used with SimulationMode::GPU.
+		bool hugePages = false;
+	};
+
+	// A particle that gets added from outside of the emitters (for an 
+	// impact, say). After that, it's just like one of its emitter's own 
+	// particles, so it's moved by the emitter's kernel, and picks up the 
+	// emitter's gravity, drag, colors and sizes.
+	struct ParticleSpawn {
+		glm::vec3 position;
+		glm::vec3 velocity;
+		glm::vec4 color = glm::vec4(1.0f);
+		float size = 0.05f;
+		float lifetime = 1.0f; // how long it lives for
+		unsigned int emitterIndex = 0;
+	};
+
+	// A burst of particles, all flying outwards from somewhere in a 
+	// sphere, with their emitter's starting color and size.
+	struct ParticleBurst {
+		glm::vec3 position;
+		glm::vec3 velocity; // added to every particle's (for something that explodes while it's moving)
+		float radius = 0.0f;
+		float speed = 5.0f;
+		float speedJitter = 0.0f; // the speeds are between speed - speedJitter and speed + speedJitter
+		float minLifetime = 1.0f;
+		float maxLifetime = 1.0f;
+		unsigned int emitterIndex = 0;
 	};
 
 	ParticleSystem(const Config& config);
@@ -20,52 +154,364 @@ public:
 	void initGraphicsResources(gfx::ResourceManager& resourceManager);
 
 	void update(double deltaT);
-	void getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls);
+
+	// Both of these are safe to call from any thread, at any time (even 
+	// during update()). The particles get added at the start of the next 
+	// update(). If there isn't room in the queue for all of them, none of 
+	// them get queued, and they return false. If there isn't room in the 
+	// pool for all of them when they're added, the rest get dropped. Not 
+	// used with SimulationMode::GPU (they always return false).
+	bool spawn(const ParticleSpawn* spawns, unsigned int count);
+	bool spawnBurst(const ParticleBurst& burst, unsigned int count);
+
+	// Saves the live particles, and where the emitters have got to (see 
+	// ParticleSnapshot), so that a system that's been run for a while 
+	// ahead of time can be started from there. Returns false if the file 
+	// couldn't be written. Not used with SimulationMode::GPU (it always 
+	// returns false).
+	bool saveSnapshot(const char* filename) const;
+
+	// Throws away all of the particles, and starts over from the 
+	// snapshot. The snapshot has to have come from a system with the 
+	// same emitters (it returns false if it doesn't have as many), and 
+	// any particles that there isn't room for get left out. Not used 
+	// with SimulationMode::GPU (it always returns false).
+	bool loadSnapshot(const ParticleSnapshot& snapshot);
+
+	// Throws away all of the particles, and starts over as if the 
+	// system had been running for seconds already (but without taking 
+	// that long). The particles are only moved by their emitter's 
+	// features (gravity, drag, the floor, and the color and size 
+	// curves), and spawn scripts, so anything else (force fields, 
+	// colliders, update scripts, sub-emitters, and the fluid or gravity 
+	// forces) only kicks in from the next update. Not used with 
+	// SimulationMode::GPU.
+	void prewarm(double seconds);
+
+	unsigned int getNumEmitters() const { return (unsigned int)emitters.size(); }
+
+	// How many chunks of particles (see ParticleChunk) the system is 
+	// holding on to right now. Always 0 with SimulationMode::GPU.
+	unsigned int getNumAllocatedChunks() const { return numAllocatedChunks; }
+
+	// How much memory the pool that the chunks come from (which is 
+	// shared with every other system that has the same compactParticles 
+	// and hugePages) has mapped, and how many pages (and so TLB entries) 
+	// it takes up.
+	ChunkPool::Stats getChunkPoolStats() const { return getChunkPool().getStats(); }
+
+	// How many new particles haven't been added because there wasn't 
+	// room for them, and how many live ones have been thrown out to make 
+	// room (see OverflowPolicy), since the system was made. Sub-emitter 
+	// children that didn't fit in subEmitterTarget's queue count here, 
+	// rather than there. Always 0 with SimulationMode::GPU.
+	unsigned long long getNumDroppedParticles() const { return numDroppedParticles; }
+	unsigned long long getNumEvictedParticles() const { return numEvictedParticles; }
+
+	// Only used with OverflowPolicy::EVICT_FARTHEST.
+	void setCameraPosition(const glm::vec3& position) { cameraPosition = position; }
+
+	// What went wrong with any scripts that didn't compile (or couldn't 
+	// be found), one per line. Those emitters just go without them.
+	const std::string& getScriptErrors() const { return scriptErrors; }
+
+	// Moves an emitter (or, with Motion::HOP, the center of its circle).
+	void setEmitterPosition(unsigned int emitterIndex, const glm::vec3& worldPos);
+
+	// Only used with SimulationMode::NBODY. Smaller angles are more 
+	// accurate, bigger ones are quicker (see BarnesHutSolver).
+	void setOpeningAngle(float openingAngle);
+	float getOpeningAngle() const;
+
+	// interpolationAlpha blends between the particle positions before 
+	// and after the last update(), from 0 (before) to 1 (after). This is 
+	// for when the simulation runs at a fixed rate that doesn't match the 
+	// frame rate (see FixedTimestep).
+	void getDrawCalls(gfx::ResourceManager& resourceManager, std::vector<gfx::DrawCall>& drawCalls, float interpolationAlpha = 1.0f);
 
 private:
 
 	struct Particle {
 		glm::vec4 position;
+		glm::vec4 prevPosition; // where it was before the last update
 		glm::vec3 velocity;
 		glm::vec4 color;
 		float size;
 		float lifetime;
 		float maxLife;
+		unsigned int emitterIndex;
 	};
 
-	struct HopEmitter {
-		glm::vec3 worldPos;
-		float circleRadius;
-		int numHops;
-		float hopHeight;
-		float horizontalSpeed;
+	// The parts of an emitter that change as it runs.
+	struct EmitterState {
 		double lifetime;
 
-		float offsetRadius;
-		float drag;
+		// Where it is (and how fast it's going) at the end of this update.
+		glm::vec3 position;
+		glm::vec3 velocity;
+
+		// Where it was at the start of this update. The particles that it 
+		// emits during the update start out somewhere in between.
+		glm::vec3 startPosition;
 
-		glm::vec4 particleStartColor;
-		glm::vec4 particleMidColor;
-		glm::vec4 particleEndColor;
+		// The fraction of a particle that we didn't get to emit 
+		// last update, so that it can be emitted this update.
+		float emissionRemainder;
+	};
+
+	// These have the same memory layout as the SimParams interface 
+	// block and the EmitterParams struct in particle_sim.comp.
+	struct SimParams {
+		float deltaT;
+		unsigned int numToEmit; // from all of the emitters together
+		unsigned int randomSeed;
+		unsigned int particleBase;
+		unsigned int numParticles;
+		unsigned int systemIndex;
+		unsigned int numEmitters;
+		unsigned int padding;
+	};
 
-		float particleStartSize;
-		float particleEndSize;
-		int particlesPerSecond;
+	// The colors and sizes aren't in here, since they're in the 
+	// emitter's LifetimeCurves, which only get sent once.
+	struct EmitterParams {
+		glm::vec4 position; // w is the velocity jitter
+		glm::vec4 velocity; // w is the drag
+		glm::vec4 shapeSize; // the half extents for a box, and w is the radius for a sphere
+		glm::vec4 startPosition; // where the emitter was at the start of the update (w is unused)
+		float minLifetime;
+		float maxLifetime;
+		unsigned int shape;
+		unsigned int features; // EmitterDesc::Features
+		unsigned int firstToEmit; // this emitter's particles are numbers firstToEmit to firstToEmit + numToEmit - 1 of the emit pass
+		unsigned int numToEmit;
+		unsigned int padding[2];
+	};
 
-		float particleMinLifetime;
-		float particleMaxLifetime;
+	// This struct has the same memory layout as the 
+	// ParticleParams interface block in particle.vert.
+	struct ShaderParams {
+		float interpolationAlpha;
+		float padding[3];
 	};
 
-	Particle* particles = nullptr;
+	// A burst, along with how many particles it has.
+	struct QueuedBurst {
+		ParticleBurst burst;
+		unsigned int count;
+	};
+
+	// The particles live in chunks of PARTICLES_PER_CHUNK, which come 
+	// out of a pool that every system shares (see getChunkPool()). A 
+	// chunk only gets taken when there's no room left in the ones we 
+	// have, and goes back as soon as there's nothing alive in it, so a 
+	// system that's mostly idle only costs as much memory as the 
+	// particles it actually has. Particle i is particle 
+	// i % PARTICLES_PER_CHUNK of chunk i / PARTICLES_PER_CHUNK, and the 
+	// chunks that we aren't using are null. Not used with 
+	// SimulationMode::GPU.
+	//
+	// The header takes up a whole cache line, so that the particles 
+	// start on one.
+	//
+	// With compactParticles, the chunks have CompactParticleBlocks in 
+	// them instead, whose positions are from the chunk's origin. A new chunk's 
+	// origin is wherever its first particle is, and it's moved to the 
+	// middle of the chunk's particles every update (they all get 
+	// rewritten anyway), so they stay close to it.
+	static const unsigned int CHUNK_SHIFT = 14;
+	static const unsigned int PARTICLES_PER_CHUNK = 1 << CHUNK_SHIFT;
+	struct alignas(64) ParticleChunk {
+		unsigned int numLive; // as of the last update, plus any that have been added since
+		unsigned int numUsed; // every particle past these has never been taken
+		glm::vec3 origin; // only with compactParticles
+		glm::vec3 nextOrigin; // where the origin moves to next update
+		bool needsOrigin; // until the first particle gets stored in it
+
+		// The particles come straight after.
+		Particle* getParticles() { return (Particle*)(this + 1); }
+		const Particle* getParticles() const { return (const Particle*)(this + 1); }
+		CompactParticleBlock* getCompactBlocks() { return (CompactParticleBlock*)(this + 1); }
+		const CompactParticleBlock* getCompactBlocks() const { return (const CompactParticleBlock*)(this + 1); }
+	};
+	std::vector<ParticleChunk*> chunks;
+
+	// Only with compactParticles. The particles get updated where they 
+	// are, a block at a time, by their emitters' compact kernels, unless something needs to 
+	// see them as full-size Particles (force fields, colliders, update 
+	// scripts or sub-emitters), in which case they get unpacked into 
+	// compactBatch a batch at a time to be updated, and packed up again 
+	// afterwards. New particles get put together in stagedParticles, 
+	// and packed up once they're finished with (see storeStagedParticles()).
+	bool batchCompactUpdates = false;
+	std::vector<Particle> compactBatch;
+	std::deque<Particle> stagedParticles;
+	std::vector<unsigned int> stagedParticleIndices;
+	float lastDeltaT = 0.0f; // to work out where the particles were
+	unsigned int numAllocatedChunks = 0;
+	unsigned int numUnallocatedParticles = 0; // the room left for more chunks
 	int numActiveParticles = 0;
 
+	// Something that happened to a particle during the update that sets 
+	// off one of its emitter's sub-emitters. They all get dealt with 
+	// together, after the particles have been updated.
+	struct ParticleEvent {
+		glm::vec3 position;
+		glm::vec3 velocity;
+		unsigned int emitterIndex; // the parent's
+		unsigned int subEmitterIndex;
+	};
+
+	// The indices of the unused particles in the chunks that we have, 
+	// as of the end of the last update (less the ones that have been 
+	// used since), so that new particles never have to go looking for 
+	// somewhere to go. The ones in the lowest chunk are at the back, so 
+	// they get used first, and the higher chunks get a chance to empty 
+	// out.
+	std::vector<unsigned int> freeParticles;
+
+	// Only used with the OverflowPolicy values that evict. Every update, 
+	// the live particles get sorted into NUM_EVICTION_BUCKETS buckets 
+	// (as they're updated), with the ones that we'd most like to get rid 
+	// of in bucket 0. Whatever gets evicted comes off of the first bucket 
+	// that still has anything in it, so it doesn't matter how many have 
+	// been evicted already. The buckets split up 0 to evictionScale (the 
+	// biggest age, time left or distance from the last update), and are 
+	// only good until the end of the update (evictionIndexReady).
+	static const unsigned int NUM_EVICTION_BUCKETS = 64;
+	std::vector<std::vector<unsigned int>> evictionBuckets;
+	unsigned int firstEvictionBucket = 0;
+	unsigned int numEvictableParticles = 0;
+	float evictionScale = 0.0f;
+	float nextEvictionScale = 0.0f;
+	bool evictionIndexReady = false;
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	unsigned long long numDroppedParticles = 0;
+	unsigned long long numEvictedParticles = 0;
+
+	// Not used with SimulationMode::GPU.
+	SpawnQueue<ParticleSpawn>* spawnQueue = nullptr;
+	SpawnQueue<QueuedBurst>* burstQueue = nullptr;
+
 	Config config;
-	HopEmitter emitter;
+	std::vector<EmitterDesc> emitters;
+	std::vector<EmitterState> emitterStates;
+	std::vector<int> numToEmitPerEmitter; // for each emitter, this update
+	unsigned int emitRandomState = 1; // for randomFloat()
 
 	gfx::ResourceManager::HVAO vaoHandle = 0;
 	gfx::ResourceManager::HBUFFER storageBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER paramsBufferHandle = 0;
 	gfx::ResourceManager::HPROGRAM programHandle = 0;
 
-	// Updates a single particle.
-	inline void updateParticle(Particle& particle, double deltaT);
+	// Only used with SimulationMode::GPU.
+	gfx::ResourceManager* gpuResourceManager = nullptr;
+	GPUParticleArena* arena = nullptr;
+	bool ownsArena = false;
+	unsigned int arenaSystemIndex = GPUParticleArena::INVALID_SYSTEM;
+	gfx::ResourceManager::HBUFFER freeListBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER simParamsBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER emitterParamsBufferHandle = 0;
+	gfx::ResourceManager::HBUFFER curvesBufferHandle = 0;
+	std::vector<EmitterParams> emitterParams;
+	unsigned int numGPUUpdates = 0;
+
+	// Each emitter's particles are updated by the kernel 
+	// that only has the features that the emitter uses.
+	std::vector<ParticleUpdateKernels<Particle>::Kernel> emitterKernels;
+	std::vector<ParticleUpdateKernels<Particle>::CompactKernel> emitterCompactKernels;
+	std::vector<LifetimeCurves> emitterCurves;
+	std::vector<EmitterPath> emitterPaths; // empty, apart from for Motion::PATH
+
+	// For each emitter, a bit (1 << SubEmitterTrigger) for every kind of 
+	// trigger that its sub-emitters use, so the update loop can skip 
+	// straight past the particles that don't have any.
+	std::vector<unsigned int> emitterTriggers;
+	std::vector<ParticleEvent> particleEvents;
+
+	// Only for emitters with scripts (null otherwise). The scripts that 
+	// we compiled ourselves are ours to delete. Each emitter's particles 
+	// get run through its update script a chunk at a time, and the 
+	// particles it's just emitted get run through its spawn script 
+	// all together.
+	std::vector<const ParticleScript*> emitterUpdateScripts;
+	std::vector<const ParticleScript*> emitterSpawnScripts;
+	std::vector<ParticleScript*> loadedScripts;
+	std::vector<std::vector<Particle*>> scriptChunks;
+	std::vector<Particle*> spawnedParticles;
+	unsigned int scriptRandomState = 1;
+	std::string scriptErrors;
+
+	// Only for Shape::MESH (null otherwise). The meshes that we loaded 
+	// ourselves (rather than being handed) are ours to delete. The points 
+	// on an emitter's mesh are all picked at once, before it emits.
+	std::vector<const EmitterMesh*> emitterMeshes;
+	std::vector<EmitterMesh*> loadedMeshes;
+	std::vector<EmitterMesh::SurfacePoint> surfacePoints;
+	unsigned int surfaceRandomState = 1;
+
+	// Only used with SimulationMode::SPH and SimulationMode::NBODY. The 
+	// solvers work on the live particles, packed together, so these are 
+	// the live particles' indices, and their positions, velocities and 
+	// accelerations.
+	SPHSolver* fluidSolver = nullptr;
+	BarnesHutSolver* nbodySolver = nullptr;
+	std::vector<unsigned int> interactingParticles;
+	std::vector<glm::vec3> interactingPositions;
+	std::vector<glm::vec3> interactingVelocities;
+	std::vector<glm::vec3> interactingAccelerations;
+
+	// Only when there are force fields. The particles get pushed a 
+	// chunk at a time (on every thread), with just the fields that 
+	// reach each chunk, so each thread has its own chunk.
+	ForceFieldSet* forceFieldSet = nullptr;
+	std::vector<std::vector<Particle*>> threadChunkParticles;
+	std::vector<std::vector<unsigned int>> threadChunkFields;
+
+	// Only when there are colliders. The particles get collided a 
+	// chunk at a time, with just the colliders near each chunk.
+	ColliderSet* colliderSet = nullptr;
+	std::vector<Particle*> chunkParticles;
+	std::vector<unsigned int> chunkColliders;
+
+	static ChunkPool& getChunkPool(bool compact, bool hugePages);
+	ChunkPool& getChunkPool() const { return getChunkPool(config.compactParticles, config.hugePages); }
+	Particle& getParticle(unsigned int index) { return chunks[index >> CHUNK_SHIFT]->getParticles()[index & (PARTICLES_PER_CHUNK - 1)]; }
+	Particle* getNewParticle(unsigned int index);
+	void storeStagedParticles();
+	unsigned int getChunkSize(unsigned int chunkIndex) const; // the last chunk might not be full size
+	unsigned int getNumFreeParticles() const;
+	Particle* takeFreeParticle();
+	Particle* takeParticle();
+	Particle* evictParticle();
+	unsigned int getEvictionBucket(const Particle& particle);
+	bool allocateChunk();
+	void releaseChunk(unsigned int chunkIndex);
+	void removeAllParticles();
+	void storeStartingParticles();
+	unsigned int addParticles(const Particle* particles, unsigned int count);
+
+	void addQueuedSpawns();
+	unsigned int spawnBurstParticles(const ParticleBurst& burst, unsigned int count);
+	void addParticleEvents(const Particle& particle, float previousLifetime, unsigned int kernelEvents);
+	int processParticleEvents();
+	void updateEmitter(unsigned int emitterIndex, double deltaT);
+	glm::vec3 getEmitterPosition(unsigned int emitterIndex, double timeIntoUpdate, double deltaT) const;
+	int getNumParticlesToEmit(unsigned int emitterIndex, double deltaT);
+	int getNumParticlesToEmit(double deltaT, int maxParticlesToEmit);
+	float randomFloat(float min, float max);
+	void emitParticle(Particle& particle, unsigned int emitterIndex, double deltaT, const EmitterMesh::SurfacePoint* surfacePoint = nullptr, float minLifetime = 0.0f);
+
+	void initGPUSimulation(gfx::ResourceManager& resourceManager);
+	void updateGPU(double deltaT);
+
+	void applyInteractionForces(double deltaT);
+	bool updateParticle(Particle& particle, unsigned int index, double deltaT, bool indexForEviction);
+	unsigned int updateCompactChunk(unsigned int chunkIndex, double deltaT, bool indexForEviction);
+	unsigned int updateCompactChunkInBatches(unsigned int chunkIndex, double deltaT, bool indexForEviction);
+	void finishUpdateBatches(double deltaT);
+	void applyForceFields(double deltaT);
+	void pushByForceFields(Particle* particles, unsigned int count, double deltaT, unsigned int threadIndex);
+	void collideChunk();
+	void runUpdateScript(unsigned int emitterIndex, float deltaT);
 };
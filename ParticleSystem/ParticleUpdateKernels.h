@@ -0,0 +1,280 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#include "CompactParticle.h"
+#include "EmitterDesc.h"
+#include "LifetimeCurves.h"
+
+// Every combination of EmitterDesc::Features gets its own version of
+// the particle update (a "kernel"), so that a particle only pays for
+// the features that its emitter actually uses.
+//
+// The features are a template parameter, so inside each kernel, every
+// "if (Features & ...)" is a constant, and the compiler throws away the
+// code for the features that are turned off. Then get() picks the
+// kernel for a set of features out of a table with all of them in it.
+//
+// Particle can be any struct with position, velocity, color, size,
+// lifetime and maxLife, like ParticleSystem's.
+//
+// A kernel returns what happened to the particle (as Events), so that
+// whoever's calling it can make a note of it for later, rather than
+// having to deal with it in the middle of the loop.
+//
+// The compact kernels update the live particles in some of the lanes
+// of a CompactParticleBlock (the ones in lanes, which all belong to the
+// same emitter) where they are, and pack them up again around
+// newOrigin, so they only get read once and written once. With SSE,
+// they do a whole row at a time, without ever unpacking them into
+// Particles. They age the particles too (the ones that die just get
+// marked as dead), add the ones that are still alive to the bounds, and
+// return which lanes those are. They don't say what happened to them,
+// so they're only for emitters with no sub-emitters.
+template <typename Particle>
+class ParticleUpdateKernels {
+public:
+	enum Events : unsigned int {
+		NO_EVENTS = 0,
+		BOUNCED = 1 << 0 // off of the floor
+	};
+
+	typedef unsigned int (*Kernel)(Particle& particle, const EmitterDesc& emitter, const LifetimeCurves& curves, float deltaT);
+	typedef unsigned int (*CompactKernel)(CompactParticleBlock& block, unsigned int lanes, const glm::vec3& origin, const glm::vec3& newOrigin,
+		const EmitterDesc& emitter, const LifetimeCurves& curves, float deltaT, glm::vec3& boundsMin, glm::vec3& boundsMax);
+
+	static Kernel get(unsigned int features) {
+		return getTable(std::make_index_sequence<NUM_KERNELS>())[features & EmitterDesc::ALL_FEATURES];
+	}
+
+	static CompactKernel getCompact(unsigned int features) {
+		return getCompactTable(std::make_index_sequence<NUM_KERNELS>())[features & EmitterDesc::ALL_FEATURES];
+	}
+
+private:
+	static const unsigned int NUM_KERNELS = EmitterDesc::ALL_FEATURES + 1;
+
+	template <size_t... Features>
+	static const Kernel* getTable(std::index_sequence<Features...>) {
+		static const Kernel kernels[] = { &update<(unsigned int)Features>... };
+		return kernels;
+	}
+
+	template <size_t... Features>
+	static const CompactKernel* getCompactTable(std::index_sequence<Features...>) {
+		static const CompactKernel kernels[] = { &updateCompact<(unsigned int)Features>... };
+		return kernels;
+	}
+
+	template <unsigned int Features>
+	static unsigned int updateCompact(CompactParticleBlock& block, unsigned int lanes, const glm::vec3& origin, const glm::vec3& newOrigin,
+		const EmitterDesc& emitter, const LifetimeCurves& curves, float deltaT, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+		typedef CompactParticleBlock Block;
+#ifdef COMPACT_PARTICLE_SSE
+		// Just like update(), only 4 lanes (a "quad") at a time.
+		__m128 dt = _mm_set1_ps(deltaT);
+		__m128 signBit = _mm_set1_ps(-0.0f);
+		__m128 minX = _mm_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+		__m128 maxX = _mm_set1_ps(-FLT_MAX), maxY = maxX, maxZ = maxX;
+		unsigned int aliveLanes = 0;
+		for (unsigned int quad = 0; quad < Block::SIZE; quad += 4) {
+			unsigned int quadLanes = (lanes >> quad) & 0xF;
+			if (quadLanes == 0) {
+				continue;
+			}
+			__m128 x = _mm_add_ps(Block::loadQuad(block.halves[Block::POSITION_X] + quad), _mm_set1_ps(origin.x));
+			__m128 y = _mm_add_ps(Block::loadQuad(block.halves[Block::POSITION_Y] + quad), _mm_set1_ps(origin.y));
+			__m128 z = _mm_add_ps(Block::loadQuad(block.halves[Block::POSITION_Z] + quad), _mm_set1_ps(origin.z));
+			__m128 vx = Block::loadQuad(block.halves[Block::VELOCITY_X] + quad);
+			__m128 vy = Block::loadQuad(block.halves[Block::VELOCITY_Y] + quad);
+			__m128 vz = Block::loadQuad(block.halves[Block::VELOCITY_Z] + quad);
+			__m128 maxLife = Block::loadQuad(block.halves[Block::MAX_LIFE] + quad);
+			__m128i ages = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(block.ages + quad)), _mm_setzero_si128());
+
+			__m128 lifetime = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(ages), _mm_set1_ps(1.0f / 65535.0f)), maxLife);
+			lifetime = _mm_add_ps(lifetime, dt);
+			__m128 alive = _mm_and_ps(_mm_cmplt_ps(lifetime, maxLife), getLaneMask(quadLanes));
+			aliveLanes |= _mm_movemask_ps(alive) << quad;
+
+			if (Features & EmitterDesc::GRAVITY) {
+				const float g = -9.8f; // gravity (acceleration)
+				vy = _mm_add_ps(vy, _mm_set1_ps(g * deltaT));
+			}
+			if (Features & EmitterDesc::DRAG) {
+				__m128 drag = _mm_set1_ps(glm::max(0.0f, 1.0f - emitter.drag * deltaT));
+				vx = _mm_mul_ps(vx, drag);
+				vy = _mm_mul_ps(vy, drag);
+				vz = _mm_mul_ps(vz, drag);
+			}
+			x = _mm_add_ps(x, _mm_mul_ps(vx, dt));
+			y = _mm_add_ps(y, _mm_mul_ps(vy, dt));
+			z = _mm_add_ps(z, _mm_mul_ps(vz, dt));
+			if (Features & EmitterDesc::FLOOR_COLLISION) {
+				__m128 flip = _mm_and_ps(_mm_cmplt_ps(y, _mm_setzero_ps()), signBit);
+				y = _mm_xor_ps(y, flip);
+				vy = _mm_xor_ps(vy, flip);
+			}
+
+			__m128 t = _mm_div_ps(lifetime, maxLife);
+			__m128 size = _mm_setzero_ps();
+			if (Features & EmitterDesc::SIZE_CURVE) {
+				__m128 index = _mm_add_ps(_mm_mul_ps(t, _mm_set1_ps((float)(LIFETIME_CURVE_SIZE - 1))), _mm_set1_ps(0.5f));
+				index = _mm_min_ps(_mm_max_ps(index, _mm_setzero_ps()), _mm_set1_ps((float)(LIFETIME_CURVE_SIZE - 1)));
+				alignas(16) int indices[4];
+				_mm_store_si128((__m128i*)indices, _mm_cvttps_epi32(index));
+				size = _mm_setr_ps(curves.sizes[indices[0]], curves.sizes[indices[1]], curves.sizes[indices[2]], curves.sizes[indices[3]]);
+			}
+
+			// A particle that's gone further than a half float can 
+			// reach is lost anyway, and mustn't drag the origin away 
+			// with it. Anything that isn't finite (or alive) gets 
+			// turned into a NaN (since infinity minus infinity is one), 
+			// and min and max ignore a NaN in their first argument.
+			__m128 notAlive = _mm_xor_ps(alive, _mm_castsi128_ps(_mm_set1_epi32(-1)));
+			__m128 boundsX = _mm_or_ps(_mm_add_ps(x, _mm_sub_ps(x, x)), notAlive);
+			__m128 boundsY = _mm_or_ps(_mm_add_ps(y, _mm_sub_ps(y, y)), notAlive);
+			__m128 boundsZ = _mm_or_ps(_mm_add_ps(z, _mm_sub_ps(z, z)), notAlive);
+			minX = _mm_min_ps(boundsX, minX);
+			minY = _mm_min_ps(boundsY, minY);
+			minZ = _mm_min_ps(boundsZ, minZ);
+			maxX = _mm_max_ps(boundsX, maxX);
+			maxY = _mm_max_ps(boundsY, maxY);
+			maxZ = _mm_max_ps(boundsZ, maxZ);
+
+			// Only the lanes that we were given get written, and only 
+			// the live ones get anything other than their ages. Those 
+			// are rounded, and never quite DEAD (see Block::toAge()), 
+			// and sign extended, so that packing them down to 16 bits 
+			// doesn't saturate them.
+			__m128i aliveMask = _mm_castps_si128(alive);
+			aliveMask = _mm_packs_epi32(aliveMask, aliveMask);
+			storeQuad(block.halves[Block::POSITION_X] + quad, Block::packQuad(_mm_sub_ps(x, _mm_set1_ps(newOrigin.x))), aliveMask);
+			storeQuad(block.halves[Block::POSITION_Y] + quad, Block::packQuad(_mm_sub_ps(y, _mm_set1_ps(newOrigin.y))), aliveMask);
+			storeQuad(block.halves[Block::POSITION_Z] + quad, Block::packQuad(_mm_sub_ps(z, _mm_set1_ps(newOrigin.z))), aliveMask);
+			if (Features & EmitterDesc::DRAG) {
+				storeQuad(block.halves[Block::VELOCITY_X] + quad, Block::packQuad(vx), aliveMask);
+				storeQuad(block.halves[Block::VELOCITY_Z] + quad, Block::packQuad(vz), aliveMask);
+			}
+			if (Features & (EmitterDesc::GRAVITY | EmitterDesc::DRAG | EmitterDesc::FLOOR_COLLISION)) {
+				storeQuad(block.halves[Block::VELOCITY_Y] + quad, Block::packQuad(vy), aliveMask);
+			}
+			if (Features & EmitterDesc::SIZE_CURVE) {
+				storeQuad(block.halves[Block::SIZE_HALF] + quad, Block::packQuad(size), aliveMask);
+			}
+			__m128 scaledAge = _mm_add_ps(_mm_mul_ps(t, _mm_set1_ps(65535.0f)), _mm_set1_ps(0.5f));
+			scaledAge = _mm_min_ps(_mm_max_ps(scaledAge, _mm_setzero_ps()), _mm_set1_ps((float)(Block::DEAD - 1)));
+			__m128i newAges = _mm_srai_epi32(_mm_slli_epi32(_mm_cvttps_epi32(scaledAge), 16), 16);
+			newAges = _mm_packs_epi32(newAges, newAges);
+			__m128i laneMask = _mm_castps_si128(getLaneMask(quadLanes));
+			laneMask = _mm_packs_epi32(laneMask, laneMask);
+			storeQuad(block.ages + quad, _mm_set1_epi16((short)Block::DEAD), laneMask);
+			storeQuad(block.ages + quad, newAges, aliveMask);
+		}
+
+		boundsMin = glm::min(boundsMin, glm::vec3(getMin(minX), getMin(minY), getMin(minZ)));
+		boundsMax = glm::max(boundsMax, glm::vec3(getMax(maxX), getMax(maxY), getMax(maxZ)));
+		return aliveLanes;
+#else
+		// One at a time, through a Particle.
+		unsigned int aliveLanes = 0;
+		for (unsigned int lane = 0; lane < Block::SIZE; ++lane) {
+			if (!(lanes & (1 << lane))) {
+				continue;
+			}
+			Particle particle;
+			block.unpack(lane, particle, origin);
+			particle.lifetime += deltaT;
+			if (!(particle.lifetime < particle.maxLife)) {
+				block.ages[lane] = Block::DEAD;
+				continue;
+			}
+			// There's nowhere to keep a color, so there's no point 
+			// looking one up.
+			update<Features & ~EmitterDesc::COLOR_CURVE>(particle, emitter, curves, deltaT);
+			block.pack(lane, particle, newOrigin);
+			aliveLanes |= 1 << lane;
+			for (int axis = 0; axis < 3; ++axis) {
+				float value = particle.position[axis];
+				if (std::isfinite(value)) {
+					boundsMin[axis] = value < boundsMin[axis] ? value : boundsMin[axis];
+					boundsMax[axis] = value > boundsMax[axis] ? value : boundsMax[axis];
+				}
+			}
+		}
+		return aliveLanes;
+#endif
+	}
+
+#ifdef COMPACT_PARTICLE_SSE
+	// All ones for each of the bottom 4 bits of lanes that are set.
+	static __m128 getLaneMask(unsigned int lanes) {
+		__m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)lanes), bits), bits));
+	}
+
+	// Only the lanes in mask (as 16 bits each, in the bottom 64 bits).
+	static void storeQuad(unsigned short* row, __m128i values, __m128i mask) {
+		__m128i old = _mm_loadl_epi64((const __m128i*)row);
+		_mm_storel_epi64((__m128i*)row, _mm_or_si128(_mm_and_si128(mask, values), _mm_andnot_si128(mask, old)));
+	}
+
+	static float getMin(__m128 values) {
+		values = _mm_min_ps(values, _mm_movehl_ps(values, values));
+		return _mm_cvtss_f32(_mm_min_ss(values, _mm_shuffle_ps(values, values, 1)));
+	}
+
+	static float getMax(__m128 values) {
+		values = _mm_max_ps(values, _mm_movehl_ps(values, values));
+		return _mm_cvtss_f32(_mm_max_ss(values, _mm_shuffle_ps(values, values, 1)));
+	}
+#endif
+
+	template <unsigned int Features>
+	static unsigned int update(Particle& particle, const EmitterDesc& emitter, const LifetimeCurves& curves, float deltaT) {
+		unsigned int events = NO_EVENTS;
+
+		if (Features & EmitterDesc::GRAVITY) {
+			const float g = -9.8f; // gravity (acceleration)
+			particle.velocity.y += g * deltaT;
+		}
+
+		if (Features & EmitterDesc::DRAG) {
+			// If deltaT is ever big enough, this would go negative and the
+			// particle would shoot off backwards. Drag can stop it, but
+			// never turn it around.
+			particle.velocity *= glm::max(0.0f, 1.0f - emitter.drag * deltaT);
+		}
+
+		// Update the position
+		particle.position.x += particle.velocity.x * deltaT;
+		particle.position.y += particle.velocity.y * deltaT;
+		particle.position.z += particle.velocity.z * deltaT;
+
+		if (Features & EmitterDesc::FLOOR_COLLISION) {
+			if (particle.position.y < 0) {
+				// Flip the particle about the xz plane.
+				particle.position.y = -particle.position.y;
+				// Flip the y-velocity too so the particle goes upward.
+				particle.velocity.y = -particle.velocity.y;
+				events |= BOUNCED;
+			}
+		}
+
+		if (Features & (EmitterDesc::COLOR_CURVE | EmitterDesc::SIZE_CURVE)) {
+			// What percentage of the particle's lifetime has it lived?
+			unsigned int curveIndex = LifetimeCurves::getIndex(particle.lifetime / particle.maxLife);
+
+			if (Features & EmitterDesc::COLOR_CURVE) {
+				particle.color = curves.colors[curveIndex];
+			}
+
+			if (Features & EmitterDesc::SIZE_CURVE) {
+				particle.size = curves.sizes[curveIndex];
+			}
+		}
+
+		return events;
+	}
+};
@@ -4,6 +4,7 @@
 #include "Camera.h"
 #include "ClearOptions.h"
 #include "DrawCall.h"
+#include "FrameReader.h"
 #include "Viewport.h"
 
 namespace gfx {
@@ -25,6 +26,8 @@ namespace gfx {
 	// support from multiple APIs!
 	class Renderer {
 	public:
+		virtual ~Renderer() {}
+
 		// Clears the screen entirely, according to the ClearOptions.
 		virtual void clear(const ClearOptions& clearOptions)=0;
 
@@ -36,5 +39,12 @@ namespace gfx {
 
 		// Takes a list of draw calls and draws them!
 		virtual void draw(const std::vector<DrawCall> drawCalls)=0;
+
+		// Creates a FrameReader for reading back the part of the screen 
+		// covered by the viewport, with room for ringSize frames to be in 
+		// flight at once. The caller owns the FrameReader, and needs to 
+		// delete it before the Renderer goes away. Returns nullptr if this 
+		// Renderer doesn't support reading frames back.
+		virtual FrameReader* createFrameReader(const Viewport& viewport, unsigned int ringSize) { return nullptr; }
 	};
 }
\ No newline at end of file
@@ -21,6 +21,7 @@ namespace gfx {
 	// of the OpenGL-specific code lives.
 	class ResourceManager {
 	public:
+		virtual ~ResourceManager() {}
 
 		// Shader Programs
 		typedef unsigned int HPROGRAM;
@@ -49,8 +50,40 @@ namespace gfx {
 		virtual HBUFFER createStreamingStorageBuffer(unsigned int initialDataSize, unsigned char* initialData) = 0;
 		virtual void streamDataToStorageBuffer(HBUFFER bufferHandle, const BufferCallback &bufferCallback) = 0;
 
+		// Overwrites just part of a storage buffer, leaving the rest 
+		// of it alone. Streaming re-specifies the whole buffer every time, 
+		// which is a waste when only a few bytes of a big buffer changed.
+		virtual void updateStorageBuffer(HBUFFER bufferHandle, unsigned int offset, unsigned int size, const void* data) = 0;
+
+		// A storage buffer that the CPU fills in once, and after that only 
+		// the GPU reads and writes, e.g. from a compute shader.
+		virtual HBUFFER createStorageBuffer(unsigned int size, const void* initialData) = 0;
+
 		virtual void deleteBuffer(HBUFFER bufferHandle) = 0;
 
+		// Plugs a buffer into one of the numbered binding points that the 
+		// interface blocks in our shaders refer to, i.e. layout(binding = N).
+		virtual void bindUniformBufferBase(HBUFFER bufferHandle, unsigned int index) = 0;
+		virtual void bindStorageBufferBase(HBUFFER bufferHandle, unsigned int index) = 0;
+
+		// Compute
+		
+		// Runs a compute program, with whatever buffers are currently bound.
+		// The work is split into numGroupsX * numGroupsY * numGroupsZ groups, 
+		// and the size of each group is set by the shader's local_size.
+		virtual void dispatchCompute(HPROGRAM programHandle, unsigned int numGroupsX, unsigned int numGroupsY, unsigned int numGroupsZ) = 0;
+
+		// The GPU doesn't promise that one dispatch (or draw) sees what an 
+		// earlier one wrote to a storage buffer, unless we put a barrier 
+		// in between. The bits say what the later reads are for.
+		enum MemoryBarrierBits : unsigned int {
+			STORAGE_BARRIER = 1 << 0, // storage buffer reads in any shader
+			COMMAND_BARRIER = 1 << 1, // indirect draw/dispatch arguments
+			ALL_BARRIERS = 0xFFFFFFFF
+		};
+
+		virtual void memoryBarrier(unsigned int barriers) = 0;
+
 		// VAO
 		typedef unsigned int HVAO;
 
@@ -0,0 +1,139 @@
+#include "SPHSolver.h"
+
+#include <climits>
+#include <cmath>
+#include <glm/ext.hpp>
+
+#define PARTICLE_BATCH_SIZE 1024
+
+SPHSolver::SPHSolver(const Config& config, ThreadPool& threadPool)
+    : config(config), threadPool(threadPool), grid(threadPool) {
+    // The kernels from the paper. Each one is zero
+    // past the smoothing radius (h), and adds up to 1.
+    //   poly6(r)                = 315 / (64 pi h^9) * (h^2 - r^2)^3, for the density
+    //   gradient of spiky(r)    = -45 / (pi h^6) * (h - r)^2 * r/|r|, for the pressure
+    //   laplacian of viscosity(r) = 45 / (pi h^6) * (h - r), for the viscosity
+    float h = config.smoothingRadius;
+    float pi = glm::pi<float>();
+    poly6Scale = 315.0f / (64.0f * pi * pow(h, 9.0f));
+    spikyGradientScale = -45.0f / (pi * pow(h, 6.0f));
+    viscosityLaplacianScale = 45.0f / (pi * pow(h, 6.0f));
+}
+
+void SPHSolver::computeAccelerations(const glm::vec3* positions, const glm::vec3* velocities, unsigned int numParticles, glm::vec3* accelerations) {
+    const float h = config.smoothingRadius;
+    const float h2 = h * h;
+    const float mass = config.particleMass;
+
+    grid.build(positions, numParticles, h);
+    const unsigned int* sortedIndices = grid.getSortedIndices();
+
+    sortedPositions.resize(numParticles);
+    sortedVelocities.resize(numParticles);
+    densities.resize(numParticles);
+    inverseDensities.resize(numParticles);
+    pressures.resize(numParticles);
+
+    threadPool.parallelFor(numParticles, PARTICLE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int i = begin; i < end; ++i) {
+            sortedPositions[i] = positions[sortedIndices[i]];
+            sortedVelocities[i] = velocities[sortedIndices[i]];
+        }
+    });
+
+    // First the density (and from that, the pressure) at every particle...
+    threadPool.parallelFor(numParticles, PARTICLE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        unsigned int cells[SpatialHashGrid::MAX_NEIGHBOR_CELLS];
+        unsigned int numCells = 0;
+        glm::ivec3 cellCoords(INT_MAX);
+        for (unsigned int i = begin; i < end; ++i) {
+            const glm::vec3 position = sortedPositions[i];
+
+            // The particles are in cell order, so this
+            // only happens once per cell (or so).
+            glm::ivec3 particleCellCoords = grid.getCellCoords(position);
+            if (particleCellCoords != cellCoords) {
+                cellCoords = particleCellCoords;
+                numCells = grid.getNeighborCells(cellCoords, cells);
+            }
+
+            float density = 0.0f;
+            for (unsigned int c = 0; c < numCells; ++c) {
+                unsigned int cellEnd = grid.getCellEnd(cells[c]);
+                for (unsigned int j = grid.getCellStart(cells[c]); j < cellEnd; ++j) {
+                    glm::vec3 offset = position - sortedPositions[j];
+                    float r2 = glm::dot(offset, offset);
+
+                    // Most of the particles in the cells are too far away 
+                    // to count, and which ones are is anybody's guess, so 
+                    // clamping is quicker than an if.
+                    float w = glm::max(h2 - r2, 0.0f);
+                    density += w * w * w;
+                }
+            }
+            density *= mass * poly6Scale;
+
+            densities[i] = density;
+            inverseDensities[i] = 1.0f / density;
+
+            // Letting the pressure go negative would pull the particles
+            // together wherever they're spread out, and they'd clump up.
+            pressures[i] = config.stiffness * glm::max(density - config.restDensity, 0.0f);
+        }
+    });
+
+    // ...then the forces from the pressure and viscosity. Dividing by the
+    // particle's density turns the force into an acceleration.
+    threadPool.parallelFor(numParticles, PARTICLE_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        unsigned int cells[SpatialHashGrid::MAX_NEIGHBOR_CELLS];
+        unsigned int numCells = 0;
+        glm::ivec3 cellCoords(INT_MAX);
+        for (unsigned int i = begin; i < end; ++i) {
+            const glm::vec3 position = sortedPositions[i];
+            const glm::vec3 velocity = sortedVelocities[i];
+            const float pressure = pressures[i];
+
+            glm::ivec3 particleCellCoords = grid.getCellCoords(position);
+            if (particleCellCoords != cellCoords) {
+                cellCoords = particleCellCoords;
+                numCells = grid.getNeighborCells(cellCoords, cells);
+            }
+
+            glm::vec3 pressureForce(0.0f);
+            glm::vec3 viscosityForce(0.0f);
+            for (unsigned int c = 0; c < numCells; ++c) {
+                unsigned int cellEnd = grid.getCellEnd(cells[c]);
+                for (unsigned int j = grid.getCellStart(cells[c]); j < cellEnd; ++j) {
+                    glm::vec3 offset = position - sortedPositions[j];
+                    float r2 = glm::dot(offset, offset);
+                    if (r2 >= h2 || j == i) {
+                        continue;
+                    }
+
+                    // Divides are slow, and this loop runs a lot, so we 
+                    // multiply by the inverses (of r and the density) instead.
+                    float r = std::sqrt(r2);
+                    float w = h - r;
+                    float neighborInverseDensity = inverseDensities[j];
+
+                    // Two particles right on top of each other don't have a
+                    // direction to push in, so they just don't push.
+                    if (r > 0.0f) {
+                        float sharedPressure = (pressure + pressures[j]) * 0.5f;
+                        pressureForce += offset * (sharedPressure * neighborInverseDensity * w * w / r);
+                    }
+                    viscosityForce += (sortedVelocities[j] - velocity) * (w * neighborInverseDensity);
+                }
+            }
+            pressureForce *= -mass * spikyGradientScale;
+            viscosityForce *= config.viscosity * mass * viscosityLaplacianScale;
+
+            glm::vec3 acceleration = (pressureForce + viscosityForce) * inverseDensities[i];
+            float accelerationSquared = glm::dot(acceleration, acceleration);
+            if (accelerationSquared > config.maxAcceleration * config.maxAcceleration) {
+                acceleration *= config.maxAcceleration / std::sqrt(accelerationSquared);
+            }
+            accelerations[sortedIndices[i]] = acceleration;
+        }
+    });
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "SpatialHashGrid.h"
+#include "ThreadPool.h"
+
+// Works out the forces that make a bunch of particles behave like a
+// fluid, with Smoothed Particle Hydrodynamics (SPH). This is the version
+// from "Particle-Based Fluid Simulation for Interactive Applications"
+// (Muller et al.).
+//
+// Every particle is a little blob of fluid, "smoothed" out over a sphere
+// of radius smoothingRadius. Adding up the blobs that overlap a particle
+// gives the fluid's density there, and where the density is higher than
+// restDensity, the pressure pushes the particles apart. Viscosity nudges
+// each particle's velocity towards its neighbors'.
+//
+// Only the particles within smoothingRadius of each other matter, so
+// they're found with a SpatialHashGrid that has cells that size. Before
+// anything else, the particles get copied into the grid's order, so
+// neighbors are next to each other in memory too. Each step is split
+// across the threads of a ThreadPool.
+class SPHSolver {
+public:
+	struct Config {
+		float smoothingRadius = 0.25f;
+		float restDensity = 1000.0f;
+		float particleMass = 2.0f; // about restDensity * (smoothingRadius / 2)^3, so a particle has a few dozen neighbors at rest
+		float stiffness = 50.0f; // how hard the pressure pushes back, per unit of density over restDensity
+		float viscosity = 200.0f;
+
+		// A particle that gets squashed right up against another one can
+		// get a huge push. With a big time step, that sends it flying, so
+		// the accelerations are clamped to this.
+		float maxAcceleration = 500.0f;
+	};
+
+	SPHSolver(const Config& config, ThreadPool& threadPool = ThreadPool::getDefault());
+
+	// Works out each particle's acceleration from the fluid forces (but
+	// not gravity, or anything else). The arrays all have numParticles
+	// elements.
+	void computeAccelerations(const glm::vec3* positions, const glm::vec3* velocities, unsigned int numParticles, glm::vec3* accelerations);
+
+	const Config& getConfig() const { return config; }
+
+private:
+	Config config;
+	ThreadPool& threadPool;
+	SpatialHashGrid grid;
+
+	// The constant parts of the smoothing kernels.
+	float poly6Scale;
+	float spikyGradientScale;
+	float viscosityLaplacianScale;
+
+	// In the grid's order, and kept around between
+	// updates, so we aren't re-allocating all the time.
+	std::vector<glm::vec3> sortedPositions;
+	std::vector<glm::vec3> sortedVelocities;
+	std::vector<float> densities;
+	std::vector<float> inverseDensities;
+	std::vector<float> pressures;
+};
@@ -0,0 +1,127 @@
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define POINT_BATCH_SIZE 4096
+#define MIN_TABLE_SIZE 1024
+
+SpatialHashGrid::SpatialHashGrid(ThreadPool& threadPool) : threadPool(threadPool) {
+}
+
+glm::ivec3 SpatialHashGrid::getCellCoords(const glm::vec3& point) const {
+    // floor(), not a plain cast, or the cells on either side
+    // of zero would be twice as big as all of the others.
+    return glm::ivec3(glm::floor(point / cellSize));
+}
+
+unsigned int SpatialHashGrid::hashCell(const glm::ivec3& coords) const {
+    // Big primes, from "Optimized Spatial Hashing for Collision Detection
+    // of Deformable Objects" (Teschner et al.)
+    unsigned int hash = ((unsigned int)coords.x * 73856093u) ^ ((unsigned int)coords.y * 19349663u) ^ ((unsigned int)coords.z * 83492791u);
+    return hash & (tableSize - 1);
+}
+
+void SpatialHashGrid::build(const glm::vec3* points, unsigned int numPoints, float cellSize) {
+    this->cellSize = cellSize;
+    this->numPoints = numPoints;
+
+    // About twice as many cells as points keeps the hash
+    // collisions down, without wasting too much memory.
+    unsigned int neededTableSize = MIN_TABLE_SIZE;
+    while (neededTableSize < numPoints * 2) {
+        neededTableSize *= 2;
+    }
+    if (neededTableSize != tableSize) {
+        tableSize = neededTableSize;
+        cellCounts.reset(new std::atomic<unsigned int>[tableSize]);
+        for (unsigned int i = 0; i < tableSize; ++i) {
+            cellCounts[i].store(0, std::memory_order_relaxed);
+        }
+        cellStarts.resize(tableSize + 1);
+    }
+
+    pointCells.resize(numPoints);
+    pointRanks.resize(numPoints);
+    sortedIndices.resize(numPoints);
+
+    // Step 1: count the points in each cell.
+    threadPool.parallelFor(numPoints, POINT_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int i = begin; i < end; ++i) {
+            unsigned int cell = hashCell(getCellCoords(points[i]));
+            pointCells[i] = cell;
+            pointRanks[i] = cellCounts[cell].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // Step 2: the prefix sum. Each block of cells adds up its own
+    // counts, then we add up the blocks (there aren't many), and
+    // then each block works out where its cells start.
+    const unsigned int numBlocks = threadPool.getNumThreads() * 4;
+    const unsigned int cellsPerBlock = (tableSize + numBlocks - 1) / numBlocks;
+    blockSums.resize(numBlocks);
+
+    threadPool.parallelFor(numBlocks, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int block = begin; block < end; ++block) {
+            unsigned int firstCell = block * cellsPerBlock;
+            unsigned int lastCell = std::min(firstCell + cellsPerBlock, tableSize);
+            unsigned int sum = 0;
+            for (unsigned int cell = firstCell; cell < lastCell; ++cell) {
+                sum += cellCounts[cell].load(std::memory_order_relaxed);
+            }
+            blockSums[block] = sum;
+        }
+    });
+
+    unsigned int total = 0;
+    for (unsigned int block = 0; block < numBlocks; ++block) {
+        unsigned int sum = blockSums[block];
+        blockSums[block] = total;
+        total += sum;
+    }
+
+    threadPool.parallelFor(numBlocks, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int block = begin; block < end; ++block) {
+            unsigned int firstCell = block * cellsPerBlock;
+            unsigned int lastCell = std::min(firstCell + cellsPerBlock, tableSize);
+            unsigned int start = blockSums[block];
+            for (unsigned int cell = firstCell; cell < lastCell; ++cell) {
+                cellStarts[cell] = start;
+                start += cellCounts[cell].exchange(0, std::memory_order_relaxed);
+            }
+        }
+    });
+    cellStarts[tableSize] = total;
+
+    // Step 3: put every point where it goes.
+    threadPool.parallelFor(numPoints, POINT_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+        for (unsigned int i = begin; i < end; ++i) {
+            sortedIndices[cellStarts[pointCells[i]] + pointRanks[i]] = i;
+        }
+    });
+}
+
+unsigned int SpatialHashGrid::getNeighborCells(const glm::ivec3& center, unsigned int cells[MAX_NEIGHBOR_CELLS]) const {
+    unsigned int numCells = 0;
+    for (int z = -1; z <= 1; ++z) {
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                unsigned int cell = hashCell(center + glm::ivec3(x, y, z));
+
+                bool alreadyFound = false;
+                for (unsigned int i = 0; i < numCells; ++i) {
+                    if (cells[i] == cell) {
+                        alreadyFound = true;
+                        break;
+                    }
+                }
+
+                // Empty cells aren't worth coming back to.
+                if (!alreadyFound && cellStarts[cell] != cellStarts[cell + 1]) {
+                    cells[numCells++] = cell;
+                }
+            }
+        }
+    }
+    return numCells;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "ThreadPool.h"
+
+// A uniform grid of cubic cells, for finding all of the points near
+// some other point without checking every single one of them.
+//
+// The grid doesn't have any bounds. Instead, each cell's (x, y, z)
+// coordinates get hashed into a table, so the points can go anywhere,
+// and the table only has to be about as big as the number of points.
+// Every so often two cells hash to the same spot, which just means a
+// few extra points to look at (and throw away, because they're too far).
+//
+// build() sorts the points by cell with a counting sort, split across the
+// threads of a ThreadPool:
+//   1. Hash every point's cell, and count how many points are in each
+//      cell. Counting is an atomic add, which also tells each point where
+//      it goes among the points of its cell.
+//   2. Turn the counts into the index where each cell's points start
+//      (a "prefix sum").
+//   3. Put every point's index where it goes.
+// After that, the points in a cell are one run of getSortedIndices(),
+// from getCellStart() to getCellEnd().
+class SpatialHashGrid {
+public:
+	// The most cells that getNeighborCells() can find.
+	static const unsigned int MAX_NEIGHBOR_CELLS = 27;
+
+	SpatialHashGrid(ThreadPool& threadPool = ThreadPool::getDefault());
+
+	// Points that are less than cellSize apart are always
+	// in the same cell, or in cells that are next to each other.
+	void build(const glm::vec3* points, unsigned int numPoints, float cellSize);
+
+	unsigned int getNumPoints() const { return numPoints; }
+
+	// The points' indices (into the array given to build()), in cell order.
+	const unsigned int* getSortedIndices() const { return sortedIndices.data(); }
+
+	// The (x, y, z) coordinates of the cell that point is in.
+	glm::ivec3 getCellCoords(const glm::vec3& point) const;
+
+	// Finds the cells around the one at cellCoords (and that one too),
+	// which is every cell that could have a point within cellSize of a
+	// point in it. Cells that hash to the same spot are only found once,
+	// so no point gets found twice. Returns how many there are.
+	//
+	// Points that are next to each other in getSortedIndices() are 
+	// usually in the same cell, so it's worth hanging on to the cells 
+	// and only calling this again when the cell changes.
+	unsigned int getNeighborCells(const glm::ivec3& cellCoords, unsigned int cells[MAX_NEIGHBOR_CELLS]) const;
+
+	// The range of getSortedIndices() that a cell's points are in.
+	unsigned int getCellStart(unsigned int cell) const { return cellStarts[cell]; }
+	unsigned int getCellEnd(unsigned int cell) const { return cellStarts[cell + 1]; }
+
+private:
+	ThreadPool& threadPool;
+
+	float cellSize = 1.0f;
+	unsigned int numPoints = 0;
+	unsigned int tableSize = 0; // always a power of 2
+
+	// For each point, its cell, and where it goes among the points in that cell.
+	std::vector<unsigned int> pointCells;
+	std::vector<unsigned int> pointRanks;
+
+	// How many points are in each cell. These are set back to
+	// zero as they're used up, so they're ready for the next build().
+	std::unique_ptr<std::atomic<unsigned int>[]> cellCounts;
+
+	// tableSize + 1 of them, so the last cell has an end too.
+	std::vector<unsigned int> cellStarts;
+
+	std::vector<unsigned int> sortedIndices;
+
+	// The prefix sum is done in blocks of cells. These are the sums of the blocks.
+	std::vector<unsigned int> blockSums;
+
+	unsigned int hashCell(const glm::ivec3& coords) const;
+};
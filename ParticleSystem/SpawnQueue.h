@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+// A fixed-size queue that any number of threads can push onto at once,
+// without any locks, and that one thread (the ParticleSystem's update)
+// takes everything back off of.
+//
+// Every slot has a ticket number. A slot is free for the pusher whose
+// position in the queue matches its ticket, and once that pusher has
+// filled it in, the ticket moves on by one, which tells the popper that
+// it's ready. When the popper is done with it, the ticket moves on by
+// the size of the queue, so it's free for whoever wraps around to it
+// next time.
+//
+// Pushing a whole batch of items only takes one compare-and-swap, since
+// the popper always empties slots in order: if the last slot that the
+// batch needs is free, so is every slot before it.
+template<typename T>
+class SpawnQueue {
+public:
+	// capacity gets rounded up to a power of 2.
+	SpawnQueue(unsigned int capacity) {
+		unsigned int size = 1;
+		while (size < capacity) {
+			size *= 2;
+		}
+		mask = size - 1;
+		slots = std::vector<Slot>(size);
+		for (unsigned int i = 0; i < size; ++i) {
+			slots[i].ticket.store(i, std::memory_order_relaxed);
+		}
+		pushPosition.store(0, std::memory_order_relaxed);
+	}
+
+	unsigned int getCapacity() const { return mask + 1; }
+
+	// Safe to call from any thread. All of the items go on, or (if
+	// there isn't room for all of them) none of them do.
+	bool push(const T* items, unsigned int count) {
+		if (count == 0) {
+			return true;
+		}
+		if (count > getCapacity()) {
+			return false;
+		}
+
+		unsigned int position = pushPosition.load(std::memory_order_relaxed);
+		for (;;) {
+			unsigned int ticket = slots[(position + count - 1) & mask].ticket.load(std::memory_order_acquire);
+			int difference = (int)(ticket - (position + count - 1));
+			if (difference == 0) {
+				if (pushPosition.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+					break;
+				}
+				// Someone else got in first, and position is now theirs + their count.
+			}
+			else if (difference < 0) {
+				return false; // full (the popper hasn't got to those slots yet)
+			}
+			else {
+				position = pushPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		for (unsigned int i = 0; i < count; ++i) {
+			Slot& slot = slots[(position + i) & mask];
+			slot.item = items[i];
+			slot.ticket.store(position + i + 1, std::memory_order_release);
+		}
+		return true;
+	}
+
+	bool push(const T& item) {
+		return push(&item, 1);
+	}
+
+	// Only ever call this from one thread at a time. Calls
+	// function(item) for every item that has finished being pushed,
+	// in order, and stops at the first one that hasn't (which will
+	// still be there next time).
+	template<typename Function>
+	void popAll(Function function) {
+		for (;;) {
+			Slot& slot = slots[popPosition & mask];
+			if (slot.ticket.load(std::memory_order_acquire) != popPosition + 1) {
+				return;
+			}
+			function(slot.item);
+			slot.ticket.store(popPosition + mask + 1, std::memory_order_release);
+			++popPosition;
+		}
+	}
+
+private:
+	struct Slot {
+		std::atomic<unsigned int> ticket;
+		T item;
+	};
+
+	std::vector<Slot> slots;
+	unsigned int mask;
+	std::atomic<unsigned int> pushPosition;
+	unsigned int popPosition = 0; // only the popper uses this
+};
@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+
+// Set on the pool's own threads (and on the caller while it's helping
+// out) so that nested parallelFor() calls can be detected.
+static thread_local bool insideParallelFor = false;
+
+ThreadPool::ThreadPool(unsigned int numThreads) : nextItem(0) {
+	if (numThreads == 0) {
+		numThreads = std::thread::hardware_concurrency();
+	}
+
+	if (numThreads == 0) {
+		numThreads = 1;
+	}
+
+	for (unsigned int i = 1; i < numThreads; ++i) {
+		workers.emplace_back(&ThreadPool::workerMain, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shuttingDown = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::parallelFor(unsigned int count, unsigned int batchSize, const RangeFunction& function) {
+	if (count == 0) {
+		return;
+	}
+
+	if (batchSize == 0) {
+		batchSize = 1;
+	}
+
+	// Not worth waking anybody up for a single batch, and we can't
+	// start a new job from inside one that is already running.
+	if (workers.empty() || count <= batchSize || insideParallelFor) {
+		function(0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->function = &function;
+		this->count = count;
+		this->batchSize = batchSize;
+		nextItem.store(0);
+		busyWorkers = (unsigned int)workers.size();
+		++generation;
+	}
+	wakeCondition.notify_all();
+
+	// The calling thread is thread 0.
+	insideParallelFor = true;
+	runBatches(0);
+	insideParallelFor = false;
+
+	// Wait for the stragglers.
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+	this->function = nullptr;
+}
+
+ThreadPool& ThreadPool::getDefault() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::workerMain(unsigned int threadIndex) {
+	insideParallelFor = true;
+	unsigned long long lastGeneration = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&] { return shuttingDown || generation != lastGeneration; });
+			if (shuttingDown) {
+				return;
+			}
+			lastGeneration = generation;
+		}
+
+		runBatches(threadIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--busyWorkers;
+		}
+		doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::runBatches(unsigned int threadIndex) {
+	// Each thread just keeps grabbing the next batch until there
+	// aren't any left. Threads that finish early grab more batches,
+	// so the work balances itself out.
+	while (true) {
+		unsigned int begin = nextItem.fetch_add(batchSize);
+		if (begin >= count) {
+			break;
+		}
+
+		unsigned int end = begin + batchSize;
+		if (end > count || end < begin) {
+			end = count;
+		}
+
+		(*function)(begin, end, threadIndex);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A very small pool of worker threads for splitting up big loops.
+//
+// The only thing it knows how to do is a "parallel for": you give it
+// a number of items and a function, and it chops the items up into
+// batches and hands the batches out to its threads. The thread that
+// calls parallelFor() pitches in too, and doesn't return until every
+// batch is finished, so from the caller's point of view it behaves just
+// like a regular (but faster) for loop.
+//
+// Only one parallelFor() can be in flight at a time. If a batch function
+// calls parallelFor() itself, the inner loop simply runs on that thread.
+class ThreadPool {
+public:
+	// Called once per batch with the half-open item range [begin, end)
+	// and the index of the thread running it. The thread index is always
+	// less than getNumThreads(), so it can be used to index per-thread
+	// scratch memory without any locking.
+	typedef std::function<void(unsigned int begin, unsigned int end, unsigned int threadIndex)> RangeFunction;
+
+	// numThreads counts the calling thread as well. Zero means
+	// "one per hardware thread".
+	ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+
+	// The total number of threads that work on a parallelFor(),
+	// including the calling thread.
+	unsigned int getNumThreads() const { return (unsigned int)workers.size() + 1; }
+
+	// Runs function over [0, count) in batches of batchSize items.
+	void parallelFor(unsigned int count, unsigned int batchSize, const RangeFunction& function);
+
+	// A pool that is shared by anyone who doesn't need their own.
+	static ThreadPool& getDefault();
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	unsigned long long generation = 0;
+	bool shuttingDown = false;
+
+	// The job that is currently running.
+	const RangeFunction* function = nullptr;
+	unsigned int count = 0;
+	unsigned int batchSize = 1;
+	std::atomic<unsigned int> nextItem;
+	unsigned int busyWorkers = 0;
+
+	void workerMain(unsigned int threadIndex);
+	void runBatches(unsigned int threadIndex);
+};
@@ -9,3 +9,28 @@ std::string loadAsciiFile(const char* filename) {
 	file.close();
 	return str;
 }
+
+std::string insertShaderDefines(const std::string& shaderSource, const std::string& defines) {
+	size_t afterVersion = 0;
+	if (shaderSource.compare(0, 8, "#version") == 0) {
+		afterVersion = shaderSource.find('\n');
+		afterVersion = afterVersion == std::string::npos ? shaderSource.size() : afterVersion + 1;
+	}
+
+	std::string result = shaderSource.substr(0, afterVersion);
+	if (afterVersion > 0 && result.back() != '\n') {
+		result += '\n';
+	}
+	result += defines;
+	if (!defines.empty() && defines.back() != '\n') {
+		result += '\n';
+	}
+
+	// So that compile errors still point at the right line of the original file.
+	if (afterVersion > 0) {
+		result += "#line 2\n";
+	}
+
+	result += shaderSource.substr(afterVersion);
+	return result;
+}
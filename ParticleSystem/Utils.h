@@ -3,3 +3,24 @@
 #include <string>
 
 std::string loadAsciiFile(const char* filename);
+
+// A quick random number generator (xorshift32). It's much quicker than 
+// rand() (which has to lock, and only gives 15 bits on some platforms), 
+// and each user can keep a state of its own. The state must never be 0, 
+// since xorshift never gets out of it.
+inline unsigned int nextRandom(unsigned int& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Between 0 and 1 (but never 1), from the top 24 bits.
+inline float nextRandomFloat(unsigned int& state) {
+	return (float)(nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Adds some extra lines (usually #defines) to the top of a shader. GLSL 
+// wants the #version line to come before anything else, so they go 
+// right after that line.
+std::string insertShaderDefines(const std::string& shaderSource, const std::string& defines);
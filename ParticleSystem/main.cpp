@@ -15,11 +15,235 @@
 #include "Renderer.h"
 
 #include "ParticleSystem.h"
+#include "EmitterDesc.h"
+#include "AnalyticParticleSystem.h"
 #include "GraphicsSystem.h"
+#include "FrameCapture.h"
+#include "FixedTimestep.h"
 
 using namespace glm;
 
+#define HEADLESS_WIDTH 1280
+#define HEADLESS_HEIGHT 720
+#define HEADLESS_FRAMES 300 // 5 seconds, unless -headless says otherwise
+#define PREWARM_SECONDS 5.0 // unless -prewarm says otherwise
+
+static ClearOptions getClearOptions() {
+    ClearOptions clearOptions;
+    clearOptions.clearColor = true;
+    clearOptions.r = 0.1f;
+    clearOptions.g = 0.05f;
+    clearOptions.b = 0.1f;
+    clearOptions.a = 1.0f;
+    clearOptions.clearDepth = true;
+    clearOptions.depth = 1.0;
+    clearOptions.clearStencil = true;
+    clearOptions.stencilValue = 0;
+    return clearOptions;
+}
+
+// Every frame goes to the "capture" directory, which has to be there.
+static FrameCapture::Config getCaptureConfig() {
+    FrameCapture::Config captureConfig;
+    captureConfig.filenamePattern = "capture/frame_%05d.png";
+    captureConfig.format = FrameCapture::Format::PNG;
+    captureConfig.maxQueuedFrames = 16;
+    captureConfig.readbackRingSize = 3;
+    return captureConfig;
+}
+
+// Draws the particles with the software renderer, into a framebuffer 
+// rather than a window, and saves numFrames of them to the "capture" 
+// directory, so that they can be looked at (or compared with reference 
+// images) on a machine that doesn't have a GPU. The camera stays where 
+// it starts, and every frame is one simulation step, so the frames 
+// come out the same every time. Returns the process's exit code.
+static int runHeadless(ParticleSystem::Config particleSystemConfig, int numFrames) {
+    // The software renderer can't run compute shaders.
+    if (particleSystemConfig.simulationMode == ParticleSystem::SimulationMode::GPU) {
+        particleSystemConfig.simulationMode = ParticleSystem::SimulationMode::CPU;
+    }
+
+    gfx::GraphicsSystem gfx(gfx::GraphicsSystem::Software, HEADLESS_WIDTH, HEADLESS_HEIGHT);
+    if (!gfx.isValid()) {
+        return 1;
+    }
+
+    ParticleSystem particleSystem(particleSystemConfig);
+    particleSystem.initGraphicsResources(gfx.resourceManager());
+
+    Camera camera;
+
+    Viewport viewport;
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = HEADLESS_WIDTH;
+    viewport.height = HEADLESS_HEIGHT;
+
+    ClearOptions clearOptions = getClearOptions();
+
+    CreateDirectoryA("capture", NULL);
+    FrameCapture frameCapture(gfx.renderer(), viewport, getCaptureConfig());
+    if (!frameCapture.isSupported()) {
+        return 1;
+    }
+
+    std::vector<gfx::DrawCall> drawCalls;
+    for (int frame = 0; frame < numFrames; ++frame) {
+        drawCalls.clear();
+        particleSystem.setCameraPosition(glm::vec3(camera.getTransform().getMatrix()[3]));
+        particleSystem.update(1.0 / 60.0);
+        particleSystem.getDrawCalls(gfx.resourceManager(), drawCalls);
+
+        gfx.renderer().clear(clearOptions);
+        gfx.renderer().setupCamera(camera, viewport);
+        gfx.renderer().draw(drawCalls);
+        frameCapture.captureFrame();
+        gfx.device().swapBuffers();
+    }
+
+    frameCapture.finish();
+    return frameCapture.getNumWriteErrors() == 0 && frameCapture.getNumDroppedFrames() == 0 ? 0 : 1;
+}
+
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow) {
+    // Init scene
+    ParticleSystem::Config particleSystemConfig;
+    particleSystemConfig.maxParticles = 100000;
+
+    // Running with -gpusim on the command line moves the 
+    // simulation into a compute shader.
+    if (wcsstr(pCmdLine, L"-gpusim") != nullptr) {
+        particleSystemConfig.simulationMode = ParticleSystem::SimulationMode::GPU;
+    }
+
+    // Running with -emitters on the command line swaps the hopping 
+    // emitter for the ones in emitters.txt (see EmitterDesc.h).
+    if (wcsstr(pCmdLine, L"-emitters") != nullptr) {
+        loadEmitterDescs("emitters.txt", particleSystemConfig.emitters);
+    }
+
+    // Running with -sph on the command line turns the particles into
+    // a fluid (see SPHSolver), which gets poured onto the floor.
+    if (wcsstr(pCmdLine, L"-sph") != nullptr) {
+        particleSystemConfig.maxParticles = 200000;
+        particleSystemConfig.simulationMode = ParticleSystem::SimulationMode::SPH;
+        if (particleSystemConfig.emitters.empty()) {
+            EmitterDesc fluidEmitter;
+            fluidEmitter.shape = EmitterDesc::Shape::BOX;
+            fluidEmitter.halfExtents = glm::vec3(2.0f, 0.5f, 2.0f);
+            fluidEmitter.motion = EmitterDesc::Motion::STATIC;
+            fluidEmitter.worldPos = glm::vec3(0.0f, 4.0f, -10.0f);
+            fluidEmitter.velocityJitter = 0.2f;
+            fluidEmitter.particlesPerSecond = 20000.0f;
+            fluidEmitter.particleMinLifetime = 20.0f;
+            fluidEmitter.particleMaxLifetime = 25.0f;
+            fluidEmitter.particleStartColor = glm::vec4(0.3f, 0.6f, 1.0f, 1.0f);
+            fluidEmitter.particleMidColor = glm::vec4(0.1f, 0.3f, 0.9f, 1.0f);
+            fluidEmitter.particleEndColor = glm::vec4(0.05f, 0.1f, 0.4f, 1.0f);
+            fluidEmitter.features = EmitterDesc::GRAVITY | EmitterDesc::FLOOR_COLLISION | EmitterDesc::COLOR_CURVE;
+            particleSystemConfig.emitters.push_back(fluidEmitter);
+        }
+    }
+
+    // Running with -nbody on the command line makes every particle
+    // pull on every other one (see BarnesHutSolver), so a big cloud
+    // of them collapses in on itself. The up and down arrows trade
+    // accuracy for speed while it's running.
+    bool nbody = wcsstr(pCmdLine, L"-nbody") != nullptr;
+    if (nbody) {
+        particleSystemConfig.simulationMode = ParticleSystem::SimulationMode::NBODY;
+        if (particleSystemConfig.emitters.empty()) {
+            EmitterDesc cloudEmitter;
+            cloudEmitter.shape = EmitterDesc::Shape::SPHERE;
+            cloudEmitter.radius = 15.0f;
+            cloudEmitter.motion = EmitterDesc::Motion::STATIC;
+            cloudEmitter.worldPos = glm::vec3(0.0f, 10.0f, -30.0f);
+            cloudEmitter.velocityJitter = 0.5f;
+            cloudEmitter.particlesPerSecond = 100000.0f;
+            cloudEmitter.particleMinLifetime = 30.0f;
+            cloudEmitter.particleMaxLifetime = 40.0f;
+            cloudEmitter.features = EmitterDesc::COLOR_CURVE;
+            particleSystemConfig.emitters.push_back(cloudEmitter);
+        }
+    }
+
+    // Running with -colliders on the command line puts a few things 
+    // in the particles' way for them to bounce off of (see ColliderSet).
+    if (wcsstr(pCmdLine, L"-colliders") != nullptr) {
+        Collider ball;
+        ball.shape = Collider::Shape::SPHERE;
+        ball.position = glm::vec3(0.0f, 1.5f, -10.0f);
+        ball.radius = 1.5f;
+        ball.restitution = 0.7f;
+        particleSystemConfig.colliders.push_back(ball);
+
+        Collider pipe;
+        pipe.shape = Collider::Shape::CAPSULE;
+        pipe.position = glm::vec3(-6.0f, 1.0f, -14.0f);
+        pipe.endPosition = glm::vec3(6.0f, 1.0f, -14.0f);
+        pipe.radius = 0.5f;
+        particleSystemConfig.colliders.push_back(pipe);
+
+        Collider crate;
+        crate.shape = Collider::Shape::BOX;
+        crate.position = glm::vec3(5.0f, 1.0f, -8.0f);
+        crate.halfExtents = glm::vec3(1.0f);
+        crate.friction = 0.5f;
+        particleSystemConfig.colliders.push_back(crate);
+    }
+
+    // Running with -forces on the command line stirs the particles up 
+    // with some turbulence, and a whirlwind in the middle of the 
+    // emitter's circle (see ForceFieldSet).
+    if (wcsstr(pCmdLine, L"-forces") != nullptr) {
+        ForceField turbulence;
+        turbulence.type = ForceField::Type::TURBULENCE;
+        turbulence.strength = 20.0f;
+        turbulence.frequency = 0.05f;
+        particleSystemConfig.forceFields.push_back(turbulence);
+
+        ForceField whirlwind;
+        whirlwind.type = ForceField::Type::VORTEX;
+        whirlwind.position = glm::vec3(0.0f, 0.0f, -10.0f);
+        whirlwind.direction = glm::vec3(0.0f, 1.0f, 0.0f);
+        whirlwind.strength = 30.0f;
+        whirlwind.radius = 4.0f;
+        whirlwind.boundsMin = glm::vec3(-12.0f, -5.0f, -22.0f);
+        whirlwind.boundsMax = glm::vec3(12.0f, 20.0f, 2.0f);
+        particleSystemConfig.forceFields.push_back(whirlwind);
+    }
+
+    // Running with -evict on the command line makes room for new 
+    // particles by throwing out the furthest ones from the camera, 
+    // rather than leaving the emitters stalled once the pool's full.
+    if (wcsstr(pCmdLine, L"-evict") != nullptr) {
+        particleSystemConfig.overflowPolicy = ParticleSystem::OverflowPolicy::EVICT_FARTHEST;
+    }
+
+    // Running with -compact on the command line keeps the particles in
+    // a quarter of the memory, at the cost of some accuracy (see
+    // CompactParticleBlock).
+    if (wcsstr(pCmdLine, L"-compact") != nullptr) {
+        particleSystemConfig.compactParticles = true;
+    }
+
+    // Running with -hugepages on the command line takes the particles 
+    // out of 2 MB pages, if Windows will let us have them (which needs 
+    // the "Lock pages in memory" right).
+    if (wcsstr(pCmdLine, L"-hugepages") != nullptr) {
+        particleSystemConfig.hugePages = true;
+    }
+
+    // Running with -headless on the command line doesn't open a 
+    // window (see runHeadless()). It can be followed by how many frames 
+    // to draw, e.g. -headless 600.
+    const wchar_t* headlessFlag = wcsstr(pCmdLine, L"-headless");
+    if (headlessFlag != nullptr) {
+        int numFrames = (int)wcstol(headlessFlag + wcslen(L"-headless"), nullptr, 10);
+        return runHeadless(particleSystemConfig, numFrames > 0 ? numFrames : HEADLESS_FRAMES);
+    }
+
     // Create window
     WindowParams params;
     params.hInstance = hInstance;
@@ -40,12 +264,45 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     window.setKeyboardEventHandler(&keyboardInput);
     window.setOnMouseMovedHandler(&mouseInput);
 
-    // Init scene
-    ParticleSystem::Config particleSystemConfig;
-    particleSystemConfig.maxParticles = 100000;
     ParticleSystem particleSystem(particleSystemConfig);
     particleSystem.initGraphicsResources(gfx.resourceManager());
 
+    // Running with -snapshot on the command line starts the particles 
+    // off from particles.snapshot, as if they'd already been running 
+    // for a while. If there isn't one (or it's from different emitters), 
+    // they're run for 5 seconds, and that gets saved for next time.
+    if (wcsstr(pCmdLine, L"-snapshot") != nullptr) {
+        ParticleSnapshot* snapshot = ParticleSnapshot::load("particles.snapshot");
+        if (snapshot == nullptr || !particleSystem.loadSnapshot(*snapshot)) {
+            for (int i = 0; i < 300; ++i) {
+                particleSystem.update(1.0 / 60.0);
+            }
+            particleSystem.saveSnapshot("particles.snapshot");
+        }
+        delete snapshot;
+    }
+
+    // Running with -prewarm on the command line starts the particles off 
+    // as if they'd already been running for a while, without having to 
+    // run them (see ParticleSystem::prewarm()). It can be followed by 
+    // how many seconds, e.g. -prewarm 10.
+    const wchar_t* prewarmFlag = wcsstr(pCmdLine, L"-prewarm");
+    if (prewarmFlag != nullptr) {
+        double prewarmSeconds = wcstod(prewarmFlag + wcslen(L"-prewarm"), nullptr);
+        particleSystem.prewarm(prewarmSeconds > 0.0 ? prewarmSeconds : PREWARM_SECONDS);
+    }
+
+    // Running with -ambient on the command line adds a few million 
+    // "ambient" particles, which are simulated entirely on the GPU.
+    AnalyticParticleSystem* ambientParticles = nullptr;
+    if (wcsstr(pCmdLine, L"-ambient") != nullptr) {
+        AnalyticParticleSystem::Config ambientConfig;
+        ambientConfig.maxParticles = 4000000;
+        ambientConfig.particlesPerSecond = 500000.0f;
+        ambientParticles = new AnalyticParticleSystem(ambientConfig);
+        ambientParticles->initGraphicsResources(gfx.resourceManager());
+    }
+
     Camera camera;
 
     Viewport viewport;
@@ -54,19 +311,27 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     viewport.width = window.getClientWidth();
     viewport.height = window.getClientHeight();
 
-    ClearOptions clearOptions;
-    clearOptions.clearColor = true;
-    clearOptions.r = 0.1f;
-    clearOptions.g = 0.05f;
-    clearOptions.b = 0.1f;
-    clearOptions.a = 1.0f;
-    clearOptions.clearDepth = true;
-    clearOptions.depth = 1.0;
-    clearOptions.clearStencil = true;
-    clearOptions.stencilValue = 0;
+    ClearOptions clearOptions = getClearOptions();
 
     std::vector<gfx::DrawCall> drawCalls;
 
+    // The particles are simulated at a steady 60 steps per second, no 
+    // matter what the frame rate is, so that they behave the same on 
+    // every machine (and in every capture).
+    FixedTimestep::Config timestepConfig;
+    timestepConfig.stepsPerSecond = 60.0;
+    timestepConfig.maxStepsPerFrame = 4;
+    FixedTimestep simTimestep(timestepConfig);
+
+    // Running with -capture on the command line saves 
+    // every frame to the "capture" directory.
+    FrameCapture* frameCapture = nullptr;
+    if (wcsstr(pCmdLine, L"-capture") != nullptr) {
+        CreateDirectoryA("capture", NULL);
+
+        frameCapture = new FrameCapture(gfx.renderer(), viewport, getCaptureConfig());
+    }
+
     window.show();
 
     int numFrames = 0;
@@ -92,10 +357,45 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
         }
 
         camera.processInput(keyboardInput, mouseInput, timer.getDeltaTime());
-        particleSystem.update(timer.getDeltaTime());
+
+        if (nbody) {
+            if (keyboardInput.isKeyDownEdge(input::KeyboardInput::KC_UP)) {
+                particleSystem.setOpeningAngle(particleSystem.getOpeningAngle() + 0.1f);
+            }
+            if (keyboardInput.isKeyDownEdge(input::KeyboardInput::KC_DOWN)) {
+                particleSystem.setOpeningAngle(glm::max(particleSystem.getOpeningAngle() - 0.1f, 0.0f));
+            }
+        }
+
+        // Space sets off a burst of particles a little way in front of the camera.
+        if (keyboardInput.isKeyDownEdge(input::KeyboardInput::KC_SPACE)) {
+            const Transform& cameraTransform = camera.getTransform();
+            ParticleSystem::ParticleBurst burst;
+            burst.position = glm::vec3(cameraTransform.getMatrix()[3]) + cameraTransform.at() * 15.0f;
+            burst.radius = 0.5f;
+            burst.speed = 8.0f;
+            burst.speedJitter = 3.0f;
+            burst.minLifetime = 1.0f;
+            burst.maxLifetime = 2.0f;
+            particleSystem.spawnBurst(burst, 5000);
+        }
+
+        particleSystem.setCameraPosition(glm::vec3(camera.getTransform().getMatrix()[3]));
+
+        unsigned int numSteps = simTimestep.advance(timer.getDeltaTime());
+        for (unsigned int step = 0; step < numSteps; ++step) {
+            particleSystem.update(simTimestep.getStepSize());
+        }
+
+        if (ambientParticles != nullptr) {
+            ambientParticles->update(timer.getDeltaTime());
+        }
 
         // Cull
-        particleSystem.getDrawCalls(gfx.resourceManager(), drawCalls);
+        particleSystem.getDrawCalls(gfx.resourceManager(), drawCalls, simTimestep.getInterpolationAlpha());
+        if (ambientParticles != nullptr) {
+            ambientParticles->getDrawCalls(gfx.resourceManager(), drawCalls);
+        }
 
         // Render
         viewport.width = window.getClientWidth();
@@ -105,9 +405,23 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
 
         gfx.renderer().draw(drawCalls);
 
+        if (frameCapture != nullptr) {
+            frameCapture->captureFrame();
+        }
+
         gfx.device().swapBuffers();
     }
 
+    if (frameCapture != nullptr) {
+        delete frameCapture;
+        frameCapture = nullptr;
+    }
+
+    if (ambientParticles != nullptr) {
+        delete ambientParticles;
+        ambientParticles = nullptr;
+    }
+
     double avgFrameTime = timer.getTotalTime() / numFrames;
 
     return 0;
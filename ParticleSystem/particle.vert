@@ -1,6 +1,15 @@
 #version 460 core
 
+// ParticleSystem defines this before compiling, to match its maxParticles.
+#ifndef NUM_PARTICLES
 #define NUM_PARTICLES 100000
+#endif
+
+// 4 when drawing with an index buffer (two triangles that share
+// two corners), 6 without one (GPUParticleArena's indirect draws).
+#ifndef VERTS_PER_PARTICLE
+#define VERTS_PER_PARTICLE 4
+#endif
 
 const vec4 offsets[4] = vec4[4](
 	vec4(-0.5, -0.5, 0, 1),
@@ -17,8 +26,16 @@ layout (std140, binding = 0) uniform Camera {
     mat4 viewProjMat;
 } camera;
 
+// Per-draw parameters that are the same for every particle
+layout (std140, binding = 1) uniform ParticleParams {
+    // How far between the previous and the current simulation 
+    // step we're drawing, from 0 (previous) to 1 (current).
+    float interpolationAlpha;
+} params;
+
 layout(std140, binding = 0) buffer Particles {
     vec4 positions[NUM_PARTICLES];
+    vec4 prevPositions[NUM_PARTICLES];
     vec4 colors[NUM_PARTICLES];
     float sizes[NUM_PARTICLES];
 } particles;
@@ -26,10 +43,16 @@ layout(std140, binding = 0) buffer Particles {
 out vec4 color;
 
 void main() {
-    int particleID = gl_VertexID / 4;
-    int offsetIndex = gl_VertexID % 4;
+    int particleID = gl_VertexID / VERTS_PER_PARTICLE;
+    int offsetIndex = gl_VertexID % VERTS_PER_PARTICLE;
+#if VERTS_PER_PARTICLE == 6
+    // The same corners that the index buffer would have picked
+    const int corners[6] = int[6](0, 1, 2, 0, 2, 3);
+    offsetIndex = corners[offsetIndex];
+#endif
 
-    vec4 viewSpacePos = camera.viewMat * particles.positions[particleID];   
+    vec4 position = mix(particles.prevPositions[particleID], particles.positions[particleID], params.interpolationAlpha);
+    vec4 viewSpacePos = camera.viewMat * position;   
     vec4 offset = offsets[offsetIndex] * particles.sizes[particleID];
     viewSpacePos += offset;
     gl_Position = camera.projMat * viewSpacePos;
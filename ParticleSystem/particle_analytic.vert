@@ -0,0 +1,111 @@
+#version 460 core
+
+// See AnalyticParticleSystem.h. Every particle is worked out from
+// scratch, from where and when it was emitted, so there is nothing
+// to update on the CPU.
+
+// Must match TIME_WRAP_PERIOD in AnalyticParticleSystem.cpp
+#define TIME_WRAP_PERIOD 1024.0
+
+// Two triangles per particle, with no index buffer.
+const vec4 offsets[6] = vec4[6](
+	vec4(-0.5, -0.5, 0, 1),
+	vec4(-0.5,  0.5, 0, 1),
+	vec4( 0.5,  0.5, 0, 1),
+	vec4(-0.5, -0.5, 0, 1),
+	vec4( 0.5,  0.5, 0, 1),
+	vec4( 0.5, -0.5, 0, 1)
+);
+
+// The Camera UBO interface block
+layout (std140, binding = 0) uniform Camera {
+    mat4 worldMat;
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+} camera;
+
+layout (std140, binding = 1) uniform AnalyticParams {
+    vec4 gravityAndDrag;
+    vec4 startColor;
+    vec4 midColor;
+    vec4 endColor;
+    vec4 sizes; // start size, end size, size variance, current time
+    uint firstSlot;
+    uint capacity;
+} params;
+
+struct SpawnRecord {
+    vec3 position;
+    float spawnTime;
+    vec3 velocity;
+    uint lifetimeAndSeed; // lifetime in ms (low 16 bits), seed (high 16 bits)
+};
+
+layout(std430, binding = 0) readonly buffer SpawnRecords {
+    SpawnRecord records[];
+};
+
+out vec4 color;
+
+// Turns a number into a "random" number between 0 and 1.
+float hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return float(x & 0xFFFFu) / 65535.0;
+}
+
+void main() {
+    int particleID = gl_VertexID / 6;
+    int offsetIndex = gl_VertexID % 6;
+
+    // The live particles start at firstSlot, and might wrap around the end of the ring.
+    uint slot = (params.firstSlot + uint(particleID)) % params.capacity;
+    SpawnRecord record = records[slot];
+
+    float lifetime = float(record.lifetimeAndSeed & 0xFFFFu) * 0.001;
+    uint seed = record.lifetimeAndSeed >> 16;
+    float age = mod(params.sizes.w - record.spawnTime + TIME_WRAP_PERIOD, TIME_WRAP_PERIOD);
+
+    if (age >= lifetime) {
+        // Dead. Put all of its corners on the same spot, outside of
+        // the screen, so that the triangles get thrown away.
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        color = vec4(0.0);
+        return;
+    }
+
+    // With gravity g and drag k, the velocity follows dv/dt = g - k*v, which works out to:
+    //   v(t) = g/k + (v0 - g/k) * e^(-k*t)
+    //   p(t) = p0 + (g/k) * t + (v0 - g/k) * (1 - e^(-k*t)) / k
+    // When there's (almost) no drag, that blows up, so we use the usual p0 + v0*t + g*t^2/2.
+    vec3 g = params.gravityAndDrag.xyz;
+    float k = params.gravityAndDrag.w;
+    vec3 position;
+    if (k > 1e-4) {
+        vec3 terminalVelocity = g / k;
+        position = record.position
+            + terminalVelocity * age
+            + (record.velocity - terminalVelocity) * (1.0 - exp(-k * age)) / k;
+    }
+    else {
+        position = record.position + record.velocity * age + 0.5 * g * age * age;
+    }
+
+    // What percentage of the particle's lifetime has it lived?
+    float t = age / lifetime;
+
+    color = t < 0.5
+        ? mix(params.startColor, params.midColor, t / 0.5)
+        : mix(params.midColor, params.endColor, (t - 0.5) / 0.5);
+
+    float size = mix(params.sizes.x, params.sizes.y, t);
+    size *= 1.0 + params.sizes.z * (hash(seed) * 2.0 - 1.0);
+
+    vec4 viewSpacePos = camera.viewMat * vec4(position, 1.0);
+    viewSpacePos += offsets[offsetIndex] * size;
+    gl_Position = camera.projMat * viewSpacePos;
+}